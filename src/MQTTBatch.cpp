@@ -0,0 +1,145 @@
+#include "MQTTBatch.h"
+
+#include <string.h>
+
+MQTTBatchWriter::MQTTBatchWriter(uint8_t *buf, size_t cap) : buf(buf), cap(cap) { this->reset(); }
+
+bool MQTTBatchWriter::add(const char suffix[], const char payload[]) {
+  return this->add(suffix, (const uint8_t *)payload, strlen(payload));
+}
+
+bool MQTTBatchWriter::add(const char suffix[], const uint8_t payload[], size_t length) {
+  // check record
+  size_t suffixLen = suffix != nullptr ? strlen(suffix) : 0;
+  if (this->len == 0 || suffixLen > 255 || this->_count == 0xffff) {
+    return false;
+  }
+
+  // get payload length length
+  size_t varLen = 1;
+  for (size_t n = length; n >= 0x80; n >>= 7) {
+    varLen++;
+  }
+
+  // check space, a record is never written partially
+  size_t needed = 1 + suffixLen + varLen + length;
+  if (needed > this->cap - this->len) {
+    return false;
+  }
+
+  // write suffix
+  uint8_t *p = this->buf + this->len;
+  *p++ = (uint8_t)suffixLen;
+  memcpy(p, suffix, suffixLen);
+  p += suffixLen;
+
+  // write payload
+  for (size_t n = length;; n >>= 7) {
+    *p++ = (uint8_t)((n & 0x7f) | (n >= 0x80 ? 0x80 : 0));
+    if (n < 0x80) {
+      break;
+    }
+  }
+  if (length > 0) {
+    memcpy(p, payload, length);
+  }
+
+  this->len += needed;
+  this->_count++;
+
+  // update record count
+  this->buf[3] = (uint8_t)this->_count;
+  this->buf[4] = (uint8_t)(this->_count >> 8);
+
+  return true;
+}
+
+void MQTTBatchWriter::reset() {
+  this->_count = 0;
+  this->len = 0;
+
+  // write header
+  if (this->buf != nullptr && this->cap >= MQTT_BATCH_HEADER) {
+    this->buf[0] = MQTT_BATCH_MAGIC;
+    this->buf[1] = MQTT_BATCH_SIGNATURE_1;
+    this->buf[2] = MQTT_BATCH_SIGNATURE_2;
+    this->buf[3] = 0;
+    this->buf[4] = 0;
+    this->len = MQTT_BATCH_HEADER;
+  }
+}
+
+// Reads the record at pos, returns 0 at the end and -1 on a malformed batch
+static int mqtt_batch_record(const uint8_t *buf, size_t len, size_t &pos, MQTTBatchRecord &record) {
+  if (pos >= len) {
+    return 0;
+  }
+
+  // read suffix
+  size_t suffixLen = buf[pos];
+  if (suffixLen + 1 > len - pos) {
+    return -1;
+  }
+  record.suffix = (const char *)buf + pos + 1;
+  record.suffixLen = suffixLen;
+  size_t p = pos + 1 + suffixLen;
+
+  // read payload length
+  size_t length = 0;
+  for (int shift = 0;; shift += 7) {
+    if (p >= len || shift > 28) {
+      return -1;
+    }
+    length |= (size_t)(buf[p] & 0x7f) << shift;
+    if ((buf[p++] & 0x80) == 0) {
+      break;
+    }
+  }
+
+  // read payload
+  if (length > len - p) {
+    return -1;
+  }
+  record.payload = buf + p;
+  record.payloadLen = length;
+  pos = p + length;
+
+  return 1;
+}
+
+MQTTBatchReader::MQTTBatchReader(const char *payload, size_t len) : buf((const uint8_t *)payload), len(len) {
+  this->_error = !MQTTBatchReader::isBatch(payload, len);
+}
+
+bool MQTTBatchReader::next(MQTTBatchRecord &record) {
+  if (this->_error) {
+    return false;
+  }
+
+  int res = mqtt_batch_record(this->buf, this->len, this->pos, record);
+  if (res < 0) {
+    this->_error = true;
+  }
+
+  return res > 0;
+}
+
+bool MQTTBatchReader::isBatch(const char *payload, size_t len) {
+  // check header
+  auto buf = (const uint8_t *)payload;
+  if (buf == nullptr || len < MQTT_BATCH_HEADER || buf[0] != MQTT_BATCH_MAGIC || buf[1] != MQTT_BATCH_SIGNATURE_1 ||
+      buf[2] != MQTT_BATCH_SIGNATURE_2) {
+    return false;
+  }
+
+  // the records must end exactly with the payload and match the count, which rejects data that only looks like a batch
+  size_t pos = MQTT_BATCH_HEADER;
+  size_t count = 0;
+  MQTTBatchRecord record;
+  int res;
+  while ((res = mqtt_batch_record(buf, len, pos, record)) > 0) {
+    count++;
+  }
+
+  return res == 0 && count == (size_t)(buf[3] | buf[4] << 8);
+}
@@ -0,0 +1,59 @@
+#ifndef MQTT_BATCH_H
+#define MQTT_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// First byte of a batch payload (invalid in UTF-8 text), followed by the signature "BT" and the record count
+#define MQTT_BATCH_MAGIC 0xfc
+#define MQTT_BATCH_SIGNATURE_1 'B'
+#define MQTT_BATCH_SIGNATURE_2 'T'
+#define MQTT_BATCH_HEADER 5
+
+// A record points into the batch payload
+struct MQTTBatchRecord {
+  const char *suffix = nullptr;
+  size_t suffixLen = 0;
+  const uint8_t *payload = nullptr;
+  size_t payloadLen = 0;
+};
+
+// Packs records of a topic suffix and a payload into one buffer
+class MQTTBatchWriter {
+ private:
+  uint8_t *buf;
+  size_t cap;
+  size_t len = 0;
+  uint16_t _count = 0;
+
+ public:
+  MQTTBatchWriter(uint8_t *buf, size_t cap);
+
+  bool add(const char suffix[], const char payload[]);
+  bool add(const char suffix[], const uint8_t payload[], size_t length);
+  void reset();
+
+  uint16_t count() { return this->_count; }
+  size_t length() { return this->_count > 0 ? this->len : 0; }
+  const uint8_t *data() { return this->buf; }
+};
+
+// Iterates the records of a received batch payload in place
+class MQTTBatchReader {
+ private:
+  const uint8_t *buf;
+  size_t len;
+  size_t pos = MQTT_BATCH_HEADER;
+  bool _error = false;
+
+ public:
+  MQTTBatchReader(const char *payload, size_t len);
+
+  bool next(MQTTBatchRecord &record);
+  void reset() { this->pos = MQTT_BATCH_HEADER; }
+
+  bool error() { return this->_error; }
+  static bool isBatch(const char *payload, size_t len);
+};
+
+#endif
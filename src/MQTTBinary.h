@@ -0,0 +1,202 @@
+#ifndef MQTT_BINARY_H
+#define MQTT_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Byte order of an encoded field
+enum MQTTByteOrder : uint8_t { MQTT_ORDER_LE = 0, MQTT_ORDER_BE = 1 };
+
+template <size_t N>
+struct MQTTBinaryWord;
+template <>
+struct MQTTBinaryWord<1> {
+  typedef uint8_t type;
+};
+template <>
+struct MQTTBinaryWord<2> {
+  typedef uint16_t type;
+};
+template <>
+struct MQTTBinaryWord<4> {
+  typedef uint32_t type;
+};
+template <>
+struct MQTTBinaryWord<8> {
+  typedef uint64_t type;
+};
+
+// Converts the raw word of a scalar to its type, floating point values are copied bitwise and all other types
+// (integers, bool and enums) are converted by value as copying bytes into a bool or enum is undefined
+template <typename T>
+struct MQTTBinaryValue {
+  template <typename W>
+  static T from(W w) {
+    return static_cast<T>(w);
+  }
+};
+template <>
+struct MQTTBinaryValue<float> {
+  template <typename W>
+  static float from(W w) {
+    float value;
+    memcpy(&value, &w, sizeof(value));
+    return value;
+  }
+};
+template <>
+struct MQTTBinaryValue<double> {
+  template <typename W>
+  static double from(W w) {
+    double value;
+    memcpy(&value, &w, sizeof(value));
+    return value;
+  }
+};
+
+// Accepted wire values of a scalar, bool takes 0 and 1 only, specialize it for enums to reject unknown values
+template <typename T>
+struct MQTTBinaryRange {
+  static bool valid(uint64_t) { return true; }
+};
+template <>
+struct MQTTBinaryRange<bool> {
+  static bool valid(uint64_t w) { return w <= 1; }
+};
+
+// Reads and writes a scalar (integer, bool, enum, float or double) with explicit byte order
+template <typename T, MQTTByteOrder O>
+struct MQTTBinaryCodec {
+  typedef typename MQTTBinaryWord<sizeof(T)>::type word;
+
+  static void write(uint8_t *p, T value) {
+    word w;
+    memcpy(&w, &value, sizeof(T));
+    for (size_t i = 0; i < sizeof(T); i++) {
+      p[O == MQTT_ORDER_LE ? i : sizeof(T) - 1 - i] = (uint8_t)(w >> (i * 8));
+    }
+  }
+
+  static word load(const uint8_t *p) {
+    word w = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      w |= (word)((word)p[O == MQTT_ORDER_LE ? i : sizeof(T) - 1 - i] << (i * 8));
+    }
+    return w;
+  }
+
+  static bool valid(const uint8_t *p) { return MQTTBinaryRange<T>::valid(load(p)); }
+
+  // returns a zero value if the encoded value is not valid for the type
+  static T read(const uint8_t *p) {
+    word w = load(p);
+    if (!MQTTBinaryRange<T>::valid(w)) {
+      return T();
+    }
+    return MQTTBinaryValue<T>::from(w);
+  }
+};
+
+// A struct member that is part of a layout
+template <typename S, typename T, T S::*M, MQTTByteOrder O = MQTT_ORDER_LE>
+struct MQTTMember {
+  typedef T type;
+  static const size_t size = sizeof(T);
+
+  static void encode(const S &s, uint8_t *p) { MQTTBinaryCodec<T, O>::write(p, s.*M); }
+  static void decode(const uint8_t *p, S &s) { s.*M = MQTTBinaryCodec<T, O>::read(p); }
+  static bool valid(const uint8_t *p) { return MQTTBinaryCodec<T, O>::valid(p); }
+  static T read(const uint8_t *p) { return MQTTBinaryCodec<T, O>::read(p); }
+};
+
+#define MQTT_MEMBER(S, field, order) MQTTMember<S, decltype(S::field), &S::field, order>
+
+// A packed wire layout of struct S made of MQTTMember fields in order
+template <typename S, typename... Fields>
+struct MQTTLayout;
+
+template <typename S>
+struct MQTTLayout<S> {
+  static const size_t size = 0;
+
+  static void encodeFields(const S &, uint8_t *) {}
+  static void decodeFields(const uint8_t *, S &) {}
+  static bool validFields(const uint8_t *) { return true; }
+};
+
+template <typename S, typename F, typename... Rest>
+struct MQTTLayout<S, F, Rest...> {
+  typedef MQTTLayout<S, Rest...> next;
+  static const size_t size = F::size + next::size;
+
+  static void encodeFields(const S &s, uint8_t *p) {
+    F::encode(s, p);
+    next::encodeFields(s, p + F::size);
+  }
+
+  static void decodeFields(const uint8_t *p, S &s) {
+    F::decode(p, s);
+    next::decodeFields(p + F::size, s);
+  }
+
+  static bool validFields(const uint8_t *p) { return F::valid(p) && next::validFields(p + F::size); }
+
+  // returns the encoded length or zero if the buffer is too small
+  static size_t encode(const S &s, uint8_t *buf, size_t cap) {
+    if (buf == nullptr || cap < size) {
+      return 0;
+    }
+    encodeFields(s, buf);
+    return size;
+  }
+
+  // returns false and leaves the struct unchanged if the length does not match the layout or a field is invalid
+  static bool decode(const uint8_t *buf, size_t len, S &s) {
+    if (buf == nullptr || len != size || !validFields(buf)) {
+      return false;
+    }
+    decodeFields(buf, s);
+    return true;
+  }
+};
+
+// Field type and byte offset of the I-th field of a layout
+template <size_t I, typename L>
+struct MQTTLayoutField;
+
+template <typename S, typename F, typename... Rest>
+struct MQTTLayoutField<0, MQTTLayout<S, F, Rest...>> {
+  typedef F field;
+  static const size_t offset = 0;
+};
+
+template <size_t I, typename S, typename F, typename... Rest>
+struct MQTTLayoutField<I, MQTTLayout<S, F, Rest...>> {
+  typedef MQTTLayoutField<I - 1, MQTTLayout<S, Rest...>> next;
+  typedef typename next::field field;
+  static const size_t offset = F::size + next::offset;
+};
+
+// Read-only view that accesses the fields of an encoded payload in place
+template <typename L>
+class MQTTLayoutView {
+ private:
+  const uint8_t *buf;
+
+ public:
+  MQTTLayoutView(const void *payload, size_t len) : buf(len == L::size ? (const uint8_t *)payload : nullptr) {}
+
+  bool valid() const { return this->buf != nullptr; }
+
+  // returns a zero value on an invalid view or for an invalid field value
+  template <size_t I>
+  typename MQTTLayoutField<I, L>::field::type get() const {
+    if (this->buf == nullptr) {
+      return typename MQTTLayoutField<I, L>::field::type();
+    }
+    return MQTTLayoutField<I, L>::field::read(this->buf + MQTTLayoutField<I, L>::offset);
+  }
+};
+
+#endif
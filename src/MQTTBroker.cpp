@@ -0,0 +1,652 @@
+#include "MQTTBroker.h"
+
+#include "MQTTClient.h"
+
+extern "C" {
+#include "lwmqtt/packet.h"
+}
+
+MQTTBroker::MQTTBroker(MQTTBrokerSession *sessions, size_t sessionCount, MQTTBrokerSubscription *subscriptions,
+                       size_t subscriptionCount)
+    : sessions(sessions),
+      sessionCount(sessionCount),
+      subscriptions(subscriptions),
+      subscriptionCount(subscriptionCount) {
+  for (size_t i = 0; i < sessionCount; i++) {
+    sessions[i].client = nullptr;
+    sessions[i].connected = false;
+  }
+  for (size_t i = 0; i < subscriptionCount; i++) {
+    subscriptions[i].session = nullptr;
+  }
+}
+
+bool MQTTBroker::accept(Client &client) {
+  // release a session that still holds the same (reused) connection object without closing it
+  for (size_t i = 0; i < this->sessionCount; i++) {
+    if (this->sessions[i].client == &client) {
+      this->sessions[i].client = nullptr;
+      this->drop(this->sessions[i]);
+    }
+  }
+
+  // take the first free session
+  for (size_t i = 0; i < this->sessionCount; i++) {
+    MQTTBrokerSession &session = this->sessions[i];
+    if (session.client == nullptr) {
+      session.client = &client;
+      session.lastRead = millis();
+      session.keepAlive = 0;
+      session.nextId = 1;
+      memset(session.received, 0, sizeof(session.received));
+      session.receivedPos = 0;
+      session.len = 0;
+      session.connected = false;
+      session.clientId[0] = '\0';
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void MQTTBroker::loop() {
+  uint32_t now = millis();
+
+  for (size_t i = 0; i < this->sessionCount; i++) {
+    MQTTBrokerSession &session = this->sessions[i];
+    if (session.client == nullptr) {
+      continue;
+    }
+
+    // release closed connections
+    if (!session.client->connected()) {
+      this->drop(session);
+      continue;
+    }
+
+    // read what is available without blocking
+    int available = session.client->available();
+    if (available > 0 && session.len < MQTT_BROKER_BUFFER_SIZE) {
+      size_t n = MQTT_BROKER_BUFFER_SIZE - session.len;
+      if ((size_t)available < n) {
+        n = (size_t)available;
+      }
+      int r = session.client->read(session.buf + session.len, n);
+      if (r > 0) {
+        session.len += (size_t)r;
+        session.lastRead = now;
+      }
+    }
+
+    // handle complete packets
+    if (!this->process(session)) {
+      this->drop(session);
+      continue;
+    }
+
+    // drop connections that did not connect in time or missed 1.5 keep alive intervals
+    uint32_t limit = session.connected ? session.keepAlive * 1500UL : this->timeout;
+    if (limit > 0 && now - session.lastRead > limit) {
+      this->drop(session);
+    }
+  }
+}
+
+bool MQTTBroker::process(MQTTBrokerSession &session) {
+  while (session.client != nullptr && session.len >= 2) {
+    // wait for the complete remaining length
+    uint32_t remLen;
+    lwmqtt_err_t err = lwmqtt_detect_remaining_length(session.buf + 1, session.len - 1, &remLen);
+    if (err == LWMQTT_BUFFER_TOO_SHORT) {
+      return true;
+    } else if (err != LWMQTT_SUCCESS) {
+      return false;
+    }
+
+    // packets that never fit the buffer close the connection
+    int remLenLen;
+    lwmqtt_varnum_length(remLen, &remLenLen);
+    size_t total = 1 + (size_t)remLenLen + remLen;
+    if (total > MQTT_BROKER_BUFFER_SIZE) {
+      return false;
+    }
+
+    // wait for the complete packet
+    if (session.len < total) {
+      return true;
+    }
+
+    if (!this->handle(session, session.buf, total)) {
+      return false;
+    }
+
+    // the session may have been dropped while fanning out to itself
+    if (session.client == nullptr) {
+      return true;
+    }
+
+    // shift remaining bytes to the front
+    session.len -= total;
+    memmove(session.buf, session.buf + total, session.len);
+  }
+
+  return true;
+}
+
+bool MQTTBroker::handle(MQTTBrokerSession &session, uint8_t *buf, size_t len) {
+  auto type = (lwmqtt_packet_type_t)(buf[0] >> 4);
+
+  // the first packet must be a connect
+  if (!session.connected) {
+    return type == LWMQTT_CONNECT_PACKET && this->handleConnect(session, buf, len);
+  }
+
+  size_t outLen;
+  uint16_t packetId;
+  switch (type) {
+    case LWMQTT_PUBLISH_PACKET: {
+      bool dup;
+      lwmqtt_string_t topic;
+      lwmqtt_message_t message;
+      if (lwmqtt_decode_publish(buf, len, &dup, &packetId, &topic, &message) != LWMQTT_SUCCESS) {
+        return false;
+      }
+
+      // acknowledge before delivery, QoS 2 is answered with the first step of its handshake
+      if (message.qos > 0) {
+        auto ack = message.qos == LWMQTT_QOS1 ? LWMQTT_PUBACK_PACKET : LWMQTT_PUBREC_PACKET;
+        if (lwmqtt_encode_ack(this->out, sizeof(this->out), &outLen, ack, packetId) != LWMQTT_SUCCESS ||
+            !this->send(session, outLen)) {
+          return false;
+        }
+      }
+
+      // a QoS 2 message is delivered once, retransmissions before its release are only acknowledged again
+      if (message.qos == LWMQTT_QOS2) {
+        if (!this->receive(session, packetId)) {
+          return true;
+        }
+      }
+
+      this->fanOut(topic, message);
+      if (this->callback != nullptr) {
+        this->callback(this, topic.data, topic.len, (const char *)message.payload, message.payload_len);
+      }
+      return true;
+    }
+
+    case LWMQTT_PUBREL_PACKET:
+      if (lwmqtt_decode_ack(buf, len, LWMQTT_PUBREL_PACKET, &packetId) != LWMQTT_SUCCESS ||
+          lwmqtt_encode_ack(this->out, sizeof(this->out), &outLen, LWMQTT_PUBCOMP_PACKET, packetId) != LWMQTT_SUCCESS) {
+        return false;
+      }
+      this->release(session, packetId);
+      return this->send(session, outLen);
+
+    case LWMQTT_PUBACK_PACKET:
+      // deliveries are sent once and never redelivered, so acknowledgements need no state
+      return lwmqtt_decode_ack(buf, len, LWMQTT_PUBACK_PACKET, &packetId) == LWMQTT_SUCCESS;
+
+    case LWMQTT_SUBSCRIBE_PACKET:
+      return this->handleSubscribe(session, buf, len);
+
+    case LWMQTT_UNSUBSCRIBE_PACKET:
+      return this->handleUnsubscribe(session, buf, len);
+
+    case LWMQTT_PINGREQ_PACKET:
+      if (lwmqtt_encode_zero(this->out, sizeof(this->out), &outLen, LWMQTT_PINGRESP_PACKET) != LWMQTT_SUCCESS) {
+        return false;
+      }
+      return this->send(session, outLen);
+
+    default:
+      // disconnect, a second connect and unexpected packets close the connection
+      return false;
+  }
+}
+
+bool MQTTBroker::handleConnect(MQTTBrokerSession &session, uint8_t *buf, size_t len) {
+  lwmqtt_connect_options_t options;
+  lwmqtt_will_t will;
+  bool willPresent;
+  if (lwmqtt_decode_connect(buf, len, &options, &will, &willPresent) != LWMQTT_SUCCESS) {
+    return false;
+  }
+
+  // client ids must fit the session
+  lwmqtt_return_code_t code = options.return_code;
+  if (code == LWMQTT_CONNECTION_ACCEPTED && options.client_id.len >= MQTT_BROKER_CLIENT_ID_LENGTH) {
+    code = LWMQTT_IDENTIFIER_REJECTED;
+  }
+
+  if (code == LWMQTT_CONNECTION_ACCEPTED) {
+    // a new connection with the same client id takes over
+    for (size_t i = 0; i < this->sessionCount; i++) {
+      MQTTBrokerSession &other = this->sessions[i];
+      if (&other != &session && other.connected && other.client != nullptr &&
+          lwmqtt_strcmp(options.client_id, other.clientId) == 0) {
+        this->drop(other);
+      }
+    }
+
+    memcpy(session.clientId, options.client_id.data, options.client_id.len);
+    session.clientId[options.client_id.len] = '\0';
+    session.keepAlive = options.keep_alive;
+    session.connected = true;
+  }
+
+  // sessions are never persisted
+  size_t outLen;
+  if (lwmqtt_encode_connack(this->out, sizeof(this->out), &outLen, false, code) != LWMQTT_SUCCESS ||
+      !this->send(session, outLen)) {
+    return false;
+  }
+
+  return code == LWMQTT_CONNECTION_ACCEPTED;
+}
+
+bool MQTTBroker::handleSubscribe(MQTTBrokerSession &session, uint8_t *buf, size_t len) {
+  uint16_t packetId;
+  int count;
+  lwmqtt_string_t filters[MQTT_BROKER_MAX_FILTERS];
+  lwmqtt_qos_t qos[MQTT_BROKER_MAX_FILTERS];
+  if (lwmqtt_decode_subscribe(buf, len, &packetId, MQTT_BROKER_MAX_FILTERS, &count, filters, qos) != LWMQTT_SUCCESS) {
+    return false;
+  }
+
+  for (int i = 0; i < count; i++) {
+    // reject invalid levels and filters that do not fit
+    if (qos[i] == LWMQTT_QOS_FAILURE || filters[i].len == 0 || filters[i].len >= MQTT_BROKER_FILTER_LENGTH) {
+      qos[i] = LWMQTT_QOS_FAILURE;
+      continue;
+    }
+
+    // QoS 2 is downgraded
+    if (qos[i] > LWMQTT_QOS1) {
+      qos[i] = LWMQTT_QOS1;
+    }
+
+    // replace an existing subscription or take a free entry
+    MQTTBrokerSubscription *entry = nullptr;
+    for (size_t j = 0; j < this->subscriptionCount; j++) {
+      MQTTBrokerSubscription &sub = this->subscriptions[j];
+      if (sub.session == &session && lwmqtt_strcmp(filters[i], sub.filter) == 0) {
+        entry = &sub;
+        break;
+      } else if (sub.session == nullptr && entry == nullptr) {
+        entry = &sub;
+      }
+    }
+    if (entry == nullptr) {
+      qos[i] = LWMQTT_QOS_FAILURE;
+      continue;
+    }
+
+    entry->session = &session;
+    entry->qos = (uint8_t)qos[i];
+    memcpy(entry->filter, filters[i].data, filters[i].len);
+    entry->filter[filters[i].len] = '\0';
+  }
+
+  size_t outLen;
+  if (lwmqtt_encode_suback(this->out, sizeof(this->out), &outLen, packetId, count, qos) != LWMQTT_SUCCESS) {
+    return false;
+  }
+
+  return this->send(session, outLen);
+}
+
+bool MQTTBroker::handleUnsubscribe(MQTTBrokerSession &session, uint8_t *buf, size_t len) {
+  uint16_t packetId;
+  int count;
+  lwmqtt_string_t filters[MQTT_BROKER_MAX_FILTERS];
+  if (lwmqtt_decode_unsubscribe(buf, len, &packetId, MQTT_BROKER_MAX_FILTERS, &count, filters) != LWMQTT_SUCCESS) {
+    return false;
+  }
+
+  for (int i = 0; i < count; i++) {
+    for (size_t j = 0; j < this->subscriptionCount; j++) {
+      MQTTBrokerSubscription &sub = this->subscriptions[j];
+      if (sub.session == &session && lwmqtt_strcmp(filters[i], sub.filter) == 0) {
+        sub.session = nullptr;
+      }
+    }
+  }
+
+  size_t outLen;
+  if (lwmqtt_encode_ack(this->out, sizeof(this->out), &outLen, LWMQTT_UNSUBACK_PACKET, packetId) != LWMQTT_SUCCESS) {
+    return false;
+  }
+
+  return this->send(session, outLen);
+}
+
+bool MQTTBroker::receive(MQTTBrokerSession &session, uint16_t packetId) {
+  // a known id is a retransmission of a delivered message
+  size_t entry = MQTT_BROKER_QOS2_IDS;
+  for (size_t i = 0; i < MQTT_BROKER_QOS2_IDS; i++) {
+    if (session.received[i] == packetId) {
+      return false;
+    } else if (session.received[i] == 0 && entry == MQTT_BROKER_QOS2_IDS) {
+      entry = i;
+    }
+  }
+
+  // remember the id until its release in a free entry, or else replace the entries in turn
+  if (entry == MQTT_BROKER_QOS2_IDS) {
+    entry = session.receivedPos;
+    session.receivedPos = (uint8_t)((session.receivedPos + 1) % MQTT_BROKER_QOS2_IDS);
+  }
+  session.received[entry] = packetId;
+
+  return true;
+}
+
+void MQTTBroker::release(MQTTBrokerSession &session, uint16_t packetId) {
+  for (size_t i = 0; i < MQTT_BROKER_QOS2_IDS; i++) {
+    if (session.received[i] == packetId) {
+      session.received[i] = 0;
+    }
+  }
+}
+
+void MQTTBroker::fanOut(lwmqtt_string_t topic, lwmqtt_message_t message) {
+  // the payload is copied into the shared output buffer, so it must not point into it
+  for (size_t i = 0; i < this->sessionCount; i++) {
+    MQTTBrokerSession &session = this->sessions[i];
+    if (session.client == nullptr || !session.connected) {
+      continue;
+    }
+
+    // overlapping subscriptions deliver a single copy with the highest granted level
+    int granted = -1;
+    for (size_t j = 0; j < this->subscriptionCount; j++) {
+      MQTTBrokerSubscription &sub = this->subscriptions[j];
+      if (sub.session == &session && sub.qos > granted &&
+          MQTTClient::topicMatches(sub.filter, topic.data, topic.len)) {
+        granted = sub.qos;
+      }
+    }
+    if (granted < 0) {
+      continue;
+    }
+
+    // forwarded messages are never retained
+    lwmqtt_message_t msg = message;
+    msg.retained = false;
+    if ((int)msg.qos > granted) {
+      msg.qos = (lwmqtt_qos_t)granted;
+    }
+
+    uint16_t packetId = 0;
+    if (msg.qos > 0) {
+      packetId = session.nextId++;
+      if (session.nextId == 0) {
+        session.nextId = 1;
+      }
+    }
+
+    // the encoder only writes the header, the payload follows in the same buffer
+    size_t len;
+    if (lwmqtt_encode_publish(this->out, sizeof(this->out), &len, false, packetId, topic, msg) != LWMQTT_SUCCESS ||
+        len + msg.payload_len > sizeof(this->out)) {
+      continue;
+    }
+    memcpy(this->out + len, msg.payload, msg.payload_len);
+    len += msg.payload_len;
+
+    // slow consumers are disconnected instead of blocking the others
+    if (!this->send(session, len)) {
+      this->drop(session);
+    }
+  }
+}
+
+bool MQTTBroker::send(MQTTBrokerSession &session, size_t len) {
+  return session.client->write(this->out, len) == len;
+}
+
+void MQTTBroker::drop(MQTTBrokerSession &session) {
+  if (session.client != nullptr) {
+    session.client->stop();
+  }
+
+  // remove all subscriptions of the session
+  for (size_t i = 0; i < this->subscriptionCount; i++) {
+    if (this->subscriptions[i].session == &session) {
+      this->subscriptions[i].session = nullptr;
+    }
+  }
+
+  session.client = nullptr;
+  session.connected = false;
+  session.len = 0;
+}
+
+bool MQTTBroker::publish(const char topic[], const char payload[], size_t length, int qos) {
+  if (qos < 0 || qos > 1) {
+    return false;
+  }
+
+  lwmqtt_message_t message = lwmqtt_default_message;
+  message.qos = (lwmqtt_qos_t)qos;
+  message.payload = (uint8_t *)payload;
+  message.payload_len = length;
+
+  // fail if the message can not be encoded at all
+  size_t headerLen;
+  lwmqtt_string_t str = lwmqtt_string(topic);
+  if (lwmqtt_publish_header_length(str, message, &headerLen) != LWMQTT_SUCCESS ||
+      headerLen + length > MQTT_BROKER_BUFFER_SIZE) {
+    return false;
+  }
+
+  this->fanOut(str, message);
+  return true;
+}
+
+size_t MQTTBroker::connections() {
+  size_t n = 0;
+  for (size_t i = 0; i < this->sessionCount; i++) {
+    if (this->sessions[i].client != nullptr && this->sessions[i].connected) {
+      n++;
+    }
+  }
+  return n;
+}
+
+#if MQTT_BROKER_POSIX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+void MQTTSocketClient::attach(int _fd) {
+  this->stop();
+  this->fd = _fd;
+
+  // send small packets immediately and never raise SIGPIPE
+  int one = 1;
+  setsockopt(this->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  setsockopt(this->fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+int MQTTSocketClient::connect(IPAddress ip, uint16_t port) {
+  char host[16];
+  snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return this->connect(host, port);
+}
+
+int MQTTSocketClient::connect(const char *host, uint16_t port) {
+  this->stop();
+
+  char service[6];
+  snprintf(service, sizeof(service), "%u", port);
+
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *res;
+  if (getaddrinfo(host, service, &hints, &res) != 0) {
+    return 0;
+  }
+
+  // try all resolved addresses
+  for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+    int s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (s < 0) {
+      continue;
+    }
+    if (::connect(s, ai->ai_addr, ai->ai_addrlen) == 0) {
+      this->attach(s);
+      break;
+    }
+    close(s);
+  }
+
+  freeaddrinfo(res);
+  return this->fd >= 0 ? 1 : 0;
+}
+
+size_t MQTTSocketClient::write(const uint8_t *buf, size_t size) {
+  size_t written = 0;
+  while (this->fd >= 0 && written < size) {
+    ssize_t r = send(this->fd, buf + written, size - written, MSG_NOSIGNAL);
+    if (r < 0 && errno == EINTR) {
+      continue;
+    } else if (r <= 0) {
+      this->stop();
+      break;
+    }
+    written += (size_t)r;
+  }
+
+  return written;
+}
+
+int MQTTSocketClient::available() {
+  int n = 0;
+  if (this->fd < 0 || ioctl(this->fd, FIONREAD, &n) < 0) {
+    return 0;
+  }
+
+  return n;
+}
+
+int MQTTSocketClient::read() {
+  uint8_t b;
+  return this->read(&b, 1) == 1 ? b : -1;
+}
+
+int MQTTSocketClient::read(uint8_t *buf, size_t size) {
+  if (this->fd < 0) {
+    return -1;
+  }
+
+  ssize_t r = recv(this->fd, buf, size, MSG_DONTWAIT);
+  if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    this->stop();
+    return -1;
+  }
+
+  return r < 0 ? 0 : (int)r;
+}
+
+int MQTTSocketClient::peek() {
+  uint8_t b;
+  if (this->fd < 0 || recv(this->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) != 1) {
+    return -1;
+  }
+
+  return b;
+}
+
+void MQTTSocketClient::stop() {
+  if (this->fd >= 0) {
+    close(this->fd);
+    this->fd = -1;
+  }
+}
+
+uint8_t MQTTSocketClient::connected() {
+  if (this->fd < 0) {
+    return 0;
+  }
+
+  // an orderly shutdown by the peer reads as zero bytes
+  uint8_t b;
+  ssize_t r = recv(this->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    this->stop();
+    return 0;
+  }
+
+  return 1;
+}
+
+bool MQTTSocketServer::begin(uint16_t port, int backlog) {
+  this->end();
+
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  if (s < 0) {
+    return false;
+  }
+
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s, backlog) != 0 ||
+      fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) != 0) {
+    close(s);
+    return false;
+  }
+
+  this->fd = s;
+  return true;
+}
+
+MQTTSocketClient *MQTTSocketServer::accept() {
+  if (this->fd < 0) {
+    return nullptr;
+  }
+
+  // connections are only taken when a client is free, the others wait in the backlog
+  for (size_t i = 0; i < this->clientCount; i++) {
+    if (this->clients[i].idle()) {
+      int s = ::accept(this->fd, nullptr, nullptr);
+      if (s < 0) {
+        return nullptr;
+      }
+      this->clients[i].attach(s);
+      return &this->clients[i];
+    }
+  }
+
+  return nullptr;
+}
+
+void MQTTSocketServer::end() {
+  if (this->fd >= 0) {
+    close(this->fd);
+    this->fd = -1;
+  }
+}
+
+#endif
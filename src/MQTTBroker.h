@@ -0,0 +1,151 @@
+#ifndef MQTT_BROKER_H
+#define MQTT_BROKER_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+extern "C" {
+#include "lwmqtt/lwmqtt.h"
+}
+
+// Size of the packet buffer of each connection (may be overridden with a build flag)
+#ifndef MQTT_BROKER_BUFFER_SIZE
+#define MQTT_BROKER_BUFFER_SIZE 256
+#endif
+
+// Maximum length of client ids and subscription filters including the terminator
+#ifndef MQTT_BROKER_CLIENT_ID_LENGTH
+#define MQTT_BROKER_CLIENT_ID_LENGTH 24
+#endif
+#ifndef MQTT_BROKER_FILTER_LENGTH
+#define MQTT_BROKER_FILTER_LENGTH 32
+#endif
+
+// Enable the POSIX socket client and server to run the broker on a host (e.g. -DMQTT_BROKER_POSIX=1)
+#ifndef MQTT_BROKER_POSIX
+#define MQTT_BROKER_POSIX 0
+#endif
+
+// Number of received QoS 2 packet ids remembered per connection until their release
+#ifndef MQTT_BROKER_QOS2_IDS
+#define MQTT_BROKER_QOS2_IDS 4
+#endif
+
+// Maximum number of filters in a single subscribe or unsubscribe packet
+#ifndef MQTT_BROKER_MAX_FILTERS
+#define MQTT_BROKER_MAX_FILTERS 4
+#endif
+
+// State of a local connection
+typedef struct {
+  Client *client;
+  uint32_t lastRead;
+  uint16_t keepAlive;
+  uint16_t nextId;
+  uint16_t received[MQTT_BROKER_QOS2_IDS];  // QoS 2 packets delivered but not yet released, zero marks a free entry
+  uint8_t receivedPos;
+  size_t len;
+  bool connected;
+  char clientId[MQTT_BROKER_CLIENT_ID_LENGTH];
+  uint8_t buf[MQTT_BROKER_BUFFER_SIZE];
+} MQTTBrokerSession;
+
+// Entry of the subscription table
+typedef struct {
+  MQTTBrokerSession *session;
+  uint8_t qos;
+  char filter[MQTT_BROKER_FILTER_LENGTH];
+} MQTTBrokerSubscription;
+
+class MQTTBroker;
+
+typedef void (*MQTTBrokerCallback)(MQTTBroker *broker, const char topic[], size_t topicLen, const char payload[],
+                                   size_t length);
+
+// Small broker that fans out messages between local connections in fixed memory. Deliveries use QoS 0 or 1 and are
+// sent once: sessions are not persisted, so nothing is redelivered and messages in flight when a connection drops
+// are lost. Received QoS 2 messages are delivered exactly once.
+class MQTTBroker {
+ private:
+  MQTTBrokerSession *sessions;
+  size_t sessionCount;
+  MQTTBrokerSubscription *subscriptions;
+  size_t subscriptionCount;
+  MQTTBrokerCallback callback = nullptr;
+  uint32_t timeout = 5000;
+  uint8_t out[MQTT_BROKER_BUFFER_SIZE];
+
+  bool process(MQTTBrokerSession &session);
+  bool handle(MQTTBrokerSession &session, uint8_t *buf, size_t len);
+  bool handleConnect(MQTTBrokerSession &session, uint8_t *buf, size_t len);
+  bool handleSubscribe(MQTTBrokerSession &session, uint8_t *buf, size_t len);
+  bool handleUnsubscribe(MQTTBrokerSession &session, uint8_t *buf, size_t len);
+  bool receive(MQTTBrokerSession &session, uint16_t packetId);
+  void release(MQTTBrokerSession &session, uint16_t packetId);
+  void fanOut(lwmqtt_string_t topic, lwmqtt_message_t message);
+  bool send(MQTTBrokerSession &session, size_t len);
+  void drop(MQTTBrokerSession &session);
+
+ public:
+  MQTTBroker(MQTTBrokerSession *sessions, size_t sessionCount, MQTTBrokerSubscription *subscriptions,
+             size_t subscriptionCount);
+
+  void onMessage(MQTTBrokerCallback cb) { this->callback = cb; }
+  void setTimeout(uint32_t _timeout) { this->timeout = _timeout; }
+
+  bool accept(Client &client);
+  void loop();
+
+  bool publish(const char topic[], const char payload[], size_t length, int qos = 0);
+  bool publish(const char topic[], const char payload[]) { return this->publish(topic, payload, strlen(payload)); }
+
+  size_t connections();
+};
+
+#if MQTT_BROKER_POSIX
+
+// Client over a blocking POSIX socket that reads without blocking, used to run the broker on a host
+class MQTTSocketClient : public Client {
+ private:
+  int fd = -1;
+
+ public:
+  MQTTSocketClient() = default;
+  ~MQTTSocketClient() { this->stop(); }
+
+  void attach(int _fd);
+  bool idle() { return this->fd < 0; }
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override { return this->write(&b, 1); }
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return this->fd >= 0; }
+};
+
+// Non-blocking TCP listener that hands out connections from a fixed pool of socket clients
+class MQTTSocketServer {
+ private:
+  int fd = -1;
+  MQTTSocketClient *clients;
+  size_t clientCount;
+
+ public:
+  MQTTSocketServer(MQTTSocketClient *clients, size_t clientCount) : clients(clients), clientCount(clientCount) {}
+  ~MQTTSocketServer() { this->end(); }
+
+  bool begin(uint16_t port, int backlog = 16);
+  MQTTSocketClient *accept();
+  void end();
+};
+
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#include "MQTTCbor.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// major types
+#define MQTT_CBOR_UINT 0
+#define MQTT_CBOR_NINT 1
+#define MQTT_CBOR_BYTES 2
+#define MQTT_CBOR_TEXT 3
+#define MQTT_CBOR_ARRAY 4
+#define MQTT_CBOR_MAP 5
+#define MQTT_CBOR_SIMPLE 7
+
+void MQTTCborWriter::put(uint8_t byte) {
+  if (!this->_ok || this->len >= this->cap) {
+    this->_ok = false;
+    return;
+  }
+
+  this->buf[this->len++] = byte;
+}
+
+void MQTTCborWriter::put(const void *data, size_t size) {
+  if (!this->_ok || size > this->cap - this->len) {
+    this->_ok = false;
+    return;
+  }
+
+  memcpy(this->buf + this->len, data, size);
+  this->len += size;
+}
+
+void MQTTCborWriter::head(uint8_t major, uint64_t value) {
+  major = (uint8_t)(major << 5);
+
+  // use the shortest argument encoding
+  int size;
+  if (value < 24) {
+    this->put((uint8_t)(major | value));
+    return;
+  } else if (value <= 0xff) {
+    this->put((uint8_t)(major | 24));
+    size = 1;
+  } else if (value <= 0xffff) {
+    this->put((uint8_t)(major | 25));
+    size = 2;
+  } else if (value <= 0xffffffff) {
+    this->put((uint8_t)(major | 26));
+    size = 4;
+  } else {
+    this->put((uint8_t)(major | 27));
+    size = 8;
+  }
+
+  // write argument in network byte order
+  for (int i = size - 1; i >= 0; i--) {
+    this->put((uint8_t)(value >> (i * 8)));
+  }
+}
+
+MQTTCborWriter &MQTTCborWriter::map(size_t count) {
+  this->head(MQTT_CBOR_MAP, count);
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::array(size_t count) {
+  this->head(MQTT_CBOR_ARRAY, count);
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::beginMap() {
+  this->put((uint8_t)(MQTT_CBOR_MAP << 5 | 31));
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::beginArray() {
+  this->put((uint8_t)(MQTT_CBOR_ARRAY << 5 | 31));
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::end() {
+  this->put(0xff);
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::text(const char str[]) { return this->text(str, strlen(str)); }
+
+MQTTCborWriter &MQTTCborWriter::text(const char str[], size_t length) {
+  this->head(MQTT_CBOR_TEXT, length);
+  this->put(str, length);
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::bytes(const uint8_t data[], size_t length) {
+  this->head(MQTT_CBOR_BYTES, length);
+  this->put(data, length);
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::integer(int64_t value) {
+  if (value < 0) {
+    // negative integers are encoded as -1 - n
+    this->head(MQTT_CBOR_NINT, (uint64_t)(-(value + 1)));
+  } else {
+    this->head(MQTT_CBOR_UINT, (uint64_t)value);
+  }
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::uinteger(uint64_t value) {
+  this->head(MQTT_CBOR_UINT, value);
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::number(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  this->put((uint8_t)(MQTT_CBOR_SIMPLE << 5 | 26));
+  for (int i = 3; i >= 0; i--) {
+    this->put((uint8_t)(bits >> (i * 8)));
+  }
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::number(double value) {
+  // use single precision if no precision is lost (double is float on AVR), finite values beyond the float range are
+  // not converted as the cast is undefined for them
+  if (sizeof(double) == sizeof(float) || isnan(value) || isinf(value) ||
+      (value >= -FLT_MAX && value <= FLT_MAX && (double)(float)value == value)) {
+    return this->number((float)value);
+  }
+
+  uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(value));
+  this->put((uint8_t)(MQTT_CBOR_SIMPLE << 5 | 27));
+  for (int i = 7; i >= 0; i--) {
+    this->put((uint8_t)(bits >> (i * 8)));
+  }
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::boolean(bool value) {
+  this->put((uint8_t)(MQTT_CBOR_SIMPLE << 5 | (value ? 21 : 20)));
+  return *this;
+}
+
+MQTTCborWriter &MQTTCborWriter::null() {
+  this->put((uint8_t)(MQTT_CBOR_SIMPLE << 5 | 22));
+  return *this;
+}
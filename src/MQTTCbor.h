@@ -0,0 +1,51 @@
+#ifndef MQTT_CBOR_H
+#define MQTT_CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal streaming CBOR (RFC 8949) encoder that writes into a caller supplied buffer
+class MQTTCborWriter {
+ private:
+  uint8_t *buf;
+  size_t cap;
+  size_t len = 0;
+  bool _ok = true;
+
+  void put(uint8_t byte);
+  void put(const void *data, size_t size);
+  void head(uint8_t major, uint64_t value);
+
+ public:
+  MQTTCborWriter(uint8_t *buf, size_t cap) : buf(buf), cap(cap) {}
+
+  // containers with a known number of entries (pairs for maps)
+  MQTTCborWriter &map(size_t count);
+  MQTTCborWriter &array(size_t count);
+
+  // containers of unknown size, closed with end()
+  MQTTCborWriter &beginMap();
+  MQTTCborWriter &beginArray();
+  MQTTCborWriter &end();
+
+  MQTTCborWriter &text(const char str[]);
+  MQTTCborWriter &text(const char str[], size_t length);
+  MQTTCborWriter &bytes(const uint8_t data[], size_t length);
+  MQTTCborWriter &integer(int64_t value);
+  MQTTCborWriter &uinteger(uint64_t value);
+  MQTTCborWriter &number(float value);
+  MQTTCborWriter &number(double value);
+  MQTTCborWriter &boolean(bool value);
+  MQTTCborWriter &null();
+
+  void reset() {
+    this->len = 0;
+    this->_ok = true;
+  }
+
+  bool ok() { return this->_ok; }
+  size_t length() { return this->len; }
+  const uint8_t *data() { return this->buf; }
+};
+
+#endif
@@ -1,16 +1,245 @@
 #include "MQTTClient.h"
 
+#include "MQTTLz.h"
+#include "MQTTOutbox.h"
+
+extern "C" {
+#include "lwmqtt/helpers.h"
+#include "lwmqtt/trace.h"
+}
+
+#if defined(ESP32)
+#include <esp_timer.h>
+#endif
+
+static void *mqtt_default_alloc(size_t size, MQTTAllocHint /*hint*/, void * /*ref*/) { return malloc(size); }
+
+static void mqtt_default_free(void *ptr, MQTTAllocHint /*hint*/, void * /*ref*/) { free(ptr); }
+
+static const MQTTClientAllocator mqtt_default_allocator = {mqtt_default_alloc, mqtt_default_free, nullptr};
+static const MQTTClientAllocator *mqtt_allocator = &mqtt_default_allocator;
+
+MQTT_ALWAYS_INLINE void *mqtt_raw_alloc(size_t size, MQTTAllocHint hint) {
+  return mqtt_allocator->alloc(size, hint, mqtt_allocator->ref);
+}
+
+MQTT_ALWAYS_INLINE void mqtt_raw_free(void *ptr, MQTTAllocHint hint) {
+  mqtt_allocator->free(ptr, hint, mqtt_allocator->ref);
+}
+
+// Allocation accounting per phase, enable with "-DMQTT_ALLOC_STATS=1" in the build flags
+#ifndef MQTT_ALLOC_STATS
+#define MQTT_ALLOC_STATS 0
+#endif
+
+#if MQTT_ALLOC_STATS
+static MQTTClientAllocStats mqtt_alloc_stats[MQTT_PHASE_COUNT];
+static MQTTAllocPhase mqtt_alloc_phase = MQTT_PHASE_CONFIGURE;
+static size_t mqtt_alloc_current = 0;
+static size_t mqtt_alloc_peak = 0;
+
+// Header in front of each block to remember its size, padded to keep the payload aligned
+union mqtt_alloc_header {
+  size_t size;
+  double d;
+  void *p;
+  long long ll;
+};
+
+struct MQTTAllocPhaseScope {
+  MQTTAllocPhase prev;
+  explicit MQTTAllocPhaseScope(MQTTAllocPhase phase) : prev(mqtt_alloc_phase) { mqtt_alloc_phase = phase; }
+  ~MQTTAllocPhaseScope() { mqtt_alloc_phase = prev; }
+};
+
+#define MQTT_ALLOC_PHASE(phase) MQTTAllocPhaseScope mqtt_alloc_scope(phase)
+
+static void *mqtt_malloc(size_t size, MQTTAllocHint hint) {
+  auto h = (mqtt_alloc_header *)mqtt_raw_alloc(sizeof(mqtt_alloc_header) + size, hint);
+  if (h == nullptr) {
+    return nullptr;
+  }
+  h->size = size;
+
+  MQTTClientAllocStats &stats = mqtt_alloc_stats[mqtt_alloc_phase];
+  stats.allocs++;
+  stats.bytes += size;
+  mqtt_alloc_current += size;
+  if (mqtt_alloc_current > mqtt_alloc_peak) {
+    mqtt_alloc_peak = mqtt_alloc_current;
+  }
+
+  return h + 1;
+}
+
+static void mqtt_free(void *ptr, MQTTAllocHint hint) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  auto h = (mqtt_alloc_header *)ptr - 1;
+  mqtt_alloc_stats[mqtt_alloc_phase].frees++;
+  mqtt_alloc_current -= h->size;
+  mqtt_raw_free(h, hint);
+}
+#else
+#define MQTT_ALLOC_PHASE(phase)
+
+MQTT_ALWAYS_INLINE void *mqtt_malloc(size_t size, MQTTAllocHint hint) { return mqtt_raw_alloc(size, hint); }
+MQTT_ALWAYS_INLINE void mqtt_free(void *ptr, MQTTAllocHint hint) {
+  if (ptr != nullptr) {
+    mqtt_raw_free(ptr, hint);
+  }
+}
+#endif
+
+static char *mqtt_strdup(const char *str) {
+  size_t len = strlen(str) + 1;
+  auto copy = (char *)mqtt_malloc(len, MQTT_ALLOC_SMALL);
+  if (copy != nullptr) {
+    memcpy(copy, str, len);
+  }
+  return copy;
+}
+
+void MQTTClient::setAllocator(const MQTTClientAllocator *allocator) {
+  // a null allocator restores malloc and free
+  mqtt_allocator = (allocator != nullptr) ? allocator : &mqtt_default_allocator;
+}
+
+static void *mqtt_arena_alloc(size_t size, MQTTAllocHint hint, void *ref) {
+  return ((MQTTClientArena *)ref)->alloc(size, hint);
+}
+
+static void mqtt_arena_free(void *ptr, MQTTAllocHint hint, void *ref) { ((MQTTClientArena *)ref)->free(ptr, hint); }
+
+MQTTClientArena::MQTTClientArena(uint8_t *buf, size_t size) : buf(buf), size(size) {
+  this->allocator = {mqtt_arena_alloc, mqtt_arena_free, this};
+}
+
+void *MQTTClientArena::alloc(size_t len, MQTTAllocHint hint) {
+  // small control structures stay on the heap
+  if (hint != MQTT_ALLOC_LARGE) {
+    return malloc(len);
+  }
+
+  // bump allocate with the alignment malloc would give
+  size_t start = (this->used + (sizeof(void *) * 2 - 1)) & ~(sizeof(void *) * 2 - 1);
+  if (start > this->size || this->size - start < len) {
+    return nullptr;
+  }
+  this->last = start;
+  this->used = start + len;
+
+  return this->buf + start;
+}
+
+void MQTTClientArena::free(void *ptr, MQTTAllocHint hint) {
+  if (hint != MQTT_ALLOC_LARGE) {
+    ::free(ptr);
+    return;
+  }
+
+  // only the most recent block can be given back
+  if (ptr == this->buf + this->last && this->used > this->last) {
+    this->used = this->last;
+  }
+}
+
+static void *mqtt_pool_alloc(size_t size, MQTTAllocHint hint, void *ref) {
+  return ((MQTTClientPool *)ref)->alloc(size, hint);
+}
+
+static void mqtt_pool_free(void *ptr, MQTTAllocHint hint, void *ref) { ((MQTTClientPool *)ref)->free(ptr, hint); }
+
+MQTTClientPool::MQTTClientPool(uint8_t *buf, size_t size, size_t blockSize) : buf(buf) {
+  this->allocator = {mqtt_pool_alloc, mqtt_pool_free, this};
+
+  // round blocks up to the alignment malloc would give, each free block holds the link to the next one
+  const size_t align = sizeof(void *) * 2;
+  this->blockSize = (blockSize + align - 1) & ~(align - 1);
+  this->count = (buf != nullptr && this->blockSize > 0) ? size / this->blockSize : 0;
+
+  // chain all blocks into the free list
+  for (size_t i = this->count; i > 0; i--) {
+    void *block = this->buf + (i - 1) * this->blockSize;
+    *(void **)block = this->head;
+    this->head = block;
+  }
+  this->freeCount = this->count;
+}
+
+void *MQTTClientPool::alloc(size_t len, MQTTAllocHint hint) {
+  // small control structures stay on the heap
+  if (hint != MQTT_ALLOC_LARGE) {
+    return malloc(len);
+  }
+
+  // take the first free block if the request fits
+  if (len > this->blockSize || this->head == nullptr) {
+    return nullptr;
+  }
+  void *block = this->head;
+  this->head = *(void **)block;
+  this->freeCount--;
+
+  return block;
+}
+
+void MQTTClientPool::free(void *ptr, MQTTAllocHint hint) {
+  if (hint != MQTT_ALLOC_LARGE) {
+    ::free(ptr);
+    return;
+  }
+
+  // give the block back to the front of the list
+  if (ptr == nullptr) {
+    return;
+  }
+  *(void **)ptr = this->head;
+  this->head = ptr;
+  this->freeCount++;
+}
+
+MQTTClientAllocStats MQTTClient::allocStats(MQTTAllocPhase phase) {
+#if MQTT_ALLOC_STATS
+  if (phase < MQTT_PHASE_COUNT) {
+    return mqtt_alloc_stats[phase];
+  }
+#endif
+  (void)phase;
+  return MQTTClientAllocStats();
+}
+
+size_t MQTTClient::allocPeak() {
+#if MQTT_ALLOC_STATS
+  return mqtt_alloc_peak;
+#else
+  return 0;
+#endif
+}
+
+void MQTTClient::resetAllocStats() {
+#if MQTT_ALLOC_STATS
+  memset(mqtt_alloc_stats, 0, sizeof(mqtt_alloc_stats));
+  mqtt_alloc_peak = mqtt_alloc_current;
+#endif
+}
+
+MQTT_ALWAYS_INLINE uint32_t lwmqtt_arduino_timer_now(lwmqtt_arduino_timer_t *t) {
+  // Get current time from custom source or Arduino millis
+  return (t->millis != nullptr) ? t->millis() : millis();
+}
+
 MQTT_ALWAYS_INLINE void lwmqtt_arduino_timer_set(void *ref, uint32_t timeout) {
   auto t = (lwmqtt_arduino_timer_t *)ref;
   t->timeout = timeout;
-  t->start = (t->millis != nullptr) ? t->millis() : millis();
+  t->start = lwmqtt_arduino_timer_now(t);
 }
 
 MQTT_ALWAYS_INLINE int32_t lwmqtt_arduino_timer_get(void *ref) {
   auto t = (lwmqtt_arduino_timer_t *)ref;
-  
-  // Get current time from custom source or Arduino millis
-  uint32_t now = (t->millis != nullptr) ? t->millis() : millis();
+  uint32_t now = lwmqtt_arduino_timer_now(t);
   
   // Unsigned subtraction automatically handles rollover correctly
   uint32_t elapsed = now - t->start;
@@ -19,15 +248,147 @@ MQTT_ALWAYS_INLINE int32_t lwmqtt_arduino_timer_get(void *ref) {
   return (int32_t)(t->timeout - elapsed);
 }
 
+static uint64_t lwmqtt_arduino_micros64(lwmqtt_arduino_micros_t *ext) {
+#if defined(ESP32)
+  // The ESP32 high resolution timer is already 64-bit
+  (void)ext;
+  return (uint64_t)esp_timer_get_time();
+#else
+  // Extend the 32-bit micros() counter (wraps every ~71 minutes) with the state of the calling client, so clients
+  // never race on a shared counter
+  uint32_t now = micros();
+  if (now < ext->last) {
+    ext->high++;
+  }
+  ext->last = now;
+  return ((uint64_t)ext->high << 32) | now;
+#endif
+}
+
+MQTT_ALWAYS_INLINE uint64_t lwmqtt_arduino_utimer_now(lwmqtt_arduino_utimer_t *t) {
+  return (t->micros != nullptr) ? t->micros() : lwmqtt_arduino_micros64(t->ext);
+}
+
+static void lwmqtt_arduino_utimer_set(void *ref, uint32_t timeout) {
+  auto t = (lwmqtt_arduino_utimer_t *)ref;
+  t->timeout = timeout;
+  t->start = lwmqtt_arduino_utimer_now(t);
+}
+
+static int32_t lwmqtt_arduino_utimer_get(void *ref) {
+  auto t = (lwmqtt_arduino_utimer_t *)ref;
+  int64_t remaining = (int64_t)t->timeout * 1000 - (int64_t)(lwmqtt_arduino_utimer_now(t) - t->start);
+
+  // Round up so a deadline less than a millisecond away still counts as pending
+  if (remaining > 0) {
+    return (int32_t)((remaining + 999) / 1000);
+  }
+  if (remaining < (int64_t)INT32_MIN * 1000) {
+    return INT32_MIN;
+  }
+  return (int32_t)(remaining / 1000);
+}
+
+static size_t lwmqtt_arduino_network_room(lwmqtt_arduino_network_t *n) {
+  // Clients that never implemented availableForWrite() report 0 forever, so only trust a zero
+  // once the client has proven support by reporting free space at least once
+  int avail = n->client->availableForWrite();
+  if (avail > 0) {
+    n->writeProbe = true;
+    return (size_t)avail;
+  }
+  return n->writeProbe ? 0 : SIZE_MAX;
+}
+
+static void lwmqtt_arduino_network_flush(lwmqtt_arduino_network_t *n) {
+  lwmqtt_arduino_ring_t *r = &n->tx;
+
+  while (r->len > 0) {
+    // Write the contiguous part starting at head, limited by what the client can take now
+    size_t chunk = r->size - r->head;
+    if (chunk > r->len) chunk = r->len;
+    size_t room = lwmqtt_arduino_network_room(n);
+    if (chunk > room) chunk = room;
+    if (chunk == 0) return;
+
+    size_t written = n->client->write(r->buf + r->head, chunk);
+    if (written == 0) return;
+
+    r->head = (r->head + written) % r->size;
+    r->len -= written;
+  }
+
+  // Rewind when empty so the next packet is queued contiguously
+  r->head = 0;
+}
+
+static bool lwmqtt_arduino_ring_push(lwmqtt_arduino_ring_t *r, const uint8_t *data, size_t len) {
+  if (r->size - r->len < len) {
+    return false;
+  }
+
+  size_t tail = (r->head + r->len) % r->size;
+  size_t first = r->size - tail;
+  if (first > len) first = len;
+  memcpy(r->buf + tail, data, first);
+  memcpy(r->buf, data + first, len - first);
+  r->len += len;
+
+  return true;
+}
+
+static void lwmqtt_arduino_network_wait(lwmqtt_arduino_wait_t *w, Client *client, uint32_t idle, uint32_t remaining) {
+  w->stats.wakeups++;
+
+  switch (w->policy) {
+    case MQTT_WAIT_SPIN:
+      // Stay on the CPU for the first empty reads, data is often only microseconds away
+      if (idle >= w->param) {
+        yield();
+      }
+      return;
+
+    case MQTT_WAIT_SLEEP: {
+      // Double the sleep with every empty read, capped by the policy and the remaining time
+      uint32_t ms = 1u << (idle < 15 ? idle : 15);
+      if (w->param > 0 && ms > w->param) ms = w->param;
+      if (ms > remaining) ms = remaining;
+      delay(ms);
+      return;
+    }
+
+    case MQTT_WAIT_CUSTOM:
+      if (w->callback != nullptr) {
+        w->callback(client, idle, remaining);
+        return;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  // Yield to RTOS/WiFi task
+  yield();
+}
+
 MQTT_ALWAYS_INLINE lwmqtt_err_t lwmqtt_arduino_network_read(void *ref, uint8_t *buffer, size_t len, size_t *read,
                                                 uint32_t timeout) {
   auto n = (lwmqtt_arduino_network_t *)ref;
+
+  // Push out queued writes first, a pending ack wait would otherwise never see its request leave
+  if (n->tx.len > 0) {
+    lwmqtt_arduino_network_flush(n);
+  }
+
   uint32_t start = millis();
+  uint32_t idle = 0;
   *read = 0;
 
   while (len > 0) {
     // Check timeout using unsigned subtraction (handles rollover)
-    if (millis() - start >= timeout) {
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= timeout) {
       break;
     }
 
@@ -36,10 +397,12 @@ MQTT_ALWAYS_INLINE lwmqtt_err_t lwmqtt_arduino_network_read(void *ref, uint8_t *
       buffer += r;
       *read += r;
       len -= r;
+      n->wait.stats.bytes += r;
+      idle = 0;
     } else {
-      // Yield to RTOS/WiFi task
-      yield();
-      
+      // Wait according to the configured policy
+      lwmqtt_arduino_network_wait(&n->wait, n->client, idle++, timeout - elapsed);
+
       // Check connection if no data is available
       if (!n->client->connected()) {
         return LWMQTT_NETWORK_FAILED_READ;
@@ -51,19 +414,70 @@ MQTT_ALWAYS_INLINE lwmqtt_err_t lwmqtt_arduino_network_read(void *ref, uint8_t *
 }
 
 MQTT_ALWAYS_INLINE lwmqtt_err_t lwmqtt_arduino_network_write(void *ref, uint8_t *buffer, size_t len, size_t *sent,
-                                                 uint32_t /*timeout*/) {
+                                                 uint32_t timeout) {
   auto n = (lwmqtt_arduino_network_t *)ref;
-  *sent = n->client->write(buffer, len);
-  return (*sent > 0) ? LWMQTT_SUCCESS : LWMQTT_NETWORK_FAILED_WRITE;
+
+  // Blocking mode: hand everything to the client
+  if (n->tx.buf == nullptr) {
+    *sent = n->client->write(buffer, len);
+    return (*sent > 0) ? LWMQTT_SUCCESS : LWMQTT_NETWORK_FAILED_WRITE;
+  }
+
+  // Non-blocking mode: keep byte order by draining the ring before writing new data
+  lwmqtt_arduino_network_flush(n);
+
+  // Publishes have reserved their space up front and loop() checks the room for acks and pings, so a full ring means
+  // a command (subscribe, unsubscribe), which must not fail: keep draining the ring until the remainder fits, bounded
+  // by the timeout
+  size_t done = 0;
+  uint32_t start = millis();
+  for (;;) {
+    // Write directly as long as nothing is queued ahead
+    if (n->tx.len == 0 && done < len) {
+      size_t room = lwmqtt_arduino_network_room(n);
+      if (room > 0) {
+        done += n->client->write(buffer + done, (room < len - done) ? room : len - done);
+      }
+    }
+
+    // Queue the remainder for loop() to flush later
+    if (lwmqtt_arduino_ring_push(&n->tx, buffer + done, len - done)) {
+      break;
+    }
+    if (millis() - start >= timeout || !n->client->connected()) {
+      *sent = done;
+      return LWMQTT_NETWORK_WOULD_BLOCK;
+    }
+    yield();
+    lwmqtt_arduino_network_flush(n);
+  }
+
+  *sent = len;
+  return LWMQTT_SUCCESS;
 }
 
-static void MQTTClientHandler(lwmqtt_client_t * /*client*/, void *ref, lwmqtt_string_t topic,
-                              lwmqtt_message_t message) {
-  auto cb = (MQTTClientCallback *)ref;
-  
-  // Quick exit if no callback set
-  if (cb->type == MQTT_CB_NONE) return;
+#if LWMQTT_TRACE
+// records are stamped with the microsecond clock of the client, including a source set with useMicrosTimers()
+static uint32_t lwmqtt_arduino_trace_clock(void *ref) { return (uint32_t)((MQTTClient *)ref)->micros64(); }
+
+static lwmqtt_err_t lwmqtt_arduino_network_read_traced(void *ref, uint8_t *buffer, size_t len, size_t *read,
+                                                       uint32_t timeout) {
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_NETWORK_READ_BEGIN, 0, len, timeout);
+  lwmqtt_err_t err = lwmqtt_arduino_network_read(ref, buffer, len, read, timeout);
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_NETWORK_READ_END, -err, *read, len);
+  return err;
+}
+
+static lwmqtt_err_t lwmqtt_arduino_network_write_traced(void *ref, uint8_t *buffer, size_t len, size_t *sent,
+                                                        uint32_t timeout) {
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_NETWORK_WRITE_BEGIN, 0, len, timeout);
+  lwmqtt_err_t err = lwmqtt_arduino_network_write(ref, buffer, len, sent, timeout);
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_NETWORK_WRITE_END, -err, *sent, len);
+  return err;
+}
+#endif
 
+void MQTTClientDispatch(MQTTClientCallback *cb, lwmqtt_string_t topic, lwmqtt_message_t message) {
   // Zero-copy path: raw callbacks get untouched buffers and lengths (no mutation, no allocation)
   switch (cb->type) {
     case MQTT_CB_RAW:
@@ -128,19 +542,54 @@ static void MQTTClientHandler(lwmqtt_client_t * /*client*/, void *ref, lwmqtt_st
   }
 }
 
+void MQTTClientHandler(lwmqtt_client_t * /*client*/, void *ref, lwmqtt_string_t topic, lwmqtt_message_t message) {
+  auto cb = (MQTTClientCallback *)ref;
+  MQTTClient *client = cb->client;
+
+  // Forward the raw packet before the payload is touched
+  if (client != nullptr && client->bridging()) {
+    client->forwardPacket(topic, message);
+  }
+
+  // Quick exit if no callback set and nothing to cache
+  if (cb->type == MQTT_CB_NONE && (client == nullptr || !client->retainedCacheEnabled())) return;
+
+  MQTT_ALLOC_PHASE(MQTT_PHASE_RECEIVE);
+
+  // Decompress payload if enabled
+  client->inflatePayload(message);
+
+  // Suppress retained replays that match the cached copy, live messages update cached topics
+  if (client->retainedCacheEnabled() && !client->cacheRetained(topic, message)) return;
+  if (cb->type == MQTT_CB_NONE) return;
+
+  // Plain dispatch unless per-topic stats are enabled
+  if (!client->topicStatsEnabled()) {
+    MQTTClientDispatch(cb, topic, message);
+    return;
+  }
+
+  // Attribute callback time to the matching subscription filter
+  uint64_t start = client->micros64();
+  MQTTClientDispatch(cb, topic, message);
+  client->recordTopicStat(topic.data, topic.len, (uint32_t)(client->micros64() - start));
+}
+
 MQTTClient::MQTTClient(int readBufSize, int writeBufSize) {
+  MQTT_ALLOC_PHASE(MQTT_PHASE_CONSTRUCT);
+
   // Store buffer sizes
   this->readBufSize = (size_t)readBufSize;
   this->writeBufSize = (size_t)writeBufSize;
   
   // Allocate buffers (+1 for read buffer to allow null termination)
-  this->readBuf = (uint8_t *)malloc(this->readBufSize + 1);
-  this->writeBuf = (uint8_t *)malloc(this->writeBufSize);
+  this->readBuf = (uint8_t *)mqtt_malloc(this->readBufSize + 1, MQTT_ALLOC_LARGE);
+  this->writeBuf = (uint8_t *)mqtt_malloc(this->writeBufSize, MQTT_ALLOC_LARGE);
 
    // Abort early if allocation failed; keep pointers null to prevent deref later
    if (this->readBuf == nullptr || this->writeBuf == nullptr) {
-     free(this->readBuf);
-     free(this->writeBuf);
+     mqtt_free(this->readBuf, MQTT_ALLOC_LARGE);
+     mqtt_free(this->writeBuf, MQTT_ALLOC_LARGE);
      this->readBuf = nullptr;
      this->writeBuf = nullptr;
      this->readBufSize = 0;
@@ -155,17 +604,36 @@ MQTTClient::MQTTClient(int readBufSize, int writeBufSize) {
 
 MQTTClient::~MQTTClient() {
   this->destroyCallback();
+#if LWMQTT_WILL
   // free will
   this->clearWill();
+#endif
 
   // free hostname
   if (this->hostname != nullptr) {
-    free((void *)this->hostname);
+    mqtt_free((void *)this->hostname, MQTT_ALLOC_SMALL);
   }
 
+#if LWMQTT_TRACE
+  // stop stamping trace records with the clock of this client
+  lwmqtt_trace_release_clock(this);
+#endif
+
+  // free microsecond timers
+  mqtt_free(this->utimers, MQTT_ALLOC_SMALL);
+
   // free buffers
-  free(this->readBuf);
-  free(this->writeBuf);
+  mqtt_free(this->readBuf, MQTT_ALLOC_LARGE);
+  mqtt_free(this->writeBuf, MQTT_ALLOC_LARGE);
+  mqtt_free(this->network.tx.buf, MQTT_ALLOC_LARGE);
+  mqtt_free(this->lzBuf, MQTT_ALLOC_LARGE);
+  mqtt_free(this->lzOut, MQTT_ALLOC_LARGE);
+
+  // free bridge prefix
+  mqtt_free(this->bridgePrefix, MQTT_ALLOC_SMALL);
+
+  // free lanes
+  mqtt_free(this->lanes, MQTT_ALLOC_SMALL);
 }
 
 void MQTTClient::begin(Client &_client) {
@@ -181,10 +649,16 @@ void MQTTClient::begin(Client &_client) {
   lwmqtt_init(&this->client, this->writeBuf, this->writeBufSize, this->readBuf, this->readBufSize);
 
   // set timers
-  lwmqtt_set_timers(&this->client, &this->timer1, &this->timer2, lwmqtt_arduino_timer_set, lwmqtt_arduino_timer_get);
+  this->setTimers();
 
   // set network
+#if LWMQTT_TRACE
+  lwmqtt_set_network(&this->client, &this->network, lwmqtt_arduino_network_read_traced,
+                     lwmqtt_arduino_network_write_traced);
+  lwmqtt_trace_set_clock(lwmqtt_arduino_trace_clock, this);
+#else
   lwmqtt_set_network(&this->client, &this->network, lwmqtt_arduino_network_read, lwmqtt_arduino_network_write);
+#endif
 
   // set callback
   lwmqtt_set_callback(&this->client, (void *)&this->callback, MQTTClientHandler);
@@ -216,27 +690,94 @@ void MQTTClient::onMessage(MQTTClientCallbackSimpleFunction cb) {
   this->destroyCallback();
   this->callback.client = this;
   this->callback.type = MQTT_CB_FUNC_SIMPLE;
-  new (&this->callback.funcSimple) MQTTClientCallbackSimpleFunction(cb);
+  new (&this->callback.funcSimple) MQTTClientCallbackSimpleFunction(std::move(cb));
 }
 
 void MQTTClient::onMessageAdvanced(MQTTClientCallbackAdvancedFunction cb) {
   this->destroyCallback();
   this->callback.client = this;
   this->callback.type = MQTT_CB_FUNC_ADVANCED;
-  new (&this->callback.funcAdvanced) MQTTClientCallbackAdvancedFunction(cb);
+  new (&this->callback.funcAdvanced) MQTTClientCallbackAdvancedFunction(std::move(cb));
 }
 
 void MQTTClient::onMessageRaw(MQTTClientCallbackRawFunction cb) {
   this->destroyCallback();
   this->callback.client = this;
   this->callback.type = MQTT_CB_FUNC_RAW;
-  new (&this->callback.funcRaw) MQTTClientCallbackRawFunction(cb);
+  new (&this->callback.funcRaw) MQTTClientCallbackRawFunction(std::move(cb));
 }
 #endif
 
 void MQTTClient::setClockSource(MQTTClientClockSource cb) {
   this->timer1.millis = cb;
   this->timer2.millis = cb;
+
+  // queued messages are stamped with the same clock
+  for (uint8_t i = 0; this->lanes != nullptr && i < MQTT_LANES; i++) {
+    if (this->lanes->lane[i].outbox != nullptr) {
+      this->lanes->lane[i].outbox->setClock(cb);
+    }
+  }
+}
+
+bool MQTTClient::useMicrosTimers(bool enabled, MQTTClientMicrosSource cb) {
+  if (!enabled) {
+    // hand the keep alive deadline over to the millisecond timers before the microsecond ones are freed
+    lwmqtt_arduino_utimer_t *old = this->utimers;
+    this->utimers = nullptr;
+    if (this->netClient != nullptr) {
+      this->setTimers();
+    }
+    mqtt_free(old, MQTT_ALLOC_SMALL);
+    return true;
+  }
+
+  // allocate keep alive and command timer on first use
+  if (this->utimers == nullptr) {
+    this->utimers = (lwmqtt_arduino_utimer_t *)mqtt_malloc(2 * sizeof(lwmqtt_arduino_utimer_t), MQTT_ALLOC_SMALL);
+    if (this->utimers == nullptr) {
+      return false;
+    }
+    memset(this->utimers, 0, 2 * sizeof(lwmqtt_arduino_utimer_t));
+  }
+  this->utimers[0].micros = cb;
+  this->utimers[1].micros = cb;
+  this->utimers[0].ext = &this->microsExt;
+  this->utimers[1].ext = &this->microsExt;
+
+  // swap the backend if the client has already been initialized
+  if (this->netClient != nullptr) {
+    this->setTimers();
+  }
+
+  return true;
+}
+
+uint64_t MQTTClient::micros64() {
+  // use the configured microsecond source if any
+  if (this->utimers != nullptr) {
+    return lwmqtt_arduino_utimer_now(&this->utimers[0]);
+  }
+  return lwmqtt_arduino_micros64(&this->microsExt);
+}
+
+void MQTTClient::setTimers() {
+  // remember the time left until the next ping, the backend that is replaced tracked it in its own clock
+  int32_t remaining = (int32_t)this->client.keep_alive_interval;
+  if (this->client.timer_get != nullptr && this->client.keep_alive_timer != nullptr) {
+    remaining = this->client.timer_get(this->client.keep_alive_timer);
+  }
+
+  if (this->utimers != nullptr) {
+    lwmqtt_set_timers(&this->client, &this->utimers[0], &this->utimers[1], lwmqtt_arduino_utimer_set,
+                      lwmqtt_arduino_utimer_get);
+  } else {
+    lwmqtt_set_timers(&this->client, &this->timer1, &this->timer2, lwmqtt_arduino_timer_set,
+                      lwmqtt_arduino_timer_get);
+  }
+
+  // keep the keep alive deadline of a running connection, an expired one stays expired so the ping is not delayed
+  this->client.timer_set(this->client.keep_alive_timer, (remaining > 0) ? (uint32_t)remaining : 0);
 }
 
 void MQTTClient::setHost(IPAddress _address, int _port) {
@@ -248,14 +789,15 @@ void MQTTClient::setHost(IPAddress _address, int _port) {
 void MQTTClient::setHost(const char _hostname[], int _port) {
   // free hostname if set
   if (this->hostname != nullptr) {
-    free((void *)this->hostname);
+    mqtt_free((void *)this->hostname, MQTT_ALLOC_SMALL);
   }
 
   // set hostname and port
-  this->hostname = strdup(_hostname);
+  this->hostname = mqtt_strdup(_hostname);
   this->port = _port;
 }
 
+#if LWMQTT_WILL
 void MQTTClient::setWill(const char topic[], const char payload[], bool retained, int qos) {
   // Quick validation
   if (topic == nullptr || *topic == '\0') {
@@ -266,12 +808,12 @@ void MQTTClient::setWill(const char topic[], const char payload[], bool retained
   this->clearWill();
 
   // Allocate and zero-initialize will structure
-  this->will = (lwmqtt_will_t *)malloc(sizeof(lwmqtt_will_t));
+  this->will = (lwmqtt_will_t *)mqtt_malloc(sizeof(lwmqtt_will_t), MQTT_ALLOC_SMALL);
   if (this->will == nullptr) return;
   memset(this->will, 0, sizeof(lwmqtt_will_t));
 
-  // Set topic (strdup handles strlen internally)
-  char *topic_copy = strdup(topic);
+  // Set topic (mqtt_strdup handles strlen internally)
+  char *topic_copy = mqtt_strdup(topic);
   if (topic_copy == nullptr) {
     this->clearWill();
     return;
@@ -280,7 +822,7 @@ void MQTTClient::setWill(const char topic[], const char payload[], bool retained
 
   // Set payload if provided
   if (payload != nullptr && *payload != '\0') {
-    char *payload_copy = strdup(payload);
+    char *payload_copy = mqtt_strdup(payload);
     if (payload_copy == nullptr) {
       this->clearWill();
       return;
@@ -301,18 +843,19 @@ void MQTTClient::clearWill() {
 
   // free payload if set
   if (this->will->payload.len > 0) {
-    free(this->will->payload.data);
+    mqtt_free(this->will->payload.data, MQTT_ALLOC_SMALL);
   }
 
   // free topic if set
   if (this->will->topic.len > 0) {
-    free(this->will->topic.data);
+    mqtt_free(this->will->topic.data, MQTT_ALLOC_SMALL);
   }
 
   // free will
-  free(this->will);
+  mqtt_free(this->will, MQTT_ALLOC_SMALL);
   this->will = nullptr;
 }
+#endif
 
 void MQTTClient::setKeepAlive(int _keepAlive) { this->keepAlive = _keepAlive; }
 
@@ -320,12 +863,109 @@ void MQTTClient::setCleanSession(bool _cleanSession) { this->cleanSession = _cle
 
 void MQTTClient::setTimeout(int _timeout) { this->timeout = _timeout; }
 
+void MQTTClient::setLivenessInterval(int interval) {
+  this->livenessInterval = (interval > 0) ? (uint32_t)interval : 0;
+}
+
+#if LWMQTT_DROP_OVERFLOW
 void MQTTClient::dropOverflow(bool enabled) {
   // configure drop overflow
   lwmqtt_drop_overflow(&this->client, enabled, &this->_droppedMessages);
 }
+#endif
+
+void MQTTClient::setWaitPolicy(MQTTWaitPolicy policy, uint16_t param) {
+  this->network.wait.policy = policy;
+  this->network.wait.param = param;
+}
+
+void MQTTClient::setWaitCallback(MQTTClientWaitCallback cb) {
+  // a null callback restores the default policy
+  this->network.wait.callback = cb;
+  this->network.wait.policy = (cb != nullptr) ? MQTT_WAIT_CUSTOM : MQTT_WAIT_YIELD;
+}
+
+bool MQTTClient::setNonBlocking(int bufSize) {
+  // drop the current ring, pending bytes are lost
+  mqtt_free(this->network.tx.buf, MQTT_ALLOC_LARGE);
+  this->network.tx = {nullptr, 0, 0, 0};
+
+  // zero restores the blocking mode
+  if (bufSize <= 0) {
+    return true;
+  }
+
+  this->network.tx.buf = (uint8_t *)mqtt_malloc((size_t)bufSize, MQTT_ALLOC_LARGE);
+  if (this->network.tx.buf == nullptr) {
+    return false;
+  }
+  this->network.tx.size = (size_t)bufSize;
+
+  return true;
+}
+
+bool MQTTClient::setCompression(MQTTLz *_lz, size_t threshold, size_t bufSize, size_t outSize) {
+  // drop the current buffers
+  mqtt_free(this->lzBuf, MQTT_ALLOC_LARGE);
+  this->lzBuf = nullptr;
+  this->lzBufSize = 0;
+  mqtt_free(this->lzOut, MQTT_ALLOC_LARGE);
+  this->lzOut = nullptr;
+  this->lzOutSize = 0;
+
+  this->lz = _lz;
+  this->lzThreshold = threshold;
+
+  if (_lz == nullptr) {
+    return true;
+  }
+
+  // allocate compression buffer, without it payloads are compressed behind the header in the write buffer
+  if (outSize > 0) {
+    this->lzOut = (uint8_t *)mqtt_malloc(outSize, MQTT_ALLOC_LARGE);
+    if (this->lzOut == nullptr) {
+      return false;
+    }
+    this->lzOutSize = outSize;
+  }
+
+  // zero keeps received payloads untouched
+  if (bufSize == 0) {
+    return true;
+  }
+
+  // allocate buffer (+1 to allow null termination)
+  this->lzBuf = (uint8_t *)mqtt_malloc(bufSize + 1, MQTT_ALLOC_LARGE);
+  if (this->lzBuf == nullptr) {
+    return false;
+  }
+  this->lzBufSize = bufSize;
+
+  return true;
+}
+
+bool MQTTClient::inflatePayload(lwmqtt_message_t &message) {
+  // check if enabled and compressed
+  if (this->lzBuf == nullptr || !MQTTLz::compressed(message.payload, message.payload_len)) {
+    return false;
+  }
+
+  // deliver the payload as received if it cannot be decompressed
+  size_t len = this->lz->decompress(message.payload, message.payload_len, this->lzBuf, this->lzBufSize);
+  if (len == 0) {
+    return false;
+  }
+  this->lzBuf[len] = '\0';
+
+  message.payload = this->lzBuf;
+  message.payload_len = len;
+
+  return true;
+}
 
 bool MQTTClient::connect(const char clientID[], const char username[], const char password[], bool skip) {
+  MQTT_ALLOC_PHASE(this->_wasConnected ? MQTT_PHASE_RECONNECT : MQTT_PHASE_CONNECT);
+
   // close left open connection if still connected
   if (!skip && this->connected()) {
     this->close();
@@ -333,6 +973,7 @@ bool MQTTClient::connect(const char clientID[], const char username[], const cha
 
   // save client
   this->network.client = this->netClient;
+  this->network.writeProbe = false;
 
   // connect to host
   if (!skip) {
@@ -379,15 +1020,48 @@ bool MQTTClient::connect(const char clientID[], const char username[], const cha
   // copy session present flag
   this->_sessionPresent = options.session_present;
 
-  // set flag
+  // set flags and start a fresh liveness period
   this->_connected = true;
+  this->_wasConnected = true;
+  this->lastLiveness = lwmqtt_arduino_timer_now(&this->timer1);
 
   return true;
 }
 
+uint8_t *MQTTClient::payloadBuffer(const char topic[], int qos, size_t &capacity) {
+  // leave room for the largest possible header in front of the payload
+  size_t offset = 5 + 2 + strlen(topic) + (qos > 0 ? 2 : 0);
+  if (this->writeBuf == nullptr || offset >= this->writeBufSize) {
+    capacity = 0;
+    return nullptr;
+  }
+
+  capacity = this->writeBufSize - offset;
+
+  return this->writeBuf + offset;
+}
+
 bool MQTTClient::publish(const char topic[], const char payload[], int length, bool retained, int qos) {
-  // return immediately if not connected
-  if (!this->connected()) {
+  MQTT_ALLOC_PHASE(MQTT_PHASE_PUBLISH);
+
+  // reject levels that have been compiled out without dropping the connection
+  if (qos > LWMQTT_MAX_QOS) {
+    this->_lastError = LWMQTT_UNSUPPORTED_QOS;
+    return false;
+  }
+
+  // short-circuit messages to own subscriptions, messages published from a local delivery only go upstream
+  bool local = this->loopbackFilters != nullptr && topic != nullptr && !this->loopbackActive &&
+               this->loopbackMatches(topic);
+  if (local && !this->loopbackUpstream) {
+    this->deliverLocal(topic, payload, length, retained, qos);
+    return true;
+  }
+  const char *plain = payload;
+  int plainLength = length;
+
+  // return immediately if not connected
+  if (!this->connected()) {
     return false;
   }
 
@@ -398,8 +1072,34 @@ bool MQTTClient::publish(const char topic[], const char payload[], int length, b
   message.retained = retained;
   message.qos = lwmqtt_qos_t(qos);
 
-  // prepare options
+  // compress large payloads into the compression buffer or the write buffer and keep them only if smaller
+  bool inPlace = message.payload >= this->writeBuf && message.payload < this->writeBuf + this->writeBufSize;
+  if (this->lz != nullptr && length > 0 && (size_t)length >= this->lzThreshold && topic != nullptr && !inPlace) {
+    size_t cap = this->lzOutSize;
+    uint8_t *buf = (this->lzOut != nullptr) ? this->lzOut : this->payloadBuffer(topic, qos, cap);
+    if (buf != nullptr) {
+      size_t len = this->lz->compress(message.payload, message.payload_len, buf, cap);
+      if (len > 0 && len < message.payload_len) {
+        message.payload = buf;
+        message.payload_len = len;
+        length = (int)len;
+      }
+    }
+  }
+
+  // in non-blocking mode refuse the message up front instead of stalling or tearing a packet
+  if (this->network.tx.buf != nullptr) {
+    size_t topic_len = (topic != nullptr) ? strlen(topic) : 0;
+    size_t needed = 5 + 2 + topic_len + (qos > 0 ? 2 : 0) + (size_t)length;
+    if (!this->reserveWrite(needed)) {
+      this->_lastError = LWMQTT_NETWORK_WOULD_BLOCK;
+      return false;
+    }
+  }
+
+  // prepare options, the budgeted lane drain leaves the ack to a later loop()
   lwmqtt_publish_options_t options = lwmqtt_default_publish_options;
+  options.skip_ack = this->skipAck;
 
   // set duplicate packet id if available
   if (this->nextDupPacketID > 0) {
@@ -416,9 +1116,151 @@ bool MQTTClient::publish(const char topic[], const char payload[], int length, b
     return false;
   }
 
+  // deliver locally only once the message has been sent, so retries do not repeat the callback
+  if (local) {
+    this->deliverLocal(topic, plain, plainLength, retained, qos);
+  }
+
+  return true;
+}
+
+bool MQTTClient::bridge(MQTTClient *target, const char prefix[], int qos) {
+  // drop the current prefix
+  mqtt_free(this->bridgePrefix, MQTT_ALLOC_SMALL);
+  this->bridgePrefix = nullptr;
+
+  // a null target stops forwarding
+  this->bridgeTarget = nullptr;
+  this->bridgeQos = (uint8_t)((qos < 0) ? 0 : (qos > 2) ? 2 : qos);
+  if (target == nullptr) {
+    return true;
+  }
+
+  // refuse a bridge back to this client (directly or through other bridges), it would forward messages in a circle
+  for (MQTTClient *c = target; c != nullptr; c = c->bridgeTarget) {
+    if (c == this) {
+      return false;
+    }
+  }
+  this->bridgeTarget = target;
+
+  // the handler finds the client through the callback
+  this->callback.client = this;
+
+  // keep a copy of the prefix
+  if (prefix != nullptr && *prefix != '\0') {
+    this->bridgePrefix = mqtt_strdup(prefix);
+    if (this->bridgePrefix == nullptr) {
+      this->bridgeTarget = nullptr;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool MQTTClient::forwardPacket(lwmqtt_string_t topic, const lwmqtt_message_t &message) {
+  MQTTClient *target = this->bridgeTarget;
+
+  // messages are dropped while the other side is down
+  if (!target->connected()) {
+    this->_bridgeDropped++;
+    return false;
+  }
+
+  // in non-blocking mode refuse the message up front instead of stalling or tearing a packet
+  lwmqtt_string_t prefix = (this->bridgePrefix != nullptr) ? lwmqtt_string(this->bridgePrefix) : lwmqtt_string_t();
+  if (target->network.tx.buf != nullptr) {
+    size_t needed = 5 + 2 + prefix.len + topic.len + 2 + message.payload_len;
+    if (!target->reserveWrite(needed)) {
+      target->_lastError = LWMQTT_NETWORK_WOULD_BLOCK;
+      this->_bridgeDropped++;
+      return false;
+    }
+  }
+
+  // send the packet from the read buffer without waiting, acks of both sides are handled by their own loop()
+  target->_lastError = lwmqtt_forward(&target->client, this->readBuf, this->readBufSize, prefix,
+                                      (lwmqtt_qos_t)this->bridgeQos, target->timeout);
+  if (target->_lastError == LWMQTT_NETWORK_WOULD_BLOCK) {
+    // all forward ids of the target are in flight, nothing has been written
+    this->_bridgeDropped++;
+    return false;
+  } else if (target->_lastError != LWMQTT_SUCCESS) {
+    // close connection
+    target->close();
+    this->_bridgeDropped++;
+
+    return false;
+  }
+
   return true;
 }
 
+bool MQTTClient::setLane(uint8_t lane, MQTTOutbox *outbox, uint8_t weight) {
+  if (lane >= MQTT_LANES) {
+    return false;
+  }
+
+  // allocate lanes on first use
+  if (this->lanes == nullptr) {
+    this->lanes = (lwmqtt_arduino_lanes_t *)mqtt_malloc(sizeof(lwmqtt_arduino_lanes_t), MQTT_ALLOC_SMALL);
+    if (this->lanes == nullptr) {
+      return false;
+    }
+    memset(this->lanes, 0, sizeof(lwmqtt_arduino_lanes_t));
+  }
+
+  // higher lanes get twice the share of the next lower one by default
+  lwmqtt_arduino_lane_t &l = this->lanes->lane[lane];
+  l.outbox = outbox;
+  l.weight = (weight > 0) ? weight : (uint8_t)(1 << (MQTT_LANES - 1 - lane));
+  l.credit = l.weight;
+
+  // stamp queued messages with the clock of the client
+  if (outbox != nullptr) {
+    outbox->setClock(this->timer1.millis);
+  }
+
+  // one round of all lanes is the budget of a plain loop()
+  this->lanes->round = 0;
+  for (uint8_t i = 0; i < MQTT_LANES; i++) {
+    if (this->lanes->lane[i].outbox != nullptr) {
+      this->lanes->round += this->lanes->lane[i].weight;
+    }
+  }
+
+  return true;
+}
+
+bool MQTTClient::enqueue(uint8_t lane, const char topic[], const char payload[], int length, bool retained, int qos,
+                         bool conflate) {
+  // check if the lane is set up
+  if (this->lanes == nullptr || lane >= MQTT_LANES || this->lanes->lane[lane].outbox == nullptr || length < 0) {
+    return false;
+  }
+
+  return this->lanes->lane[lane].outbox->push(topic, payload, (size_t)length, retained, qos, conflate);
+}
+
+MQTTLaneStats MQTTClient::laneStats(uint8_t lane) {
+  if (this->lanes == nullptr || lane >= MQTT_LANES) {
+    return MQTTLaneStats();
+  }
+
+  return this->lanes->lane[lane].stats;
+}
+
+void MQTTClient::resetLaneStats() {
+  if (this->lanes == nullptr) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < MQTT_LANES; i++) {
+    this->lanes->lane[i].stats = MQTTLaneStats();
+  }
+}
+
 uint16_t MQTTClient::lastPacketID() {
   // get last packet id from client
   return this->client.last_packet_id;
@@ -435,6 +1277,12 @@ bool MQTTClient::subscribe(const char topic[], int qos) {
     return false;
   }
 
+  // reject levels that have been compiled out without dropping the connection
+  if (qos > LWMQTT_MAX_QOS) {
+    this->_lastError = LWMQTT_UNSUPPORTED_QOS;
+    return false;
+  }
+
   // subscribe to topic
   this->_lastError = lwmqtt_subscribe_one(&this->client, lwmqtt_string(topic), (lwmqtt_qos_t)qos, this->timeout);
   if (this->_lastError != LWMQTT_SUCCESS) {
@@ -444,9 +1292,325 @@ bool MQTTClient::subscribe(const char topic[], int qos) {
     return false;
   }
 
+  // track callback time for this filter if enabled
+  if (this->topicStats != nullptr) {
+    this->trackTopicStat(topic);
+  }
+
+  // remember filter for local delivery if enabled
+  if (this->loopbackFilters != nullptr) {
+    this->trackLoopback(topic);
+  }
+
+  return true;
+}
+
+void MQTTClient::enableTopicStats(MQTTTopicStat *slots, size_t count) {
+  // clear user provided slots, a null array disables the stats
+  this->topicStats = (count > 0) ? slots : nullptr;
+  this->topicStatsCount = (slots != nullptr) ? count : 0;
+  for (size_t i = 0; i < this->topicStatsCount; i++) {
+    this->topicStats[i] = MQTTTopicStat();
+  }
+}
+
+bool MQTTClient::trackTopicStat(const char filter[]) {
+  // check if enabled and filter fits into a slot
+  size_t len = (filter != nullptr) ? strlen(filter) : 0;
+  if (this->topicStats == nullptr || len == 0 || len >= sizeof(MQTTTopicStat::filter)) {
+    return false;
+  }
+
+  // find existing or free slot
+  for (size_t i = 0; i < this->topicStatsCount; i++) {
+    MQTTTopicStat &stat = this->topicStats[i];
+    if (stat.filter[0] == '\0') {
+      memcpy(stat.filter, filter, len + 1);
+      return true;
+    } else if (strcmp(stat.filter, filter) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void MQTTClient::recordTopicStat(const char *topic, size_t len, uint32_t micros) {
+  // the first matching filter in subscription order gets the time
+  for (size_t i = 0; i < this->topicStatsCount; i++) {
+    MQTTTopicStat &stat = this->topicStats[i];
+    if (stat.filter[0] == '\0') {
+      return;
+    }
+    if (MQTTClient::topicMatches(stat.filter, topic, len)) {
+      stat.calls++;
+      stat.totalMicros += micros;
+      if (micros > stat.maxMicros) {
+        stat.maxMicros = micros;
+      }
+      return;
+    }
+  }
+}
+
+void MQTTClient::forEachTopicStat(MQTTTopicStatIterator fn, void *ref) {
+  for (size_t i = 0; i < this->topicStatsCount && this->topicStats[i].filter[0] != '\0'; i++) {
+    fn(this->topicStats[i], ref);
+  }
+}
+
+bool MQTTClient::topicMatches(const char filter[], const char *topic, size_t len) {
+  // wildcards on the first level never match topics starting with '$'
+  if (len > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+    return false;
+  }
+
+  size_t i = 0;
+  while (*filter != '\0') {
+    if (*filter == '#') {
+      // multi-level wildcard matches the remainder
+      return true;
+    } else if (*filter == '+') {
+      // single-level wildcard consumes up to the next separator
+      while (i < len && topic[i] != '/') i++;
+      filter++;
+    } else if (i < len && topic[i] == *filter) {
+      i++;
+      filter++;
+    } else {
+      // "a/#" also matches the parent level "a"
+      return i == len && strcmp(filter, "/#") == 0;
+    }
+  }
+
+  return i == len;
+}
+
+void MQTTClient::enableLoopback(MQTTLoopbackFilter *slots, size_t count, bool upstream) {
+  // clear user provided slots, a null array disables local delivery
+  this->loopbackFilters = (count > 0) ? slots : nullptr;
+  this->loopbackCount = (slots != nullptr) ? count : 0;
+  this->loopbackUpstream = upstream;
+  for (size_t i = 0; i < this->loopbackCount; i++) {
+    this->loopbackFilters[i] = MQTTLoopbackFilter();
+  }
+
+  // the dispatcher finds the client through the callback
+  this->callback.client = this;
+}
+
+bool MQTTClient::trackLoopback(const char filter[]) {
+  // check if enabled and filter fits into a slot
+  size_t len = (filter != nullptr) ? strlen(filter) : 0;
+  if (this->loopbackFilters == nullptr || len == 0 || len >= sizeof(MQTTLoopbackFilter::filter)) {
+    return false;
+  }
+
+  // find existing or free slot
+  for (size_t i = 0; i < this->loopbackCount; i++) {
+    MQTTLoopbackFilter &slot = this->loopbackFilters[i];
+    if (slot.filter[0] == '\0') {
+      memcpy(slot.filter, filter, len + 1);
+      return true;
+    } else if (strcmp(slot.filter, filter) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void MQTTClient::untrackLoopback(const char filter[]) {
+  // remove the slot and close the gap to keep used slots in front
+  for (size_t i = 0; i < this->loopbackCount && this->loopbackFilters[i].filter[0] != '\0'; i++) {
+    if (strcmp(this->loopbackFilters[i].filter, filter) == 0) {
+      size_t last = i;
+      while (last + 1 < this->loopbackCount && this->loopbackFilters[last + 1].filter[0] != '\0') {
+        last++;
+      }
+      this->loopbackFilters[i] = this->loopbackFilters[last];
+      this->loopbackFilters[last] = MQTTLoopbackFilter();
+      return;
+    }
+  }
+}
+
+bool MQTTClient::loopbackMatches(const char topic[]) {
+  // the first match is enough, a message is delivered once even if several filters match
+  size_t len = strlen(topic);
+  for (size_t i = 0; i < this->loopbackCount && this->loopbackFilters[i].filter[0] != '\0'; i++) {
+    if (MQTTClient::topicMatches(this->loopbackFilters[i].filter, topic, len)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MQTTClient::deliverLocal(const char topic[], const char payload[], int length, bool retained, int qos) {
+  // nothing to do without a callback
+  if (this->callback.type == MQTT_CB_NONE) {
+    return;
+  }
+
+  // prepare message as it would have been received
+  size_t len = strlen(topic);
+  lwmqtt_string_t str = {(uint16_t)len, (char *)topic};
+  lwmqtt_message_t message = lwmqtt_default_message;
+  message.payload = (uint8_t *)payload;
+  message.payload_len = (size_t)length;
+
+  // advanced callbacks expect a terminated payload, copy it into the read buffer like a received one unless it is
+  // already there, payloads that would not have fit the read buffer are dropped
+  bool advanced = this->callback.type == MQTT_CB_ADVANCED;
+#if MQTT_HAS_FUNCTIONAL
+  advanced = advanced || this->callback.type == MQTT_CB_FUNC_ADVANCED;
+#endif
+  bool inReadBuf = message.payload >= this->readBuf && message.payload < this->readBuf + this->readBufSize + 1;
+  if (advanced && !inReadBuf && this->readBuf != nullptr) {
+    if ((size_t)length > this->readBufSize) {
+      this->_droppedMessages++;
+      return;
+    }
+    if (length > 0) {
+      memcpy(this->readBuf, payload, (size_t)length);
+    }
+    message.payload = this->readBuf;
+  }
+  message.retained = retained;
+  message.qos = lwmqtt_qos_t(qos);
+
+  // dispatch with the same attribution as received messages, publishes from the callback are not looped back again
+  MQTT_ALLOC_PHASE(MQTT_PHASE_RECEIVE);
+  this->loopbackActive = true;
+  if (this->topicStats == nullptr) {
+    MQTTClientDispatch(&this->callback, str, message);
+  } else {
+    uint64_t start = this->micros64();
+    MQTTClientDispatch(&this->callback, str, message);
+    this->recordTopicStat(topic, len, (uint32_t)(this->micros64() - start));
+  }
+  this->loopbackActive = false;
+}
+
+static bool mqtt_retained_match(const MQTTRetainedEntry &e, const char *topic, size_t len, uint32_t hash) {
+  // compare the stored topic, or its prefix, length and hash for longer topics
+  size_t prefix = (len < sizeof(e.topic)) ? len : sizeof(e.topic) - 1;
+  return e.stamp != 0 && e.topicLen == len && e.topicHash == hash && memcmp(e.topic, topic, prefix) == 0;
+}
+
+void MQTTClient::enableRetainedCache(MQTTRetainedEntry *slots, size_t count, uint8_t *area, size_t slotSize) {
+  // clear user provided slots, a null array disables the cache
+  this->retainedEntries = (count > 0) ? slots : nullptr;
+  this->retainedCount = (slots != nullptr) ? count : 0;
+  this->retainedArea = (slotSize > 0) ? area : nullptr;
+  this->retainedSlotSize = (area != nullptr) ? slotSize : 0;
+  this->retainedStamp = 0;
+  for (size_t i = 0; i < this->retainedCount; i++) {
+    this->retainedEntries[i] = MQTTRetainedEntry();
+  }
+
+  // the handler finds the client through the callback
+  this->callback.client = this;
+}
+
+bool MQTTClient::cacheRetained(lwmqtt_string_t topic, const lwmqtt_message_t &message) {
+  uint32_t topicHash = lwmqtt_fnv1a(topic.data, topic.len);
+  uint32_t payloadHash = lwmqtt_fnv1a(message.payload, message.payload_len);
+
+  // find the entry of the topic, or else a free or the least recently updated slot
+  MQTTRetainedEntry *entry = nullptr;
+  MQTTRetainedEntry *victim = &this->retainedEntries[0];
+  for (size_t i = 0; i < this->retainedCount; i++) {
+    MQTTRetainedEntry &e = this->retainedEntries[i];
+    if (mqtt_retained_match(e, topic.data, topic.len, topicHash)) {
+      entry = &e;
+      break;
+    } else if (e.stamp < victim->stamp) {
+      victim = &e;
+    }
+  }
+
+  // live messages (which the broker sends with the retain flag cleared) only update topics that are cached
+  if (entry == nullptr && !message.retained) {
+    return true;
+  }
+
+  // an identical replay is suppressed, payloads with a copy in the area are compared in full, others by length and
+  // hash only, so a collision is accepted to suppress a changed payload
+  uint8_t *copy = nullptr;
+  if (entry != nullptr && entry->length <= this->retainedSlotSize) {
+    copy = this->retainedArea + (entry - this->retainedEntries) * this->retainedSlotSize;
+  }
+  if (message.retained && entry != nullptr && entry->payloadHash == payloadHash &&
+      entry->length == message.payload_len &&
+      (copy == nullptr || memcmp(copy, message.payload, message.payload_len) == 0)) {
+    this->_retainedSuppressed++;
+    return false;
+  }
+
+  // an empty payload clears the retained message
+  if (message.payload_len == 0) {
+    if (entry != nullptr) {
+      *entry = MQTTRetainedEntry();
+    }
+    return true;
+  }
+
+  // store the topic, the hash and length and, if it fits, a copy of the payload
+  if (entry == nullptr) {
+    entry = victim;
+  }
+  size_t prefix = (topic.len < sizeof(entry->topic)) ? topic.len : sizeof(entry->topic) - 1;
+  memcpy(entry->topic, topic.data, prefix);
+  entry->topic[prefix] = '\0';
+  entry->topicLen = (uint16_t)topic.len;
+  entry->topicHash = topicHash;
+  entry->payloadHash = payloadHash;
+  entry->length = (uint32_t)message.payload_len;
+  entry->stamp = ++this->retainedStamp;
+  if (message.payload_len <= this->retainedSlotSize) {
+    memcpy(this->retainedArea + (entry - this->retainedEntries) * this->retainedSlotSize, message.payload,
+           message.payload_len);
+  }
+
+  // restart the stamps before they wrap
+  if (this->retainedStamp == 0xFFFFFFFFUL) {
+    for (size_t i = 0; i < this->retainedCount; i++) {
+      if (this->retainedEntries[i].stamp != 0) {
+        this->retainedEntries[i].stamp = 1;
+      }
+    }
+    this->retainedStamp = 1;
+  }
+
   return true;
 }
 
+bool MQTTClient::getRetained(const char topic[], const char *&payload, size_t &length) {
+  payload = nullptr;
+  length = 0;
+  if (this->retainedEntries == nullptr || topic == nullptr) {
+    return false;
+  }
+
+  // look up the topic, the payload is only available if it fits a slot of the area
+  size_t len = strlen(topic);
+  uint32_t topicHash = lwmqtt_fnv1a(topic, len);
+  for (size_t i = 0; i < this->retainedCount; i++) {
+    MQTTRetainedEntry &e = this->retainedEntries[i];
+    if (mqtt_retained_match(e, topic, len, topicHash)) {
+      length = e.length;
+      if (e.length <= this->retainedSlotSize) {
+        payload = (const char *)this->retainedArea + i * this->retainedSlotSize;
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#if LWMQTT_UNSUBSCRIBE
 bool MQTTClient::unsubscribe(const char topic[]) {
   // return immediately if not connected
   if (!this->connected()) {
@@ -462,20 +1626,46 @@ bool MQTTClient::unsubscribe(const char topic[]) {
     return false;
   }
 
+  // stop local delivery for this filter
+  if (this->loopbackFilters != nullptr) {
+    this->untrackLoopback(topic);
+  }
+
   return true;
 }
+#endif
 
 bool MQTTClient::loop() {
+  // read the clock once for the liveness cache and the keep alive check
+  uint32_t now = lwmqtt_arduino_timer_now(&this->timer1);
+
   // return immediately if not connected
-  if (!this->connected()) {
+  if (!this->alive(now)) {
     return false;
   }
 
+  // flush writes left over from non-blocking publishes
+  if (this->network.tx.len > 0) {
+    lwmqtt_arduino_network_flush(&this->network);
+  }
+
   // get available bytes on the network
   int available = this->netClient->available();
 
-  // yield if data is available
-  if (available > 0) {
+  // yield if data is available, acks are sent right away
+  if (available > 0 && this->network.tx.buf != nullptr) {
+    // in non-blocking mode read one packet at a time while the ring can take its ack, the rest waits in the client
+    while (available > 0 && this->controlRoom(MQTT_TX_ACK_SIZE)) {
+      this->_lastError = lwmqtt_yield(&this->client, 0, this->timeout);
+      if (this->_lastError != LWMQTT_SUCCESS) {
+        // close connection
+        this->close();
+
+        return false;
+      }
+      available = this->netClient->available();
+    }
+  } else if (available > 0) {
     this->_lastError = lwmqtt_yield(&this->client, available, this->timeout);
     if (this->_lastError != LWMQTT_SUCCESS) {
       // close connection
@@ -483,6 +1673,154 @@ bool MQTTClient::loop() {
 
       return false;
     }
+  } else if (!this->pingDue(now)) {
+    // idle fast path: nothing to read and no ping due, skip the keep alive bookkeeping
+    return this->lanes == nullptr || this->drainLanes(this->lanes->round, 0);
+  }
+
+  // pings go out before queued messages
+  if (!this->processKeepAlive()) {
+    return false;
+  }
+
+  // send at most one round of queued messages, each QoS 1 and 2 message waits for its ack
+  return this->lanes == nullptr || this->drainLanes(this->lanes->round, 0);
+}
+
+bool MQTTClient::loop(uint16_t maxPackets, uint32_t maxMicros) {
+  // read the clock once for the liveness cache and the keep alive check
+  uint32_t now = lwmqtt_arduino_timer_now(&this->timer1);
+
+  // return immediately if not connected
+  if (!this->alive(now)) {
+    return false;
+  }
+
+  // flush writes left over from non-blocking publishes
+  if (this->network.tx.len > 0) {
+    lwmqtt_arduino_network_flush(&this->network);
+  }
+
+  // process one packet at a time while bytes remain
+  uint64_t start = this->micros64();
+  uint16_t packets = 0;
+  while (this->netClient->available() > 0 && (this->network.tx.buf == nullptr || this->controlRoom(MQTT_TX_ACK_SIZE))) {
+    // without availability info the yield returns after exactly one packet
+    this->_lastError = lwmqtt_yield(&this->client, 0, this->timeout);
+    if (this->_lastError != LWMQTT_SUCCESS) {
+      // close connection
+      this->close();
+
+      return false;
+    }
+    packets++;
+
+    // stop at this packet boundary once a budget is spent, the next call resumes
+    if ((maxPackets > 0 && packets >= maxPackets) || (maxMicros > 0 && this->micros64() - start >= maxMicros)) {
+      break;
+    }
+  }
+
+  // pings go out before queued messages, the idle fast path skips the check as in loop()
+  if ((packets > 0 || this->pingDue(now)) && !this->processKeepAlive()) {
+    return false;
+  }
+
+  // send queued messages within the packet budget and what is left of the time budget
+  if (this->lanes == nullptr) {
+    return true;
+  }
+  uint32_t elapsed = (maxMicros > 0) ? (uint32_t)(this->micros64() - start) : 0;
+  if (maxMicros > 0 && elapsed >= maxMicros) {
+    return true;
+  }
+  return this->drainLanes(maxPackets, (maxMicros > 0) ? maxMicros - elapsed : 0);
+}
+
+static bool mqtt_permanent(lwmqtt_err_t err) {
+  // errors that depend on the message and not on the network
+  return err == LWMQTT_BUFFER_TOO_SHORT || err == LWMQTT_VARNUM_OVERFLOW || err == LWMQTT_REMAINING_LENGTH_OVERFLOW ||
+         err == LWMQTT_UNSUPPORTED_QOS;
+}
+
+bool MQTTClient::drainLanes(uint16_t maxMessages, uint32_t maxMicros) {
+  // weighted round robin: each lane sends up to its weight in turn, so low lanes are never starved. Acks and pings
+  // only go first between calls. Without a time budget every message is sent with publish() and blocks on its own
+  // acknowledgement, with a budget QoS 1 and 2 acks are left to a later loop() so no message waits for the network
+  lwmqtt_arduino_lanes_t *l = this->lanes;
+  MQTTOutboxMessage msg;
+  uint64_t start = (maxMicros > 0) ? this->micros64() : 0;
+  uint16_t sent = 0;
+  uint8_t empty = 0;
+  while (empty < MQTT_LANES && (maxMessages == 0 || sent < maxMessages)) {
+    lwmqtt_arduino_lane_t &lane = l->lane[l->cursor];
+
+    // refill the credit and move on to the next lane, the cursor is kept across calls
+    bool spent = lane.outbox != nullptr && lane.credit == 0;
+    if (spent || lane.outbox == nullptr || !lane.outbox->front(msg)) {
+      lane.credit = lane.weight;
+      l->cursor = (uint8_t)((l->cursor + 1) % MQTT_LANES);
+      empty = spent ? 0 : empty + 1;
+      continue;
+    }
+
+    this->_lastError = LWMQTT_SUCCESS;
+    this->skipAck = maxMicros > 0;
+    bool ok = this->publish(msg.topic, msg.payload, (int)msg.length, msg.retained, msg.qos);
+    this->skipAck = false;
+    if (ok) {
+      // record the time spent in the queue, measured with the clock that stamped it
+      uint32_t waited = lwmqtt_arduino_timer_now(&this->timer1) - msg.queued;
+      lane.stats.sent++;
+      lane.stats.totalMillis += waited;
+      if (waited > lane.stats.maxMillis) {
+        lane.stats.maxMillis = waited;
+      }
+    } else if (this->_lastError == LWMQTT_SUCCESS || this->_lastError == LWMQTT_NETWORK_WOULD_BLOCK) {
+      // a full send ring or ack table keeps the message for a later call, as does a connection that was already down
+      return this->connected();
+    } else if (!mqtt_permanent(this->_lastError)) {
+      // the message is kept for the next connection if it failed with the network
+      return false;
+    } else {
+      // messages that can never be sent (e.g. unsupported QoS or too large for the write buffer) are dropped so
+      // they do not fail every reconnect
+      lane.stats.dropped++;
+    }
+    lane.outbox->pop();
+    lane.credit--;
+    sent++;
+    empty = 0;
+
+    // a lost connection ends the round
+    if (!ok && !this->connected()) {
+      return false;
+    }
+
+    // stop once the time budget is spent, the cursor resumes the round
+    if (maxMicros > 0 && this->micros64() - start >= maxMicros) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool MQTTClient::pingDue(uint32_t now) {
+  // the keep alive timer is re-armed with every packet sent
+  if (this->client.keep_alive_interval == 0) {
+    return false;
+  }
+  if (this->utimers != nullptr) {
+    return lwmqtt_arduino_utimer_get(&this->utimers[0]) <= 0;
+  }
+  return now - this->timer1.start >= this->timer1.timeout;
+}
+
+bool MQTTClient::processKeepAlive() {
+  // a ping that does not fit the ring is sent by a later loop() instead of waiting for it
+  if (this->network.tx.buf != nullptr && !this->controlRoom(2)) {
+    return true;
   }
 
   // keep the connection alive
@@ -498,8 +1836,28 @@ bool MQTTClient::loop() {
 }
 
 bool MQTTClient::connected() {
-  // Check internal flag first (cheapest), then validate network state
-  return this->_connected && this->netClient != nullptr && this->netClient->connected() == 1;
+  // Skip the clock read when the liveness cache is disabled
+  return this->alive(this->livenessInterval > 0 ? lwmqtt_arduino_timer_now(&this->timer1) : 0);
+}
+
+bool MQTTClient::alive(uint32_t now) {
+  // Check internal flag first (cheapest)
+  if (!this->_connected || this->netClient == nullptr) {
+    return false;
+  }
+
+  // Trust the last network probe while it is younger than the liveness interval
+  if (this->livenessInterval > 0 && now - this->lastLiveness < this->livenessInterval) {
+    return true;
+  }
+
+  // Validate network state
+  if (this->netClient->connected() != 1) {
+    return false;
+  }
+  this->lastLiveness = now;
+
+  return true;
 }
 
 bool MQTTClient::disconnect() {
@@ -511,16 +1869,62 @@ bool MQTTClient::disconnect() {
   // cleanly disconnect
   this->_lastError = lwmqtt_disconnect(&this->client, this->timeout);
 
+  // give queued writes (including the disconnect packet) a chance to leave
+  uint32_t start = millis();
+  while (this->network.tx.len > 0 && millis() - start < this->timeout) {
+    lwmqtt_arduino_network_flush(&this->network);
+    yield();
+  }
+
   // close
   this->close();
 
   return this->_lastError == LWMQTT_SUCCESS;
 }
 
+bool MQTTClient::reserveWrite(size_t len) {
+  // make room by pushing out what the client can take now
+  lwmqtt_arduino_network_flush(&this->network);
+
+  // keep headroom for acks and pings sent from loop()
+  size_t room = this->network.tx.size - this->network.tx.len;
+  if (room > MQTT_TX_CONTROL_RESERVE) {
+    room -= MQTT_TX_CONTROL_RESERVE;
+  } else {
+    room = 0;
+  }
+
+  // an empty ring lets the client take bytes directly
+  if (this->network.tx.len == 0) {
+    size_t direct = lwmqtt_arduino_network_room(&this->network);
+    if (direct >= len) {
+      return true;
+    }
+    room += direct;
+  }
+
+  return room >= len;
+}
+
+bool MQTTClient::controlRoom(size_t len) {
+  // make room by pushing out what the client can take now
+  lwmqtt_arduino_network_flush(&this->network);
+
+  // control packets may use the reserve, an empty ring lets the client take bytes directly
+  if (this->network.tx.size - this->network.tx.len >= len) {
+    return true;
+  }
+  return this->network.tx.len == 0 && lwmqtt_arduino_network_room(&this->network) >= len;
+}
+
 void MQTTClient::close() {
   // set flag
   this->_connected = false;
 
+  // drop queued writes of the dead connection
+  this->network.tx.head = 0;
+  this->network.tx.len = 0;
+
   // close network
   this->netClient->stop();
 }
@@ -1,6 +1,9 @@
 #ifndef MQTT_CLIENT_H
 #define MQTT_CLIENT_H
 
+// Compile-time feature switches shared with lwmqtt (may define MQTT_NO_FUNCTIONAL)
+#include "lwmqtt/config.h"
+
 // Allow users to disable std::function support to save ~64 bytes RAM per client
 // Define MQTT_NO_FUNCTIONAL before including this header to disable
 #ifndef MQTT_NO_FUNCTIONAL
@@ -43,6 +46,7 @@ extern "C" {
 #endif
 
 typedef uint32_t (*MQTTClientClockSource)();
+typedef uint64_t (*MQTTClientMicrosSource)();
 
 typedef struct {
   uint32_t start;
@@ -50,8 +54,67 @@ typedef struct {
   MQTTClientClockSource millis;
 } lwmqtt_arduino_timer_t;
 
+// Extension of the 32-bit micros() counter to 64 bits, kept per client. A wrap is only seen if the client reads the
+// clock at least once per wrap period (~71 minutes), which loop() and the keep alive ensure while connected.
+typedef struct {
+  uint32_t last;
+  uint32_t high;
+} lwmqtt_arduino_micros_t;
+
+// Microsecond timer with a 64-bit start that never rolls over in practice
+typedef struct {
+  uint64_t start;
+  uint32_t timeout;
+  MQTTClientMicrosSource micros;
+  lwmqtt_arduino_micros_t *ext;
+} lwmqtt_arduino_utimer_t;
+
+// Strategy used by the network read while waiting for data to arrive
+enum MQTTWaitPolicy : uint8_t {
+  MQTT_WAIT_YIELD = 0,   // yield() after every empty read
+  MQTT_WAIT_SPIN = 1,    // spin for a number of empty reads, then yield()
+  MQTT_WAIT_SLEEP = 2,   // exponential delay() starting at 1ms (vTaskDelay on ESP32)
+  MQTT_WAIT_CUSTOM = 3   // user callback, e.g. blocking on socket readiness on host
+};
+
+typedef void (*MQTTClientWaitCallback)(Client *client, uint32_t idle, uint32_t remaining);
+
+typedef struct {
+  uint32_t wakeups;  // empty reads that went through the wait policy
+  uint32_t bytes;    // bytes received
+} MQTTClientWaitStats;
+
+typedef struct {
+  MQTTWaitPolicy policy;
+  uint16_t param;  // spin count or max sleep in ms
+  MQTTClientWaitCallback callback;
+  MQTTClientWaitStats stats;
+} lwmqtt_arduino_wait_t;
+
+// Ring space publish() leaves free for the control packets of loop(): the acks of both directions of a QoS 2
+// exchange (4 bytes each) and a ping request (2 bytes). loop() only reads a packet while the ring can take its ack
+// and only pings while it can take the request, so it never waits for the ring. Commands (subscribe, unsubscribe)
+// that do not fit wait for the ring to drain up to the command timeout instead of failing.
+#ifndef MQTT_TX_CONTROL_RESERVE
+#define MQTT_TX_CONTROL_RESERVE 10
+#endif
+
+// Largest control packet a received packet is answered with (puback, pubrec, pubrel or pubcomp)
+#define MQTT_TX_ACK_SIZE 4
+
+// Send-side ring used by the non-blocking write mode to hold bytes the client could not take yet
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t head;
+  size_t len;
+} lwmqtt_arduino_ring_t;
+
 typedef struct {
   Client *client;
+  lwmqtt_arduino_ring_t tx;
+  bool writeProbe;  // set once the client reported availableForWrite() > 0
+  lwmqtt_arduino_wait_t wait;
 } lwmqtt_arduino_network_t;
 
 class MQTTClient;
@@ -124,6 +187,124 @@ struct MQTTClientCallback {
   }
 };
 
+// Placement hint passed to the allocator
+enum MQTTAllocHint : uint8_t {
+  MQTT_ALLOC_SMALL = 0,  // small and hot control structures (hostname, will, timers)
+  MQTT_ALLOC_LARGE = 1   // large and cold buffers (read and write buffer, send ring)
+};
+
+typedef struct {
+  void *(*alloc)(size_t size, MQTTAllocHint hint, void *ref);
+  void (*free)(void *ptr, MQTTAllocHint hint, void *ref);
+  void *ref;
+} MQTTClientAllocator;
+
+// Bump allocator that places large allocations into a static buffer and leaves small ones to malloc
+class MQTTClientArena {
+ private:
+  uint8_t *buf;
+  size_t size;
+  size_t used = 0;
+  size_t last = 0;
+
+ public:
+  MQTTClientAllocator allocator;
+
+  MQTTClientArena(uint8_t *buf, size_t size);
+
+  void *alloc(size_t len, MQTTAllocHint hint);
+  void free(void *ptr, MQTTAllocHint hint);
+  size_t available() { return this->size - this->used; }
+};
+
+// Pool of equally sized blocks in a static buffer for large allocations that come and go, small ones go to malloc
+class MQTTClientPool {
+ private:
+  uint8_t *buf;
+  size_t blockSize;
+  size_t count;
+  void *head = nullptr;
+  size_t freeCount = 0;
+
+ public:
+  MQTTClientAllocator allocator;
+
+  MQTTClientPool(uint8_t *buf, size_t size, size_t blockSize);
+
+  void *alloc(size_t len, MQTTAllocHint hint);
+  void free(void *ptr, MQTTAllocHint hint);
+  size_t available() { return this->freeCount; }
+};
+
+// Phases used to attribute allocations when built with MQTT_ALLOC_STATS
+enum MQTTAllocPhase : uint8_t {
+  MQTT_PHASE_CONFIGURE = 0,
+  MQTT_PHASE_CONSTRUCT = 1,
+  MQTT_PHASE_CONNECT = 2,
+  MQTT_PHASE_PUBLISH = 3,
+  MQTT_PHASE_RECEIVE = 4,
+  MQTT_PHASE_RECONNECT = 5,
+  MQTT_PHASE_COUNT = 6
+};
+
+typedef struct {
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t bytes;
+} MQTTClientAllocStats;
+
+// Callback cost of one subscription filter, slots are provided by the application
+struct MQTTTopicStat {
+  char filter[40];
+  uint32_t calls;
+  uint32_t maxMicros;
+  uint64_t totalMicros;
+};
+
+typedef void (*MQTTTopicStatIterator)(const MQTTTopicStat &stat, void *ref);
+
+// Retained message seen on a topic, slots are provided by the application
+struct MQTTRetainedEntry {
+  char topic[40];  // longer topics keep their first 39 characters
+  uint16_t topicLen;
+  uint32_t topicHash;
+  uint32_t payloadHash;
+  uint32_t length;
+  uint32_t stamp;  // zero marks a free slot
+};
+
+// Subscription filter used for local loopback delivery, slots are provided by the application
+struct MQTTLoopbackFilter {
+  char filter[40];
+};
+
+class MQTTLz;
+class MQTTOutbox;
+
+// Number of outbound priority lanes, lane 0 has the highest priority
+#define MQTT_LANES 4
+
+// Queue latency of the messages sent from a lane
+typedef struct {
+  uint32_t sent;
+  uint32_t totalMillis;
+  uint32_t maxMillis;
+  uint32_t dropped;
+} MQTTLaneStats;
+
+typedef struct {
+  MQTTOutbox *outbox;
+  uint8_t weight;
+  uint8_t credit;
+  MQTTLaneStats stats;
+} lwmqtt_arduino_lane_t;
+
+typedef struct {
+  lwmqtt_arduino_lane_t lane[MQTT_LANES];
+  uint16_t round;  // sum of the weights of all set lanes, the default budget of loop()
+  uint8_t cursor;
+} lwmqtt_arduino_lanes_t;
+
 class MQTTClient {
  private:
   // Pointers (8 bytes on 64-bit, 4 on 32-bit)
@@ -132,20 +313,44 @@ class MQTTClient {
   Client *netClient = nullptr;
   const char *hostname = nullptr;
   lwmqtt_will_t *will = nullptr;
+  lwmqtt_arduino_utimer_t *utimers = nullptr;
+  MQTTTopicStat *topicStats = nullptr;
+  MQTTLoopbackFilter *loopbackFilters = nullptr;
+  MQTTRetainedEntry *retainedEntries = nullptr;
+  uint8_t *retainedArea = nullptr;
+  lwmqtt_arduino_lanes_t *lanes = nullptr;
+  MQTTLz *lz = nullptr;
+  uint8_t *lzBuf = nullptr;
+  uint8_t *lzOut = nullptr;
+  MQTTClient *bridgeTarget = nullptr;
+  char *bridgePrefix = nullptr;
 
   // Structs (contain pointers and data)
   MQTTClientCallback callback;
-  lwmqtt_arduino_network_t network = {nullptr};
+  lwmqtt_arduino_network_t network = lwmqtt_arduino_network_t();
   lwmqtt_arduino_timer_t timer1 = {0, 0, nullptr};
   lwmqtt_arduino_timer_t timer2 = {0, 0, nullptr};
+  lwmqtt_arduino_micros_t microsExt = {0, 0};
   lwmqtt_client_t client = lwmqtt_client_t();
   IPAddress address;
 
   // 4-byte aligned data
   size_t readBufSize = 0;
   size_t writeBufSize = 0;
+  size_t topicStatsCount = 0;
+  size_t loopbackCount = 0;
+  size_t retainedCount = 0;
+  size_t retainedSlotSize = 0;
+  size_t lzBufSize = 0;
+  size_t lzOutSize = 0;
+  size_t lzThreshold = 0;
   uint32_t timeout = 1000;
   uint32_t _droppedMessages = 0;
+  uint32_t _bridgeDropped = 0;
+  uint32_t _retainedSuppressed = 0;
+  uint32_t retainedStamp = 0;
+  uint32_t livenessInterval = 0;
+  uint32_t lastLiveness = 0;
   int port = 0;
 
   // 2-byte aligned data
@@ -156,6 +361,11 @@ class MQTTClient {
   bool cleanSession = true;
   bool _sessionPresent = false;
   bool _connected = false;
+  bool _wasConnected = false;
+  bool loopbackUpstream = false;
+  bool loopbackActive = false;
+  bool skipAck = false;
+  uint8_t bridgeQos = LWMQTT_QOS2;
   
   // Enums (usually int, but can be smaller)
   lwmqtt_return_code_t _returnCode = (lwmqtt_return_code_t)0;
@@ -193,28 +403,43 @@ class MQTTClient {
 #endif
 
   void setClockSource(MQTTClientClockSource cb);
+  bool useMicrosTimers(bool enabled, MQTTClientMicrosSource cb = nullptr);
+  uint64_t micros64();
 
   void setHost(const char _hostname[]) { this->setHost(_hostname, 1883); }
   void setHost(const char hostname[], int port);
   void setHost(IPAddress _address) { this->setHost(_address, 1883); }
   void setHost(IPAddress _address, int port);
 
+#if LWMQTT_WILL
   void setWill(const char topic[]) { this->setWill(topic, ""); }
   void setWill(const char topic[], const char payload[]) { this->setWill(topic, payload, false, 0); }
   void setWill(const char topic[], const char payload[], bool retained, int qos);
   void clearWill();
+#endif
 
   void setKeepAlive(int keepAlive);
   void setCleanSession(bool cleanSession);
   void setTimeout(int timeout);
+  void setLivenessInterval(int interval);
+  void setWaitPolicy(MQTTWaitPolicy policy, uint16_t param = 0);
+  void setWaitCallback(MQTTClientWaitCallback cb);
+  MQTTClientWaitStats waitStats() { return this->network.wait.stats; }
+  void resetWaitStats() { this->network.wait.stats = MQTTClientWaitStats(); }
   void setOptions(int _keepAlive, bool _cleanSession, int _timeout) {
     this->setKeepAlive(_keepAlive);
     this->setCleanSession(_cleanSession);
     this->setTimeout(_timeout);
   }
 
+#if LWMQTT_DROP_OVERFLOW
   void dropOverflow(bool enabled);
   uint32_t droppedMessages() { return this->_droppedMessages; }
+#endif
+
+  bool setNonBlocking(int bufSize);
+  size_t pendingWrites() { return this->network.tx.len; }
+  bool nonBlocking() { return this->network.tx.buf != nullptr && this->network.writeProbe; }
 
   bool connect(const char clientId[], bool skip = false) { return this->connect(clientId, nullptr, nullptr, skip); }
   bool connect(const char clientId[], const char username[], bool skip = false) {
@@ -242,6 +467,18 @@ class MQTTClient {
     return this->publish(topic, payload, length, false, 0);
   }
   bool publish(const char topic[], const char payload[], int length, bool retained, int qos);
+  uint8_t *payloadBuffer(const char topic[], int qos, size_t &capacity);
+  bool setCompression(MQTTLz *lz, size_t threshold = 200, size_t bufSize = 0, size_t outSize = 0);
+  bool setOutbox(MQTTOutbox *outbox) { return this->setLane(0, outbox); }
+  bool setLane(uint8_t lane, MQTTOutbox *outbox, uint8_t weight = 0);
+  bool enqueue(uint8_t lane, const char topic[], const char payload[], int length, bool retained = false, int qos = 0,
+               bool conflate = false);
+  MQTTLaneStats laneStats(uint8_t lane);
+  void resetLaneStats();
+
+  bool bridge(MQTTClient *target, const char prefix[] = nullptr, int qos = 2);
+  uint32_t bridgeDropped() { return this->_bridgeDropped; }
+  int inFlight() { return lwmqtt_inflight(&this->client); }
 
   uint16_t lastPacketID();
   void prepareDuplicate(uint16_t packetID);
@@ -251,16 +488,37 @@ class MQTTClient {
   bool subscribe(const char topic[]) { return this->subscribe(topic, 0); }
   bool subscribe(const char topic[], int qos);
 
+  void enableTopicStats(MQTTTopicStat *slots, size_t count);
+  bool trackTopicStat(const char filter[]);
+  void forEachTopicStat(MQTTTopicStatIterator fn, void *ref = nullptr);
+  static bool topicMatches(const char filter[], const char *topic, size_t len);
+
+  void enableLoopback(MQTTLoopbackFilter *slots, size_t count, bool upstream = false);
+  bool trackLoopback(const char filter[]);
+
+  void enableRetainedCache(MQTTRetainedEntry *slots, size_t count, uint8_t *area = nullptr, size_t slotSize = 0);
+  bool getRetained(const char topic[], const char *&payload, size_t &length);
+  uint32_t retainedSuppressed() { return this->_retainedSuppressed; }
+
+#if LWMQTT_UNSUBSCRIBE
   bool unsubscribe(const String &topic) { return this->unsubscribe(topic.c_str()); }
   bool unsubscribe(const char topic[]);
+#endif
 
   bool loop();
+  bool loop(uint16_t maxPackets, uint32_t maxMicros);
+  bool drain() { return this->loop(0, 0); }
   bool connected();
   bool sessionPresent() { return this->_sessionPresent; }
 
-    // Expose buffer info for internal handlers (kept small to avoid copying)
-    uint8_t *readBufferPtr() { return this->readBuf; }
-    size_t readBufferSize() const { return this->readBufSize; }
+  // Expose buffer info for internal handlers (kept small to avoid copying)
+  uint8_t *readBufferPtr() { return this->readBuf; }
+  size_t readBufferSize() const { return this->readBufSize; }
+
+  static void setAllocator(const MQTTClientAllocator *allocator);
+  static MQTTClientAllocStats allocStats(MQTTAllocPhase phase);
+  static size_t allocPeak();
+  static void resetAllocStats();
 
   lwmqtt_err_t lastError() { return this->_lastError; }
   lwmqtt_return_code_t returnCode() { return this->_returnCode; }
@@ -268,7 +526,29 @@ class MQTTClient {
   bool disconnect();
 
  private:
-    void destroyCallback();
+  // Hooks for the message handler and dispatcher in MQTTClient.cpp
+  friend void MQTTClientHandler(lwmqtt_client_t *client, void *ref, lwmqtt_string_t topic, lwmqtt_message_t message);
+  friend void MQTTClientDispatch(MQTTClientCallback *cb, lwmqtt_string_t topic, lwmqtt_message_t message);
+
+  bool topicStatsEnabled() const { return this->topicStats != nullptr; }
+  void recordTopicStat(const char *topic, size_t len, uint32_t micros);
+  bool inflatePayload(lwmqtt_message_t &message);
+  bool bridging() const { return this->bridgeTarget != nullptr; }
+  bool forwardPacket(lwmqtt_string_t topic, const lwmqtt_message_t &message);
+  bool retainedCacheEnabled() const { return this->retainedEntries != nullptr; }
+  bool cacheRetained(lwmqtt_string_t topic, const lwmqtt_message_t &message);
+
+  void destroyCallback();
+  bool reserveWrite(size_t len);
+  bool controlRoom(size_t len);
+  void setTimers();
+  bool drainLanes(uint16_t maxMessages, uint32_t maxMicros);
+  bool loopbackMatches(const char topic[]);
+  void deliverLocal(const char topic[], const char payload[], int length, bool retained, int qos);
+  void untrackLoopback(const char filter[]);
+  bool alive(uint32_t now);
+  bool pingDue(uint32_t now);
+  bool processKeepAlive();
   void close();
 };
 
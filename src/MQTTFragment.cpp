@@ -0,0 +1,203 @@
+#include "MQTTFragment.h"
+
+#include "MQTTClient.h"
+
+extern "C" {
+#include "lwmqtt/helpers.h"
+}
+
+static uint16_t mqtt_fragment_read(const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static void mqtt_fragment_write(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+static uint32_t mqtt_fragment_read32(const uint8_t *p) {
+  return (uint32_t)mqtt_fragment_read(p) << 16 | mqtt_fragment_read(p + 2);
+}
+
+static void mqtt_fragment_write32(uint8_t *p, uint32_t v) {
+  mqtt_fragment_write(p, (uint16_t)(v >> 16));
+  mqtt_fragment_write(p + 2, (uint16_t)v);
+}
+
+bool MQTTFragmenter::publish(MQTTClient &client, const char topic[], const uint8_t data[], size_t length,
+                             size_t chunkSize, int qos) {
+  // get payload area
+  size_t cap;
+  uint8_t *buf = client.payloadBuffer(topic, qos, cap);
+  if (buf == nullptr || cap <= MQTT_FRAGMENT_HEADER) {
+    return false;
+  }
+
+  // check chunk size
+  if (chunkSize == 0 || chunkSize > cap - MQTT_FRAGMENT_HEADER) {
+    chunkSize = cap - MQTT_FRAGMENT_HEADER;
+  }
+  if (chunkSize > 0xffff) {
+    chunkSize = 0xffff;
+  }
+  size_t chunks = length > 0 ? (length + chunkSize - 1) / chunkSize : 1;
+  if (chunks > MQTT_FRAGMENT_MAX_CHUNKS) {
+    return false;
+  }
+
+  uint16_t id = this->nextId++;
+  if (this->nextId == 0) {
+    this->nextId = 1;
+  }
+  uint32_t checksum = lwmqtt_fnv1a(data, length);
+
+  for (size_t i = 0; i < chunks; i++) {
+    // write header
+    buf[0] = MQTT_FRAGMENT_MAGIC;
+    buf[1] = MQTT_FRAGMENT_SIGNATURE_1;
+    buf[2] = MQTT_FRAGMENT_SIGNATURE_2;
+    mqtt_fragment_write(buf + 3, id);
+    mqtt_fragment_write(buf + 5, (uint16_t)i);
+    mqtt_fragment_write(buf + 7, (uint16_t)chunks);
+    mqtt_fragment_write(buf + 9, (uint16_t)chunkSize);
+    mqtt_fragment_write32(buf + 11, checksum);
+
+    // copy chunk
+    size_t offset = i * chunkSize;
+    size_t len = length - offset < chunkSize ? length - offset : chunkSize;
+    memcpy(buf + MQTT_FRAGMENT_HEADER, data + offset, len);
+
+    // publish chunk, a failure leaves the message incomplete at the receiver
+    if (!client.publish(topic, (const char *)buf, (int)(MQTT_FRAGMENT_HEADER + len), false, qos)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+MQTTReassembler::MQTTReassembler(MQTTFragmentSlot *slots, size_t count, uint8_t *buf, size_t slotSize,
+                                 uint32_t timeout)
+    : slots(slots), count(count), buf(buf), slotSize(slotSize), timeout(timeout) {
+  this->clear();
+}
+
+void MQTTReassembler::drop(MQTTFragmentSlot &slot) {
+  if (slot.used) {
+    slot.used = false;
+    this->_dropped++;
+  }
+}
+
+bool MQTTReassembler::feed(const char *topic, size_t topicLen, const char *payload, size_t len,
+                           const uint8_t *&data, size_t &length) {
+  // parse header
+  if (!MQTTReassembler::isFragment(payload, len)) {
+    return false;
+  }
+  const uint8_t *p = (const uint8_t *)payload;
+  uint16_t id = mqtt_fragment_read(p + 3);
+  uint16_t index = mqtt_fragment_read(p + 5);
+  uint16_t chunks = mqtt_fragment_read(p + 7);
+  uint16_t chunkSize = mqtt_fragment_read(p + 9);
+  uint32_t checksum = mqtt_fragment_read32(p + 11);
+  size_t chunkLen = len - MQTT_FRAGMENT_HEADER;
+
+  // validate chunk, only the last chunk may be shorter
+  if (chunks == 0 || chunks > MQTT_FRAGMENT_MAX_CHUNKS || index >= chunks || chunkSize == 0 ||
+      chunkLen > chunkSize || (index + 1 < chunks && chunkLen != chunkSize) ||
+      (size_t)index * chunkSize + chunkLen > this->slotSize) {
+    return false;
+  }
+
+  this->expire();
+
+  // find slot of message or a free slot
+  uint32_t hash = lwmqtt_fnv1a(topic, topicLen);
+  size_t found = this->count;
+  size_t empty = this->count;
+  size_t oldest = this->count;
+  uint32_t now = this->timestamp();
+  for (size_t i = 0; i < this->count; i++) {
+    MQTTFragmentSlot &slot = this->slots[i];
+    if (!slot.used) {
+      empty = empty < this->count ? empty : i;
+    } else if (slot.topic == hash && slot.id == id) {
+      found = i;
+      break;
+    } else if (oldest == this->count || now - slot.started > now - this->slots[oldest].started) {
+      oldest = i;
+    }
+  }
+
+  // claim a slot, evicting the oldest message if the table is full
+  if (found == this->count) {
+    found = empty < this->count ? empty : oldest;
+    if (found == this->count) {
+      return false;
+    }
+    MQTTFragmentSlot &slot = this->slots[found];
+    this->drop(slot);
+    slot.topic = hash;
+    slot.id = id;
+    slot.checksum = checksum;
+    slot.count = chunks;
+    slot.chunkSize = chunkSize;
+    slot.started = now;
+    slot.received = 0;
+    slot.chunks = 0;
+    slot.length = 0;
+    slot.used = true;
+  }
+
+  // reject chunks that do not match the layout of the message
+  MQTTFragmentSlot &slot = this->slots[found];
+  if (slot.count != chunks || slot.chunkSize != chunkSize || slot.checksum != checksum) {
+    return false;
+  }
+
+  // store chunk at its position, duplicates are ignored
+  uint64_t bit = (uint64_t)1 << index;
+  if ((slot.received & bit) == 0) {
+    uint8_t *area = this->buf + found * this->slotSize;
+    memcpy(area + (size_t)index * chunkSize, p + MQTT_FRAGMENT_HEADER, chunkLen);
+    slot.received |= bit;
+    slot.chunks++;
+    if (index + 1 == chunks) {
+      slot.length = (size_t)index * chunkSize + chunkLen;
+    }
+  }
+
+  // check completion
+  if (slot.chunks < slot.count) {
+    return false;
+  }
+
+  // drop messages that were assembled from foreign or corrupted chunks
+  uint8_t *area = this->buf + found * this->slotSize;
+  if (lwmqtt_fnv1a(area, slot.length) != slot.checksum) {
+    this->drop(slot);
+    return false;
+  }
+  slot.used = false;
+  data = area;
+  length = slot.length;
+
+  return true;
+}
+
+uint32_t MQTTReassembler::timestamp() { return (this->clock != nullptr) ? this->clock() : millis(); }
+
+void MQTTReassembler::expire() {
+  uint32_t now = this->timestamp();
+  for (size_t i = 0; i < this->count; i++) {
+    if (this->slots[i].used && now - this->slots[i].started >= this->timeout) {
+      this->drop(this->slots[i]);
+    }
+  }
+}
+
+void MQTTReassembler::clear() { memset(this->slots, 0, this->count * sizeof(MQTTFragmentSlot)); }
+
+bool MQTTReassembler::isFragment(const char *payload, size_t len) {
+  return payload != nullptr && len >= MQTT_FRAGMENT_HEADER && (uint8_t)payload[0] == MQTT_FRAGMENT_MAGIC &&
+         payload[1] == MQTT_FRAGMENT_SIGNATURE_1 && payload[2] == MQTT_FRAGMENT_SIGNATURE_2;
+}
@@ -0,0 +1,75 @@
+#ifndef MQTT_FRAGMENT_H
+#define MQTT_FRAGMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of chunks per message (may be overridden with a build flag, up to 64)
+#ifndef MQTT_FRAGMENT_MAX_CHUNKS
+#define MQTT_FRAGMENT_MAX_CHUNKS 64
+#endif
+
+// First byte of a chunk payload (invalid in UTF-8 text), followed by the signature "FR"
+#define MQTT_FRAGMENT_MAGIC 0xfb
+#define MQTT_FRAGMENT_SIGNATURE_1 'F'
+#define MQTT_FRAGMENT_SIGNATURE_2 'R'
+
+// Chunk header: magic, signature, message id, chunk index, chunk count, chunk size and message checksum
+#define MQTT_FRAGMENT_HEADER 15
+
+class MQTTClient;
+
+// Splits large messages into numbered chunks published as separate messages
+class MQTTFragmenter {
+ private:
+  uint16_t nextId = 1;
+
+ public:
+  bool publish(MQTTClient &client, const char topic[], const uint8_t data[], size_t length, size_t chunkSize = 0,
+               int qos = 0);
+};
+
+// State of a message being reassembled
+typedef struct {
+  uint32_t topic;
+  uint32_t checksum;
+  uint32_t started;
+  uint64_t received;
+  size_t length;
+  uint16_t id;
+  uint16_t count;
+  uint16_t chunkSize;
+  uint16_t chunks;
+  bool used;
+} MQTTFragmentSlot;
+
+// Reassembles chunked messages that may arrive out of order in a fixed table of slots
+class MQTTReassembler {
+ private:
+  MQTTFragmentSlot *slots;
+  size_t count;
+  uint8_t *buf;
+  size_t slotSize;
+  uint32_t timeout;
+  uint32_t _dropped = 0;
+  uint32_t (*clock)() = nullptr;
+
+  void drop(MQTTFragmentSlot &slot);
+  uint32_t timestamp();
+
+ public:
+  MQTTReassembler(MQTTFragmentSlot *slots, size_t count, uint8_t *buf, size_t slotSize, uint32_t timeout = 10000);
+
+  bool feed(const char *topic, size_t topicLen, const char *payload, size_t len, const uint8_t *&data,
+            size_t &length);
+  void expire();
+  void clear();
+
+  // Clock used for the timeouts of incomplete messages, null restores millis(). Pass the clock source of the client.
+  void setClock(uint32_t (*cb)()) { this->clock = cb; }
+
+  uint32_t dropped() { return this->_dropped; }
+  static bool isFragment(const char *payload, size_t len);
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "MQTTGorilla.h"
+
+#include <string.h>
+
+extern "C" {
+#include "lwmqtt/helpers.h"
+}
+
+// frame header
+#define MQTT_GORILLA_KEY 0x80
+#define MQTT_GORILLA_COUNT 0x3f
+#define MQTT_GORILLA_HEADER 2
+
+// no window has been set for a value
+#define MQTT_GORILLA_NO_WINDOW 0xff
+
+namespace {
+
+class BitWriter {
+ private:
+  uint8_t *buf;
+  size_t cap;
+  size_t bits = 0;
+
+ public:
+  bool ok = true;
+
+  BitWriter(uint8_t *buf, size_t cap) : buf(buf), cap(cap) { memset(buf, 0, cap); }
+
+  void put(uint32_t value, uint8_t n) {
+    while (n-- > 0) {
+      if (this->bits >= this->cap * 8) {
+        this->ok = false;
+        return;
+      }
+      if ((value >> n) & 1) {
+        this->buf[this->bits / 8] |= (uint8_t)(0x80 >> (this->bits % 8));
+      }
+      this->bits++;
+    }
+  }
+
+  size_t length() { return (this->bits + 7) / 8; }
+};
+
+class BitReader {
+ private:
+  const uint8_t *buf;
+  size_t len;
+  size_t bits = 0;
+
+ public:
+  bool ok = true;
+
+  BitReader(const uint8_t *buf, size_t len) : buf(buf), len(len) {}
+
+  uint32_t get(uint8_t n) {
+    uint32_t value = 0;
+    while (n-- > 0) {
+      if (this->bits >= this->len * 8) {
+        this->ok = false;
+        return 0;
+      }
+      value = (value << 1) | ((this->buf[this->bits / 8] >> (7 - this->bits % 8)) & 1);
+      this->bits++;
+    }
+    return value;
+  }
+};
+
+}  // namespace
+
+static uint32_t mqtt_gorilla_hash(const char topic[]) {
+  // zero marks a free slot
+  uint32_t hash = lwmqtt_fnv1a(topic, strlen(topic));
+  return hash != 0 ? hash : 1;
+}
+
+static uint8_t mqtt_gorilla_clz(uint32_t x) {
+  return (uint8_t)(x == 0 ? 32 : __builtin_clzl(x) - (sizeof(long) * 8 - 32));
+}
+
+static uint8_t mqtt_gorilla_ctz(uint32_t x) { return (uint8_t)(x == 0 ? 32 : __builtin_ctzl(x)); }
+
+MQTTGorillaStates::MQTTGorillaStates(MQTTGorillaState *slots, size_t size) : slots(slots), size(size) {
+  this->clear();
+}
+
+static bool mqtt_gorilla_match(const MQTTGorillaState &state, const char topic[], size_t len, uint32_t hash) {
+  // compare the stored topic, or its prefix, length and hash for longer topics
+  size_t prefix = (len < sizeof(state.name)) ? len : sizeof(state.name) - 1;
+  return state.topic == hash && state.nameLen == len && memcmp(state.name, topic, prefix) == 0;
+}
+
+MQTTGorillaState *MQTTGorillaStates::get(const char topic[]) {
+  size_t len = strlen(topic);
+  uint32_t hash = mqtt_gorilla_hash(topic);
+
+  // probe from the home slot
+  for (size_t i = 0; i < this->size; i++) {
+    MQTTGorillaState *state = &this->slots[(hash + i) % this->size];
+    if (mqtt_gorilla_match(*state, topic, len, hash)) {
+      return state;
+    } else if (state->topic == 0) {
+      MQTTGorilla::reset(*state);
+      size_t prefix = (len < sizeof(state->name)) ? len : sizeof(state->name) - 1;
+      memcpy(state->name, topic, prefix);
+      state->name[prefix] = '\0';
+      state->nameLen = (uint16_t)len;
+      state->topic = hash;
+      return state;
+    }
+  }
+
+  return nullptr;
+}
+
+void MQTTGorillaStates::reset(const char topic[]) {
+  MQTTGorillaState *state = this->get(topic);
+  if (state != nullptr) {
+    MQTTGorilla::reset(*state);
+  }
+}
+
+void MQTTGorillaStates::clear() { memset(this->slots, 0, this->size * sizeof(MQTTGorillaState)); }
+
+void MQTTGorilla::reset(MQTTGorillaState &state) {
+  // keep the topic of the slot
+  MQTTGorillaState empty;
+  memset(&empty, 0, sizeof(MQTTGorillaState));
+  memcpy(empty.name, state.name, sizeof(empty.name));
+  empty.nameLen = state.nameLen;
+  empty.topic = state.topic;
+  state = empty;
+}
+
+static void mqtt_gorilla_key(MQTTGorillaState &state, uint32_t time, uint8_t count) {
+  state.time = time;
+  state.delta = 0;
+  state.count = count;
+  state.sinceKey = 0;
+  state.started = true;
+  memset(state.leading, MQTT_GORILLA_NO_WINDOW, sizeof(state.leading));
+  memset(state.trailing, 0, sizeof(state.trailing));
+}
+
+size_t MQTTGorilla::encode(MQTTGorillaState &state, uint32_t time, const float values[], uint8_t count, uint8_t *buf,
+                           size_t cap, uint16_t keyInterval) {
+  // check arguments
+  if (count == 0 || count > MQTT_GORILLA_MAX_VALUES || count > MQTT_GORILLA_COUNT || cap < MQTT_GORILLA_HEADER) {
+    return 0;
+  }
+
+  uint32_t words[MQTT_GORILLA_MAX_VALUES];
+  memcpy(words, values, count * sizeof(uint32_t));
+
+  // send a key frame at start, on changes of the layout and periodically to recover from lost frames
+  uint8_t seq = (uint8_t)(state.seq + 1);
+  if (!state.started || state.count != count || (keyInterval > 0 && state.sinceKey + 1 >= keyInterval)) {
+    size_t len = MQTT_GORILLA_HEADER + 4 + 4 * (size_t)count;
+    if (cap < len) {
+      return 0;
+    }
+
+    BitWriter w(buf, cap);
+    w.put(MQTT_GORILLA_KEY | count, 8);
+    w.put(seq, 8);
+    w.put(time, 32);
+    for (uint8_t i = 0; i < count; i++) {
+      w.put(words[i], 32);
+    }
+
+    mqtt_gorilla_key(state, time, count);
+    memcpy(state.values, words, sizeof(words));
+    state.seq = seq;
+
+    return w.length();
+  }
+
+  // write on a copy of the state so that a failed encoding leaves it untouched
+  MQTTGorillaState next = state;
+  BitWriter w(buf, cap);
+  w.put(count, 8);
+  w.put(seq, 8);
+
+  // write delta of delta timestamp
+  int32_t delta = (int32_t)(time - state.time);
+  int32_t dod = delta - state.delta;
+  if (dod == 0) {
+    w.put(0, 1);
+  } else if (dod >= -63 && dod <= 64) {
+    w.put(0x2, 2);
+    w.put((uint32_t)(dod + 63), 7);
+  } else if (dod >= -255 && dod <= 256) {
+    w.put(0x6, 3);
+    w.put((uint32_t)(dod + 255), 9);
+  } else if (dod >= -2047 && dod <= 2048) {
+    w.put(0xe, 4);
+    w.put((uint32_t)(dod + 2047), 12);
+  } else {
+    w.put(0xf, 4);
+    w.put((uint32_t)dod, 32);
+  }
+  next.time = time;
+  next.delta = delta;
+
+  // write xor of values
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t x = words[i] ^ state.values[i];
+    if (x == 0) {
+      w.put(0, 1);
+      continue;
+    }
+
+    uint8_t leading = mqtt_gorilla_clz(x);
+    uint8_t trailing = mqtt_gorilla_ctz(x);
+
+    if (state.leading[i] != MQTT_GORILLA_NO_WINDOW && leading >= state.leading[i] && trailing >= state.trailing[i]) {
+      // reuse previous window
+      w.put(0x2, 2);
+      w.put(x >> state.trailing[i], (uint8_t)(32 - state.leading[i] - state.trailing[i]));
+    } else {
+      // write new window
+      uint8_t bits = (uint8_t)(32 - leading - trailing);
+      w.put(0x3, 2);
+      w.put(leading, 5);
+      w.put(bits - 1, 5);
+      w.put(x >> trailing, bits);
+      next.leading[i] = leading;
+      next.trailing[i] = trailing;
+    }
+    next.values[i] = words[i];
+  }
+
+  if (!w.ok) {
+    return 0;
+  }
+
+  next.sinceKey++;
+  next.seq = seq;
+  state = next;
+
+  return w.length();
+}
+
+int MQTTGorilla::decode(MQTTGorillaState &state, const uint8_t *buf, size_t len, uint32_t &time, float values[],
+                        uint8_t max) {
+  if (buf == nullptr || len < MQTT_GORILLA_HEADER) {
+    return -1;
+  }
+
+  BitReader r(buf, len);
+  uint8_t header = (uint8_t)r.get(8);
+  uint8_t seq = (uint8_t)r.get(8);
+  uint8_t count = header & MQTT_GORILLA_COUNT;
+  if (count == 0 || count > MQTT_GORILLA_MAX_VALUES || count > max) {
+    return -1;
+  }
+
+  MQTTGorillaState next = state;
+
+  if (header & MQTT_GORILLA_KEY) {
+    // read key frame
+    mqtt_gorilla_key(next, r.get(32), count);
+    for (uint8_t i = 0; i < count; i++) {
+      next.values[i] = r.get(32);
+    }
+  } else {
+    // a delta frame can only be applied on top of its predecessor
+    if (!state.started || state.count != count || seq != (uint8_t)(state.seq + 1)) {
+      return -1;
+    }
+
+    // read delta of delta timestamp
+    int32_t dod;
+    if (r.get(1) == 0) {
+      dod = 0;
+    } else if (r.get(1) == 0) {
+      dod = (int32_t)r.get(7) - 63;
+    } else if (r.get(1) == 0) {
+      dod = (int32_t)r.get(9) - 255;
+    } else if (r.get(1) == 0) {
+      dod = (int32_t)r.get(12) - 2047;
+    } else {
+      dod = (int32_t)r.get(32);
+    }
+    next.delta = state.delta + dod;
+    next.time = state.time + (uint32_t)next.delta;
+
+    // read xor of values
+    for (uint8_t i = 0; i < count; i++) {
+      if (r.get(1) == 0) {
+        continue;
+      }
+
+      if (r.get(1) == 0) {
+        if (state.leading[i] == MQTT_GORILLA_NO_WINDOW) {
+          return -1;
+        }
+      } else {
+        next.leading[i] = (uint8_t)r.get(5);
+        uint8_t bits = (uint8_t)(r.get(5) + 1);
+        if (next.leading[i] + bits > 32) {
+          return -1;
+        }
+        next.trailing[i] = (uint8_t)(32 - next.leading[i] - bits);
+      }
+
+      uint32_t x = r.get((uint8_t)(32 - next.leading[i] - next.trailing[i])) << next.trailing[i];
+      next.values[i] = state.values[i] ^ x;
+    }
+
+    next.sinceKey++;
+  }
+
+  if (!r.ok) {
+    return -1;
+  }
+
+  next.seq = seq;
+  state = next;
+
+  time = state.time;
+  memcpy(values, state.values, count * sizeof(uint32_t));
+
+  return count;
+}
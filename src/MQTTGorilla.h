@@ -0,0 +1,57 @@
+#ifndef MQTT_GORILLA_H
+#define MQTT_GORILLA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of values per frame (may be overridden with a build flag)
+#ifndef MQTT_GORILLA_MAX_VALUES
+#define MQTT_GORILLA_MAX_VALUES 8
+#endif
+
+// Stored characters of the topic of a stream, longer topics are identified by their prefix, length and hash
+#ifndef MQTT_GORILLA_TOPIC_SIZE
+#define MQTT_GORILLA_TOPIC_SIZE 32
+#endif
+
+// Previous frame of a stream, kept in the same way by the encoder and the decoder
+typedef struct {
+  char name[MQTT_GORILLA_TOPIC_SIZE];
+  uint16_t nameLen;
+  uint32_t topic;  // hash of the topic, zero marks a free slot
+  uint32_t time;
+  int32_t delta;
+  uint32_t values[MQTT_GORILLA_MAX_VALUES];
+  uint8_t leading[MQTT_GORILLA_MAX_VALUES];
+  uint8_t trailing[MQTT_GORILLA_MAX_VALUES];
+  uint16_t sinceKey;
+  uint8_t count;
+  uint8_t seq;
+  bool started;
+} MQTTGorillaState;
+
+// Fixed table of stream states keyed by topic
+class MQTTGorillaStates {
+ private:
+  MQTTGorillaState *slots;
+  size_t size;
+
+ public:
+  MQTTGorillaStates(MQTTGorillaState *slots, size_t size);
+
+  MQTTGorillaState *get(const char topic[]);
+  void reset(const char topic[]);
+  void clear();
+};
+
+// Delta-of-delta timestamp and XOR float compression of periodic frames
+class MQTTGorilla {
+ public:
+  static size_t encode(MQTTGorillaState &state, uint32_t time, const float values[], uint8_t count, uint8_t *buf,
+                       size_t cap, uint16_t keyInterval = 60);
+  static int decode(MQTTGorillaState &state, const uint8_t *buf, size_t len, uint32_t &time, float values[],
+                    uint8_t max);
+  static void reset(MQTTGorillaState &state);
+};
+
+#endif
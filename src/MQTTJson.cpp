@@ -0,0 +1,334 @@
+#include "MQTTJson.h"
+
+#include <string.h>
+
+static bool mqtt_json_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+static bool mqtt_json_digit(char c) { return c >= '0' && c <= '9'; }
+
+bool MQTTJsonToken::equals(const char str[]) const {
+  size_t n = strlen(str);
+  return n == this->len && memcmp(this->ptr, str, n) == 0;
+}
+
+bool MQTTJsonToken::toBool(bool fallback) const {
+  if (this->type == MQTT_JSON_TRUE) {
+    return true;
+  } else if (this->type == MQTT_JSON_FALSE) {
+    return false;
+  } else if (this->type == MQTT_JSON_NUMBER) {
+    return this->toDouble() != 0;
+  }
+
+  return fallback;
+}
+
+long MQTTJsonToken::toInt(long fallback) const {
+  if (this->type != MQTT_JSON_NUMBER) {
+    return fallback;
+  }
+
+  // parse sign and integer part, a fraction or exponent is truncated
+  size_t i = 0;
+  bool negative = this->ptr[0] == '-';
+  if (negative) {
+    i++;
+  }
+
+  unsigned long value = 0;
+  for (; i < this->len && mqtt_json_digit(this->ptr[i]); i++) {
+    value = value * 10 + (unsigned long)(this->ptr[i] - '0');
+  }
+
+  return negative ? -(long)value : (long)value;
+}
+
+double MQTTJsonToken::toDouble(double fallback) const {
+  if (this->type != MQTT_JSON_NUMBER) {
+    return fallback;
+  }
+
+  size_t i = 0;
+  bool negative = this->ptr[0] == '-';
+  if (negative) {
+    i++;
+  }
+
+  // collect up to 19 significant digits in an integer
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  for (; i < this->len && mqtt_json_digit(this->ptr[i]); i++) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(this->ptr[i] - '0');
+      digits += mantissa > 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (i < this->len && this->ptr[i] == '.') {
+    for (i++; i < this->len && mqtt_json_digit(this->ptr[i]); i++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(this->ptr[i] - '0');
+        digits += mantissa > 0;
+        exponent--;
+      }
+    }
+  }
+
+  // parse exponent
+  if (i < this->len && (this->ptr[i] == 'e' || this->ptr[i] == 'E')) {
+    i++;
+    bool negativeExponent = false;
+    if (i < this->len && (this->ptr[i] == '-' || this->ptr[i] == '+')) {
+      negativeExponent = this->ptr[i] == '-';
+      i++;
+    }
+    int e = 0;
+    for (; i < this->len && mqtt_json_digit(this->ptr[i]); i++) {
+      if (e < 10000) {
+        e = e * 10 + (this->ptr[i] - '0');
+      }
+    }
+    exponent += negativeExponent ? -e : e;
+  }
+
+  // scale by the power of ten using binary exponentiation
+  double value = (double)mantissa;
+  double scale = 1;
+  double base = 10;
+  for (int n = exponent < 0 ? -exponent : exponent; n > 0 && value != 0; n >>= 1) {
+    if (n & 1) {
+      scale *= base;
+    }
+    base *= base;
+  }
+  value = exponent < 0 ? value / scale : value * scale;
+
+  return negative ? -value : value;
+}
+
+size_t MQTTJsonToken::copy(char buf[], size_t size) const {
+  if (size == 0) {
+    return 0;
+  }
+
+  // copy and resolve simple escapes, unicode escapes are copied verbatim
+  size_t n = 0;
+  for (size_t i = 0; i < this->len && n + 1 < size; i++) {
+    char c = this->ptr[i];
+    if (c == '\\' && i + 1 < this->len && (this->type == MQTT_JSON_STRING || this->type == MQTT_JSON_KEY)) {
+      c = this->ptr[++i];
+      switch (c) {
+        case 'n':
+          c = '\n';
+          break;
+        case 't':
+          c = '\t';
+          break;
+        case 'r':
+          c = '\r';
+          break;
+        case 'b':
+          c = '\b';
+          break;
+        case 'f':
+          c = '\f';
+          break;
+        case 'u':
+          if (n + 2 >= size) {
+            buf[n] = 0;
+            return n;
+          }
+          buf[n++] = '\\';
+          break;
+        default:
+          break;
+      }
+    }
+    buf[n++] = c;
+  }
+  buf[n] = 0;
+
+  return n;
+}
+
+MQTTJsonType MQTTJsonReader::next(MQTTJsonToken &token) {
+  token.ptr = nullptr;
+  token.len = 0;
+
+  // skip whitespace and separators
+  while (this->pos < this->len && (mqtt_json_space(this->buf[this->pos]) || this->buf[this->pos] == ',')) {
+    this->pos++;
+  }
+
+  // check end
+  if (this->pos >= this->len || this->buf[this->pos] == 0) {
+    token.type = MQTT_JSON_END;
+    return token.type;
+  }
+
+  const char *start = this->buf + this->pos;
+  char c = *start;
+  this->pos++;
+
+  switch (c) {
+    case '{':
+    case '[':
+      if (this->depth == 255) {
+        token.type = MQTT_JSON_ERROR;
+        this->pos = this->len;
+        break;
+      }
+      this->depth++;
+      token.type = c == '{' ? MQTT_JSON_OBJECT : MQTT_JSON_ARRAY;
+      break;
+    case '}':
+    case ']':
+      if (this->depth > 0) {
+        this->depth--;
+      }
+      token.type = c == '}' ? MQTT_JSON_OBJECT_END : MQTT_JSON_ARRAY_END;
+      break;
+    case '"': {
+      // find closing quote
+      size_t end = this->pos;
+      while (end < this->len && this->buf[end] != '"') {
+        end += this->buf[end] == '\\' ? 2 : 1;
+      }
+      if (end >= this->len) {
+        token.type = MQTT_JSON_ERROR;
+        this->pos = this->len;
+        break;
+      }
+      token.ptr = this->buf + this->pos;
+      token.len = end - this->pos;
+      this->pos = end + 1;
+
+      // a string followed by a colon is a key
+      token.type = MQTT_JSON_STRING;
+      while (this->pos < this->len && mqtt_json_space(this->buf[this->pos])) {
+        this->pos++;
+      }
+      if (this->pos < this->len && this->buf[this->pos] == ':') {
+        this->pos++;
+        token.type = MQTT_JSON_KEY;
+      }
+      return token.type;
+    }
+    default: {
+      // scan a bare literal or number
+      size_t end = this->pos;
+      while (end < this->len && !mqtt_json_space(this->buf[end]) && strchr(",:]}", this->buf[end]) == nullptr &&
+             this->buf[end] != 0) {
+        end++;
+      }
+      token.ptr = start;
+      token.len = this->buf + end - start;
+      this->pos = end;
+
+      if (c == '-' || mqtt_json_digit(c)) {
+        token.type = MQTT_JSON_NUMBER;
+      } else if (token.equals("true")) {
+        token.type = MQTT_JSON_TRUE;
+      } else if (token.equals("false")) {
+        token.type = MQTT_JSON_FALSE;
+      } else if (token.equals("null")) {
+        token.type = MQTT_JSON_NULL;
+      } else {
+        token.type = MQTT_JSON_ERROR;
+        this->pos = this->len;
+      }
+      return token.type;
+    }
+  }
+
+  token.ptr = start;
+  token.len = 1;
+
+  return token.type;
+}
+
+bool MQTTJsonReader::skipFrom(const MQTTJsonToken &token) {
+  if (token.type == MQTT_JSON_ERROR || token.type == MQTT_JSON_END) {
+    return false;
+  } else if (token.type != MQTT_JSON_OBJECT && token.type != MQTT_JSON_ARRAY) {
+    return true;
+  }
+
+  // consume until the container is closed
+  uint8_t target = this->depth - 1;
+  MQTTJsonToken t;
+  while (this->depth > target) {
+    MQTTJsonType type = this->next(t);
+    if (type == MQTT_JSON_ERROR || type == MQTT_JSON_END) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool MQTTJsonReader::skip() {
+  MQTTJsonToken token;
+  this->next(token);
+  return this->skipFrom(token);
+}
+
+bool MQTTJsonReader::find(const char path[], MQTTJsonToken &token) {
+  // start at the root value
+  this->reset();
+  this->next(token);
+
+  const char *segment = path;
+  while (*segment != 0) {
+    // get segment
+    const char *dot = strchr(segment, '.');
+    size_t segmentLen = dot != nullptr ? (size_t)(dot - segment) : strlen(segment);
+
+    if (token.type == MQTT_JSON_OBJECT) {
+      // look for matching key
+      for (;;) {
+        MQTTJsonType type = this->next(token);
+        if (type != MQTT_JSON_KEY) {
+          return false;
+        } else if (token.len == segmentLen && memcmp(token.ptr, segment, segmentLen) == 0) {
+          this->next(token);
+          break;
+        } else if (!this->skip()) {
+          return false;
+        }
+      }
+    } else if (token.type == MQTT_JSON_ARRAY) {
+      // parse index
+      size_t index = 0;
+      for (size_t i = 0; i < segmentLen; i++) {
+        if (!mqtt_json_digit(segment[i])) {
+          return false;
+        }
+        index = index * 10 + (size_t)(segment[i] - '0');
+      }
+
+      // advance to element
+      for (size_t i = 0;; i++) {
+        MQTTJsonType type = this->next(token);
+        if (type == MQTT_JSON_ARRAY_END || type == MQTT_JSON_ERROR || type == MQTT_JSON_END) {
+          return false;
+        } else if (i == index) {
+          break;
+        } else if (!this->skipFrom(token)) {
+          return false;
+        }
+      }
+    } else {
+      return false;
+    }
+
+    segment += segmentLen;
+    if (*segment == '.') {
+      segment++;
+    }
+  }
+
+  return token.type != MQTT_JSON_ERROR && token.type != MQTT_JSON_END;
+}
@@ -0,0 +1,60 @@
+#ifndef MQTT_JSON_H
+#define MQTT_JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum MQTTJsonType : uint8_t {
+  MQTT_JSON_END = 0,
+  MQTT_JSON_ERROR,
+  MQTT_JSON_OBJECT,
+  MQTT_JSON_OBJECT_END,
+  MQTT_JSON_ARRAY,
+  MQTT_JSON_ARRAY_END,
+  MQTT_JSON_KEY,
+  MQTT_JSON_STRING,
+  MQTT_JSON_NUMBER,
+  MQTT_JSON_TRUE,
+  MQTT_JSON_FALSE,
+  MQTT_JSON_NULL
+};
+
+// A token points into the parsed buffer, strings and keys exclude the quotes and are not unescaped
+struct MQTTJsonToken {
+  MQTTJsonType type = MQTT_JSON_END;
+  const char *ptr = nullptr;
+  size_t len = 0;
+
+  bool equals(const char str[]) const;
+  bool toBool(bool fallback = false) const;
+  long toInt(long fallback = 0) const;
+  double toDouble(double fallback = 0) const;
+  size_t copy(char buf[], size_t size) const;
+};
+
+// Pull tokenizer that works in place over a JSON document without allocating
+class MQTTJsonReader {
+ private:
+  const char *buf;
+  size_t len;
+  size_t pos = 0;
+  uint8_t depth = 0;
+
+  bool skipFrom(const MQTTJsonToken &token);
+
+ public:
+  MQTTJsonReader(const char *buf, size_t len) : buf(buf), len(len) {}
+
+  MQTTJsonType next(MQTTJsonToken &token);
+  bool skip();
+  bool find(const char path[], MQTTJsonToken &token);
+
+  void reset() {
+    this->pos = 0;
+    this->depth = 0;
+  }
+
+  uint8_t level() { return this->depth; }
+};
+
+#endif
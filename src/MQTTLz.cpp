@@ -0,0 +1,265 @@
+#include "MQTTLz.h"
+
+#include <string.h>
+
+extern "C" {
+#include "lwmqtt/helpers.h"
+}
+
+// shortest encoded match
+#define MQTT_LZ_MIN_MATCH 4
+
+namespace {
+
+// Reads from the dictionary followed by the data as one continuous stream
+struct Stream {
+  const uint8_t *dict;
+  size_t dictLen;
+  const uint8_t *data;
+
+  uint8_t at(size_t i) const { return i < this->dictLen ? this->dict[i] : this->data[i - this->dictLen]; }
+
+  uint32_t hash(size_t i) const {
+    uint32_t v = (uint32_t)this->at(i) | (uint32_t)this->at(i + 1) << 8 | (uint32_t)this->at(i + 2) << 16 |
+                 (uint32_t)this->at(i + 3) << 24;
+    return (v * 2654435761u) >> (32 - MQTT_LZ_HASH_BITS);
+  }
+};
+
+struct Writer {
+  uint8_t *buf;
+  size_t cap;
+  size_t len;
+  bool ok;
+
+  void put(uint8_t b) {
+    if (this->len >= this->cap) {
+      this->ok = false;
+      return;
+    }
+    this->buf[this->len++] = b;
+  }
+
+  void length(size_t n) {
+    // extension bytes of a 4-bit length field
+    for (; n >= 255; n -= 255) {
+      this->put(255);
+    }
+    this->put((uint8_t)n);
+  }
+};
+
+}  // namespace
+
+static void mqtt_lz_sequence(Writer &w, const Stream &s, size_t anchor, size_t literals, size_t offset, size_t match) {
+  // write token
+  size_t m = match > 0 ? match - MQTT_LZ_MIN_MATCH : 0;
+  w.put((uint8_t)((literals < 15 ? literals : 15) << 4 | (m < 15 ? m : 15)));
+  if (literals >= 15) {
+    w.length(literals - 15);
+  }
+
+  // write literals
+  for (size_t i = 0; i < literals; i++) {
+    w.put(s.at(anchor + i));
+  }
+
+  // write match
+  if (match > 0) {
+    w.put((uint8_t)offset);
+    w.put((uint8_t)(offset >> 8));
+    if (m >= 15) {
+      w.length(m - 15);
+    }
+  }
+}
+
+void MQTTLz::setDictionary(const uint8_t *dict, size_t len) {
+  // only the tail within the window can be referenced
+  if (len > MQTT_LZ_WINDOW) {
+    dict += len - MQTT_LZ_WINDOW;
+    len = MQTT_LZ_WINDOW;
+  }
+
+  this->dict = len > 0 ? dict : nullptr;
+  this->dictLen = this->dict != nullptr ? len : 0;
+
+  // identify the dictionary so that a mismatch is detected when decompressing
+  uint8_t id = 0;
+  for (size_t i = 0; i < this->dictLen; i++) {
+    id = (uint8_t)((id ^ this->dict[i]) * 31 + 7);
+  }
+  this->dictId = id;
+}
+
+size_t MQTTLz::compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+  // positions are stored in 16 bits
+  if (in == nullptr || out == nullptr || this->dictLen + len >= 0xffff) {
+    return 0;
+  }
+
+  Stream s = {this->dict, this->dictLen, in};
+  Writer w = {out, cap, 0, true};
+
+  // write header, uncompressed length and checksum
+  w.put(this->dictLen > 0 ? MQTT_LZ_MAGIC_DICT : MQTT_LZ_MAGIC);
+  w.put(MQTT_LZ_SIGNATURE_1);
+  w.put(MQTT_LZ_SIGNATURE_2);
+  if (this->dictLen > 0) {
+    w.put(this->dictId);
+  }
+  for (size_t n = len; ; n >>= 7) {
+    w.put((uint8_t)((n & 0x7f) | (n >= 0x80 ? 0x80 : 0)));
+    if (n < 0x80) {
+      break;
+    }
+  }
+  uint32_t sum = lwmqtt_fnv1a(in, len);
+  for (int i = 0; i < 4; i++) {
+    w.put((uint8_t)(sum >> (8 * i)));
+  }
+
+  // index dictionary
+  memset(this->table, 0, sizeof(this->table));
+  for (size_t i = 0; i + MQTT_LZ_MIN_MATCH <= this->dictLen; i++) {
+    this->table[s.hash(i)] = (uint16_t)(i + 1);
+  }
+
+  // find matches
+  size_t end = this->dictLen + len;
+  size_t anchor = this->dictLen;
+  size_t pos = this->dictLen;
+  while (pos + MQTT_LZ_MIN_MATCH <= end && w.ok) {
+    uint32_t h = s.hash(pos);
+    size_t candidate = this->table[h];
+    this->table[h] = (uint16_t)(pos + 1);
+
+    // verify candidate
+    if (candidate == 0 || pos - (candidate - 1) > MQTT_LZ_WINDOW) {
+      pos++;
+      continue;
+    }
+    candidate--;
+    size_t match = 0;
+    while (pos + match < end && s.at(candidate + match) == s.at(pos + match)) {
+      match++;
+    }
+    if (match < MQTT_LZ_MIN_MATCH) {
+      pos++;
+      continue;
+    }
+
+    mqtt_lz_sequence(w, s, anchor, pos - anchor, pos - candidate, match);
+
+    // index covered positions
+    for (size_t i = pos + 1; i < pos + match && i + MQTT_LZ_MIN_MATCH <= end; i++) {
+      this->table[s.hash(i)] = (uint16_t)(i + 1);
+    }
+
+    pos += match;
+    anchor = pos;
+  }
+
+  // write remaining literals
+  mqtt_lz_sequence(w, s, anchor, end - anchor, 0, 0);
+
+  return w.ok ? w.len : 0;
+}
+
+size_t MQTTLz::decompress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+  if (!MQTTLz::compressed(in, len)) {
+    return 0;
+  }
+
+  const uint8_t *p = in + 3;
+  const uint8_t *end = in + len;
+
+  // check dictionary
+  size_t dictLen = 0;
+  if (in[0] == MQTT_LZ_MAGIC_DICT) {
+    if (p >= end || this->dictLen == 0 || *p != this->dictId) {
+      return 0;
+    }
+    dictLen = this->dictLen;
+    p++;
+  }
+
+  // read uncompressed length
+  size_t total = 0;
+  for (int shift = 0;; shift += 7) {
+    if (p >= end || shift > 28) {
+      return 0;
+    }
+    total |= (size_t)(*p & 0x7f) << shift;
+    if ((*p++ & 0x80) == 0) {
+      break;
+    }
+  }
+  if (total > cap || end - p < 4) {
+    return 0;
+  }
+  uint32_t sum = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+  p += 4;
+
+  size_t n = 0;
+  while (p < end) {
+    uint8_t token = *p++;
+
+    // read literal length
+    size_t literals = token >> 4;
+    if (literals == 15) {
+      do {
+        if (p >= end) {
+          return 0;
+        }
+        literals += *p;
+      } while (*p++ == 255);
+    }
+
+    // copy literals
+    if (literals > (size_t)(end - p) || literals > total - n) {
+      return 0;
+    }
+    memcpy(out + n, p, literals);
+    p += literals;
+    n += literals;
+
+    // the last sequence has no match, the checksum rejects data that only looks compressed
+    if (n == total) {
+      return (p == end && lwmqtt_fnv1a(out, n) == sum) ? n : 0;
+    }
+
+    // read offset and match length
+    if (end - p < 2) {
+      return 0;
+    }
+    size_t offset = (size_t)p[0] | (size_t)p[1] << 8;
+    p += 2;
+    size_t match = token & 0x0f;
+    if (match == 15) {
+      do {
+        if (p >= end) {
+          return 0;
+        }
+        match += *p;
+      } while (*p++ == 255);
+    }
+    match += MQTT_LZ_MIN_MATCH;
+    if (offset == 0 || offset > n + dictLen || match > total - n) {
+      return 0;
+    }
+
+    // copy match, which may overlap the output or start in the dictionary
+    for (size_t i = 0; i < match; i++, n++) {
+      size_t from = dictLen + n - offset;
+      out[n] = from < dictLen ? this->dict[from] : out[from - dictLen];
+    }
+  }
+
+  return 0;
+}
+
+bool MQTTLz::compressed(const uint8_t *data, size_t len) {
+  return data != nullptr && len > 3 && (data[0] == MQTT_LZ_MAGIC || data[0] == MQTT_LZ_MAGIC_DICT) &&
+         data[1] == MQTT_LZ_SIGNATURE_1 && data[2] == MQTT_LZ_SIGNATURE_2;
+}
@@ -0,0 +1,40 @@
+#ifndef MQTT_LZ_H
+#define MQTT_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the match table as a power of two (may be overridden with a build flag)
+#ifndef MQTT_LZ_HASH_BITS
+#define MQTT_LZ_HASH_BITS 9
+#endif
+
+// Maximum match distance, also limits the used part of the dictionary
+#ifndef MQTT_LZ_WINDOW
+#define MQTT_LZ_WINDOW 1024
+#endif
+
+// First byte of compressed payloads (invalid in UTF-8 text), followed by the two signature bytes "LZ"
+#define MQTT_LZ_MAGIC 0xfe
+#define MQTT_LZ_MAGIC_DICT 0xff
+#define MQTT_LZ_SIGNATURE_1 'L'
+#define MQTT_LZ_SIGNATURE_2 'Z'
+
+// Byte oriented LZ77 compressor with a fixed window and an optional preset dictionary
+class MQTTLz {
+ private:
+  uint16_t table[1 << MQTT_LZ_HASH_BITS];
+  const uint8_t *dict = nullptr;
+  size_t dictLen = 0;
+  uint8_t dictId = 0;
+
+ public:
+  void setDictionary(const uint8_t *dict, size_t len);
+
+  size_t compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+  size_t decompress(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+  static bool compressed(const uint8_t *data, size_t len);
+};
+
+#endif
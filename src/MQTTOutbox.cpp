@@ -0,0 +1,152 @@
+#include "MQTTOutbox.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+extern "C" {
+#include "lwmqtt/helpers.h"
+}
+
+#define MQTT_OUTBOX_MASK (MQTT_OUTBOX_INDEX_SIZE - 1)
+
+MQTTOutbox::MQTTOutbox(MQTTOutboxSlot *slots, size_t count, uint8_t *buf, size_t slotSize)
+    : slots(slots), count(count), buf(buf), slotSize(slotSize) {
+  this->clear();
+}
+
+bool MQTTOutbox::store(size_t slot, const char topic[], size_t topicLen, const char payload[], size_t length,
+                       bool retained, int qos) {
+  // the topic is stored with a terminator followed by the payload
+  if (topicLen + 1 + length > this->slotSize || length > 0xffff) {
+    return false;
+  }
+
+  uint8_t *data = this->buf + slot * this->slotSize;
+  memcpy(data, topic, topicLen);
+  data[topicLen] = '\0';
+  memcpy(data + topicLen + 1, payload, length);
+
+  MQTTOutboxSlot &s = this->slots[slot];
+  s.topicLen = (uint16_t)topicLen;
+  s.payloadLen = (uint16_t)length;
+  s.qos = (uint8_t)qos;
+  s.retained = retained;
+
+  return true;
+}
+
+bool MQTTOutbox::push(const char topic[], const char payload[], size_t length, bool retained, int qos,
+                      bool conflate) {
+  size_t topicLen = strlen(topic);
+  uint32_t hash = lwmqtt_fnv1a(topic, topicLen);
+
+  // replace a pending message on the same topic in place
+  size_t pos = hash & MQTT_OUTBOX_MASK;
+  if (conflate) {
+    while (this->index[pos] != 0) {
+      size_t slot = this->index[pos] - 1;
+      MQTTOutboxSlot &s = this->slots[slot];
+      if (s.hash == hash && s.topicLen == topicLen && memcmp(this->buf + slot * this->slotSize, topic, topicLen) == 0) {
+        if (!this->store(slot, topic, topicLen, payload, length, retained, qos)) {
+          return false;
+        }
+        this->_conflated++;
+        return true;
+      }
+      pos = (pos + 1) & MQTT_OUTBOX_MASK;
+    }
+  }
+
+  // otherwise append to the tail
+  if (this->len >= this->count) {
+    return false;
+  }
+  size_t slot = (this->head + this->len) % this->count;
+  if (!this->store(slot, topic, topicLen, payload, length, retained, qos)) {
+    return false;
+  }
+  this->len++;
+
+  // index conflated messages while the index is at most three quarters full
+  MQTTOutboxSlot &s = this->slots[slot];
+  s.hash = hash;
+  s.queued = (this->clock != nullptr) ? this->clock() : millis();
+  s.indexed = conflate && this->indexed < MQTT_OUTBOX_INDEX_SIZE * 3 / 4;
+  if (s.indexed) {
+    this->index[pos] = (uint16_t)(slot + 1);
+    this->indexed++;
+  }
+
+  return true;
+}
+
+void MQTTOutbox::unindex(size_t slot) {
+  MQTTOutboxSlot &s = this->slots[slot];
+  if (!s.indexed) {
+    return;
+  }
+  s.indexed = false;
+  this->indexed--;
+
+  // find the entry of the slot
+  size_t i = s.hash & MQTT_OUTBOX_MASK;
+  while (this->index[i] != slot + 1) {
+    i = (i + 1) & MQTT_OUTBOX_MASK;
+  }
+
+  // remove it and shift following entries back that would otherwise become unreachable
+  this->index[i] = 0;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & MQTT_OUTBOX_MASK;
+    if (this->index[j] == 0) {
+      return;
+    }
+    size_t k = this->slots[this->index[j] - 1].hash & MQTT_OUTBOX_MASK;
+    if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+      this->index[i] = this->index[j];
+      this->index[j] = 0;
+      i = j;
+    }
+  }
+}
+
+bool MQTTOutbox::front(MQTTOutboxMessage &message) {
+  if (this->len == 0) {
+    return false;
+  }
+
+  // a message that is being sent can no longer be replaced, later pushes queue a new one
+  this->unindex(this->head);
+
+  MQTTOutboxSlot &s = this->slots[this->head];
+  const char *data = (const char *)this->buf + this->head * this->slotSize;
+  message.topic = data;
+  message.payload = data + s.topicLen + 1;
+  message.length = s.payloadLen;
+  message.retained = s.retained;
+  message.qos = s.qos;
+  message.queued = s.queued;
+
+  return true;
+}
+
+void MQTTOutbox::pop() {
+  if (this->len == 0) {
+    return;
+  }
+
+  this->unindex(this->head);
+  this->head = (this->head + 1) % this->count;
+  this->len--;
+}
+
+void MQTTOutbox::clear() {
+  this->head = 0;
+  this->len = 0;
+  this->indexed = 0;
+  memset(this->index, 0, sizeof(this->index));
+  for (size_t i = 0; i < this->count; i++) {
+    this->slots[i].indexed = false;
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the conflation index, a power of two (may be overridden with a build flag)
+#ifndef MQTT_OUTBOX_INDEX_SIZE
+#define MQTT_OUTBOX_INDEX_SIZE 64
+#endif
+
+// State of a queued message
+typedef struct {
+  uint32_t hash;
+  uint32_t queued;
+  uint16_t topicLen;
+  uint16_t payloadLen;
+  uint8_t qos;
+  bool retained;
+  bool indexed;
+} MQTTOutboxSlot;
+
+// Queued message as returned by front(), the pointers stay valid until pop()
+typedef struct {
+  const char *topic;
+  const char *payload;
+  size_t length;
+  bool retained;
+  int qos;
+  uint32_t queued;  // clock time in milliseconds when the message has been queued
+} MQTTOutboxMessage;
+
+// FIFO of outbound messages in a fixed table of slots, conflated messages replace a pending one on the same topic
+class MQTTOutbox {
+ private:
+  MQTTOutboxSlot *slots;
+  size_t count;
+  uint8_t *buf;
+  size_t slotSize;
+  size_t head = 0;
+  size_t len = 0;
+  size_t indexed = 0;
+  uint32_t _conflated = 0;
+  uint32_t (*clock)() = nullptr;
+  uint16_t index[MQTT_OUTBOX_INDEX_SIZE];
+
+  bool store(size_t slot, const char topic[], size_t topicLen, const char payload[], size_t length, bool retained,
+             int qos);
+  void unindex(size_t slot);
+
+ public:
+  MQTTOutbox(MQTTOutboxSlot *slots, size_t count, uint8_t *buf, size_t slotSize);
+
+  bool push(const char topic[], const char payload[], size_t length, bool retained = false, int qos = 0,
+            bool conflate = false);
+  bool front(MQTTOutboxMessage &message);
+  void pop();
+  void clear();
+
+  // Clock used to stamp queued messages, null restores millis(). Set by the client to its own clock source.
+  void setClock(uint32_t (*cb)()) { this->clock = cb; }
+
+  size_t pending() { return this->len; }
+  uint32_t conflated() { return this->_conflated; }
+};
+
+#endif
@@ -0,0 +1,543 @@
+#include "MQTTSNClient.h"
+
+bool MQTTUDPDatagram::send(const uint8_t *buf, size_t len) {
+  if (this->udp.beginPacket(this->address, this->port) != 1) {
+    return false;
+  }
+  if (this->udp.write(buf, len) != len) {
+    return false;
+  }
+  return this->udp.endPacket() == 1;
+}
+
+size_t MQTTUDPDatagram::receive(uint8_t *buf, size_t cap) {
+  int len = this->udp.parsePacket();
+  if (len <= 0) {
+    return 0;
+  }
+
+  // drop datagrams that do not fit
+  if ((size_t)len > cap) {
+    while (this->udp.available() > 0) {
+      this->udp.read();
+    }
+    return 0;
+  }
+
+  int n = this->udp.read(buf, (size_t)len);
+  return n > 0 ? (size_t)n : 0;
+}
+
+void MQTTLoopbackDatagram::connect(MQTTLoopbackDatagram &other) {
+  this->peer = &other;
+  other.peer = this;
+}
+
+bool MQTTLoopbackDatagram::push(const uint8_t *data, size_t length) {
+  // queue datagram with a length prefix
+  if (length > 0xffff || length + 2 > this->size - this->len) {
+    return false;
+  }
+  this->buf[this->len] = (uint8_t)(length >> 8);
+  this->buf[this->len + 1] = (uint8_t)length;
+  memcpy(this->buf + this->len + 2, data, length);
+  this->len += length + 2;
+
+  return true;
+}
+
+bool MQTTLoopbackDatagram::send(const uint8_t *data, size_t length) {
+  return this->peer != nullptr && this->peer->push(data, length);
+}
+
+size_t MQTTLoopbackDatagram::receive(uint8_t *data, size_t cap) {
+  if (this->len < 2) {
+    return 0;
+  }
+
+  // pop first datagram, drop it if it does not fit
+  size_t length = (size_t)this->buf[0] << 8 | this->buf[1];
+  bool fits = length <= cap;
+  if (fits) {
+    memcpy(data, this->buf + 2, length);
+  }
+  this->len -= length + 2;
+  memmove(this->buf, this->buf + 2 + length, this->len);
+
+  return fits ? length : 0;
+}
+
+MQTTSNClient::MQTTSNClient() { memset(this->topics, 0, sizeof(this->topics)); }
+
+bool MQTTSNClient::connect(const char clientID[], bool cleanSession) {
+  this->close();
+  if (this->transport == nullptr) {
+    this->_lastError = LWMQTT_NETWORK_FAILED_CONNECT;
+    return false;
+  }
+
+  // topic ids registered in the previous connection are no longer valid
+  for (size_t i = 0; i < MQTT_SN_MAX_TOPICS; i++) {
+    if (!this->topics[i].predefined) {
+      this->topics[i].id = 0;
+    }
+  }
+
+  // encode connect packet
+  size_t len;
+  this->_lastError = lwmqtt_sn_encode_connect(this->buf, sizeof(this->buf), &len, lwmqtt_string(clientID),
+                                              this->keepAlive, cleanSession);
+  if (this->_lastError != LWMQTT_SUCCESS || !this->send(len) || !this->await(LWMQTT_SN_CONNACK, 0, len)) {
+    return false;
+  }
+
+  // decode connack packet
+  this->_lastError = lwmqtt_sn_decode_connack(this->buf, len, &this->_returnCode);
+  if (this->_lastError != LWMQTT_SUCCESS) {
+    return false;
+  } else if (this->_returnCode != LWMQTT_SN_ACCEPTED) {
+    this->_lastError = LWMQTT_CONNECTION_DENIED;
+    return false;
+  }
+
+  this->_connected = true;
+
+  return true;
+}
+
+uint16_t MQTTSNClient::registerTopic(const char topic[]) {
+  // check topic
+  size_t topicLen = strlen(topic);
+  if (!this->connected() || topicLen == 0 || topicLen >= MQTT_SN_TOPIC_LENGTH) {
+    return 0;
+  }
+
+  // encode register packet
+  uint16_t msgId = this->nextId();
+  size_t len;
+  this->_lastError = lwmqtt_sn_encode_register(this->buf, sizeof(this->buf), &len, 0, msgId, lwmqtt_string(topic));
+  if (this->_lastError != LWMQTT_SUCCESS || !this->send(len) || !this->await(LWMQTT_SN_REGACK, msgId, len)) {
+    return 0;
+  }
+
+  // decode regack packet
+  uint16_t topicId;
+  this->_lastError = lwmqtt_sn_decode_ack(this->buf, len, LWMQTT_SN_REGACK, &topicId, &msgId, &this->_returnCode);
+  if (this->_lastError != LWMQTT_SUCCESS || this->_returnCode != LWMQTT_SN_ACCEPTED || topicId == 0) {
+    return 0;
+  }
+
+  this->storeTopic(topicId, topic, topicLen, false);
+
+  return topicId;
+}
+
+void MQTTSNClient::predefineTopic(uint16_t topicId, const char topic[]) {
+  this->storeTopic(topicId, topic, strlen(topic), true);
+}
+
+bool MQTTSNClient::publish(const char topic[], const char payload[], int length, bool retained, int qos) {
+  // qos -1 cannot register topics
+  if (qos < 0 && strlen(topic) != 2 && this->findTopic(topic) == nullptr) {
+    this->_lastError = LWMQTT_UNSUPPORTED_QOS;
+    return false;
+  }
+
+  lwmqtt_sn_topic_t topicRef;
+  if (!this->resolve(topic, topicRef)) {
+    return false;
+  }
+
+  return this->publishTopic(topicRef, payload, length, retained, qos);
+}
+
+bool MQTTSNClient::publish(uint16_t topicId, const char payload[], int length, bool retained, int qos) {
+  lwmqtt_sn_topic_t topicRef = {LWMQTT_SN_TOPIC_PREDEFINED, topicId};
+  return this->publishTopic(topicRef, payload, length, retained, qos);
+}
+
+bool MQTTSNClient::subscribe(const char topic[], int qos) {
+  // two character names without wildcards are short topics
+  lwmqtt_sn_topic_t topicRef = {LWMQTT_SN_TOPIC_NORMAL, 0};
+  if (strlen(topic) == 2 && strpbrk(topic, "+#") == nullptr) {
+    topicRef.type = LWMQTT_SN_TOPIC_SHORT;
+    topicRef.id = (uint16_t)((uint8_t)topic[0] << 8 | (uint8_t)topic[1]);
+  }
+
+  return this->subscribeTopic(LWMQTT_SN_SUBSCRIBE, topicRef, topic, qos);
+}
+
+bool MQTTSNClient::subscribe(uint16_t topicId, int qos) {
+  lwmqtt_sn_topic_t topicRef = {LWMQTT_SN_TOPIC_PREDEFINED, topicId};
+  return this->subscribeTopic(LWMQTT_SN_SUBSCRIBE, topicRef, "", qos);
+}
+
+bool MQTTSNClient::unsubscribe(const char topic[]) {
+  lwmqtt_sn_topic_t topicRef = {LWMQTT_SN_TOPIC_NORMAL, 0};
+  if (strlen(topic) == 2 && strpbrk(topic, "+#") == nullptr) {
+    topicRef.type = LWMQTT_SN_TOPIC_SHORT;
+    topicRef.id = (uint16_t)((uint8_t)topic[0] << 8 | (uint8_t)topic[1]);
+  }
+
+  return this->subscribeTopic(LWMQTT_SN_UNSUBSCRIBE, topicRef, topic, 0);
+}
+
+bool MQTTSNClient::loop() {
+  if (this->transport == nullptr) {
+    return false;
+  }
+
+  // handle pending datagrams
+  size_t len;
+  while ((len = this->receive()) > 0) {
+    this->handle(len);
+  }
+
+  if (!this->_connected || this->keepAlive == 0) {
+    return this->_connected;
+  }
+
+  // close the connection if the gateway has been silent for 1.5 times the keep alive
+  uint32_t now = millis();
+  uint32_t interval = (uint32_t)this->keepAlive * 1000;
+  if (now - this->lastReceive > interval + interval / 2) {
+    this->_lastError = LWMQTT_PONG_TIMEOUT;
+    this->close();
+    return false;
+  }
+
+  // send ping if nothing has been sent within the keep alive
+  if (now - this->lastSend >= interval) {
+    this->_lastError = lwmqtt_sn_encode_zero(this->buf, sizeof(this->buf), &len, LWMQTT_SN_PINGREQ);
+    if (this->_lastError != LWMQTT_SUCCESS || !this->send(len)) {
+      this->close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool MQTTSNClient::connected() { return this->transport != nullptr && this->_connected; }
+
+bool MQTTSNClient::disconnect() {
+  if (!this->connected()) {
+    return false;
+  }
+
+  // send disconnect packet without waiting for the response
+  size_t len;
+  this->_lastError = lwmqtt_sn_encode_zero(this->buf, sizeof(this->buf), &len, LWMQTT_SN_DISCONNECT);
+  bool ok = this->_lastError == LWMQTT_SUCCESS && this->send(len);
+  this->close();
+
+  return ok;
+}
+
+uint16_t MQTTSNClient::nextId() {
+  uint16_t id = this->nextMsgId++;
+  if (this->nextMsgId == 0) {
+    this->nextMsgId = 1;
+  }
+  return id;
+}
+
+bool MQTTSNClient::send(size_t len) {
+  if (!this->transport->send(this->buf, len)) {
+    this->_lastError = LWMQTT_NETWORK_FAILED_WRITE;
+    return false;
+  }
+  this->lastSend = millis();
+
+  return true;
+}
+
+size_t MQTTSNClient::receive() {
+  size_t len = this->transport->receive(this->buf, sizeof(this->buf));
+  if (len > 0) {
+    this->lastReceive = millis();
+  }
+  return len;
+}
+
+bool MQTTSNClient::await(lwmqtt_sn_packet_type_t type, uint16_t msgId, size_t &len) {
+  uint32_t start = millis();
+  for (;;) {
+    len = this->receive();
+    if (len == 0) {
+      if (millis() - start >= this->timeout) {
+        this->_lastError = LWMQTT_NETWORK_TIMEOUT;
+        return false;
+      }
+      yield();
+      continue;
+    }
+
+    // check packet type
+    lwmqtt_sn_packet_type_t received;
+    if (lwmqtt_sn_detect_packet_type(this->buf, len, &received) != LWMQTT_SUCCESS) {
+      continue;
+    } else if (received != type) {
+      this->handle(len);
+      continue;
+    }
+
+    // check message id
+    uint16_t id = 0;
+    uint16_t topicId;
+    int qos;
+    lwmqtt_sn_return_code_t rc;
+    if (type == LWMQTT_SN_REGACK || type == LWMQTT_SN_PUBACK) {
+      lwmqtt_sn_decode_ack(this->buf, len, type, &topicId, &id, &rc);
+    } else if (type == LWMQTT_SN_SUBACK) {
+      lwmqtt_sn_decode_suback(this->buf, len, &qos, &topicId, &id, &rc);
+    } else if (type == LWMQTT_SN_UNSUBACK) {
+      lwmqtt_sn_decode_unsuback(this->buf, len, &id);
+    }
+    if (id == msgId) {
+      return true;
+    }
+  }
+}
+
+void MQTTSNClient::handle(size_t len) {
+  lwmqtt_sn_packet_type_t type;
+  if (lwmqtt_sn_detect_packet_type(this->buf, len, &type) != LWMQTT_SUCCESS) {
+    return;
+  }
+
+  switch (type) {
+    case LWMQTT_SN_PUBLISH: {
+      // decode publish packet
+      bool dup;
+      int qos;
+      bool retained;
+      lwmqtt_sn_topic_t topicRef;
+      uint16_t msgId;
+      uint8_t *payload;
+      size_t payloadLen;
+      if (lwmqtt_sn_decode_publish(this->buf, len, &dup, &qos, &retained, &topicRef, &msgId, &payload,
+                                   &payloadLen) != LWMQTT_SUCCESS) {
+        return;
+      }
+
+      // resolve topic name
+      char shortName[3] = {0};
+      const char *name = nullptr;
+      if (topicRef.type == LWMQTT_SN_TOPIC_SHORT) {
+        shortName[0] = (char)(topicRef.id >> 8);
+        shortName[1] = (char)topicRef.id;
+        name = shortName;
+      } else {
+        MQTTSNTopic *topic = this->findTopic(topicRef.id);
+        name = topic != nullptr ? topic->name : nullptr;
+      }
+
+      // call callback for known topics
+      lwmqtt_sn_return_code_t rc = LWMQTT_SN_INVALID_TOPIC_ID;
+      if (name != nullptr) {
+        rc = LWMQTT_SN_ACCEPTED;
+        if (this->callback != nullptr) {
+          this->callback(this, name, topicRef.id, (const char *)payload, payloadLen);
+        }
+      }
+
+      // acknowledge qos 1, the callback may have used the buffer
+      if (qos == 1 || rc != LWMQTT_SN_ACCEPTED) {
+        if (lwmqtt_sn_encode_ack(this->buf, sizeof(this->buf), &len, LWMQTT_SN_PUBACK, topicRef.id, msgId, rc) ==
+            LWMQTT_SUCCESS) {
+          this->send(len);
+        }
+      }
+      return;
+    }
+    case LWMQTT_SN_REGISTER: {
+      // remember topic id assigned by the gateway
+      uint16_t topicId;
+      uint16_t msgId;
+      lwmqtt_string_t name;
+      if (lwmqtt_sn_decode_register(this->buf, len, &topicId, &msgId, &name) != LWMQTT_SUCCESS) {
+        return;
+      }
+      lwmqtt_sn_return_code_t rc = LWMQTT_SN_CONGESTION;
+      if (name.len < MQTT_SN_TOPIC_LENGTH) {
+        this->storeTopic(topicId, name.data, name.len, false);
+        rc = LWMQTT_SN_ACCEPTED;
+      }
+
+      // acknowledge registration
+      if (lwmqtt_sn_encode_ack(this->buf, sizeof(this->buf), &len, LWMQTT_SN_REGACK, topicId, msgId, rc) ==
+          LWMQTT_SUCCESS) {
+        this->send(len);
+      }
+      return;
+    }
+    case LWMQTT_SN_PINGREQ:
+      if (lwmqtt_sn_encode_zero(this->buf, sizeof(this->buf), &len, LWMQTT_SN_PINGRESP) == LWMQTT_SUCCESS) {
+        this->send(len);
+      }
+      return;
+    case LWMQTT_SN_DISCONNECT:
+      this->close();
+      return;
+    default:
+      return;
+  }
+}
+
+bool MQTTSNClient::resolve(const char topic[], lwmqtt_sn_topic_t &topicRef) {
+  // two character names are sent as short topics
+  if (strlen(topic) == 2) {
+    topicRef.type = LWMQTT_SN_TOPIC_SHORT;
+    topicRef.id = (uint16_t)((uint8_t)topic[0] << 8 | (uint8_t)topic[1]);
+    return true;
+  }
+
+  // use known topic id
+  MQTTSNTopic *known = this->findTopic(topic);
+  if (known != nullptr) {
+    topicRef.type = known->predefined ? LWMQTT_SN_TOPIC_PREDEFINED : LWMQTT_SN_TOPIC_NORMAL;
+    topicRef.id = known->id;
+    return true;
+  }
+
+  // register topic
+  topicRef.type = LWMQTT_SN_TOPIC_NORMAL;
+  topicRef.id = this->registerTopic(topic);
+
+  return topicRef.id != 0;
+}
+
+MQTTSNTopic *MQTTSNClient::findTopic(uint16_t id) {
+  for (size_t i = 0; i < MQTT_SN_MAX_TOPICS; i++) {
+    if (this->topics[i].id == id && id != 0) {
+      return &this->topics[i];
+    }
+  }
+  return nullptr;
+}
+
+MQTTSNTopic *MQTTSNClient::findTopic(const char name[]) {
+  for (size_t i = 0; i < MQTT_SN_MAX_TOPICS; i++) {
+    if (this->topics[i].id != 0 && strcmp(this->topics[i].name, name) == 0) {
+      return &this->topics[i];
+    }
+  }
+  return nullptr;
+}
+
+void MQTTSNClient::storeTopic(uint16_t id, const char *name, size_t len, bool predefined) {
+  if (id == 0 || len >= MQTT_SN_TOPIC_LENGTH) {
+    return;
+  }
+
+  // reuse the slot of the same id, a free slot or the last registered one
+  MQTTSNTopic *slot = this->findTopic(id);
+  for (size_t i = 0; slot == nullptr && i < MQTT_SN_MAX_TOPICS; i++) {
+    if (this->topics[i].id == 0) {
+      slot = &this->topics[i];
+    }
+  }
+  for (size_t i = MQTT_SN_MAX_TOPICS; slot == nullptr && i > 0; i--) {
+    if (!this->topics[i - 1].predefined) {
+      slot = &this->topics[i - 1];
+    }
+  }
+  if (slot == nullptr) {
+    return;
+  }
+
+  slot->id = id;
+  slot->predefined = predefined;
+  memcpy(slot->name, name, len);
+  slot->name[len] = '\0';
+}
+
+bool MQTTSNClient::publishTopic(lwmqtt_sn_topic_t topicRef, const char payload[], int length, bool retained,
+                                int qos) {
+  // qos 2 is not supported, qos -1 needs no connection but a short or predefined topic
+  if (qos > 1 || qos < -1 || (qos == -1 && topicRef.type == LWMQTT_SN_TOPIC_NORMAL)) {
+    this->_lastError = LWMQTT_UNSUPPORTED_QOS;
+    return false;
+  } else if (this->transport == nullptr || (qos >= 0 && !this->connected())) {
+    return false;
+  }
+
+  // encode publish packet
+  uint16_t msgId = qos == 1 ? this->nextId() : 0;
+  size_t len;
+  this->_lastError = lwmqtt_sn_encode_publish(this->buf, sizeof(this->buf), &len, false, qos, retained, topicRef,
+                                              msgId, (uint8_t *)payload, (size_t)length);
+  if (this->_lastError != LWMQTT_SUCCESS || !this->send(len)) {
+    return false;
+  } else if (qos < 1) {
+    return true;
+  }
+
+  // await puback
+  if (!this->await(LWMQTT_SN_PUBACK, msgId, len)) {
+    return false;
+  }
+  uint16_t topicId;
+  this->_lastError = lwmqtt_sn_decode_ack(this->buf, len, LWMQTT_SN_PUBACK, &topicId, &msgId, &this->_returnCode);
+  if (this->_lastError != LWMQTT_SUCCESS || this->_returnCode != LWMQTT_SN_ACCEPTED) {
+    // forget a rejected topic id so that it is registered again
+    MQTTSNTopic *topic = this->findTopic(topicRef.id);
+    if (this->_returnCode == LWMQTT_SN_INVALID_TOPIC_ID && topic != nullptr && !topic->predefined) {
+      topic->id = 0;
+    }
+    return false;
+  }
+
+  return true;
+}
+
+bool MQTTSNClient::subscribeTopic(lwmqtt_sn_packet_type_t type, lwmqtt_sn_topic_t topicRef, const char topic[],
+                                  int qos) {
+  if (!this->connected()) {
+    return false;
+  }
+
+  // qos 2 is downgraded as it is not supported
+  if (qos > 1) {
+    qos = 1;
+  } else if (qos < 0) {
+    qos = 0;
+  }
+
+  // encode subscribe packet
+  uint16_t msgId = this->nextId();
+  size_t len;
+  this->_lastError = lwmqtt_sn_encode_subscribe(this->buf, sizeof(this->buf), &len, type, qos, msgId, topicRef,
+                                                lwmqtt_string(topic));
+  if (this->_lastError != LWMQTT_SUCCESS || !this->send(len)) {
+    return false;
+  }
+
+  // await unsuback
+  if (type == LWMQTT_SN_UNSUBSCRIBE) {
+    return this->await(LWMQTT_SN_UNSUBACK, msgId, len);
+  }
+
+  // await suback
+  if (!this->await(LWMQTT_SN_SUBACK, msgId, len)) {
+    return false;
+  }
+  uint16_t topicId;
+  this->_lastError = lwmqtt_sn_decode_suback(this->buf, len, &qos, &topicId, &msgId, &this->_returnCode);
+  if (this->_lastError != LWMQTT_SUCCESS) {
+    return false;
+  } else if (this->_returnCode != LWMQTT_SN_ACCEPTED) {
+    this->_lastError = LWMQTT_FAILED_SUBSCRIPTION;
+    return false;
+  }
+
+  // remember the topic id of names without wildcards
+  if (topicRef.type == LWMQTT_SN_TOPIC_NORMAL && topicId != 0 && strpbrk(topic, "+#") == nullptr) {
+    this->storeTopic(topicId, topic, strlen(topic), false);
+  }
+
+  return true;
+}
+
+void MQTTSNClient::close() { this->_connected = false; }
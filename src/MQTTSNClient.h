@@ -0,0 +1,143 @@
+#ifndef MQTT_SN_CLIENT_H
+#define MQTT_SN_CLIENT_H
+
+#include <Arduino.h>
+#include <Udp.h>
+
+extern "C" {
+#include "lwmqtt/lwmqtt.h"
+#include "lwmqtt/mqttsn.h"
+}
+
+// Size of the datagram buffer (may be overridden with a build flag)
+#ifndef MQTT_SN_BUFFER_SIZE
+#define MQTT_SN_BUFFER_SIZE 64
+#endif
+
+// Number of topic ids remembered per client and their maximum name length
+#ifndef MQTT_SN_MAX_TOPICS
+#define MQTT_SN_MAX_TOPICS 8
+#endif
+#ifndef MQTT_SN_TOPIC_LENGTH
+#define MQTT_SN_TOPIC_LENGTH 32
+#endif
+
+// Datagram transport used by MQTTSNClient
+class MQTTDatagram {
+ public:
+  virtual ~MQTTDatagram() {}
+
+  // send one datagram
+  virtual bool send(const uint8_t *buf, size_t len) = 0;
+
+  // receive one datagram, returns zero if none is pending
+  virtual size_t receive(uint8_t *buf, size_t cap) = 0;
+};
+
+// Datagram transport over an Arduino UDP instance (e.g. WiFiUDP or EthernetUDP)
+class MQTTUDPDatagram : public MQTTDatagram {
+ private:
+  UDP &udp;
+  IPAddress address;
+  uint16_t port;
+
+ public:
+  MQTTUDPDatagram(UDP &udp, IPAddress address, uint16_t port = 1884) : udp(udp), address(address), port(port) {}
+
+  bool send(const uint8_t *buf, size_t len) override;
+  size_t receive(uint8_t *buf, size_t cap) override;
+};
+
+// Pair of in-memory endpoints, e.g. to connect a client to a gateway on the same device or in tests
+class MQTTLoopbackDatagram : public MQTTDatagram {
+ private:
+  uint8_t *buf;
+  size_t size;
+  size_t len = 0;
+  MQTTLoopbackDatagram *peer = nullptr;
+
+ public:
+  MQTTLoopbackDatagram(uint8_t *buf, size_t size) : buf(buf), size(size) {}
+
+  void connect(MQTTLoopbackDatagram &other);
+  bool push(const uint8_t *data, size_t length);
+
+  bool send(const uint8_t *data, size_t length) override;
+  size_t receive(uint8_t *data, size_t cap) override;
+};
+
+class MQTTSNClient;
+
+typedef void (*MQTTSNClientCallback)(MQTTSNClient *client, const char topic[], uint16_t topicId,
+                                     const char payload[], size_t length);
+
+typedef struct {
+  uint16_t id;
+  bool predefined;
+  char name[MQTT_SN_TOPIC_LENGTH];
+} MQTTSNTopic;
+
+class MQTTSNClient {
+ private:
+  uint8_t buf[MQTT_SN_BUFFER_SIZE];
+  MQTTSNTopic topics[MQTT_SN_MAX_TOPICS];
+  MQTTDatagram *transport = nullptr;
+  MQTTSNClientCallback callback = nullptr;
+  uint32_t timeout = 1000;
+  uint32_t lastSend = 0;
+  uint32_t lastReceive = 0;
+  uint16_t keepAlive = 10;
+  uint16_t nextMsgId = 1;
+  bool _connected = false;
+  lwmqtt_sn_return_code_t _returnCode = LWMQTT_SN_ACCEPTED;
+  lwmqtt_err_t _lastError = LWMQTT_SUCCESS;
+
+ public:
+  void *ref = nullptr;
+
+  MQTTSNClient();
+
+  void begin(MQTTDatagram &_transport) { this->transport = &_transport; }
+  void onMessage(MQTTSNClientCallback cb) { this->callback = cb; }
+
+  void setKeepAlive(int _keepAlive) { this->keepAlive = (uint16_t)_keepAlive; }
+  void setTimeout(int _timeout) { this->timeout = (uint32_t)_timeout; }
+
+  bool connect(const char clientID[], bool cleanSession = true);
+
+  uint16_t registerTopic(const char topic[]);
+  void predefineTopic(uint16_t topicId, const char topic[]);
+
+  bool publish(const char topic[], const char payload[]) {
+    return this->publish(topic, payload, (int)strlen(payload), false, 0);
+  }
+  bool publish(const char topic[], const char payload[], int length, bool retained = false, int qos = 0);
+  bool publish(uint16_t topicId, const char payload[], int length, bool retained = false, int qos = 0);
+
+  bool subscribe(const char topic[], int qos = 0);
+  bool subscribe(uint16_t topicId, int qos = 0);
+  bool unsubscribe(const char topic[]);
+
+  bool loop();
+  bool connected();
+  bool disconnect();
+
+  lwmqtt_err_t lastError() { return this->_lastError; }
+  lwmqtt_sn_return_code_t returnCode() { return this->_returnCode; }
+
+ private:
+  uint16_t nextId();
+  bool send(size_t len);
+  size_t receive();
+  bool await(lwmqtt_sn_packet_type_t type, uint16_t msgId, size_t &len);
+  void handle(size_t len);
+  bool resolve(const char topic[], lwmqtt_sn_topic_t &topicRef);
+  MQTTSNTopic *findTopic(uint16_t id);
+  MQTTSNTopic *findTopic(const char name[]);
+  void storeTopic(uint16_t id, const char *name, size_t len, bool predefined);
+  bool publishTopic(lwmqtt_sn_topic_t topicRef, const char payload[], int length, bool retained, int qos);
+  bool subscribeTopic(lwmqtt_sn_packet_type_t type, lwmqtt_sn_topic_t topicRef, const char topic[], int qos);
+  void close();
+};
+
+#endif
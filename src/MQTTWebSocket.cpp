@@ -0,0 +1,363 @@
+#include "MQTTWebSocket.h"
+
+#include <stdio.h>
+
+// opcodes
+#define MQTT_WS_CONTINUATION 0x0
+#define MQTT_WS_BINARY 0x2
+#define MQTT_WS_CLOSE 0x8
+#define MQTT_WS_PING 0x9
+#define MQTT_WS_PONG 0xa
+
+static void mqtt_ws_base64(const uint8_t *in, size_t len, char *out) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0) | (i + 2 < len ? in[i + 2] : 0);
+    *out++ = alphabet[(v >> 18) & 0x3f];
+    *out++ = alphabet[(v >> 12) & 0x3f];
+    *out++ = i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=';
+    *out++ = i + 2 < len ? alphabet[v & 0x3f] : '=';
+  }
+  *out = '\0';
+}
+
+static void mqtt_ws_mask(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t key[4], size_t offset) {
+  // rotate the key to the current position of the frame
+  uint8_t rotated[4];
+  for (size_t i = 0; i < 4; i++) {
+    rotated[i] = key[(offset + i) % 4];
+  }
+  uint32_t word;
+  memcpy(&word, rotated, 4);
+
+  // mask a word at a time, the copies compile to plain loads and stores
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    uint32_t v;
+    memcpy(&v, src + i, 4);
+    v ^= word;
+    memcpy(dst + i, &v, 4);
+  }
+  for (; i < len; i++) {
+    dst[i] = src[i] ^ rotated[i % 4];
+  }
+}
+
+uint32_t MQTTWebSocketClient::nextMask() {
+  // xorshift32, masking keys only need to be unpredictable for intermediaries
+  uint32_t x = this->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  this->seed = x;
+  return x;
+}
+
+int MQTTWebSocketClient::connect(IPAddress ip, uint16_t port) {
+  char host[16];
+  snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  this->stop();
+  if (!this->client.connect(ip, port)) {
+    return 0;
+  }
+  return this->handshake(host, port) ? 1 : 0;
+}
+
+int MQTTWebSocketClient::connect(const char *host, uint16_t port) {
+  this->stop();
+  if (!this->client.connect(host, port)) {
+    return 0;
+  }
+  return this->handshake(host, port) ? 1 : 0;
+}
+
+bool MQTTWebSocketClient::handshake(const char host[], uint16_t port) {
+  // reset state
+  this->state = MQTT_WS_HEADER;
+  this->remaining = 0;
+  this->headerLen = 0;
+  this->seed ^= (uint32_t)micros() ^ (uint32_t)(uintptr_t)this ^ 0x9e3779b9u;
+  if (this->seed == 0) {
+    this->seed = 1;
+  }
+
+  // generate key
+  uint8_t nonce[16];
+  for (size_t i = 0; i < sizeof(nonce); i += 4) {
+    uint32_t r = this->nextMask();
+    memcpy(nonce + i, &r, 4);
+  }
+  char key[25];
+  mqtt_ws_base64(nonce, sizeof(nonce), key);
+
+  // send upgrade request
+  char request[256];
+  int len = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\nHost: %s:%u\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Protocol: mqtt\r\n\r\n",
+                     this->path, host, (unsigned)port, key);
+  if (len <= 0 || (size_t)len >= sizeof(request) ||
+      this->client.write((const uint8_t *)request, (size_t)len) != (size_t)len) {
+    this->client.stop();
+    return false;
+  }
+
+  // read status line and headers until the empty line
+  uint32_t start = millis();
+  char line[16];
+  size_t lineLen = 0;
+  size_t lines = 0;
+  bool upgraded = false;
+  for (;;) {
+    if (millis() - start > this->timeout || !this->client.connected()) {
+      this->client.stop();
+      return false;
+    }
+    if (this->client.available() <= 0) {
+      yield();
+      continue;
+    }
+
+    int c = this->client.read();
+    if (c < 0 || c == '\r') {
+      continue;
+    } else if (c != '\n') {
+      // only the beginning of a line is needed
+      if (lineLen < sizeof(line) - 1) {
+        line[lineLen++] = (char)c;
+      }
+      continue;
+    }
+
+    // handle line
+    line[lineLen] = '\0';
+    if (lines == 0) {
+      upgraded = strncmp(line, "HTTP/1.1 101", 12) == 0;
+    } else if (lineLen == 0) {
+      break;
+    }
+    lineLen = 0;
+    lines++;
+  }
+
+  if (!upgraded) {
+    this->client.stop();
+    return false;
+  }
+
+  this->open = true;
+
+  return true;
+}
+
+bool MQTTWebSocketClient::writeFrame(uint8_t opcode, const uint8_t *buf, size_t size) {
+  uint8_t chunk[MQTT_WS_CHUNK_SIZE];
+
+  // write header with fin bit and mask flag
+  size_t n = 0;
+  chunk[n++] = (uint8_t)(0x80 | opcode);
+  if (size < 126) {
+    chunk[n++] = (uint8_t)(0x80 | size);
+  } else if (size <= 0xffff) {
+    chunk[n++] = 0x80 | 126;
+    chunk[n++] = (uint8_t)(size >> 8);
+    chunk[n++] = (uint8_t)size;
+  } else {
+    chunk[n++] = 0x80 | 127;
+    for (int i = 7; i >= 0; i--) {
+      chunk[n++] = (uint8_t)((uint64_t)size >> (i * 8));
+    }
+  }
+
+  // write masking key
+  uint32_t mask = this->nextMask();
+  uint8_t key[4];
+  memcpy(key, &mask, 4);
+  memcpy(chunk + n, key, 4);
+  n += 4;
+
+  // mask the payload into the chunk behind the header and send it in pieces
+  size_t done = 0;
+  do {
+    size_t len = size - done < sizeof(chunk) - n ? size - done : sizeof(chunk) - n;
+    mqtt_ws_mask(chunk + n, buf + done, len, key, done);
+    if (this->client.write(chunk, n + len) != n + len) {
+      // a partially written frame cannot be continued
+      this->open = false;
+      this->client.stop();
+      return false;
+    }
+    done += len;
+    n = 0;
+  } while (done < size);
+
+  return true;
+}
+
+size_t MQTTWebSocketClient::write(const uint8_t *buf, size_t size) {
+  if (!this->open || size == 0) {
+    return 0;
+  }
+
+  return this->writeFrame(MQTT_WS_BINARY, buf, size) ? size : 0;
+}
+
+int MQTTWebSocketClient::availableForWrite() {
+  // leave room for the largest header of a frame
+  int room = this->client.availableForWrite();
+  return room > 14 ? room - 14 : 0;
+}
+
+bool MQTTWebSocketClient::fill() {
+  for (;;) {
+    if (this->state == MQTT_WS_DATA && this->remaining > 0) {
+      return true;
+    }
+
+    // read control frame payload
+    if (this->state == MQTT_WS_CONTROL) {
+      while (this->controlLen < this->controlNeed) {
+        if (this->client.available() <= 0) {
+          return false;
+        }
+        int c = this->client.read();
+        if (c < 0) {
+          return false;
+        }
+        this->control[this->controlLen++] = (uint8_t)c;
+      }
+      this->state = MQTT_WS_HEADER;
+      this->handleControl();
+      if (!this->open) {
+        return false;
+      }
+      continue;
+    }
+
+    // read frame header, its length depends on the first two bytes
+    size_t need = 2;
+    for (;;) {
+      if (this->headerLen >= 2) {
+        uint8_t len7 = this->header[1] & 0x7f;
+        need = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) + ((this->header[1] & 0x80) ? 4 : 0);
+      }
+      if (this->headerLen >= need) {
+        break;
+      }
+      if (this->client.available() <= 0) {
+        return false;
+      }
+      int c = this->client.read();
+      if (c < 0) {
+        return false;
+      }
+      this->header[this->headerLen++] = (uint8_t)c;
+    }
+    this->headerLen = 0;
+
+    // servers must not mask frames
+    if (this->header[1] & 0x80) {
+      this->stop();
+      return false;
+    }
+
+    // get payload length
+    uint64_t len = this->header[1] & 0x7f;
+    if (len == 126) {
+      len = (uint64_t)this->header[2] << 8 | this->header[3];
+    } else if (len == 127) {
+      len = 0;
+      for (int i = 0; i < 8; i++) {
+        len = len << 8 | this->header[2 + i];
+      }
+    }
+
+    // handle control frames after reading their payload
+    uint8_t opcode = this->header[0] & 0x0f;
+    if (opcode & 0x8) {
+      if (len > sizeof(this->control)) {
+        this->stop();
+        return false;
+      }
+      this->controlOpcode = opcode;
+      this->controlNeed = (uint8_t)len;
+      this->controlLen = 0;
+      this->state = MQTT_WS_CONTROL;
+      continue;
+    }
+
+    // text, binary and continuation frames are treated alike
+    this->remaining = len;
+    this->state = MQTT_WS_DATA;
+  }
+}
+
+void MQTTWebSocketClient::handleControl() {
+  switch (this->controlOpcode) {
+    case MQTT_WS_PING:
+      this->writeFrame(MQTT_WS_PONG, this->control, this->controlLen);
+      break;
+    case MQTT_WS_CLOSE:
+      // echo close and drop the connection
+      this->writeFrame(MQTT_WS_CLOSE, this->control, this->controlLen < 2 ? this->controlLen : 2);
+      this->open = false;
+      this->client.stop();
+      break;
+    default:
+      break;
+  }
+}
+
+int MQTTWebSocketClient::available() {
+  if (!this->fill()) {
+    return 0;
+  }
+
+  int avail = this->client.available();
+  return (uint64_t)avail < this->remaining ? avail : (int)this->remaining;
+}
+
+int MQTTWebSocketClient::read() {
+  if (!this->fill()) {
+    return -1;
+  }
+
+  int c = this->client.read();
+  if (c >= 0) {
+    this->remaining--;
+  }
+  return c;
+}
+
+int MQTTWebSocketClient::read(uint8_t *buf, size_t size) {
+  if (!this->fill()) {
+    return -1;
+  }
+
+  // read up to the end of the frame
+  if (size > this->remaining) {
+    size = (size_t)this->remaining;
+  }
+  int n = this->client.read(buf, size);
+  if (n > 0) {
+    this->remaining -= (uint64_t)n;
+  }
+  return n;
+}
+
+int MQTTWebSocketClient::peek() { return this->fill() ? this->client.peek() : -1; }
+
+void MQTTWebSocketClient::stop() {
+  // send a normal closure
+  if (this->open) {
+    static const uint8_t code[2] = {0x03, 0xe8};
+    this->writeFrame(MQTT_WS_CLOSE, code, sizeof(code));
+    this->open = false;
+  }
+  this->client.stop();
+  this->state = MQTT_WS_HEADER;
+  this->remaining = 0;
+  this->headerLen = 0;
+}
+
+uint8_t MQTTWebSocketClient::connected() { return this->open && this->client.connected(); }
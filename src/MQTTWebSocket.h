@@ -0,0 +1,57 @@
+#ifndef MQTT_WEBSOCKET_H
+#define MQTT_WEBSOCKET_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Size of the stack buffer used to mask outgoing frames (may be overridden with a build flag)
+#ifndef MQTT_WS_CHUNK_SIZE
+#define MQTT_WS_CHUNK_SIZE 128
+#endif
+
+// Client adapter that tunnels the byte stream through RFC 6455 binary frames
+class MQTTWebSocketClient : public Client {
+ private:
+  enum State : uint8_t { MQTT_WS_HEADER, MQTT_WS_DATA, MQTT_WS_CONTROL };
+
+  Client &client;
+  const char *path;
+  uint32_t timeout = 5000;
+  uint32_t seed = 0;
+  uint64_t remaining = 0;
+  uint8_t header[14];
+  uint8_t headerLen = 0;
+  uint8_t control[125];
+  uint8_t controlLen = 0;
+  uint8_t controlNeed = 0;
+  uint8_t controlOpcode = 0;
+  State state = MQTT_WS_HEADER;
+  bool open = false;
+
+  bool handshake(const char host[], uint16_t port);
+  bool fill();
+  void handleControl();
+  bool writeFrame(uint8_t opcode, const uint8_t *buf, size_t size);
+  uint32_t nextMask();
+
+ public:
+  explicit MQTTWebSocketClient(Client &client, const char path[] = "/mqtt") : client(client), path(path) {}
+
+  void setHandshakeTimeout(uint32_t _timeout) { this->timeout = _timeout; }
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override { return this->write(&b, 1); }
+  size_t write(const uint8_t *buf, size_t size) override;
+  int availableForWrite() override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override { this->client.flush(); }
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return this->open; }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "packet.h"
+#include "trace.h"
 
 void lwmqtt_init(lwmqtt_client_t *client, uint8_t *write_buf, size_t write_buf_size, uint8_t *read_buf,
                  size_t read_buf_size) {
@@ -25,6 +26,12 @@ void lwmqtt_init(lwmqtt_client_t *client, uint8_t *write_buf, size_t write_buf_s
 
   client->drop_overflow = false;
   client->overflow_counter = NULL;
+
+#if LWMQTT_MAX_QOS > 0
+  for (int i = 0; i < LWMQTT_INFLIGHT_IDS; i++) {
+    client->inflight_ids[i] = 0;
+  }
+#endif
 }
 
 void lwmqtt_set_network(lwmqtt_client_t *client, void *ref, lwmqtt_network_read_t read, lwmqtt_network_write_t write) {
@@ -49,10 +56,12 @@ void lwmqtt_set_callback(lwmqtt_client_t *client, void *ref, lwmqtt_callback_t c
   client->callback = cb;
 }
 
+#if LWMQTT_DROP_OVERFLOW
 void lwmqtt_drop_overflow(lwmqtt_client_t *client, bool enabled, uint32_t *counter) {
   client->drop_overflow = enabled;
   client->overflow_counter = counter;
 }
+#endif
 
 static uint16_t lwmqtt_get_next_packet_id(lwmqtt_client_t *client) {
   // Increment and wrap (0 is not valid, so wrap from 65535 to 1)
@@ -94,6 +103,7 @@ static lwmqtt_err_t lwmqtt_read_from_network(lwmqtt_client_t *client, size_t off
   return LWMQTT_SUCCESS;
 }
 
+#if LWMQTT_DROP_OVERFLOW
 static lwmqtt_err_t lwmqtt_drain_network(lwmqtt_client_t *client, size_t amount) {
   // read while data is left
   while (amount > 0) {
@@ -123,6 +133,7 @@ static lwmqtt_err_t lwmqtt_drain_network(lwmqtt_client_t *client, size_t amount)
 
   return LWMQTT_SUCCESS;
 }
+#endif
 
 static lwmqtt_err_t lwmqtt_write_to_network(lwmqtt_client_t *client, uint8_t *buf, size_t len) {
   // prepare counter
@@ -165,6 +176,9 @@ static lwmqtt_err_t lwmqtt_read_packet_in_buffer(lwmqtt_client_t *client, size_t
     return err;
   }
 
+  // trace packet start
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_PACKET_READ_BEGIN, client->read_buf[0], 0, 0);
+
   // detect packet type
   err = lwmqtt_detect_packet_type(client->read_buf, 1, packet_type);
   if (err != LWMQTT_SUCCESS) {
@@ -194,6 +208,7 @@ static lwmqtt_err_t lwmqtt_read_packet_in_buffer(lwmqtt_client_t *client, size_t
     return err;
   }
 
+#if LWMQTT_DROP_OVERFLOW
   // handle overflow
   if (client->drop_overflow && 1 + len + rem_len > client->read_buf_size) {
     // drain network
@@ -211,8 +226,12 @@ static lwmqtt_err_t lwmqtt_read_packet_in_buffer(lwmqtt_client_t *client, size_t
       *client->overflow_counter += 1;
     }
 
+    // trace dropped packet
+    LWMQTT_TRACE_EVENT(LWMQTT_TRACE_PACKET_READ_END, LWMQTT_NO_PACKET, 1 + len + rem_len, 0);
+
     return LWMQTT_SUCCESS;
   }
+#endif
 
   // read the rest of the buffer if needed
   if (rem_len > 0) {
@@ -225,6 +244,9 @@ static lwmqtt_err_t lwmqtt_read_packet_in_buffer(lwmqtt_client_t *client, size_t
   // adjust counter
   *read += 1 + len + rem_len;
 
+  // trace packet end
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_PACKET_READ_END, *packet_type, 1 + len + rem_len, 0);
+
   return LWMQTT_SUCCESS;
 }
 
@@ -241,6 +263,31 @@ static lwmqtt_err_t lwmqtt_send_packet_in_buffer(lwmqtt_client_t *client, size_t
   return LWMQTT_SUCCESS;
 }
 
+#if LWMQTT_MAX_QOS > 0
+static uint16_t *lwmqtt_inflight_slot(lwmqtt_client_t *client) {
+  // find a free slot for a packet whose ack is handled in the background
+  for (int i = 0; i < LWMQTT_INFLIGHT_IDS; i++) {
+    if (client->inflight_ids[i] == 0) {
+      return &client->inflight_ids[i];
+    }
+  }
+
+  return NULL;
+}
+
+static bool lwmqtt_inflight_acked(lwmqtt_client_t *client, uint16_t packet_id) {
+  // release the id if the ack belongs to a forward or a publish that skipped its ack
+  for (int i = 0; i < LWMQTT_INFLIGHT_IDS; i++) {
+    if (client->inflight_ids[i] == packet_id) {
+      client->inflight_ids[i] = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+#endif
+
 static lwmqtt_err_t lwmqtt_cycle_once(lwmqtt_client_t *client, size_t *read, lwmqtt_packet_type_t *packet_type) {
   // read next packet from the network
   lwmqtt_err_t err = lwmqtt_read_packet_in_buffer(client, read, packet_type);
@@ -263,9 +310,20 @@ static lwmqtt_err_t lwmqtt_cycle_once(lwmqtt_client_t *client, size_t *read, lwm
         return err;
       }
 
+      // trace decode
+      LWMQTT_TRACE_EVENT(LWMQTT_TRACE_DECODE, LWMQTT_PUBLISH_PACKET, packet_id, msg.payload_len);
+
+      // a broker never sends above the granted level, so a level that has been compiled out is a protocol
+      // violation: drop the message without an ack instead of tearing down the session
+      if (msg.qos > LWMQTT_MAX_QOS) {
+        break;
+      }
+
       // call callback if set
       if (client->callback != NULL) {
+        LWMQTT_TRACE_EVENT(LWMQTT_TRACE_CALLBACK_BEGIN, topic.len, packet_id, msg.payload_len);
         client->callback(client, client->callback_ref, topic, msg);
+        LWMQTT_TRACE_EVENT(LWMQTT_TRACE_CALLBACK_END, topic.len, packet_id, msg.payload_len);
       }
 
       // break early on qos zero
@@ -273,13 +331,14 @@ static lwmqtt_err_t lwmqtt_cycle_once(lwmqtt_client_t *client, size_t *read, lwm
         break;
       }
 
+#if LWMQTT_MAX_QOS > 0
       // define ack packet
-      lwmqtt_packet_type_t ack_type = LWMQTT_NO_PACKET;
-      if (msg.qos == LWMQTT_QOS1) {
-        ack_type = LWMQTT_PUBACK_PACKET;
-      } else if (msg.qos == LWMQTT_QOS2) {
+      lwmqtt_packet_type_t ack_type = LWMQTT_PUBACK_PACKET;
+#if LWMQTT_MAX_QOS > 1
+      if (msg.qos == LWMQTT_QOS2) {
         ack_type = LWMQTT_PUBREC_PACKET;
       }
+#endif
 
       // encode ack packet
       size_t len;
@@ -294,9 +353,14 @@ static lwmqtt_err_t lwmqtt_cycle_once(lwmqtt_client_t *client, size_t *read, lwm
         return err;
       }
 
+      // trace ack
+      LWMQTT_TRACE_EVENT(LWMQTT_TRACE_ACK_SENT, ack_type, packet_id, 0);
+#endif
+
       break;
     }
 
+#if LWMQTT_MAX_QOS > 1
     // handle pubrec packets
     case LWMQTT_PUBREC_PACKET: {
       // decode pubrec packet
@@ -319,6 +383,9 @@ static lwmqtt_err_t lwmqtt_cycle_once(lwmqtt_client_t *client, size_t *read, lwm
         return err;
       }
 
+      // trace ack
+      LWMQTT_TRACE_EVENT(LWMQTT_TRACE_ACK_SENT, LWMQTT_PUBREL_PACKET, packet_id, 0);
+
       break;
     }
 
@@ -344,8 +411,30 @@ static lwmqtt_err_t lwmqtt_cycle_once(lwmqtt_client_t *client, size_t *read, lwm
         return err;
       }
 
+      // trace ack
+      LWMQTT_TRACE_EVENT(LWMQTT_TRACE_ACK_SENT, LWMQTT_PUBCOMP_PACKET, packet_id, 0);
+
       break;
     }
+#endif
+
+#if LWMQTT_MAX_QOS > 0
+    // handle puback and pubcomp packets
+    case LWMQTT_PUBACK_PACKET:
+    case LWMQTT_PUBCOMP_PACKET: {
+      // decode ack packet
+      uint16_t packet_id;
+      err = lwmqtt_decode_ack(client->read_buf, client->read_buf_size, *packet_type, &packet_id);
+      if (err != LWMQTT_SUCCESS) {
+        return err;
+      }
+
+      // release ids handled in the background, other acks are consumed by the waiting command
+      lwmqtt_inflight_acked(client, packet_id);
+
+      break;
+    }
+#endif
 
     // handle pingresp packets
     case LWMQTT_PINGRESP_PACKET: {
@@ -411,6 +500,13 @@ lwmqtt_err_t lwmqtt_connect(lwmqtt_client_t *client, lwmqtt_connect_options_t *o
   // reset pong pending flag
   client->pong_pending = false;
 
+  // forget forwards of the previous connection
+#if LWMQTT_MAX_QOS > 0
+  for (int i = 0; i < LWMQTT_INFLIGHT_IDS; i++) {
+    client->inflight_ids[i] = 0;
+  }
+#endif
+
   // reset return code and session present
   options->return_code = LWMQTT_UNKNOWN_RETURN_CODE;
   options->session_present = false;
@@ -452,6 +548,46 @@ lwmqtt_err_t lwmqtt_connect(lwmqtt_client_t *client, lwmqtt_connect_options_t *o
   return LWMQTT_SUCCESS;
 }
 
+static lwmqtt_err_t lwmqtt_await_publish_ack(lwmqtt_client_t *client, lwmqtt_qos_t qos, uint16_t packet_id) {
+#if LWMQTT_MAX_QOS > 0
+  // define ack packet
+  lwmqtt_packet_type_t ack_type = LWMQTT_NO_PACKET;
+  if (qos == LWMQTT_QOS1) {
+    ack_type = LWMQTT_PUBACK_PACKET;
+  } else if (qos == LWMQTT_QOS2) {
+    ack_type = LWMQTT_PUBCOMP_PACKET;
+  }
+
+  // wait for the ack with the packet id, acks of forwards in between are skipped
+  for (;;) {
+    lwmqtt_packet_type_t packet_type = LWMQTT_NO_PACKET;
+    lwmqtt_err_t err = lwmqtt_cycle_until(client, &packet_type, 0, ack_type);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    } else if (packet_type != ack_type) {
+      return LWMQTT_MISSING_OR_WRONG_PACKET;
+    }
+
+    // decode ack packet
+    uint16_t ack_id;
+    err = lwmqtt_decode_ack(client->read_buf, client->read_buf_size, ack_type, &ack_id);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    } else if (ack_id == packet_id) {
+      return LWMQTT_SUCCESS;
+    } else if (client->timer_get(client->command_timer) <= 0) {
+      return LWMQTT_MISSING_OR_WRONG_PACKET;
+    }
+  }
+#else
+  (void)client;
+  (void)qos;
+  (void)packet_id;
+
+  return LWMQTT_SUCCESS;
+#endif
+}
+
 lwmqtt_err_t lwmqtt_publish(lwmqtt_client_t *client, lwmqtt_publish_options_t *options, lwmqtt_string_t topic,
                             lwmqtt_message_t msg, uint32_t timeout) {
   // ensure default options
@@ -460,12 +596,29 @@ lwmqtt_err_t lwmqtt_publish(lwmqtt_client_t *client, lwmqtt_publish_options_t *o
     options = &def_options;
   }
 
+  // reject levels that have been compiled out
+  if (msg.qos > LWMQTT_MAX_QOS) {
+    return LWMQTT_UNSUPPORTED_QOS;
+  }
+
+  // a skipped ack is tracked in the background, refuse the message up front if no id is free
+#if LWMQTT_MAX_QOS > 0
+  uint16_t *slot = NULL;
+  if (msg.qos != LWMQTT_QOS0 && options->skip_ack) {
+    slot = lwmqtt_inflight_slot(client);
+    if (slot == NULL) {
+      return LWMQTT_NETWORK_WOULD_BLOCK;
+    }
+  }
+#endif
+
   // set command timer
   client->timer_set(client->command_timer, timeout);
 
   // add packet id if at least qos 1
   bool dup = false;
   uint16_t packet_id = 0;
+#if LWMQTT_MAX_QOS > 0
   if (msg.qos == LWMQTT_QOS1 || msg.qos == LWMQTT_QOS2) {
     if (options->dup_id != NULL && *options->dup_id > 0) {
       dup = true;
@@ -477,64 +630,191 @@ lwmqtt_err_t lwmqtt_publish(lwmqtt_client_t *client, lwmqtt_publish_options_t *o
       }
     }
   }
+#endif
 
   // encode publish packet
   size_t len = 0;
-  lwmqtt_err_t err = lwmqtt_encode_publish(client->write_buf, client->write_buf_size, &len, dup, packet_id, topic, msg);
-  if (err != LWMQTT_SUCCESS) {
-    return err;
-  }
+  lwmqtt_err_t err;
+  uint8_t *write_end = client->write_buf + client->write_buf_size;
+  if (msg.payload_len > 0 && msg.payload > client->write_buf && msg.payload < write_end) {
+    // the payload has been written into the write buffer, back-patch the header in front of it
+    err = lwmqtt_publish_header_length(topic, msg, &len);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    } else if ((size_t)(msg.payload - client->write_buf) < len) {
+      return LWMQTT_BUFFER_TOO_SHORT;
+    }
 
-  // send packet (without payload)
-  err = lwmqtt_send_packet_in_buffer(client, len);
-  if (err != LWMQTT_SUCCESS) {
-    return err;
-  }
+    // encode header
+    uint8_t *buf = msg.payload - len;
+    err = lwmqtt_encode_publish(buf, len, &len, dup, packet_id, topic, msg);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
 
-  // send payload if available
-  if (msg.payload_len > 0) {
-    err = lwmqtt_write_to_network(client, msg.payload, msg.payload_len);
+    // send header and payload at once
+    err = lwmqtt_write_to_network(client, buf, len + msg.payload_len);
     if (err != LWMQTT_SUCCESS) {
       return err;
     }
-  }
 
-  // immediately return on qos zero
-  if (msg.qos == LWMQTT_QOS0) {
-    return LWMQTT_SUCCESS;
+    // reset keep alive timer
+    client->timer_set(client->keep_alive_timer, client->keep_alive_interval);
+  } else {
+    err = lwmqtt_encode_publish(client->write_buf, client->write_buf_size, &len, dup, packet_id, topic, msg);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+
+    // send packet (without payload)
+    err = lwmqtt_send_packet_in_buffer(client, len);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+
+    // send payload if available
+    if (msg.payload_len > 0) {
+      err = lwmqtt_write_to_network(client, msg.payload, msg.payload_len);
+      if (err != LWMQTT_SUCCESS) {
+        return err;
+      }
+    }
   }
 
-  // skip if requested
-  if (options->skip_ack) {
+  // immediately return on qos zero or if requested
+  if (msg.qos == LWMQTT_QOS0 || options->skip_ack) {
+#if LWMQTT_MAX_QOS > 0
+    if (slot != NULL) {
+      *slot = packet_id;
+    }
+#endif
     return LWMQTT_SUCCESS;
   }
 
-  // define ack packet
-  lwmqtt_packet_type_t ack_type = LWMQTT_NO_PACKET;
-  if (msg.qos == LWMQTT_QOS1) {
-    ack_type = LWMQTT_PUBACK_PACKET;
-  } else if (msg.qos == LWMQTT_QOS2) {
-    ack_type = LWMQTT_PUBCOMP_PACKET;
-  }
+  return lwmqtt_await_publish_ack(client, msg.qos, packet_id);
+}
 
-  // wait for ack packet
-  lwmqtt_packet_type_t packet_type = LWMQTT_NO_PACKET;
-  err = lwmqtt_cycle_until(client, &packet_type, 0, ack_type);
+lwmqtt_err_t lwmqtt_forward(lwmqtt_client_t *client, uint8_t *buf, size_t buf_len, lwmqtt_string_t prefix,
+                            lwmqtt_qos_t max_qos, uint32_t timeout) {
+  // locate topic, packet id and payload in the received packet
+  bool dup;
+  uint16_t packet_id;
+  lwmqtt_string_t topic;
+  lwmqtt_message_t msg;
+  lwmqtt_err_t err = lwmqtt_decode_publish(buf, buf_len, &dup, &packet_id, &topic, &msg);
   if (err != LWMQTT_SUCCESS) {
     return err;
-  } else if (packet_type != ack_type) {
-    return LWMQTT_MISSING_OR_WRONG_PACKET;
   }
 
-  // decode ack packet
-  err = lwmqtt_decode_ack(client->read_buf, client->read_buf_size, ack_type, &packet_id);
-  if (err != LWMQTT_SUCCESS) {
-    return err;
+  // lower the level if requested
+  bool had_id = msg.qos != LWMQTT_QOS0;
+  if (max_qos < msg.qos) {
+    msg.qos = max_qos;
+  }
+
+  // reject levels that have been compiled out
+  if (msg.qos > LWMQTT_MAX_QOS) {
+    return LWMQTT_UNSUPPORTED_QOS;
+  }
+
+  // the packet id belongs to the sending side and is replaced by a tracked id of this client
+  packet_id = 0;
+#if LWMQTT_MAX_QOS > 0
+  uint16_t *slot = NULL;
+  if (msg.qos != LWMQTT_QOS0) {
+    slot = lwmqtt_inflight_slot(client);
+    if (slot == NULL) {
+      return LWMQTT_NETWORK_WOULD_BLOCK;
+    }
+    packet_id = lwmqtt_get_next_packet_id(client);
+  }
+#endif
+
+  // set command timer
+  client->timer_set(client->command_timer, timeout);
+
+  // fixed header of the forwarded packet, the retained flag is kept
+  uint8_t header = buf[0];
+  lwmqtt_write_bits(&header, 0, 3, 1);
+  lwmqtt_write_bits(&header, (uint8_t)msg.qos, 1, 2);
+
+  if (prefix.len == 0 && had_id == (msg.qos != LWMQTT_QOS0)) {
+    // the layout is unchanged, patch the header and packet id in place and send the packet at once
+    buf[0] = header;
+    if (had_id) {
+      uint8_t *id_ptr = (uint8_t *)topic.data + topic.len;
+      lwmqtt_write_num(&id_ptr, id_ptr + 2, packet_id);
+    }
+    err = lwmqtt_write_to_network(client, buf, (size_t)(msg.payload + msg.payload_len - buf));
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+  } else {
+    // encode a new header with the prefixed topic into the write buffer
+    uint8_t *buf_ptr = client->write_buf;
+    uint8_t *buf_end = client->write_buf + client->write_buf_size;
+    uint32_t rem_len = 2 + prefix.len + topic.len + (msg.qos != LWMQTT_QOS0 ? 2 : 0) + (uint32_t)msg.payload_len;
+    err = lwmqtt_write_byte(&buf_ptr, buf_end, header);
+    if (err == LWMQTT_SUCCESS) {
+      err = lwmqtt_write_varnum(&buf_ptr, buf_end, rem_len);
+    }
+    if (err == LWMQTT_SUCCESS) {
+      err = lwmqtt_write_num(&buf_ptr, buf_end, (uint16_t)(prefix.len + topic.len));
+    }
+    if (err == LWMQTT_SUCCESS) {
+      err = lwmqtt_write_data(&buf_ptr, buf_end, (uint8_t *)prefix.data, prefix.len);
+    }
+    if (err == LWMQTT_SUCCESS) {
+      err = lwmqtt_write_data(&buf_ptr, buf_end, (uint8_t *)topic.data, topic.len);
+    }
+    if (err == LWMQTT_SUCCESS && msg.qos != LWMQTT_QOS0) {
+      err = lwmqtt_write_num(&buf_ptr, buf_end, packet_id);
+    }
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+
+    // send header, the payload follows from the received packet
+    err = lwmqtt_write_to_network(client, client->write_buf, (size_t)(buf_ptr - client->write_buf));
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+    if (msg.payload_len > 0) {
+      err = lwmqtt_write_to_network(client, msg.payload, msg.payload_len);
+      if (err != LWMQTT_SUCCESS) {
+        return err;
+      }
+    }
   }
 
+  // reset keep alive timer
+  client->timer_set(client->keep_alive_timer, client->keep_alive_interval);
+
+#if LWMQTT_MAX_QOS > 0
+  // track the id, the ack is handled by a later cycle (pubrec is answered, puback and pubcomp release the id)
+  if (slot != NULL) {
+    *slot = packet_id;
+  }
+#endif
+
   return LWMQTT_SUCCESS;
 }
 
+int lwmqtt_inflight(lwmqtt_client_t *client) {
+  int count = 0;
+#if LWMQTT_MAX_QOS > 0
+  for (int i = 0; i < LWMQTT_INFLIGHT_IDS; i++) {
+    if (client->inflight_ids[i] != 0) {
+      count++;
+    }
+  }
+#else
+  (void)client;
+#endif
+
+  return count;
+}
+
 lwmqtt_err_t lwmqtt_subscribe(lwmqtt_client_t *client, int count, lwmqtt_string_t *topic_filter, lwmqtt_qos_t *qos,
                               uint32_t timeout) {
   // set command timer
@@ -587,6 +867,7 @@ lwmqtt_err_t lwmqtt_subscribe_one(lwmqtt_client_t *client, lwmqtt_string_t topic
   return lwmqtt_subscribe(client, 1, &topic_filter, &qos, timeout);
 }
 
+#if LWMQTT_UNSUBSCRIBE
 lwmqtt_err_t lwmqtt_unsubscribe(lwmqtt_client_t *client, int count, lwmqtt_string_t *topic_filter, uint32_t timeout) {
   // set command timer
   client->timer_set(client->command_timer, timeout);
@@ -627,6 +908,7 @@ lwmqtt_err_t lwmqtt_unsubscribe(lwmqtt_client_t *client, int count, lwmqtt_strin
 lwmqtt_err_t lwmqtt_unsubscribe_one(lwmqtt_client_t *client, lwmqtt_string_t topic_filter, uint32_t timeout) {
   return lwmqtt_unsubscribe(client, 1, &topic_filter, timeout);
 }
+#endif
 
 lwmqtt_err_t lwmqtt_disconnect(lwmqtt_client_t *client, uint32_t timeout) {
   // set command timer
@@ -699,5 +981,8 @@ lwmqtt_err_t lwmqtt_keep_alive(lwmqtt_client_t *client, uint32_t timeout) {
   // set flag
   client->pong_pending = true;
 
+  // trace ping
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_KEEP_ALIVE, LWMQTT_PINGREQ_PACKET, 0, 0);
+
   return LWMQTT_SUCCESS;
 }
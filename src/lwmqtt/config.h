@@ -0,0 +1,70 @@
+#ifndef LWMQTT_CONFIG_H
+#define LWMQTT_CONFIG_H
+
+/**
+ * Compile-time feature switches. Disabled features are compiled out of the client, the packet codec and the Arduino
+ * wrapper to save flash and branches on the hot path.
+ *
+ * The switches must be the same for all translation units, set them with build flags (e.g. "-DLWMQTT_MAX_QOS=0") or
+ * edit the defaults below.
+ */
+
+/**
+ * The minimal profile keeps QoS 0 publish and subscribe only.
+ */
+#ifdef LWMQTT_PROFILE_MINIMAL
+#ifndef LWMQTT_MAX_QOS
+#define LWMQTT_MAX_QOS 0
+#endif
+#ifndef LWMQTT_WILL
+#define LWMQTT_WILL 0
+#endif
+#ifndef LWMQTT_UNSUBSCRIBE
+#define LWMQTT_UNSUBSCRIBE 0
+#endif
+#ifndef LWMQTT_DROP_OVERFLOW
+#define LWMQTT_DROP_OVERFLOW 0
+#endif
+#ifndef MQTT_NO_FUNCTIONAL
+#define MQTT_NO_FUNCTIONAL
+#endif
+#endif
+
+/**
+ * The highest supported QoS level (0, 1 or 2) for publishing and receiving. Publishing and subscribing above it fail
+ * with LWMQTT_UNSUPPORTED_QOS, received messages above it are dropped without an ack.
+ */
+#ifndef LWMQTT_MAX_QOS
+#define LWMQTT_MAX_QOS 2
+#endif
+
+/**
+ * Support for last will messages.
+ */
+#ifndef LWMQTT_WILL
+#define LWMQTT_WILL 1
+#endif
+
+/**
+ * Support for unsubscribing.
+ */
+#ifndef LWMQTT_UNSUBSCRIBE
+#define LWMQTT_UNSUBSCRIBE 1
+#endif
+
+/**
+ * Support for dropping packets that overflow the read buffer.
+ */
+#ifndef LWMQTT_DROP_OVERFLOW
+#define LWMQTT_DROP_OVERFLOW 1
+#endif
+
+/**
+ * The number of QoS 1 and 2 packets whose ack is handled in the background (forwards and publishes with skip_ack)
+ * that may be in flight at the same time.
+ */
+#ifndef LWMQTT_INFLIGHT_IDS
+#define LWMQTT_INFLIGHT_IDS 8
+#endif
+
+#endif  // LWMQTT_CONFIG_H
@@ -155,4 +155,13 @@ lwmqtt_err_t lwmqtt_read_varnum(uint8_t **buf, const uint8_t *buf_end, uint32_t
  */
 lwmqtt_err_t lwmqtt_write_varnum(uint8_t **buf, const uint8_t *buf_end, uint32_t varnum);
 
+/**
+ * Computes the 32-bit FNV-1a hash of the specified bytes.
+ *
+ * @param data Pointer to the bytes.
+ * @param len The number of bytes.
+ * @return The hash.
+ */
+uint32_t lwmqtt_fnv1a(const void *data, size_t len);
+
 #endif
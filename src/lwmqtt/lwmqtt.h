@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "config.h"
+
 /**
  * The error type used by all exposed APIs.
  *
@@ -27,6 +29,8 @@ typedef enum {
   LWMQTT_FAILED_SUBSCRIPTION = -11,
   LWMQTT_SUBACK_ARRAY_OVERFLOW = -12,
   LWMQTT_PONG_TIMEOUT = -13,
+  LWMQTT_NETWORK_WOULD_BLOCK = -14,
+  LWMQTT_UNSUPPORTED_QOS = -15,
 } lwmqtt_err_t;
 
 /**
@@ -238,6 +242,10 @@ struct lwmqtt_client_t {
 
   bool drop_overflow;
   uint32_t *overflow_counter;
+
+#if LWMQTT_MAX_QOS > 0
+  uint16_t inflight_ids[LWMQTT_INFLIGHT_IDS];
+#endif
 };
 
 /**
@@ -283,6 +291,7 @@ void lwmqtt_set_timers(lwmqtt_client_t *client, void *keep_alive_timer, void *co
  */
 void lwmqtt_set_callback(lwmqtt_client_t *client, void *ref, lwmqtt_callback_t cb);
 
+#if LWMQTT_DROP_OVERFLOW
 /**
  * Will configure the client to drop packets that overflow the read buffer. If a counter is provided it will be
  * incremented with each dropped packet.
@@ -292,6 +301,7 @@ void lwmqtt_set_callback(lwmqtt_client_t *client, void *ref, lwmqtt_callback_t c
  * @param counter The dropped packet counter.
  */
 void lwmqtt_drop_overflow(lwmqtt_client_t *client, bool enabled, uint32_t *counter);
+#endif
 
 /**
  * Will send a connect packet and wait for a connack response. If options are provided they are used for the
@@ -313,10 +323,16 @@ lwmqtt_err_t lwmqtt_connect(lwmqtt_client_t *client, lwmqtt_connect_options_t *o
  * Will send a publish packet and wait for all acks to complete. If the encoded packet (without payload) is bigger than
  * the write buffer the function will return LWMQTT_BUFFER_TOO_SHORT without attempting to send the packet.
  *
+ * Messages with a QoS above LWMQTT_MAX_QOS are rejected with LWMQTT_UNSUPPORTED_QOS.
+ *
  * If options.dup_id is present and zero, the client will store the used packet id at the specified location (QoS >= 1).
  * If options.dup_id is present and non-zero, the client will use the specified number as the packet id and flag the
  * message as a duplicate (QoS >= 1).
  *
+ * If options.skip_ack is set, the call returns once the packet has been written. The packet id of a QoS 1 or 2
+ * message is then tracked like a forward (see lwmqtt_forward()), and LWMQTT_NETWORK_WOULD_BLOCK is returned without
+ * writing if all LWMQTT_INFLIGHT_IDS ids are in flight.
+ *
  * Note: The message callback might be called with incoming messages as part of this call.
  *
  * @param client The client object.
@@ -329,9 +345,45 @@ lwmqtt_err_t lwmqtt_connect(lwmqtt_client_t *client, lwmqtt_connect_options_t *o
 lwmqtt_err_t lwmqtt_publish(lwmqtt_client_t *client, lwmqtt_publish_options_t *options, lwmqtt_string_t topic,
                             lwmqtt_message_t msg, uint32_t timeout);
 
+/**
+ * Will forward a publish packet received by another client without decoding and re-encoding the message. Only the
+ * fixed header, the packet id and the optional topic prefix are rewritten, the payload is sent from the supplied
+ * buffer. The acks of the receiving client are not affected.
+ *
+ * If neither a prefix is added nor the presence of the packet id changes, the packet is patched in place and sent
+ * with a single write. The fixed header and packet id in the supplied buffer are then overwritten, the topic and
+ * payload are left untouched. Otherwise the new header is encoded into the write buffer.
+ *
+ * The call returns once the packet has been written and does not read from the network, so it may be called from
+ * the message callback of the other client. The packet ids of QoS 1 and 2 forwards are tracked until their ack is
+ * handled by a later call to lwmqtt_yield() or skipped while awaiting the ack of an own publish. If all
+ * LWMQTT_INFLIGHT_IDS ids are in flight, nothing is written and LWMQTT_NETWORK_WOULD_BLOCK is returned. Forwards still
+ * in flight when the client reconnects are forgotten.
+ *
+ * @param client The client object.
+ * @param buf The buffer holding the received publish packet (e.g. the read buffer of the other client).
+ * @param buf_len The length of the specified buffer.
+ * @param prefix The topic prefix, may be empty.
+ * @param max_qos The highest QoS level to forward with, higher levels are lowered.
+ * @param timeout The command timeout.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_forward(lwmqtt_client_t *client, uint8_t *buf, size_t buf_len, lwmqtt_string_t prefix,
+                            lwmqtt_qos_t max_qos, uint32_t timeout);
+
+/**
+ * Will return the number of QoS 1 and 2 forwards and publishes with skip_ack that await their ack.
+ *
+ * @param client The client object.
+ * @return The number of packets in flight.
+ */
+int lwmqtt_inflight(lwmqtt_client_t *client);
+
 /**
  * Will send a subscribe packet with multiple topic filters plus QOS levels and wait for the suback to complete.
  *
+ * QOS levels above LWMQTT_MAX_QOS are rejected with LWMQTT_UNSUPPORTED_QOS.
+ *
  * Note: The message callback might be called with incoming messages as part of this call.
  *
  * @param client The client object.
@@ -358,6 +410,7 @@ lwmqtt_err_t lwmqtt_subscribe(lwmqtt_client_t *client, int count, lwmqtt_string_
 lwmqtt_err_t lwmqtt_subscribe_one(lwmqtt_client_t *client, lwmqtt_string_t topic_filter, lwmqtt_qos_t qos,
                                   uint32_t timeout);
 
+#if LWMQTT_UNSUBSCRIBE
 /**
  * Will send an unsubscribe packet with multiple topic filters and wait for the unsuback to complete.
  *
@@ -382,6 +435,7 @@ lwmqtt_err_t lwmqtt_unsubscribe(lwmqtt_client_t *client, int count, lwmqtt_strin
  * @return An error value.
  */
 lwmqtt_err_t lwmqtt_unsubscribe_one(lwmqtt_client_t *client, lwmqtt_string_t topic_filter, uint32_t timeout);
+#endif
 
 /**
  * Will send a disconnect packet and finish the client.
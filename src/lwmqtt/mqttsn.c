@@ -0,0 +1,515 @@
+#include "mqttsn.h"
+
+static lwmqtt_err_t lwmqtt_sn_write_header(uint8_t **buf, const uint8_t *buf_end, size_t body_len,
+                                           lwmqtt_sn_packet_type_t packet_type) {
+  // a length above 255 is encoded in three bytes
+  size_t total = body_len + 2;
+  lwmqtt_err_t err;
+  if (total <= 255) {
+    err = lwmqtt_write_byte(buf, buf_end, (uint8_t)total);
+  } else if (body_len + 4 <= 0xffff) {
+    err = lwmqtt_write_byte(buf, buf_end, 0x01);
+    if (err == LWMQTT_SUCCESS) {
+      err = lwmqtt_write_num(buf, buf_end, (uint16_t)(body_len + 4));
+    }
+  } else {
+    return LWMQTT_REMAINING_LENGTH_OVERFLOW;
+  }
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write message type
+  return lwmqtt_write_byte(buf, buf_end, (uint8_t)packet_type);
+}
+
+static lwmqtt_err_t lwmqtt_sn_read_header(uint8_t **buf, uint8_t **buf_end, lwmqtt_sn_packet_type_t packet_type) {
+  uint8_t *start = *buf;
+
+  // read length
+  uint8_t byte;
+  lwmqtt_err_t err = lwmqtt_read_byte(buf, *buf_end, &byte);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+  size_t total = byte;
+  if (byte == 0x01) {
+    uint16_t num;
+    err = lwmqtt_read_num(buf, *buf_end, &num);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+    total = num;
+  }
+
+  // check length
+  if (total < (size_t)(*buf - start) + 1 || total > (size_t)(*buf_end - start)) {
+    return LWMQTT_REMAINING_LENGTH_MISMATCH;
+  }
+  *buf_end = start + total;
+
+  // read message type
+  err = lwmqtt_read_byte(buf, *buf_end, &byte);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check packet type
+  if (byte != (uint8_t)packet_type) {
+    return LWMQTT_MISSING_OR_WRONG_PACKET;
+  }
+
+  return LWMQTT_SUCCESS;
+}
+
+static uint8_t lwmqtt_sn_flags(bool dup, int qos, bool retained, lwmqtt_sn_topic_type_t topic_type) {
+  uint8_t flags = 0;
+  lwmqtt_write_bits(&flags, (uint8_t)dup, 7, 1);
+  lwmqtt_write_bits(&flags, (uint8_t)(qos < 0 ? 3 : qos), 5, 2);
+  lwmqtt_write_bits(&flags, (uint8_t)retained, 4, 1);
+  lwmqtt_write_bits(&flags, (uint8_t)topic_type, 0, 2);
+  return flags;
+}
+
+static int lwmqtt_sn_qos(uint8_t flags) {
+  uint8_t qos = lwmqtt_read_bits(flags, 5, 2);
+  return qos == 3 ? -1 : (int)qos;
+}
+
+lwmqtt_err_t lwmqtt_sn_detect_packet_type(uint8_t *buf, size_t buf_len, lwmqtt_sn_packet_type_t *packet_type) {
+  // read length
+  if (buf_len < 2) {
+    return LWMQTT_BUFFER_TOO_SHORT;
+  }
+  size_t total = buf[0];
+  size_t offset = 1;
+  if (buf[0] == 0x01) {
+    if (buf_len < 4) {
+      return LWMQTT_BUFFER_TOO_SHORT;
+    }
+    total = (size_t)buf[1] << 8 | buf[2];
+    offset = 3;
+  }
+
+  // check length
+  if (total != buf_len) {
+    return LWMQTT_REMAINING_LENGTH_MISMATCH;
+  }
+
+  *packet_type = (lwmqtt_sn_packet_type_t)buf[offset];
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_encode_connect(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_string_t client_id,
+                                      uint16_t duration, bool clean_session) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  lwmqtt_err_t err = lwmqtt_sn_write_header(&buf_ptr, buf_end, 4 + (size_t)client_id.len, LWMQTT_SN_CONNECT);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write flags
+  uint8_t flags = 0;
+  lwmqtt_write_bits(&flags, (uint8_t)clean_session, 2, 1);
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, flags);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write protocol id
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, 0x01);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write duration
+  err = lwmqtt_write_num(&buf_ptr, buf_end, duration);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write client id
+  err = lwmqtt_write_data(&buf_ptr, buf_end, (uint8_t *)client_id.data, client_id.len);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_decode_connack(uint8_t *buf, size_t buf_len, lwmqtt_sn_return_code_t *return_code) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  lwmqtt_err_t err = lwmqtt_sn_read_header(&buf_ptr, &buf_end, LWMQTT_SN_CONNACK);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read return code
+  uint8_t rc;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &rc);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+  *return_code = (lwmqtt_sn_return_code_t)rc;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_encode_register(uint8_t *buf, size_t buf_len, size_t *len, uint16_t topic_id, uint16_t msg_id,
+                                       lwmqtt_string_t topic_name) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  lwmqtt_err_t err = lwmqtt_sn_write_header(&buf_ptr, buf_end, 4 + (size_t)topic_name.len, LWMQTT_SN_REGISTER);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write topic id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, topic_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write message id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write topic name
+  err = lwmqtt_write_data(&buf_ptr, buf_end, (uint8_t *)topic_name.data, topic_name.len);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_decode_register(uint8_t *buf, size_t buf_len, uint16_t *topic_id, uint16_t *msg_id,
+                                       lwmqtt_string_t *topic_name) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  lwmqtt_err_t err = lwmqtt_sn_read_header(&buf_ptr, &buf_end, LWMQTT_SN_REGISTER);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read topic id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, topic_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read message id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // the rest is the topic name
+  topic_name->len = (uint16_t)(buf_end - buf_ptr);
+  topic_name->data = (char *)buf_ptr;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_encode_ack(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_sn_packet_type_t packet_type,
+                                  uint16_t topic_id, uint16_t msg_id, lwmqtt_sn_return_code_t return_code) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  lwmqtt_err_t err = lwmqtt_sn_write_header(&buf_ptr, buf_end, 5, packet_type);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write topic id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, topic_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write message id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write return code
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, (uint8_t)return_code);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_decode_ack(uint8_t *buf, size_t buf_len, lwmqtt_sn_packet_type_t packet_type,
+                                  uint16_t *topic_id, uint16_t *msg_id, lwmqtt_sn_return_code_t *return_code) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  lwmqtt_err_t err = lwmqtt_sn_read_header(&buf_ptr, &buf_end, packet_type);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check length
+  if (buf_end - buf_ptr != 5) {
+    return LWMQTT_REMAINING_LENGTH_MISMATCH;
+  }
+
+  // read topic id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, topic_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read message id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read return code
+  uint8_t rc;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &rc);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+  *return_code = (lwmqtt_sn_return_code_t)rc;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_encode_publish(uint8_t *buf, size_t buf_len, size_t *len, bool dup, int qos, bool retained,
+                                      lwmqtt_sn_topic_t topic, uint16_t msg_id, uint8_t *payload, size_t payload_len) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  lwmqtt_err_t err = lwmqtt_sn_write_header(&buf_ptr, buf_end, 5 + payload_len, LWMQTT_SN_PUBLISH);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write flags
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, lwmqtt_sn_flags(dup, qos, retained, topic.type));
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write topic id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, topic.id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write message id, zero for qos 0 and -1
+  err = lwmqtt_write_num(&buf_ptr, buf_end, qos > 0 ? msg_id : 0);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write payload
+  err = lwmqtt_write_data(&buf_ptr, buf_end, payload, payload_len);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_decode_publish(uint8_t *buf, size_t buf_len, bool *dup, int *qos, bool *retained,
+                                      lwmqtt_sn_topic_t *topic, uint16_t *msg_id, uint8_t **payload,
+                                      size_t *payload_len) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  lwmqtt_err_t err = lwmqtt_sn_read_header(&buf_ptr, &buf_end, LWMQTT_SN_PUBLISH);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read flags
+  uint8_t flags;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &flags);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+  *dup = lwmqtt_read_bits(flags, 7, 1) == 1;
+  *qos = lwmqtt_sn_qos(flags);
+  *retained = lwmqtt_read_bits(flags, 4, 1) == 1;
+  topic->type = (lwmqtt_sn_topic_type_t)lwmqtt_read_bits(flags, 0, 2);
+
+  // read topic id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, &topic->id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read message id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // the rest is the payload
+  *payload_len = buf_end - buf_ptr;
+  *payload = *payload_len > 0 ? buf_ptr : NULL;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_encode_subscribe(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_sn_packet_type_t packet_type,
+                                        int qos, uint16_t msg_id, lwmqtt_sn_topic_t topic, lwmqtt_string_t topic_name) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  size_t topic_len = topic.type == LWMQTT_SN_TOPIC_NORMAL ? topic_name.len : 2;
+  lwmqtt_err_t err = lwmqtt_sn_write_header(&buf_ptr, buf_end, 3 + topic_len, packet_type);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write flags
+  if (packet_type == LWMQTT_SN_UNSUBSCRIBE) {
+    qos = 0;
+  }
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, lwmqtt_sn_flags(false, qos, false, topic.type));
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write message id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write topic name or id
+  if (topic.type == LWMQTT_SN_TOPIC_NORMAL) {
+    err = lwmqtt_write_data(&buf_ptr, buf_end, (uint8_t *)topic_name.data, topic_name.len);
+  } else {
+    err = lwmqtt_write_num(&buf_ptr, buf_end, topic.id);
+  }
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_decode_suback(uint8_t *buf, size_t buf_len, int *qos, uint16_t *topic_id, uint16_t *msg_id,
+                                     lwmqtt_sn_return_code_t *return_code) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  lwmqtt_err_t err = lwmqtt_sn_read_header(&buf_ptr, &buf_end, LWMQTT_SN_SUBACK);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read flags
+  uint8_t flags;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &flags);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+  *qos = lwmqtt_sn_qos(flags);
+
+  // read topic id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, topic_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read message id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, msg_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read return code
+  uint8_t rc;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &rc);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+  *return_code = (lwmqtt_sn_return_code_t)rc;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_sn_decode_unsuback(uint8_t *buf, size_t buf_len, uint16_t *msg_id) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  lwmqtt_err_t err = lwmqtt_sn_read_header(&buf_ptr, &buf_end, LWMQTT_SN_UNSUBACK);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read message id
+  return lwmqtt_read_num(&buf_ptr, buf_end, msg_id);
+}
+
+lwmqtt_err_t lwmqtt_sn_encode_zero(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_sn_packet_type_t packet_type) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  lwmqtt_err_t err = lwmqtt_sn_write_header(&buf_ptr, buf_end, 0, packet_type);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+#ifndef LWMQTT_MQTTSN_H
+#define LWMQTT_MQTTSN_H
+
+#include "helpers.h"
+
+/**
+ * The supported MQTT-SN (v1.2) packet types.
+ */
+typedef enum {
+  LWMQTT_SN_CONNECT = 0x04,
+  LWMQTT_SN_CONNACK = 0x05,
+  LWMQTT_SN_REGISTER = 0x0a,
+  LWMQTT_SN_REGACK = 0x0b,
+  LWMQTT_SN_PUBLISH = 0x0c,
+  LWMQTT_SN_PUBACK = 0x0d,
+  LWMQTT_SN_SUBSCRIBE = 0x12,
+  LWMQTT_SN_SUBACK = 0x13,
+  LWMQTT_SN_UNSUBSCRIBE = 0x14,
+  LWMQTT_SN_UNSUBACK = 0x15,
+  LWMQTT_SN_PINGREQ = 0x16,
+  LWMQTT_SN_PINGRESP = 0x17,
+  LWMQTT_SN_DISCONNECT = 0x18
+} lwmqtt_sn_packet_type_t;
+
+/**
+ * The MQTT-SN topic id types.
+ */
+typedef enum {
+  LWMQTT_SN_TOPIC_NORMAL = 0,
+  LWMQTT_SN_TOPIC_PREDEFINED = 1,
+  LWMQTT_SN_TOPIC_SHORT = 2
+} lwmqtt_sn_topic_type_t;
+
+/**
+ * The MQTT-SN return codes.
+ */
+typedef enum {
+  LWMQTT_SN_ACCEPTED = 0,
+  LWMQTT_SN_CONGESTION = 1,
+  LWMQTT_SN_INVALID_TOPIC_ID = 2,
+  LWMQTT_SN_NOT_SUPPORTED = 3
+} lwmqtt_sn_return_code_t;
+
+/**
+ * A topic reference. Short topic names are stored as the two characters in network byte order.
+ */
+typedef struct {
+  lwmqtt_sn_topic_type_t type;
+  uint16_t id;
+} lwmqtt_sn_topic_t;
+
+/**
+ * Detects the packet type and validates the length field of a datagram.
+ *
+ * @param buf The datagram.
+ * @param buf_len The length of the datagram.
+ * @param packet_type The packet type.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_detect_packet_type(uint8_t *buf, size_t buf_len, lwmqtt_sn_packet_type_t *packet_type);
+
+/**
+ * Encodes a connect packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param client_id The client id.
+ * @param duration The keep alive duration in seconds.
+ * @param clean_session The clean session flag.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_encode_connect(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_string_t client_id,
+                                      uint16_t duration, bool clean_session);
+
+/**
+ * Decodes a connack packet from the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param return_code The return code.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_decode_connack(uint8_t *buf, size_t buf_len, lwmqtt_sn_return_code_t *return_code);
+
+/**
+ * Encodes a register packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param topic_id The topic id (zero when sent by a client).
+ * @param msg_id The message id.
+ * @param topic_name The topic name.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_encode_register(uint8_t *buf, size_t buf_len, size_t *len, uint16_t topic_id, uint16_t msg_id,
+                                       lwmqtt_string_t topic_name);
+
+/**
+ * Decodes a register packet from the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param topic_id The topic id.
+ * @param msg_id The message id.
+ * @param topic_name The topic name, pointing into the buffer.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_decode_register(uint8_t *buf, size_t buf_len, uint16_t *topic_id, uint16_t *msg_id,
+                                       lwmqtt_string_t *topic_name);
+
+/**
+ * Encodes an ack (regack, puback) packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param packet_type The packet type.
+ * @param topic_id The topic id.
+ * @param msg_id The message id.
+ * @param return_code The return code.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_encode_ack(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_sn_packet_type_t packet_type,
+                                  uint16_t topic_id, uint16_t msg_id, lwmqtt_sn_return_code_t return_code);
+
+/**
+ * Decodes an ack (regack, puback) packet from the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param packet_type The packet type.
+ * @param topic_id The topic id.
+ * @param msg_id The message id.
+ * @param return_code The return code.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_decode_ack(uint8_t *buf, size_t buf_len, lwmqtt_sn_packet_type_t packet_type,
+                                  uint16_t *topic_id, uint16_t *msg_id, lwmqtt_sn_return_code_t *return_code);
+
+/**
+ * Encodes a publish packet including the payload into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param dup The dup flag.
+ * @param qos The QoS level (-1, 0, 1 or 2).
+ * @param retained The retained flag.
+ * @param topic The topic.
+ * @param msg_id The message id.
+ * @param payload The payload.
+ * @param payload_len The length of the payload.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_encode_publish(uint8_t *buf, size_t buf_len, size_t *len, bool dup, int qos, bool retained,
+                                      lwmqtt_sn_topic_t topic, uint16_t msg_id, uint8_t *payload, size_t payload_len);
+
+/**
+ * Decodes a publish packet from the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param dup The dup flag.
+ * @param qos The QoS level (-1, 0, 1 or 2).
+ * @param retained The retained flag.
+ * @param topic The topic.
+ * @param msg_id The message id.
+ * @param payload The payload, pointing into the buffer.
+ * @param payload_len The length of the payload.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_decode_publish(uint8_t *buf, size_t buf_len, bool *dup, int *qos, bool *retained,
+                                      lwmqtt_sn_topic_t *topic, uint16_t *msg_id, uint8_t **payload,
+                                      size_t *payload_len);
+
+/**
+ * Encodes a subscribe or unsubscribe packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param packet_type The packet type.
+ * @param qos The requested QoS level (ignored for unsubscribe).
+ * @param msg_id The message id.
+ * @param topic The topic type and id, for normal topics the id is ignored.
+ * @param topic_name The topic name or filter for normal topics.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_encode_subscribe(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_sn_packet_type_t packet_type,
+                                        int qos, uint16_t msg_id, lwmqtt_sn_topic_t topic, lwmqtt_string_t topic_name);
+
+/**
+ * Decodes a suback packet from the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param qos The granted QoS level.
+ * @param topic_id The assigned topic id.
+ * @param msg_id The message id.
+ * @param return_code The return code.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_decode_suback(uint8_t *buf, size_t buf_len, int *qos, uint16_t *topic_id, uint16_t *msg_id,
+                                     lwmqtt_sn_return_code_t *return_code);
+
+/**
+ * Decodes an unsuback packet from the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param msg_id The message id.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_decode_unsuback(uint8_t *buf, size_t buf_len, uint16_t *msg_id);
+
+/**
+ * Encodes a pingreq, pingresp or disconnect packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param packet_type The packet type.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_sn_encode_zero(uint8_t *buf, size_t buf_len, size_t *len, lwmqtt_sn_packet_type_t packet_type);
+
+#endif  // LWMQTT_MQTTSN_H
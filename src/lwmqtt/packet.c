@@ -67,10 +67,14 @@ lwmqtt_err_t lwmqtt_encode_connect(uint8_t *buf, size_t buf_len, size_t *len, lw
   // add client id to remaining length
   rem_len += options->client_id.len + 2;
 
+#if LWMQTT_WILL
   // add will if present to remaining length
   if (will != NULL) {
     rem_len += will->topic.len + 2 + will->payload.len + 2;
   }
+#else
+  (void)will;
+#endif
 
   // add username if username or password is present to remaining length
   if (options->username.len > 0 || options->password.len > 0) {
@@ -123,12 +127,14 @@ lwmqtt_err_t lwmqtt_encode_connect(uint8_t *buf, size_t buf_len, size_t *len, lw
   // set clean session
   lwmqtt_write_bits(&flags, (uint8_t)(options->clean_session), 1, 1);
 
+#if LWMQTT_WILL
   // set will flags if present
   if (will != NULL) {
     lwmqtt_write_bits(&flags, 1, 2, 1);
     lwmqtt_write_bits(&flags, will->qos, 3, 2);
     lwmqtt_write_bits(&flags, (uint8_t)(will->retained), 5, 1);
   }
+#endif
 
   // set username flag if username or password is present
   if (options->username.len > 0 || options->password.len > 0) {
@@ -158,6 +164,7 @@ lwmqtt_err_t lwmqtt_encode_connect(uint8_t *buf, size_t buf_len, size_t *len, lw
     return err;
   }
 
+#if LWMQTT_WILL
   // write will if present
   if (will != NULL) {
     // write topic
@@ -178,6 +185,7 @@ lwmqtt_err_t lwmqtt_encode_connect(uint8_t *buf, size_t buf_len, size_t *len, lw
       return err;
     }
   }
+#endif
 
   // write username if username of password is present
   if (options->username.len > 0 || options->password.len > 0) {
@@ -498,6 +506,26 @@ lwmqtt_err_t lwmqtt_encode_publish(uint8_t *buf, size_t buf_len, size_t *len, bo
   return LWMQTT_SUCCESS;
 }
 
+lwmqtt_err_t lwmqtt_publish_header_length(lwmqtt_string_t topic, lwmqtt_message_t msg, size_t *len) {
+  // calculate remaining length
+  uint32_t rem_len = 2 + topic.len + (uint32_t)msg.payload_len;
+  if (msg.qos > 0) {
+    rem_len += 2;
+  }
+
+  // check remaining length length
+  int rem_len_len;
+  lwmqtt_err_t err = lwmqtt_varnum_length(rem_len, &rem_len_len);
+  if (err == LWMQTT_VARNUM_OVERFLOW) {
+    return LWMQTT_REMAINING_LENGTH_OVERFLOW;
+  }
+
+  // header, remaining length and variable header
+  *len = 1 + (size_t)rem_len_len + rem_len - msg.payload_len;
+
+  return LWMQTT_SUCCESS;
+}
+
 lwmqtt_err_t lwmqtt_encode_subscribe(uint8_t *buf, size_t buf_len, size_t *len, uint16_t packet_id, int count,
                                      lwmqtt_string_t *topic_filters, lwmqtt_qos_t *qos_levels) {
   // prepare pointer
@@ -552,6 +580,11 @@ lwmqtt_err_t lwmqtt_encode_subscribe(uint8_t *buf, size_t buf_len, size_t *len,
       return err;
     }
 
+    // reject levels that have been compiled out
+    if (qos_levels[i] > LWMQTT_MAX_QOS) {
+      return LWMQTT_UNSUPPORTED_QOS;
+    }
+
     // write qos level
     err = lwmqtt_write_byte(&buf_ptr, buf_end, (uint8_t)qos_levels[i]);
     if (err != LWMQTT_SUCCESS) {
@@ -622,6 +655,7 @@ lwmqtt_err_t lwmqtt_decode_suback(uint8_t *buf, size_t buf_len, uint16_t *packet
   return LWMQTT_SUCCESS;
 }
 
+#if LWMQTT_UNSUBSCRIBE
 lwmqtt_err_t lwmqtt_encode_unsubscribe(uint8_t *buf, size_t buf_len, size_t *len, uint16_t packet_id, int count,
                                        lwmqtt_string_t *topic_filters) {
   // prepare pointer
@@ -681,3 +715,332 @@ lwmqtt_err_t lwmqtt_encode_unsubscribe(uint8_t *buf, size_t buf_len, size_t *len
 
   return LWMQTT_SUCCESS;
 }
+#endif
+
+lwmqtt_err_t lwmqtt_decode_connect(uint8_t *buf, size_t buf_len, lwmqtt_connect_options_t *options,
+                                   lwmqtt_will_t *will, bool *will_present) {
+  // prepare pointers
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  uint8_t header;
+  lwmqtt_err_t err = lwmqtt_read_byte(&buf_ptr, buf_end, &header);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check packet type
+  if (lwmqtt_read_bits(header, 4, 4) != LWMQTT_CONNECT_PACKET) {
+    return LWMQTT_MISSING_OR_WRONG_PACKET;
+  }
+
+  // read remaining length
+  uint32_t rem_len;
+  err = lwmqtt_read_varnum(&buf_ptr, buf_end, &rem_len);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check buffer capacity
+  if ((uint32_t)(buf_end - buf_ptr) < rem_len) {
+    return LWMQTT_BUFFER_TOO_SHORT;
+  }
+
+  // reset buf end
+  buf_end = buf_ptr + rem_len;
+
+  // read protocol name
+  lwmqtt_string_t name;
+  err = lwmqtt_read_string(&buf_ptr, buf_end, &name);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read protocol level
+  uint8_t level;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &level);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // only MQTT 3.1.1 is supported
+  options->return_code = LWMQTT_CONNECTION_ACCEPTED;
+  if (lwmqtt_strcmp(name, "MQTT") != 0 || level != 4) {
+    options->return_code = LWMQTT_UNACCEPTABLE_PROTOCOL;
+    return LWMQTT_SUCCESS;
+  }
+
+  // read flags
+  uint8_t flags;
+  err = lwmqtt_read_byte(&buf_ptr, buf_end, &flags);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // get clean session
+  options->clean_session = lwmqtt_read_bits(flags, 1, 1) == 1;
+
+  // read keep alive
+  err = lwmqtt_read_num(&buf_ptr, buf_end, &options->keep_alive);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read client id
+  err = lwmqtt_read_string(&buf_ptr, buf_end, &options->client_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read will if present
+  *will_present = lwmqtt_read_bits(flags, 2, 1) == 1;
+  if (*will_present) {
+    uint8_t qos_val = lwmqtt_read_bits(flags, 3, 2);
+    will->qos = (qos_val <= 2) ? (lwmqtt_qos_t)qos_val : LWMQTT_QOS0;
+    will->retained = lwmqtt_read_bits(flags, 5, 1) == 1;
+
+    // read topic
+    err = lwmqtt_read_string(&buf_ptr, buf_end, &will->topic);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+
+    // read payload
+    err = lwmqtt_read_string(&buf_ptr, buf_end, &will->payload);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+  }
+
+  // read username if present
+  options->username.len = 0;
+  options->username.data = NULL;
+  if (lwmqtt_read_bits(flags, 7, 1) == 1) {
+    err = lwmqtt_read_string(&buf_ptr, buf_end, &options->username);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+  }
+
+  // read password if present
+  options->password.len = 0;
+  options->password.data = NULL;
+  if (lwmqtt_read_bits(flags, 6, 1) == 1) {
+    err = lwmqtt_read_string(&buf_ptr, buf_end, &options->password);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+  }
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_encode_connack(uint8_t *buf, size_t buf_len, size_t *len, bool session_present,
+                                   lwmqtt_return_code_t return_code) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  uint8_t header = 0;
+  lwmqtt_write_bits(&header, LWMQTT_CONNACK_PACKET, 4, 4);
+  lwmqtt_err_t err = lwmqtt_write_byte(&buf_ptr, buf_end, header);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write remaining length
+  err = lwmqtt_write_varnum(&buf_ptr, buf_end, 2);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write flags
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, (uint8_t)(session_present ? 1 : 0));
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write return code
+  err = lwmqtt_write_byte(&buf_ptr, buf_end, (uint8_t)return_code);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // set written length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_decode_subscribe(uint8_t *buf, size_t buf_len, uint16_t *packet_id, int max_count, int *count,
+                                     lwmqtt_string_t *topic_filters, lwmqtt_qos_t *qos_levels) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  uint8_t header;
+  lwmqtt_err_t err = lwmqtt_read_byte(&buf_ptr, buf_end, &header);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check packet type
+  if (lwmqtt_read_bits(header, 4, 4) != LWMQTT_SUBSCRIBE_PACKET) {
+    return LWMQTT_MISSING_OR_WRONG_PACKET;
+  }
+
+  // read remaining length
+  uint32_t rem_len;
+  err = lwmqtt_read_varnum(&buf_ptr, buf_end, &rem_len);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check buffer capacity
+  if ((uint32_t)(buf_end - buf_ptr) < rem_len) {
+    return LWMQTT_BUFFER_TOO_SHORT;
+  }
+
+  // reset buf end
+  buf_end = buf_ptr + rem_len;
+
+  // read packet id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, packet_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read all subscriptions
+  for (*count = 0; buf_ptr < buf_end; (*count)++) {
+    // check max count before writing
+    if (*count >= max_count) {
+      return LWMQTT_SUBACK_ARRAY_OVERFLOW;
+    }
+
+    // read topic filter
+    err = lwmqtt_read_string(&buf_ptr, buf_end, &topic_filters[*count]);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+
+    // read requested qos level
+    uint8_t raw_qos_level;
+    err = lwmqtt_read_byte(&buf_ptr, buf_end, &raw_qos_level);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+
+    // set qos level, invalid levels are reported as failure
+    qos_levels[*count] = (raw_qos_level <= 2) ? (lwmqtt_qos_t)raw_qos_level : LWMQTT_QOS_FAILURE;
+  }
+
+  // a subscribe must carry at least one filter
+  if (*count == 0) {
+    return LWMQTT_REMAINING_LENGTH_MISMATCH;
+  }
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_encode_suback(uint8_t *buf, size_t buf_len, size_t *len, uint16_t packet_id, int count,
+                                  lwmqtt_qos_t *granted_qos_levels) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // write header
+  uint8_t header = 0;
+  lwmqtt_write_bits(&header, LWMQTT_SUBACK_PACKET, 4, 4);
+  lwmqtt_err_t err = lwmqtt_write_byte(&buf_ptr, buf_end, header);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write remaining length
+  err = lwmqtt_write_varnum(&buf_ptr, buf_end, 2 + (uint32_t)count);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write packet id
+  err = lwmqtt_write_num(&buf_ptr, buf_end, packet_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // write all granted qos levels
+  for (int i = 0; i < count; i++) {
+    err = lwmqtt_write_byte(&buf_ptr, buf_end, (uint8_t)granted_qos_levels[i]);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+  }
+
+  // set written length
+  *len = buf_ptr - buf;
+
+  return LWMQTT_SUCCESS;
+}
+
+lwmqtt_err_t lwmqtt_decode_unsubscribe(uint8_t *buf, size_t buf_len, uint16_t *packet_id, int max_count, int *count,
+                                       lwmqtt_string_t *topic_filters) {
+  // prepare pointer
+  uint8_t *buf_ptr = buf;
+  uint8_t *buf_end = buf + buf_len;
+
+  // read header
+  uint8_t header;
+  lwmqtt_err_t err = lwmqtt_read_byte(&buf_ptr, buf_end, &header);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check packet type
+  if (lwmqtt_read_bits(header, 4, 4) != LWMQTT_UNSUBSCRIBE_PACKET) {
+    return LWMQTT_MISSING_OR_WRONG_PACKET;
+  }
+
+  // read remaining length
+  uint32_t rem_len;
+  err = lwmqtt_read_varnum(&buf_ptr, buf_end, &rem_len);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // check buffer capacity
+  if ((uint32_t)(buf_end - buf_ptr) < rem_len) {
+    return LWMQTT_BUFFER_TOO_SHORT;
+  }
+
+  // reset buf end
+  buf_end = buf_ptr + rem_len;
+
+  // read packet id
+  err = lwmqtt_read_num(&buf_ptr, buf_end, packet_id);
+  if (err != LWMQTT_SUCCESS) {
+    return err;
+  }
+
+  // read all topic filters
+  for (*count = 0; buf_ptr < buf_end; (*count)++) {
+    // check max count before writing
+    if (*count >= max_count) {
+      return LWMQTT_SUBACK_ARRAY_OVERFLOW;
+    }
+
+    err = lwmqtt_read_string(&buf_ptr, buf_end, &topic_filters[*count]);
+    if (err != LWMQTT_SUCCESS) {
+      return err;
+    }
+  }
+
+  // an unsubscribe must carry at least one filter
+  if (*count == 0) {
+    return LWMQTT_REMAINING_LENGTH_MISMATCH;
+  }
+
+  return LWMQTT_SUCCESS;
+}
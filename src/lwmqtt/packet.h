@@ -139,6 +139,16 @@ lwmqtt_err_t lwmqtt_decode_publish(uint8_t *buf, size_t buf_len, bool *dup, uint
 lwmqtt_err_t lwmqtt_encode_publish(uint8_t *buf, size_t buf_len, size_t *len, bool dup, uint16_t packet_id,
                                    lwmqtt_string_t topic, lwmqtt_message_t msg);
 
+/**
+ * Calculates the encoded length of a publish packet without the payload.
+ *
+ * @param topic The topic.
+ * @param msg The message.
+ * @param len The encoded length of the packet without payload.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_publish_header_length(lwmqtt_string_t topic, lwmqtt_message_t msg, size_t *len);
+
 /**
  * Encodes a subscribe packet into the supplied buffer.
  *
@@ -168,6 +178,7 @@ lwmqtt_err_t lwmqtt_encode_subscribe(uint8_t *buf, size_t buf_len, size_t *len,
 lwmqtt_err_t lwmqtt_decode_suback(uint8_t *buf, size_t buf_len, uint16_t *packet_id, int max_count, int *count,
                                   lwmqtt_qos_t *granted_qos_levels);
 
+#if LWMQTT_UNSUBSCRIBE
 /**
  * Encodes the supplied unsubscribe data into the supplied buffer, ready for sending
  *
@@ -181,5 +192,78 @@ lwmqtt_err_t lwmqtt_decode_suback(uint8_t *buf, size_t buf_len, uint16_t *packet
  */
 lwmqtt_err_t lwmqtt_encode_unsubscribe(uint8_t *buf, size_t buf_len, size_t *len, uint16_t packet_id, int count,
                                        lwmqtt_string_t *topic_filters);
+#endif
+
+/**
+ * Decodes a connect packet from the supplied buffer. Used by the broker side.
+ *
+ * The strings point into the supplied buffer. An unsupported protocol name or level is reported through the return
+ * code of the options with a successful decode.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param options The decoded connect options.
+ * @param will The decoded will, only set if present.
+ * @param will_present Whether a will has been supplied.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_decode_connect(uint8_t *buf, size_t buf_len, lwmqtt_connect_options_t *options,
+                                   lwmqtt_will_t *will, bool *will_present);
+
+/**
+ * Encodes a connack packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param session_present The session present flag.
+ * @param return_code The return code.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_encode_connack(uint8_t *buf, size_t buf_len, size_t *len, bool session_present,
+                                   lwmqtt_return_code_t return_code);
+
+/**
+ * Decodes a subscribe packet from the supplied buffer. The topic filters point into the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param packet_id The packet id.
+ * @param max_count The maximum number of members allowed in the topic_filters and qos_levels array.
+ * @param count The number of decoded members.
+ * @param topic_filters The array of topic filters.
+ * @param qos_levels The array of requested QoS levels.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_decode_subscribe(uint8_t *buf, size_t buf_len, uint16_t *packet_id, int max_count, int *count,
+                                     lwmqtt_string_t *topic_filters, lwmqtt_qos_t *qos_levels);
+
+/**
+ * Encodes a suback packet into the supplied buffer.
+ *
+ * @param buf The buffer into which the packet will be encoded.
+ * @param buf_len The length of the specified buffer.
+ * @param len The encoded length of the packet.
+ * @param packet_id The packet id.
+ * @param count The number of members in the granted_qos_levels array.
+ * @param granted_qos_levels The granted QoS levels.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_encode_suback(uint8_t *buf, size_t buf_len, size_t *len, uint16_t packet_id, int count,
+                                  lwmqtt_qos_t *granted_qos_levels);
+
+/**
+ * Decodes an unsubscribe packet from the supplied buffer. The topic filters point into the supplied buffer.
+ *
+ * @param buf The raw buffer data.
+ * @param buf_len The length of the specified buffer.
+ * @param packet_id The packet id.
+ * @param max_count The maximum number of members allowed in the topic_filters array.
+ * @param count The number of decoded members.
+ * @param topic_filters The array of topic filters.
+ * @return An error value.
+ */
+lwmqtt_err_t lwmqtt_decode_unsubscribe(uint8_t *buf, size_t buf_len, uint16_t *packet_id, int max_count, int *count,
+                                       lwmqtt_string_t *topic_filters);
 
 #endif  // LWMQTT_PACKET_H
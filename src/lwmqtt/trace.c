@@ -0,0 +1,52 @@
+#include "trace.h"
+
+#if LWMQTT_TRACE
+
+static lwmqtt_trace_record_t lwmqtt_trace_ring[LWMQTT_TRACE_SIZE];
+static uint32_t lwmqtt_trace_count = 0;
+static lwmqtt_trace_clock_t lwmqtt_trace_clock = NULL;
+static void *lwmqtt_trace_clock_ref = NULL;
+
+void lwmqtt_trace_set_clock(lwmqtt_trace_clock_t clock, void *ref) {
+  lwmqtt_trace_clock = clock;
+  lwmqtt_trace_clock_ref = ref;
+}
+
+void lwmqtt_trace_release_clock(void *ref) {
+  if (lwmqtt_trace_clock_ref == ref) {
+    lwmqtt_trace_clock = NULL;
+    lwmqtt_trace_clock_ref = NULL;
+  }
+}
+
+void lwmqtt_trace(uint16_t event, uint16_t arg0, uint32_t arg1, uint32_t arg2) {
+  // claim next slot, the oldest record is overwritten once the ring is full
+  lwmqtt_trace_record_t *rec = &lwmqtt_trace_ring[lwmqtt_trace_count % LWMQTT_TRACE_SIZE];
+  lwmqtt_trace_count++;
+
+  rec->time = (lwmqtt_trace_clock != NULL) ? lwmqtt_trace_clock(lwmqtt_trace_clock_ref) : 0;
+  rec->event = event;
+  rec->arg0 = arg0;
+  rec->arg1 = arg1;
+  rec->arg2 = arg2;
+}
+
+size_t lwmqtt_trace_dump(lwmqtt_trace_record_t *records, size_t max_count) {
+  // get number of retained records
+  size_t count = (lwmqtt_trace_count < LWMQTT_TRACE_SIZE) ? lwmqtt_trace_count : LWMQTT_TRACE_SIZE;
+  if (count > max_count) {
+    count = max_count;
+  }
+
+  // copy oldest first
+  uint32_t first = lwmqtt_trace_count - (uint32_t)count;
+  for (size_t i = 0; i < count; i++) {
+    records[i] = lwmqtt_trace_ring[(first + i) % LWMQTT_TRACE_SIZE];
+  }
+
+  return count;
+}
+
+void lwmqtt_trace_reset(void) { lwmqtt_trace_count = 0; }
+
+#endif
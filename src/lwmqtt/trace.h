@@ -0,0 +1,108 @@
+#ifndef LWMQTT_TRACE_H
+#define LWMQTT_TRACE_H
+
+#include "lwmqtt.h"
+
+/**
+ * Enables the event trace ring. When zero, all trace points compile to nothing and no memory is reserved.
+ *
+ * The flag must be set for all translation units, e.g. with "-DLWMQTT_TRACE=1" in the build flags.
+ */
+#ifndef LWMQTT_TRACE
+#define LWMQTT_TRACE 0
+#endif
+
+/**
+ * The number of records kept in the ring. Each record uses 16 bytes.
+ */
+#ifndef LWMQTT_TRACE_SIZE
+#define LWMQTT_TRACE_SIZE 128
+#endif
+
+/**
+ * The traced events. Events ending in BEGIN and END form a duration pair.
+ */
+typedef enum {
+  LWMQTT_TRACE_PACKET_READ_BEGIN = 1,
+  LWMQTT_TRACE_PACKET_READ_END = 2,
+  LWMQTT_TRACE_DECODE = 3,
+  LWMQTT_TRACE_CALLBACK_BEGIN = 4,
+  LWMQTT_TRACE_CALLBACK_END = 5,
+  LWMQTT_TRACE_ACK_SENT = 6,
+  LWMQTT_TRACE_KEEP_ALIVE = 7,
+  LWMQTT_TRACE_NETWORK_READ_BEGIN = 8,
+  LWMQTT_TRACE_NETWORK_READ_END = 9,
+  LWMQTT_TRACE_NETWORK_WRITE_BEGIN = 10,
+  LWMQTT_TRACE_NETWORK_WRITE_END = 11,
+} lwmqtt_trace_event_t;
+
+/**
+ * A single trace record (16 bytes, little-endian on all supported targets).
+ */
+typedef struct {
+  uint32_t time;
+  uint16_t event;
+  uint16_t arg0;
+  uint32_t arg1;
+  uint32_t arg2;
+} lwmqtt_trace_record_t;
+
+/**
+ * The callback used to timestamp trace records.
+ *
+ * @param ref The reference passed with the clock, e.g. the client whose clock is used.
+ * @return The current time in microseconds.
+ */
+typedef uint32_t (*lwmqtt_trace_clock_t)(void *ref);
+
+#if LWMQTT_TRACE
+
+/**
+ * Will set the clock used to timestamp trace records.
+ *
+ * @param clock The clock callback.
+ * @param ref The reference passed to the clock.
+ */
+void lwmqtt_trace_set_clock(lwmqtt_trace_clock_t clock, void *ref);
+
+/**
+ * Will remove the clock if it has been set with the supplied reference, records are then stamped with zero.
+ *
+ * @param ref The reference passed with the clock.
+ */
+void lwmqtt_trace_release_clock(void *ref);
+
+/**
+ * Will append a record to the trace ring, overwriting the oldest record when full.
+ *
+ * @param event The event.
+ * @param arg0 The first event argument.
+ * @param arg1 The second event argument.
+ * @param arg2 The third event argument.
+ */
+void lwmqtt_trace(uint16_t event, uint16_t arg0, uint32_t arg1, uint32_t arg2);
+
+/**
+ * Will copy the recorded events, oldest first, into the supplied array.
+ *
+ * @param records The array to copy into.
+ * @param max_count The maximum number of records to copy.
+ * @return The number of copied records.
+ */
+size_t lwmqtt_trace_dump(lwmqtt_trace_record_t *records, size_t max_count);
+
+/**
+ * Will discard all recorded events.
+ */
+void lwmqtt_trace_reset(void);
+
+#define LWMQTT_TRACE_EVENT(event, arg0, arg1, arg2) \
+  lwmqtt_trace((uint16_t)(event), (uint16_t)(arg0), (uint32_t)(arg1), (uint32_t)(arg2))
+
+#else
+
+#define LWMQTT_TRACE_EVENT(event, arg0, arg1, arg2) ((void)0)
+
+#endif
+
+#endif  // LWMQTT_TRACE_H
@@ -0,0 +1,78 @@
+// Compares malloc, MQTTClientArena and MQTTClientPool for the allocations of a client: the read and write buffer as
+// large blocks and the hostname as a small one.
+
+#include <MQTTClient.h>
+
+#include <new>
+
+#include "bench.h"
+#include "test.h"
+
+static const size_t bufSize = 256;
+static uint8_t area[4 * 512];
+
+// allocates and frees the blocks of one client through an allocator
+static void cycle(const MQTTClientAllocator &a) {
+  void *read = a.alloc(bufSize + 1, MQTT_ALLOC_LARGE, a.ref);
+  void *write = a.alloc(bufSize, MQTT_ALLOC_LARGE, a.ref);
+  void *host = a.alloc(16, MQTT_ALLOC_SMALL, a.ref);
+  CHECK(read != nullptr && write != nullptr && host != nullptr);
+  bench_sink += (uintptr_t)read ^ (uintptr_t)write ^ (uintptr_t)host;
+  a.free(host, MQTT_ALLOC_SMALL, a.ref);
+  a.free(write, MQTT_ALLOC_LARGE, a.ref);
+  a.free(read, MQTT_ALLOC_LARGE, a.ref);
+}
+
+static void *heapAlloc(size_t size, MQTTAllocHint, void *) { return malloc(size); }
+static void heapFree(void *ptr, MQTTAllocHint, void *) { free(ptr); }
+
+int main(int argc, char **argv) {
+  uint32_t n = benchIterations(argc, argv, 1000000);
+
+  // malloc for everything
+  MQTTClientAllocator heap = {heapAlloc, heapFree, nullptr};
+  uint64_t start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    cycle(heap);
+  }
+  benchReport("malloc blocks", benchNanos() - start, n);
+
+  // the arena only reclaims its last block, so it is set up again for every client
+  alignas(MQTTClientArena) uint8_t storage[sizeof(MQTTClientArena)];
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    MQTTClientArena *arena = new (storage) MQTTClientArena(area, sizeof(area));
+    cycle(arena->allocator);
+  }
+  benchReport("arena blocks", benchNanos() - start, n);
+
+  // the pool takes blocks back in any order
+  MQTTClientPool pool(area, sizeof(area), 512);
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    cycle(pool.allocator);
+  }
+  benchReport("pool blocks", benchNanos() - start, n);
+  CHECK(pool.available() == 4);
+
+  // whole clients created and destroyed through malloc and the pool
+  uint32_t m = n / 10 + 1;
+  start = benchNanos();
+  for (uint32_t i = 0; i < m; i++) {
+    MQTTClient client((int)bufSize);
+    client.setHost("broker.local", 1883);
+  }
+  benchReport("malloc client", benchNanos() - start, m);
+
+  MQTTClient::setAllocator(&pool.allocator);
+  start = benchNanos();
+  for (uint32_t i = 0; i < m; i++) {
+    MQTTClient client((int)bufSize);
+    client.setHost("broker.local", 1883);
+  }
+  benchReport("pool client", benchNanos() - start, m);
+  MQTTClient::setAllocator(nullptr);
+  CHECK(pool.available() == 4);
+
+  return TEST_DONE();
+}
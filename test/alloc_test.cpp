@@ -0,0 +1,234 @@
+// Counts every heap allocation of the process to check the steady state of the client for allocations and to report
+// the peak heap of a client per configuration. malloc and friends are interposed with the linker flag
+// -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc (see CMakeLists.txt), new and delete are routed to them.
+
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+#include <MQTTLz.h>
+#include <MQTTOutbox.h>
+
+#include <malloc.h>
+#include <new>
+
+#include "pipe.h"
+#include "test.h"
+
+#ifndef ALLOC_CONFIG
+#define ALLOC_CONFIG "default"
+#endif
+
+static uint32_t allocs = 0;
+static uint32_t frees = 0;
+static size_t current = 0;
+static size_t peak = 0;
+
+extern "C" {
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static void counted(void *ptr) {
+  if (ptr != nullptr) {
+    allocs++;
+    current += malloc_usable_size(ptr);
+    if (current > peak) {
+      peak = current;
+    }
+  }
+}
+
+void *__wrap_malloc(size_t size) {
+  void *ptr = __real_malloc(size);
+  counted(ptr);
+  return ptr;
+}
+
+void __wrap_free(void *ptr) {
+  if (ptr != nullptr) {
+    frees++;
+    current -= malloc_usable_size(ptr);
+  }
+  __real_free(ptr);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  void *ptr = __real_calloc(count, size);
+  counted(ptr);
+  return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  if (ptr != nullptr) {
+    frees++;
+    current -= malloc_usable_size(ptr);
+  }
+  void *res = __real_realloc(ptr, size);
+  counted(res);
+  return res;
+}
+}
+
+void *operator new(size_t size) {
+  void *ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[2];
+static MQTTBroker broker(sessions, 1, subscriptions, 2);
+
+// the broker echoes the messages of the client back to it and runs while the client waits
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+static const int qos = (LWMQTT_MAX_QOS < 1) ? 0 : 1;
+static int received = 0;
+
+static void onSimple(String &, String &) { received++; }
+static void onAdvanced(MQTTClient *, char[], char[], int) { received++; }
+static void onRaw(MQTTClient *, const char *, size_t, const char *, size_t) { received++; }
+
+enum CallbackType { SIMPLE, ADVANCED, RAW, FUNC_SIMPLE, FUNC_ADVANCED, FUNC_RAW };
+
+static void setCallback(MQTTClient &client, CallbackType type) {
+  switch (type) {
+    case SIMPLE:
+      client.onMessage(onSimple);
+      break;
+    case ADVANCED:
+      client.onMessageAdvanced(onAdvanced);
+      break;
+    case RAW:
+      client.onMessageRaw(onRaw);
+      break;
+#if MQTT_HAS_FUNCTIONAL
+    case FUNC_SIMPLE:
+      client.onMessage(MQTTClientCallbackSimpleFunction([](String &, String &) { received++; }));
+      break;
+    case FUNC_ADVANCED:
+      client.onMessageAdvanced(
+          MQTTClientCallbackAdvancedFunction([](MQTTClient *, char[], char[], int) { received++; }));
+      break;
+    case FUNC_RAW:
+      client.onMessageRaw(
+          MQTTClientCallbackRawFunction([](MQTTClient *, const char *, size_t, const char *, size_t) { received++; }));
+      break;
+#else
+    default:
+      break;
+#endif
+  }
+}
+
+// publishes messages to the own subscription and returns the allocations made while doing so
+static uint32_t roundTrips(MQTTClient &client, int count) {
+  uint32_t before = allocs;
+  for (int i = 0; i < count; i++) {
+    CHECK(client.publish("alloc/test", "payload", false, qos));
+    for (int j = 0; j < 4; j++) {
+      broker.loop();
+      client.loop();
+    }
+  }
+  return allocs - before;
+}
+
+static void testCallback(CallbackType type, const char *name) {
+  const int count = 10;
+
+  PipeClient net, session;
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+
+  MQTTClient client(128);
+  client.begin(net);
+  client.setWaitCallback(runBroker);
+  setCallback(client, type);
+  CHECK(client.connect("alloc"));
+  CHECK(client.subscribe("alloc/#", qos));
+
+  // warm up once, then the steady state must only allocate the strings of the simple callbacks
+  roundTrips(client, 1);
+  received = 0;
+  uint32_t freesBefore = frees;
+  uint32_t n = roundTrips(client, count);
+  CHECK(received == count);
+  CHECK(frees - freesBefore == n);
+  if (type == SIMPLE || type == FUNC_SIMPLE) {
+    CHECK(n == 2 * count);
+  } else {
+    CHECK(n == 0);
+  }
+  printf("%-14s %u allocations per message\n", name, n / count);
+
+  client.disconnect();
+  broker.loop();
+}
+
+typedef void (*Configure)(MQTTClient &client);
+
+static MQTTLz lz;
+static MQTTOutboxSlot outboxSlots[4];
+static uint8_t outboxBuf[4 * 64];
+static MQTTOutbox outbox(outboxSlots, 4, outboxBuf, 64);
+
+static void reportPeak(const char *name, int bufSize, Configure configure) {
+  PipeClient net, session;
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+
+  size_t base = current;
+  peak = current;
+  uint32_t before = allocs;
+  {
+    MQTTClient client(bufSize);
+    client.begin(net);
+    client.setWaitCallback(runBroker);
+    client.onMessageRaw(onRaw);
+    if (configure != nullptr) {
+      configure(client);
+    }
+    CHECK(client.connect("alloc"));
+    CHECK(client.subscribe("alloc/#", qos));
+    roundTrips(client, 10);
+    client.disconnect();
+    broker.loop();
+  }
+  CHECK(current == base);
+  printf("%-8s %-22s %5zu bytes peak, %u allocations\n", ALLOC_CONFIG, name, peak - base, allocs - before);
+}
+
+int main() {
+  testCallback(RAW, "raw");
+  testCallback(ADVANCED, "advanced");
+  testCallback(SIMPLE, "simple");
+#if MQTT_HAS_FUNCTIONAL
+  testCallback(FUNC_RAW, "func raw");
+  testCallback(FUNC_ADVANCED, "func advanced");
+  testCallback(FUNC_SIMPLE, "func simple");
+#endif
+
+#if MQTT_ALLOC_STATS
+  // the accounting of the library must agree that publishing and receiving does not allocate
+  CHECK(MQTTClient::allocStats(MQTT_PHASE_PUBLISH).allocs == 0);
+  CHECK(MQTTClient::allocStats(MQTT_PHASE_RECEIVE).allocs == 0);
+#endif
+
+  reportPeak("buffers 64", 64, nullptr);
+  reportPeak("buffers 1024", 1024, nullptr);
+  reportPeak("non-blocking 256", 128, [](MQTTClient &c) { CHECK(c.setNonBlocking(256)); });
+  reportPeak("micros timers", 128, [](MQTTClient &c) { CHECK(c.useMicrosTimers(true)); });
+  reportPeak("compression", 128, [](MQTTClient &c) { CHECK(c.setCompression(&lz, 32, 256)); });
+  reportPeak("outbox lane", 128, [](MQTTClient &c) { CHECK(c.setLane(0, &outbox)); });
+
+  return TEST_DONE();
+}
@@ -0,0 +1,177 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+
+#include <cstdlib>
+
+#include "pipe.h"
+#include "test.h"
+
+static int large = 0;
+static int small = 0;
+static size_t largeBytes = 0;
+
+// counts the live allocations per hint and forwards them to malloc
+static void *countAlloc(size_t size, MQTTAllocHint hint, void *ref) {
+  (*(int *)ref)++;
+  if (hint == MQTT_ALLOC_LARGE) {
+    large++;
+    largeBytes += size;
+  } else {
+    small++;
+  }
+  return malloc(size);
+}
+
+static void countFree(void *ptr, MQTTAllocHint hint, void *) {
+  if (ptr == nullptr) {
+    return;
+  }
+  if (hint == MQTT_ALLOC_LARGE) {
+    large--;
+  } else {
+    small--;
+  }
+  free(ptr);
+}
+
+static void testAllocator() {
+  int calls = 0;
+  MQTTClientAllocator allocator = {countAlloc, countFree, &calls};
+  MQTTClient::setAllocator(&allocator);
+  {
+    // the read and write buffers are large, the read buffer has room for a terminator
+    MQTTClient client(128, 64);
+    CHECK(large == 2 && small == 0);
+    CHECK(largeBytes == 129 + 64);
+
+    // the send ring is large, hostname and timers are small
+    CHECK(client.setNonBlocking(256));
+    CHECK(large == 3);
+    client.setHost("broker.example", 1883);
+    CHECK(client.useMicrosTimers(true));
+    CHECK(small == 2);
+
+    // replacing and dropping returns the blocks with the same hint
+    client.setHost("other.example", 1883);
+    CHECK(small == 2);
+    CHECK(client.setNonBlocking(0));
+    CHECK(large == 2);
+  }
+  CHECK(large == 0 && small == 0);
+
+  // a null allocator restores malloc and free
+  MQTTClient::setAllocator(nullptr);
+  int before = calls;
+  {
+    MQTTClient client(128);
+    client.setHost("broker.example", 1883);
+  }
+  CHECK(calls == before);
+}
+
+static void testArena() {
+  uint8_t buf[256];
+  MQTTClientArena arena(buf, sizeof(buf));
+  CHECK(arena.available() == sizeof(buf));
+
+  // large blocks are placed aligned into the buffer
+  uint8_t *a = (uint8_t *)arena.alloc(10, MQTT_ALLOC_LARGE);
+  uint8_t *b = (uint8_t *)arena.alloc(20, MQTT_ALLOC_LARGE);
+  CHECK(a == buf);
+  CHECK(b == buf + 2 * sizeof(void *) * ((10 + 2 * sizeof(void *) - 1) / (2 * sizeof(void *))));
+  CHECK(arena.available() == sizeof(buf) - (size_t)(b - buf) - 20);
+
+  // only the most recent block is given back
+  size_t available = arena.available();
+  arena.free(a, MQTT_ALLOC_LARGE);
+  CHECK(arena.available() == available);
+  arena.free(b, MQTT_ALLOC_LARGE);
+  CHECK(arena.alloc(20, MQTT_ALLOC_LARGE) == b);
+
+  // blocks that do not fit fail instead of falling back to the heap
+  CHECK(arena.alloc(sizeof(buf), MQTT_ALLOC_LARGE) == nullptr);
+
+  // small blocks stay on the heap
+  uint8_t *c = (uint8_t *)arena.alloc(16, MQTT_ALLOC_SMALL);
+  CHECK(c != nullptr && (c < buf || c >= buf + sizeof(buf)));
+  arena.free(c, MQTT_ALLOC_SMALL);
+}
+
+static void testPool() {
+  alignas(void *) uint8_t buf[3 * 64];
+  MQTTClientPool pool(buf, sizeof(buf), 64);
+  CHECK(pool.available() == 3);
+
+  // blocks are given back in any order and reused
+  void *a = pool.alloc(64, MQTT_ALLOC_LARGE);
+  void *b = pool.alloc(10, MQTT_ALLOC_LARGE);
+  void *c = pool.alloc(64, MQTT_ALLOC_LARGE);
+  CHECK(a != nullptr && b != nullptr && c != nullptr);
+  CHECK(pool.available() == 0);
+  CHECK(pool.alloc(1, MQTT_ALLOC_LARGE) == nullptr);
+  pool.free(a, MQTT_ALLOC_LARGE);
+  CHECK(pool.available() == 1);
+  CHECK(pool.alloc(64, MQTT_ALLOC_LARGE) == a);
+  pool.free(b, MQTT_ALLOC_LARGE);
+  pool.free(c, MQTT_ALLOC_LARGE);
+  pool.free(a, MQTT_ALLOC_LARGE);
+  CHECK(pool.available() == 3);
+
+  // blocks larger than the block size fail
+  CHECK(pool.alloc(65, MQTT_ALLOC_LARGE) == nullptr);
+  CHECK(pool.available() == 3);
+}
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[2];
+static MQTTBroker broker(sessions, 1, subscriptions, 2);
+static int received = 0;
+
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+static void countMessage(MQTTClient *, const char *, size_t, const char *, size_t) { received++; }
+
+static void testClient() {
+  static uint8_t buf[512];
+  MQTTClientArena arena(buf, sizeof(buf));
+  MQTTClient::setAllocator(&arena.allocator);
+
+  // a client whose buffers do not fit is left without buffers and refuses to begin
+  PipeClient net, session;
+  {
+    MQTTClient client(1024);
+    client.begin(net);
+    CHECK(client.lastError() == LWMQTT_BUFFER_TOO_SHORT);
+    CHECK(arena.available() == sizeof(buf));
+  }
+
+  // a client that fits works from the arena
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+  {
+    MQTTClient client(128);
+    CHECK(arena.available() < sizeof(buf) - 128 - 128);
+    client.begin(net);
+    client.setWaitCallback(runBroker);
+    client.onMessageRaw(countMessage);
+    CHECK(client.connect("arena"));
+    CHECK(client.subscribe("arena/#", 1));
+    CHECK(client.publish("arena/test", "hello", false, 1));
+    for (int i = 0; i < 4; i++) {
+      broker.loop();
+      client.loop();
+    }
+    CHECK(received == 1);
+    CHECK(client.disconnect());
+    broker.loop();
+  }
+  MQTTClient::setAllocator(nullptr);
+}
+
+int main() {
+  testAllocator();
+  testArena();
+  testPool();
+  testClient();
+  return TEST_DONE();
+}
@@ -0,0 +1,94 @@
+#include <MQTTBatch.h>
+
+#include <string.h>
+
+#include "test.h"
+
+static bool recordIs(const MQTTBatchRecord &record, const char *suffix, const char *payload) {
+  return record.suffixLen == strlen(suffix) && memcmp(record.suffix, suffix, record.suffixLen) == 0 &&
+         record.payloadLen == strlen(payload) && memcmp(record.payload, payload, record.payloadLen) == 0;
+}
+
+static void testRoundTrip() {
+  uint8_t buf[512];
+  MQTTBatchWriter batch(buf, sizeof(buf));
+  CHECK(batch.length() == 0);
+  CHECK(batch.add("temperature", "21.5"));
+  CHECK(batch.add("humidity", "48"));
+  CHECK(batch.add("", ""));
+
+  // a payload with a two byte length
+  uint8_t large[200];
+  memset(large, 0xab, sizeof(large));
+  CHECK(batch.add("large", large, sizeof(large)));
+  CHECK(batch.count() == 4);
+
+  const char *payload = (const char *)batch.data();
+  CHECK(MQTTBatchReader::isBatch(payload, batch.length()));
+  MQTTBatchReader reader(payload, batch.length());
+  MQTTBatchRecord record;
+  CHECK(reader.next(record) && recordIs(record, "temperature", "21.5"));
+  CHECK(reader.next(record) && recordIs(record, "humidity", "48"));
+  CHECK(reader.next(record) && recordIs(record, "", ""));
+  CHECK(reader.next(record) && record.payloadLen == sizeof(large) && memcmp(record.payload, large, 200) == 0);
+  CHECK(!reader.next(record));
+  CHECK(!reader.error());
+
+  // reset starts over
+  reader.reset();
+  CHECK(reader.next(record) && recordIs(record, "temperature", "21.5"));
+}
+
+static void testFull() {
+  uint8_t buf[24];
+  MQTTBatchWriter batch(buf, sizeof(buf));
+  CHECK(batch.add("a", "0123456789"));
+  size_t len = batch.length();
+  CHECK(!batch.add("b", "0123456789"));
+  CHECK(batch.length() == len && batch.count() == 1);
+
+  batch.reset();
+  CHECK(batch.count() == 0 && batch.length() == 0);
+  CHECK(batch.add("b", "0123456789"));
+
+  // too small for the header
+  uint8_t tiny[4];
+  MQTTBatchWriter none(tiny, sizeof(tiny));
+  CHECK(!none.add("", ""));
+}
+
+static void testMalformed() {
+  uint8_t buf[64];
+  MQTTBatchWriter batch(buf, sizeof(buf));
+  CHECK(batch.add("a", "1"));
+  CHECK(batch.add("b", "2"));
+  const char *payload = (const char *)batch.data();
+  size_t len = batch.length();
+
+  // truncated, extended and miscounted batches are rejected
+  CHECK(!MQTTBatchReader::isBatch(payload, len - 1));
+  char longer[64];
+  memcpy(longer, payload, len);
+  longer[len] = 0;
+  CHECK(!MQTTBatchReader::isBatch(longer, len + 1));
+  longer[3] = 3;
+  CHECK(!MQTTBatchReader::isBatch(longer, len));
+
+  MQTTBatchReader reader(payload, len - 1);
+  MQTTBatchRecord record;
+  CHECK(!reader.next(record));
+  CHECK(reader.error());
+
+  // binary data starting with the magic byte alone is not a batch
+  const char binary[] = {(char)MQTT_BATCH_MAGIC, 1, 'x', 1, 'y'};
+  CHECK(!MQTTBatchReader::isBatch(binary, sizeof(binary)));
+  CHECK(!MQTTBatchReader::isBatch("text", 4));
+  CHECK(!MQTTBatchReader::isBatch(nullptr, 0));
+}
+
+int main() {
+  testRoundTrip();
+  testFull();
+  testMalformed();
+  return TEST_DONE();
+}
@@ -0,0 +1,35 @@
+#ifndef MQTT_BENCH_H
+#define MQTT_BENCH_H
+
+// Minimal timing helpers for the host benchmarks. Every benchmark takes the number of iterations as its first
+// argument, ctest runs them with a few iterations only to keep them building and working.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t benchNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint32_t benchIterations(int argc, char **argv, uint32_t def) {
+  return (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 10) : def;
+}
+
+// prints the time per iteration and, if bytes are given, the throughput
+static inline void benchReport(const char *name, uint64_t nanos, uint32_t iterations, size_t bytes = 0) {
+  double ns = (iterations > 0) ? (double)nanos / iterations : 0;
+  if (bytes > 0 && nanos > 0) {
+    printf("%-32s %10.1f ns/op %10.1f MB/s\n", name, ns, (double)bytes * iterations * 1000.0 / (double)nanos);
+  } else {
+    printf("%-32s %10.1f ns/op\n", name, ns);
+  }
+}
+
+// keeps results alive so the measured work is not optimized away
+static volatile uintptr_t bench_sink = 0;
+
+#endif
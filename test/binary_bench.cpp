@@ -0,0 +1,124 @@
+// Publishing and decoding a sensor frame as a packed MQTTLayout and as JSON: payload size, encode and publish through
+// a client into a pipe, and decoding on the receiving side with the layout and with MQTTJsonReader.
+
+#include <MQTTBinary.h>
+#include <MQTTClient.h>
+#include <MQTTJson.h>
+
+#include "bench.h"
+#include "pipe.h"
+#include "test.h"
+
+struct Frame {
+  uint32_t time;
+  int16_t level;
+  float temperature;
+  bool alarm;
+};
+
+typedef MQTTLayout<Frame, MQTT_MEMBER(Frame, time, MQTT_ORDER_BE), MQTT_MEMBER(Frame, level, MQTT_ORDER_BE),
+                   MQTT_MEMBER(Frame, temperature, MQTT_ORDER_BE), MQTT_MEMBER(Frame, alarm, MQTT_ORDER_BE)>
+    FrameLayout;
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+static size_t encodeJson(const Frame &f, char *buf, size_t cap) {
+  int n = snprintf(buf, cap, "{\"time\":%lu,\"level\":%d,\"temperature\":%.2f,\"alarm\":%s}", (unsigned long)f.time,
+                   f.level, (double)f.temperature, f.alarm ? "true" : "false");
+  CHECK(n > 0 && (size_t)n < cap);
+  return (size_t)n;
+}
+
+static bool decodeJson(const char *buf, size_t len, Frame &f) {
+  MQTTJsonReader r(buf, len);
+  MQTTJsonToken token;
+  if (r.next(token) != MQTT_JSON_OBJECT) {
+    return false;
+  }
+  while (r.next(token) == MQTT_JSON_KEY) {
+    MQTTJsonToken value;
+    r.next(value);
+    if (token.equals("time")) {
+      f.time = (uint32_t)value.toInt();
+    } else if (token.equals("level")) {
+      f.level = (int16_t)value.toInt();
+    } else if (token.equals("temperature")) {
+      f.temperature = (float)value.toDouble();
+    } else if (token.equals("alarm")) {
+      f.alarm = value.toBool();
+    }
+  }
+  return token.type == MQTT_JSON_OBJECT_END;
+}
+
+static void drain(PipeClient &server) {
+  uint8_t buf[256];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t n = benchIterations(argc, argv, 1000000);
+  Frame frame = {1700000000u, -12, 21.25f, false};
+  uint8_t bin[FrameLayout::size];
+  char json[128];
+
+  size_t jsonLen = encodeJson(frame, json, sizeof(json));
+  printf("frame size: layout %zu bytes, json %zu bytes\n", FrameLayout::size, jsonLen);
+
+  PipeClient net, server;
+  MQTTClient client(128);
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  CHECK(client.connect("bench"));
+  drain(server);
+
+  // encode and publish, the layout is encoded into the payload buffer of the client
+  uint64_t start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    frame.time++;
+    size_t capacity;
+    uint8_t *buf = client.payloadBuffer("s/frame", 0, capacity);
+    size_t len = FrameLayout::encode(frame, buf, capacity);
+    CHECK(client.publish("s/frame", (const char *)buf, (int)len, false, 0));
+    drain(server);
+  }
+  benchReport("publish layout", benchNanos() - start, n, FrameLayout::size);
+
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    frame.time++;
+    size_t len = encodeJson(frame, json, sizeof(json));
+    CHECK(client.publish("s/frame", json, (int)len, false, 0));
+    drain(server);
+  }
+  benchReport("publish json", benchNanos() - start, n, jsonLen);
+
+  // decode on the receiving side
+  FrameLayout::encode(frame, bin, sizeof(bin));
+  jsonLen = encodeJson(frame, json, sizeof(json));
+  Frame out;
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    CHECK(FrameLayout::decode(bin, sizeof(bin), out));
+    bench_sink += out.time;
+  }
+  benchReport("decode layout", benchNanos() - start, n, FrameLayout::size);
+
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    MQTTLayoutView<FrameLayout> view(bin, sizeof(bin));
+    bench_sink += (uintptr_t)view.get<1>();
+  }
+  benchReport("read one field, layout view", benchNanos() - start, n, FrameLayout::size);
+
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    CHECK(decodeJson(json, jsonLen, out));
+    bench_sink += out.time;
+  }
+  benchReport("decode json", benchNanos() - start, n, jsonLen);
+
+  return TEST_DONE();
+}
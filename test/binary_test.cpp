@@ -0,0 +1,105 @@
+#include <MQTTBinary.h>
+
+#include "test.h"
+
+enum Mode : uint8_t { MODE_OFF = 0, MODE_ON = 7 };
+
+// only the enumerated modes are accepted on the wire
+template <>
+struct MQTTBinaryRange<Mode> {
+  static bool valid(uint64_t w) { return w == MODE_OFF || w == MODE_ON; }
+};
+
+struct Frame {
+  uint32_t time;
+  int16_t level;
+  float temperature;
+  double total;
+  bool alarm;
+  Mode mode;
+};
+
+typedef MQTTLayout<Frame, MQTT_MEMBER(Frame, time, MQTT_ORDER_BE), MQTT_MEMBER(Frame, level, MQTT_ORDER_LE),
+                   MQTT_MEMBER(Frame, temperature, MQTT_ORDER_BE), MQTT_MEMBER(Frame, total, MQTT_ORDER_LE),
+                   MQTT_MEMBER(Frame, alarm, MQTT_ORDER_LE), MQTT_MEMBER(Frame, mode, MQTT_ORDER_LE)>
+    FrameLayout;
+
+static_assert(FrameLayout::size == 4 + 2 + 4 + 8 + 1 + 1, "layout is packed");
+static_assert(MQTTLayoutField<2, FrameLayout>::offset == 6, "offsets are computed at compile time");
+
+static void testRoundTrip() {
+  Frame frame = {0x01020304, -2, 21.5f, 1234.5678, true, MODE_ON};
+  uint8_t buf[32];
+  CHECK(FrameLayout::encode(frame, buf, sizeof(buf)) == FrameLayout::size);
+
+  // explicit byte order per field
+  CHECK(buf[0] == 0x01 && buf[1] == 0x02 && buf[2] == 0x03 && buf[3] == 0x04);
+  CHECK(buf[4] == 0xfe && buf[5] == 0xff);
+  CHECK(buf[6] == 0x41 && buf[7] == 0xac && buf[8] == 0x00 && buf[9] == 0x00);
+  CHECK(buf[18] == 1 && buf[19] == 7);
+
+  Frame out = {};
+  CHECK(FrameLayout::decode(buf, FrameLayout::size, out));
+  CHECK(out.time == frame.time && out.level == frame.level && out.temperature == frame.temperature);
+  CHECK(out.total == frame.total && out.alarm && out.mode == MODE_ON);
+}
+
+static void testLimits() {
+  Frame frame = {};
+  uint8_t buf[32];
+  CHECK(FrameLayout::encode(frame, buf, FrameLayout::size - 1) == 0);
+  CHECK(FrameLayout::encode(frame, nullptr, sizeof(buf)) == 0);
+  CHECK(!FrameLayout::decode(buf, FrameLayout::size + 1, frame));
+  CHECK(!FrameLayout::decode(nullptr, FrameLayout::size, frame));
+}
+
+static void testInvalidValues() {
+  Frame frame = {1, 2, 3.0f, 4.0, true, MODE_ON};
+  uint8_t buf[32];
+  FrameLayout::encode(frame, buf, sizeof(buf));
+
+  // a bool other than 0 or 1 is rejected and the struct is left unchanged
+  buf[18] = 2;
+  Frame out = {};
+  CHECK(!FrameLayout::decode(buf, FrameLayout::size, out));
+  CHECK(out.time == 0 && !out.alarm);
+  MQTTLayoutView<FrameLayout> view(buf, FrameLayout::size);
+  CHECK(view.valid() && view.get<0>() == 1 && !view.get<4>());
+
+  // an enum value outside the range of its specialization is rejected
+  buf[18] = 1;
+  buf[19] = 3;
+  CHECK(!FrameLayout::decode(buf, FrameLayout::size, out));
+  CHECK(view.get<4>() && view.get<5>() == MODE_OFF);
+  buf[19] = MODE_ON;
+  CHECK(FrameLayout::decode(buf, FrameLayout::size, out));
+  CHECK(out.alarm && out.mode == MODE_ON);
+}
+
+static void testView() {
+  Frame frame = {42, 300, -1.25f, 0.5, false, MODE_ON};
+  uint8_t buf[32];
+  FrameLayout::encode(frame, buf, sizeof(buf));
+
+  MQTTLayoutView<FrameLayout> view(buf, FrameLayout::size);
+  CHECK(view.valid());
+  CHECK(view.get<0>() == 42);
+  CHECK(view.get<1>() == 300);
+  CHECK(view.get<2>() == -1.25f);
+  CHECK(view.get<3>() == 0.5);
+  CHECK(!view.get<4>());
+  CHECK(view.get<5>() == MODE_ON);
+
+  // a view of the wrong length is invalid and reads zeros
+  MQTTLayoutView<FrameLayout> invalid(buf, FrameLayout::size - 1);
+  CHECK(!invalid.valid());
+  CHECK(invalid.get<0>() == 0 && invalid.get<2>() == 0 && invalid.get<5>() == MODE_OFF);
+}
+
+int main() {
+  testRoundTrip();
+  testLimits();
+  testInvalidValues();
+  testView();
+  return TEST_DONE();
+}
@@ -0,0 +1,150 @@
+#include <MQTTClient.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+static std::string readAll(PipeClient &pipe) {
+  std::string out;
+  int c;
+  while ((c = pipe.read()) >= 0) {
+    out += (char)c;
+  }
+  return out;
+}
+
+static void writeAck(PipeClient &server, uint8_t type, uint16_t id) {
+  const uint8_t ack[] = {type, 2, (uint8_t)(id >> 8), (uint8_t)id};
+  server.write(ack, sizeof(ack));
+}
+
+// the test plays the broker of both clients on the server side of their pipes
+static void connectRaw(MQTTClient &client, PipeClient &net, PipeClient &server, const char *id) {
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  client.setTimeout(50);
+  CHECK(client.connect(id));
+  readAll(server);
+}
+
+static void testRewrite() {
+  PipeClient aNet, aServer, bNet, bServer;
+  MQTTClient a(128), b(128);
+  connectRaw(a, aNet, aServer, "a");
+  connectRaw(b, bNet, bServer, "b");
+
+  // with a prefix the topic is rewritten and the packet id is replaced by one of the target
+  CHECK(a.bridge(&b, "fwd/"));
+  const uint8_t publish[] = {0x33, 9, 0, 3, 's', '/', 't', 0x12, 0x34, 'h', 'i'};
+  aServer.write(publish, sizeof(publish));
+  CHECK(a.loop());
+  uint16_t id = b.lastPacketID();
+  CHECK(id != 0x1234);
+  std::string sent = readAll(bServer);
+  const char expected[] = {0x33, 13, 0, 7, 'f', 'w', 'd', '/', 's', '/', 't', (char)(id >> 8), (char)id, 'h', 'i'};
+  CHECK(sent == std::string(expected, sizeof(expected)));
+  CHECK(b.inFlight() == 1);
+
+  // the source acks its own packet id
+  CHECK(readAll(aServer) == std::string("\x40\x02\x12\x34", 4));
+
+  // the ack of the target releases the forward
+  writeAck(bServer, 0x40, id);
+  CHECK(b.loop());
+  CHECK(b.inFlight() == 0);
+
+  // without a prefix the packet is patched in place, only the id differs
+  CHECK(a.bridge(&b));
+  aServer.write(publish, sizeof(publish));
+  CHECK(a.loop());
+  id = b.lastPacketID();
+  std::string patched((const char *)publish, sizeof(publish));
+  patched[7] = (char)(id >> 8);
+  patched[8] = (char)id;
+  CHECK(readAll(bServer) == patched);
+  readAll(aServer);
+
+  // a forward at QoS 2 is completed with pubrec, pubrel and pubcomp
+  writeAck(bServer, 0x50, id);
+  CHECK(b.loop());
+  CHECK(readAll(bServer) == std::string("\x62\x02", 2) + (char)(id >> 8) + (char)id);
+  CHECK(b.inFlight() == 1);
+  writeAck(bServer, 0x70, id);
+  CHECK(b.loop());
+  CHECK(b.inFlight() == 0);
+
+  // lowered to QoS 0 the packet id is dropped and nothing is tracked
+  CHECK(a.bridge(&b, nullptr, 0));
+  aServer.write(publish, sizeof(publish));
+  CHECK(a.loop());
+  const char lowered[] = {0x31, 7, 0, 3, 's', '/', 't', 'h', 'i'};
+  CHECK(readAll(bServer) == std::string(lowered, sizeof(lowered)));
+  CHECK(b.inFlight() == 0);
+}
+
+static void testConcurrentPublish() {
+  PipeClient aNet, aServer, bNet, bServer;
+  MQTTClient a(128), b(128);
+  connectRaw(a, aNet, aServer, "a");
+  connectRaw(b, bNet, bServer, "b");
+  CHECK(a.bridge(&b, nullptr, 1));
+
+  // a forward is in flight when the target publishes itself
+  const uint8_t publish[] = {0x32, 9, 0, 3, 's', '/', 't', 0x00, 0x01, 'h', 'i'};
+  aServer.write(publish, sizeof(publish));
+  CHECK(a.loop());
+  uint16_t forward = b.lastPacketID();
+  readAll(bServer);
+
+  // the ack of the forward arrives first and must not complete the own publish
+  writeAck(bServer, 0x40, forward);
+  writeAck(bServer, 0x40, (uint16_t)(forward + 1));
+  CHECK(b.publish("own", "x", false, 1));
+  CHECK(b.lastPacketID() == forward + 1);
+  CHECK(b.inFlight() == 0);
+  CHECK(bNet.available() == 0);
+
+  // an ack of a forward alone lets the own publish time out
+  aServer.write(publish, sizeof(publish));
+  CHECK(a.loop());
+  forward = b.lastPacketID();
+  readAll(bServer);
+  writeAck(bServer, 0x40, forward);
+  CHECK(!b.publish("own", "x", false, 1));
+  CHECK(b.lastError() == LWMQTT_MISSING_OR_WRONG_PACKET);
+  CHECK(b.inFlight() == 0);
+}
+
+static void testFullTable() {
+  PipeClient aNet, aServer, bNet, bServer;
+  MQTTClient a(128), b(128);
+  connectRaw(a, aNet, aServer, "a");
+  connectRaw(b, bNet, bServer, "b");
+  CHECK(a.bridge(&b, nullptr, 1));
+
+  // unacknowledged forwards fill the id table, further ones are dropped without closing the target
+  const uint8_t publish[] = {0x32, 9, 0, 3, 's', '/', 't', 0x00, 0x01, 'h', 'i'};
+  for (int i = 0; i <= LWMQTT_INFLIGHT_IDS; i++) {
+    aServer.write(publish, sizeof(publish));
+    CHECK(a.loop());
+  }
+  CHECK(b.inFlight() == LWMQTT_INFLIGHT_IDS);
+  CHECK(a.bridgeDropped() == 1);
+  CHECK(b.connected());
+
+  // a reconnect forgets the forwards of the old connection
+  b.disconnect();
+  connectRaw(b, bNet, bServer, "b");
+  CHECK(b.inFlight() == 0);
+}
+
+int main() {
+  testRewrite();
+  testConcurrentPublish();
+  testFullTable();
+  return TEST_DONE();
+}
@@ -0,0 +1,102 @@
+// Load test of the broker over TCP on the host: publishers and subscribers on one thread, the broker on another.
+//   broker_load [port] [messages per publisher] [publishers] [subscribers] [qos]
+
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#define MAX_CLIENTS 16
+
+static MQTTSocketClient pool[MAX_CLIENTS];
+static MQTTSocketServer server(pool, MAX_CLIENTS);
+static MQTTBrokerSession sessions[MAX_CLIENTS];
+static MQTTBrokerSubscription subscriptions[MAX_CLIENTS];
+static MQTTBroker broker(sessions, MAX_CLIENTS, subscriptions, MAX_CLIENTS);
+
+static std::atomic<bool> running(true);
+static uint32_t received = 0;
+
+static void countMessage(MQTTClient *, const char *, size_t, const char *, size_t) { received++; }
+
+int main(int argc, char **argv) {
+  int port = (argc > 1) ? atoi(argv[1]) : 18830;
+  int messages = (argc > 2) ? atoi(argv[2]) : 1000;
+  int publishers = (argc > 3) ? atoi(argv[3]) : 2;
+  int subscribers = (argc > 4) ? atoi(argv[4]) : 4;
+  int qos = (argc > 5) ? atoi(argv[5]) : 1;
+  if (publishers < 1 || subscribers < 1 || publishers + subscribers > MAX_CLIENTS) {
+    fprintf(stderr, "between 2 and %d clients are supported\n", MAX_CLIENTS);
+    return 2;
+  }
+  if (!server.begin((uint16_t)port)) {
+    fprintf(stderr, "failed to listen on port %d\n", port);
+    return 2;
+  }
+
+  std::thread thread([] {
+    while (running) {
+      MQTTSocketClient *client = server.accept();
+      if (client != nullptr) {
+        broker.accept(*client);
+      }
+      broker.loop();
+      yield();
+    }
+  });
+
+  static MQTTSocketClient nets[MAX_CLIENTS];
+  static MQTTClient *clients[MAX_CLIENTS];
+  int total = publishers + subscribers;
+  bool ok = true;
+  for (int i = 0; i < total; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "client-%d", i);
+    clients[i] = new MQTTClient(256);
+    clients[i]->begin("127.0.0.1", port, nets[i]);
+    clients[i]->setTimeout(5000);
+    clients[i]->onMessageRaw(countMessage);
+    ok = ok && clients[i]->connect(id);
+    if (ok && i >= publishers) {
+      ok = clients[i]->subscribe("load/#", qos);
+    }
+  }
+
+  // publish round robin and let the subscribers read in between
+  char payload[64];
+  memset(payload, 'x', sizeof(payload));
+  uint32_t expected = (uint32_t)(messages * publishers * subscribers);
+  unsigned long start = micros();
+  for (int m = 0; ok && m < messages; m++) {
+    for (int p = 0; ok && p < publishers; p++) {
+      ok = clients[p]->publish("load/data", payload, sizeof(payload), false, qos);
+    }
+    for (int s = publishers; s < total; s++) {
+      clients[s]->loop();
+    }
+  }
+  unsigned long deadline = millis() + 5000;
+  while (ok && received < expected && millis() < deadline) {
+    for (int s = publishers; s < total; s++) {
+      clients[s]->loop();
+    }
+  }
+  unsigned long elapsed = micros() - start;
+
+  running = false;
+  thread.join();
+  for (int i = 0; i < total; i++) {
+    delete clients[i];
+  }
+
+  double seconds = elapsed / 1e6;
+  printf("published %d, delivered %u of %u in %.3f s (%.0f deliveries/s)\n", messages * publishers, received, expected,
+         seconds, received / seconds);
+
+  // QoS 0 may be lost under load, QoS 1 deliveries must be complete
+  return ok && (qos == 0 || received == expected) ? 0 : 1;
+}
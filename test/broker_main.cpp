@@ -0,0 +1,39 @@
+// Host broker example: accepts local connections and prints every published message.
+//   mqtt_broker [port]
+
+#include <MQTTBroker.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+#define MAX_CLIENTS 8
+
+static MQTTSocketClient pool[MAX_CLIENTS];
+static MQTTSocketServer server(pool, MAX_CLIENTS);
+static MQTTBrokerSession sessions[MAX_CLIENTS];
+static MQTTBrokerSubscription subscriptions[4 * MAX_CLIENTS];
+static MQTTBroker broker(sessions, MAX_CLIENTS, subscriptions, 4 * MAX_CLIENTS);
+
+static void printMessage(MQTTBroker *, const char topic[], size_t topicLen, const char payload[], size_t length) {
+  printf("%.*s: %.*s\n", (int)topicLen, topic, (int)length, payload);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  int port = (argc > 1) ? atoi(argv[1]) : 1883;
+  if (!server.begin((uint16_t)port)) {
+    fprintf(stderr, "failed to listen on port %d\n", port);
+    return 1;
+  }
+  broker.onMessage(printMessage);
+  printf("listening on port %d\n", port);
+
+  for (;;) {
+    MQTTSocketClient *client = server.accept();
+    if (client != nullptr && !broker.accept(*client)) {
+      client->stop();
+    }
+    broker.loop();
+    delay(1);
+  }
+}
@@ -0,0 +1,105 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+
+#include "pipe.h"
+#include "test.h"
+
+static MQTTBrokerSession sessions[2];
+static MQTTBrokerSubscription subscriptions[4];
+static MQTTBroker broker(sessions, 2, subscriptions, 4);
+
+static int received = 0;
+
+// the client runs the broker while it waits for data, so both sides work in a single thread
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+static void countMessage(MQTTClient *, const char *, size_t, const char *, size_t) { received++; }
+
+static void settle(MQTTClient &client) {
+  for (int i = 0; i < 10; i++) {
+    broker.loop();
+    client.loop();
+  }
+}
+
+static void testQos2Once() {
+  PipeClient subClient, subSession, pubClient, pubSession;
+  PipeClient::pair(subClient, subSession);
+  PipeClient::pair(pubClient, pubSession);
+  CHECK(broker.accept(subSession));
+  CHECK(broker.accept(pubSession));
+
+  MQTTClient sub(128);
+  sub.begin(subClient);
+  sub.setWaitCallback(runBroker);
+  sub.onMessageRaw(countMessage);
+  CHECK(sub.connect("sub"));
+  CHECK(sub.subscribe("t/#", 1));
+
+  // raw publisher: connect, a QoS 2 publish, its retransmission, the release and a new message with the same id
+  const uint8_t connect[] = {0x10, 13, 0, 4, 'M', 'Q', 'T', 'T', 4, 2, 0, 10, 0, 1, 'p'};
+  const uint8_t publish[] = {0x34, 9, 0, 3, 't', '/', 'x', 0, 7, 'h', 'i'};
+  const uint8_t retransmit[] = {0x3c, 9, 0, 3, 't', '/', 'x', 0, 7, 'h', 'i'};
+  const uint8_t release[] = {0x62, 2, 0, 7};
+  pubClient.write(connect, sizeof(connect));
+  pubClient.write(publish, sizeof(publish));
+  settle(sub);
+  CHECK(received == 1);
+
+  pubClient.write(retransmit, sizeof(retransmit));
+  settle(sub);
+  CHECK(received == 1);
+
+  pubClient.write(release, sizeof(release));
+  pubClient.write(publish, sizeof(publish));
+  settle(sub);
+  CHECK(received == 2);
+
+  // connack, two pubrec (one per publish including the retransmission), pubcomp and the last pubrec
+  uint8_t acks[64];
+  int n = pubClient.read(acks, sizeof(acks));
+  CHECK(n == 4 + 4 + 4 + 4 + 4);
+  CHECK(acks[4] == 0x50 && acks[8] == 0x50 && acks[12] == 0x70 && acks[16] == 0x50);
+
+  sub.disconnect();
+  pubClient.stop();
+  broker.loop();
+  CHECK(broker.connections() == 0);
+}
+
+static void testFanOut() {
+  PipeClient aClient, aSession, bClient, bSession;
+  PipeClient::pair(aClient, aSession);
+  PipeClient::pair(bClient, bSession);
+  CHECK(broker.accept(aSession));
+  CHECK(broker.accept(bSession));
+
+  MQTTClient a(128), b(128);
+  a.begin(aClient);
+  b.begin(bClient);
+  a.setWaitCallback(runBroker);
+  b.setWaitCallback(runBroker);
+  b.onMessageRaw(countMessage);
+  CHECK(a.connect("a"));
+  CHECK(b.connect("b"));
+  CHECK(b.subscribe("s/+", 1));
+
+  // QoS 1 publishes are acknowledged by the broker and delivered once to the matching subscription
+  received = 0;
+  CHECK(a.publish("s/1", "one", false, 1));
+  CHECK(a.publish("x/1", "two", false, 1));
+  CHECK(broker.publish("s/2", "three"));
+  settle(b);
+  CHECK(received == 2);
+
+  a.disconnect();
+  b.disconnect();
+  broker.loop();
+  CHECK(broker.connections() == 0);
+}
+
+int main() {
+  testQos2Once();
+  testFanOut();
+  return TEST_DONE();
+}
@@ -0,0 +1,67 @@
+// Size and encoding time of a sensor record as CBOR with MQTTCborWriter and as JSON with snprintf, and the time to
+// find a field in the JSON document with MQTTJsonReader.
+
+#include <MQTTCbor.h>
+#include <MQTTJson.h>
+
+#include "bench.h"
+#include "test.h"
+
+static size_t encodeCbor(uint8_t *buf, size_t cap, uint32_t i) {
+  MQTTCborWriter w(buf, cap);
+  w.map(5)
+      .text("id")
+      .text("sensor-17")
+      .text("ts")
+      .uinteger(1700000000u + i)
+      .text("temp")
+      .number(21.5f + (float)(i % 10))
+      .text("rssi")
+      .integer(-60 - (int)(i % 20))
+      .text("ok")
+      .boolean(true);
+  CHECK(w.ok());
+  return w.length();
+}
+
+static size_t encodeJson(char *buf, size_t cap, uint32_t i) {
+  int n = snprintf(buf, cap, "{\"id\":\"sensor-17\",\"ts\":%lu,\"temp\":%.1f,\"rssi\":%d,\"ok\":true}",
+                   (unsigned long)(1700000000u + i), 21.5 + (double)(i % 10), -60 - (int)(i % 20));
+  CHECK(n > 0 && (size_t)n < cap);
+  return (size_t)n;
+}
+
+int main(int argc, char **argv) {
+  uint32_t n = benchIterations(argc, argv, 1000000);
+  uint8_t cbor[128];
+  char json[128];
+
+  size_t cborLen = encodeCbor(cbor, sizeof(cbor), 0);
+  size_t jsonLen = encodeJson(json, sizeof(json), 0);
+  printf("record size: cbor %zu bytes, json %zu bytes\n", cborLen, jsonLen);
+
+  uint64_t start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    bench_sink += encodeCbor(cbor, sizeof(cbor), i);
+  }
+  benchReport("encode cbor", benchNanos() - start, n, cborLen);
+
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    bench_sink += encodeJson(json, sizeof(json), i);
+  }
+  benchReport("encode json (snprintf)", benchNanos() - start, n, jsonLen);
+
+  // a sketch that receives JSON looks up its fields in place
+  jsonLen = encodeJson(json, sizeof(json), 0);
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    MQTTJsonReader r(json, jsonLen);
+    MQTTJsonToken token;
+    CHECK(r.find("rssi", token));
+    bench_sink += (uintptr_t)token.toInt();
+  }
+  benchReport("find json field", benchNanos() - start, n, jsonLen);
+
+  return TEST_DONE();
+}
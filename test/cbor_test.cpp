@@ -0,0 +1,211 @@
+#include <MQTTCbor.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <string>
+
+#include "test.h"
+
+static bool bytesAre(MQTTCborWriter &w, const uint8_t *expected, size_t len) {
+  return w.ok() && w.length() == len && memcmp(w.data(), expected, len) == 0;
+}
+
+#define BYTES_ARE(w, ...)                              \
+  do {                                                 \
+    const uint8_t expected[] = {__VA_ARGS__};          \
+    CHECK(bytesAre(w, expected, sizeof(expected)));    \
+  } while (0)
+
+// vectors from RFC 8949 appendix A
+static void testVectors() {
+  uint8_t buf[64];
+  MQTTCborWriter w(buf, sizeof(buf));
+
+  w.uinteger(0);
+  BYTES_ARE(w, 0x00);
+  w.reset();
+  w.uinteger(23);
+  BYTES_ARE(w, 0x17);
+  w.reset();
+  w.uinteger(24);
+  BYTES_ARE(w, 0x18, 0x18);
+  w.reset();
+  w.uinteger(1000);
+  BYTES_ARE(w, 0x19, 0x03, 0xe8);
+  w.reset();
+  w.uinteger(1000000);
+  BYTES_ARE(w, 0x1a, 0x00, 0x0f, 0x42, 0x40);
+  w.reset();
+  w.uinteger(1000000000000);
+  BYTES_ARE(w, 0x1b, 0x00, 0x00, 0x00, 0xe8, 0xd4, 0xa5, 0x10, 0x00);
+  w.reset();
+  w.integer(-1);
+  BYTES_ARE(w, 0x20);
+  w.reset();
+  w.integer(-1000);
+  BYTES_ARE(w, 0x39, 0x03, 0xe7);
+  w.reset();
+  w.integer(INT64_MIN);
+  BYTES_ARE(w, 0x3b, 0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff);
+  w.reset();
+  w.number(100000.0f);
+  BYTES_ARE(w, 0xfa, 0x47, 0xc3, 0x50, 0x00);
+  w.reset();
+  w.number(1.1);
+  BYTES_ARE(w, 0xfb, 0x3f, 0xf1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a);
+  w.reset();
+  w.number(0.5);
+  BYTES_ARE(w, 0xfa, 0x3f, 0x00, 0x00, 0x00);
+  w.reset();
+  w.number(1.0e+300);
+  BYTES_ARE(w, 0xfb, 0x7e, 0x37, 0xe4, 0x3c, 0x88, 0x00, 0x75, 0x9c);
+  w.reset();
+  w.number(-(double)INFINITY);
+  BYTES_ARE(w, 0xfa, 0xff, 0x80, 0x00, 0x00);
+  w.reset();
+  w.boolean(false).boolean(true).null();
+  BYTES_ARE(w, 0xf4, 0xf5, 0xf6);
+  w.reset();
+  w.text("IETF");
+  BYTES_ARE(w, 0x64, 0x49, 0x45, 0x54, 0x46);
+  w.reset();
+  const uint8_t data[] = {1, 2, 3, 4};
+  w.bytes(data, 4);
+  BYTES_ARE(w, 0x44, 0x01, 0x02, 0x03, 0x04);
+  w.reset();
+  w.map(2).text("a").integer(1).text("b").array(2).integer(2).integer(3);
+  BYTES_ARE(w, 0xa2, 0x61, 0x61, 0x01, 0x61, 0x62, 0x82, 0x02, 0x03);
+  w.reset();
+  w.beginMap().text("a").integer(1).text("b").beginArray().integer(2).integer(3).end().end();
+  BYTES_ARE(w, 0xbf, 0x61, 0x61, 0x01, 0x61, 0x62, 0x9f, 0x02, 0x03, 0xff, 0xff);
+}
+
+// decodes one item into diagnostic notation, returns the number of consumed bytes or zero
+static size_t decode(const uint8_t *p, size_t len, std::string &out) {
+  if (len == 0) return 0;
+  uint8_t major = p[0] >> 5, info = p[0] & 0x1f;
+  size_t n = 1;
+  uint64_t arg = info;
+  if (major == 7 && (info == 26 || info == 27)) {
+    size_t size = (info == 26) ? 4 : 8;
+    if (len < 1 + size) return 0;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < size; i++) bits = bits << 8 | p[1 + i];
+    double v;
+    if (size == 4) {
+      uint32_t b = (uint32_t)bits;
+      float f;
+      memcpy(&f, &b, 4);
+      v = f;
+    } else {
+      memcpy(&v, &bits, 8);
+    }
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), "%g", v);
+    out += tmp;
+    return 1 + size;
+  } else if (info >= 24 && info <= 27) {
+    size_t size = (size_t)1 << (info - 24);
+    if (len < 1 + size) return 0;
+    arg = 0;
+    for (size_t i = 0; i < size; i++) arg = arg << 8 | p[1 + i];
+    n += size;
+  }
+  bool indefinite = info == 31;
+  char tmp[32];
+  switch (major) {
+    case 0:
+      snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)arg);
+      out += tmp;
+      return n;
+    case 1:
+      snprintf(tmp, sizeof(tmp), "-%llu", (unsigned long long)arg + 1);
+      out += tmp;
+      return n;
+    case 2:
+    case 3:
+      if (len - n < arg) return 0;
+      out += (major == 3) ? "\"" : "h'";
+      if (major == 3) {
+        out.append((const char *)p + n, arg);
+      } else {
+        for (size_t i = 0; i < arg; i++) {
+          snprintf(tmp, sizeof(tmp), "%02x", p[n + i]);
+          out += tmp;
+        }
+      }
+      out += (major == 3) ? "\"" : "'";
+      return n + arg;
+    case 4:
+    case 5: {
+      out += (major == 4) ? "[" : "{";
+      size_t items = (major == 5) ? arg * 2 : arg;
+      for (size_t i = 0; indefinite || i < items; i++) {
+        if (indefinite && n < len && p[n] == 0xff) {
+          n++;
+          break;
+        }
+        if (i > 0) out += (major == 5 && i % 2 == 1) ? ": " : ", ";
+        size_t m = decode(p + n, len - n, out);
+        if (m == 0) return 0;
+        n += m;
+      }
+      out += (major == 4) ? "]" : "}";
+      return n;
+    }
+    case 7:
+      out += (info == 20) ? "false" : (info == 21) ? "true" : (info == 22) ? "null" : "?";
+      return n;
+    default:
+      return 0;
+  }
+}
+
+static void testRoundTrip() {
+  uint8_t buf[128];
+  MQTTCborWriter w(buf, sizeof(buf));
+  const uint8_t raw[] = {0xde, 0xad};
+  w.map(3)
+      .text("temp")
+      .number(21.5f)
+      .text("values")
+      .beginArray()
+      .integer(-300)
+      .uinteger(70000)
+      .boolean(true)
+      .null()
+      .bytes(raw, 2)
+      .end()
+      .text("precise")
+      .number(0.1);
+  CHECK(w.ok());
+
+  std::string out;
+  CHECK(decode(w.data(), w.length(), out) == w.length());
+  CHECK(out == "{\"temp\": 21.5, \"values\": [-300, 70000, true, null, h'dead'], \"precise\": 0.1}");
+}
+
+static void testOverflow() {
+  uint8_t buf[8];
+  MQTTCborWriter w(buf, sizeof(buf));
+  w.array(2).text("abc");
+  CHECK(w.ok() && w.length() == 5);
+  w.text("abcd");
+  CHECK(!w.ok());
+
+  // once failed the writer stays failed until reset
+  size_t len = w.length();
+  w.null();
+  CHECK(!w.ok() && w.length() == len && len <= sizeof(buf));
+  w.reset();
+  w.null();
+  CHECK(w.ok() && w.length() == 1);
+}
+
+int main() {
+  testVectors();
+  testRoundTrip();
+  testOverflow();
+  return TEST_DONE();
+}
@@ -0,0 +1,146 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+#include <MQTTFragment.h>
+
+#include "pipe.h"
+#include "test.h"
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[2];
+static MQTTBroker broker(sessions, 1, subscriptions, 2);
+
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+// chunks as received from the broker
+static uint8_t chunks[16][64];
+static size_t chunkLens[16];
+static size_t chunkCount = 0;
+
+static void storeChunk(MQTTClient *, const char *, size_t, const char *payload, size_t length) {
+  if (chunkCount < 16 && length <= 64) {
+    memcpy(chunks[chunkCount], payload, length);
+    chunkLens[chunkCount++] = length;
+  }
+}
+
+static void settle(MQTTClient &client) {
+  for (int i = 0; i < 20; i++) {
+    broker.loop();
+    client.loop();
+  }
+}
+
+static uint8_t message[100];
+
+// a manual clock for the timeouts of the reassembler
+static uint32_t fakeNow = 0;
+static uint32_t fakeMillis() { return fakeNow; }
+
+// publishes the message in 25 byte chunks and collects them
+static void publishChunks(MQTTClient &client, MQTTFragmenter &fragmenter) {
+  chunkCount = 0;
+  CHECK(fragmenter.publish(client, "f/data", message, sizeof(message), 25, 1));
+  settle(client);
+  CHECK(chunkCount == 4);
+}
+
+static bool feed(MQTTReassembler &r, size_t i, const uint8_t *&data, size_t &length) {
+  return r.feed("f/data", 6, (const char *)chunks[i], chunkLens[i], data, length);
+}
+
+static void testFragments(MQTTClient &client) {
+  MQTTFragmenter fragmenter;
+  MQTTFragmentSlot slots[2];
+  uint8_t area[2 * 128];
+  MQTTReassembler reassembler(slots, 2, area, 128, 50);
+  const uint8_t *data;
+  size_t length;
+
+  for (size_t i = 0; i < sizeof(message); i++) {
+    message[i] = (uint8_t)(i * 7);
+  }
+  publishChunks(client, fragmenter);
+  for (size_t i = 0; i < chunkCount; i++) {
+    CHECK(MQTTReassembler::isFragment((const char *)chunks[i], chunkLens[i]));
+  }
+
+  // reverse order with a duplicate
+  CHECK(!feed(reassembler, 3, data, length));
+  CHECK(!feed(reassembler, 1, data, length));
+  CHECK(!feed(reassembler, 1, data, length));
+  CHECK(!feed(reassembler, 2, data, length));
+  CHECK(feed(reassembler, 0, data, length));
+  CHECK(length == sizeof(message) && memcmp(data, message, length) == 0);
+  CHECK(reassembler.dropped() == 0);
+
+  // a corrupted chunk fails the checksum of the message
+  chunks[2][20] ^= 0x01;
+  for (size_t i = 0; i < 3; i++) {
+    CHECK(!feed(reassembler, i, data, length));
+  }
+  CHECK(!feed(reassembler, 3, data, length));
+  CHECK(reassembler.dropped() == 1);
+
+  // incomplete messages expire after the timeout on the clock of the reassembler, across its rollover
+  reassembler.setClock(fakeMillis);
+  fakeNow = 0xfffffff0u;
+  publishChunks(client, fragmenter);
+  CHECK(!feed(reassembler, 0, data, length));
+  fakeNow += 49;
+  reassembler.expire();
+  CHECK(reassembler.dropped() == 1);
+  fakeNow += 1;
+  reassembler.expire();
+  CHECK(reassembler.dropped() == 2);
+  for (size_t i = 1; i < 4; i++) {
+    CHECK(!feed(reassembler, i, data, length));
+  }
+
+  // a new message takes the slot of the oldest one when the table is full
+  publishChunks(client, fragmenter);
+  uint8_t kept[4][64];
+  memcpy(kept, chunks, sizeof(kept));
+  fakeNow += 10;
+  CHECK(!feed(reassembler, 0, data, length));
+  publishChunks(client, fragmenter);
+  fakeNow += 10;
+  CHECK(!feed(reassembler, 0, data, length));
+  CHECK(reassembler.dropped() == 3);
+  memcpy(chunks, kept, sizeof(kept));
+  for (size_t i = 1; i < 3; i++) {
+    CHECK(!feed(reassembler, i, data, length));
+  }
+  CHECK(feed(reassembler, 3, data, length));
+  CHECK(length == sizeof(message) && memcmp(data, message, length) == 0);
+
+  // too large messages do not fit the slots
+  MQTTReassembler small(slots, 2, area, 64);
+  publishChunks(client, fragmenter);
+  CHECK(!feed(small, 3, data, length));
+}
+
+static void testNotFragments() {
+  const char binary[] = {(char)MQTT_FRAGMENT_MAGIC, 0, 1, 0, 0, 0, 1, 0, 4, 0, 0, 0, 0, 0, 0, 'a', 'b'};
+  CHECK(!MQTTReassembler::isFragment(binary, sizeof(binary)));
+  CHECK(!MQTTReassembler::isFragment("FR", 2));
+  CHECK(!MQTTReassembler::isFragment(nullptr, 0));
+}
+
+int main() {
+  PipeClient net, session;
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+
+  MQTTClient client(64);
+  client.begin(net);
+  client.setWaitCallback(runBroker);
+  client.onMessageRaw(storeChunk);
+  CHECK(client.connect("fragment"));
+  CHECK(client.subscribe("f/#", 1));
+
+  testFragments(client);
+  testNotFragments();
+
+  client.disconnect();
+  return TEST_DONE();
+}
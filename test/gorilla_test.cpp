@@ -0,0 +1,136 @@
+#include <MQTTGorilla.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <string>
+
+extern "C" {
+#include <lwmqtt/helpers.h>
+}
+
+#include "test.h"
+
+// a slowly changing sensor sampled every second with some jitter
+static void sample(int i, uint32_t &time, float values[3]) {
+  time = 1000000u + (uint32_t)i * 1000u + (uint32_t)(i % 3);
+  values[0] = 21.5f + (float)(i / 10) * 0.25f;
+  values[1] = 48.0f;
+  values[2] = 1013.25f + sinf((float)i * 0.1f);
+}
+
+static void testRoundTrip() {
+  MQTTGorillaState enc, dec;
+  MQTTGorilla::reset(enc);
+  MQTTGorilla::reset(dec);
+
+  size_t total = 0;
+  size_t keyLen = 0;
+  for (int i = 0; i < 100; i++) {
+    uint32_t time, outTime;
+    float values[3], out[3];
+    sample(i, time, values);
+
+    uint8_t buf[64];
+    size_t len = MQTTGorilla::encode(enc, time, values, 3, buf, sizeof(buf), 60);
+    CHECK(len > 0);
+    if (i == 0) {
+      keyLen = len;
+    }
+    total += len;
+
+    CHECK(MQTTGorilla::decode(dec, buf, len, outTime, out, 3) == 3);
+    CHECK(outTime == time && memcmp(out, values, sizeof(values)) == 0);
+  }
+
+  // compressed frames are much smaller than key frames
+  CHECK(total < 100 * keyLen / 2);
+}
+
+static void testLoss() {
+  MQTTGorillaState enc, dec;
+  MQTTGorilla::reset(enc);
+  MQTTGorilla::reset(dec);
+  uint8_t buf[64];
+  uint32_t time, outTime;
+  float values[3], out[3];
+
+  // a lost frame breaks the chain until the next key frame
+  for (int i = 0; i < 10; i++) {
+    sample(i, time, values);
+    size_t len = MQTTGorilla::encode(enc, time, values, 3, buf, sizeof(buf), 5);
+    int res = (i == 2) ? 0 : MQTTGorilla::decode(dec, buf, len, outTime, out, 3);
+    if (i < 2 || i >= 5) {
+      CHECK(res == 3 && outTime == time);
+    } else if (i > 2) {
+      CHECK(res == -1);
+    }
+  }
+
+  // a different number of values starts with a key frame
+  float two[2] = {1.0f, 2.0f};
+  size_t len = MQTTGorilla::encode(enc, time + 1000, two, 2, buf, sizeof(buf));
+  CHECK(MQTTGorilla::decode(dec, buf, len, outTime, out, 3) == 2 && out[1] == 2.0f);
+
+  // a frame with more values than the decoder accepts fails
+  sample(11, time, values);
+  len = MQTTGorilla::encode(enc, time, values, 3, buf, sizeof(buf));
+  CHECK(MQTTGorilla::decode(dec, buf, len, outTime, out, 2) < 0);
+}
+
+static void testBuffer() {
+  MQTTGorillaState enc;
+  MQTTGorilla::reset(enc);
+  uint8_t buf[4];
+  uint32_t time;
+  float values[3];
+  sample(0, time, values);
+
+  // a full buffer leaves the state unchanged
+  CHECK(MQTTGorilla::encode(enc, time, values, 3, buf, sizeof(buf)) == 0);
+  CHECK(!enc.started);
+}
+
+static void testStates() {
+  MQTTGorillaState slots[2];
+  MQTTGorillaStates states(slots, 2);
+  MQTTGorillaState *a = states.get("a");
+  MQTTGorillaState *b = states.get("b");
+  CHECK(a != nullptr && b != nullptr && a != b);
+  CHECK(states.get("a") == a);
+  CHECK(states.get("c") == nullptr);
+
+  // reset restarts the stream but keeps its slot
+  a->started = true;
+  states.reset("a");
+  CHECK(states.get("a") == a && !a->started);
+  CHECK(states.get("c") == nullptr);
+  states.clear();
+  CHECK(states.get("d") != nullptr);
+
+  // topics with the same hash get their own states
+  const char x[] = "s/638738", y[] = "s/1520580";
+  CHECK(lwmqtt_fnv1a(x, strlen(x)) == lwmqtt_fnv1a(y, strlen(y)));
+  states.clear();
+  MQTTGorillaState *sx = states.get(x);
+  MQTTGorillaState *sy = states.get(y);
+  CHECK(sx != nullptr && sy != nullptr && sx != sy);
+  CHECK(states.get(x) == sx && states.get(y) == sy);
+  CHECK(strcmp(sx->name, x) == 0);
+
+  // long topics are stored by prefix and told apart by their length
+  states.clear();
+  std::string l40(40, 'l'), l41(41, 'l');
+  MQTTGorillaState *sl = states.get(l40.c_str());
+  CHECK(sl != nullptr && sl->nameLen == 40 && strlen(sl->name) == MQTT_GORILLA_TOPIC_SIZE - 1);
+  CHECK(states.get(l41.c_str()) != sl);
+  CHECK(states.get(l40.c_str()) == sl);
+}
+
+int main() {
+  testRoundTrip();
+  testLoss();
+  testBuffer();
+  testStates();
+  return TEST_DONE();
+}
@@ -0,0 +1,127 @@
+#include <MQTTJson.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <string>
+
+#include "test.h"
+
+static const char doc[] =
+    "{ \"id\": \"dev-1\", \"cfg\": {\"interval\": 250, \"ratio\": -1.5e-3, \"on\": true, \"list\": [1, [2, 3], {\"x\": "
+    "null}, 4]}, \"name\": \"a \\\"quoted\\\" \\n word\", \"empty\": {}, \"last\": false }";
+
+// tokenizes the document and writes it back without whitespace
+static std::string minify(const char *json, size_t len) {
+  MQTTJsonReader reader(json, len);
+  MQTTJsonToken token;
+  std::string out;
+  bool first = true;
+  for (;;) {
+    MQTTJsonType type = reader.next(token);
+    if (type == MQTT_JSON_END || type == MQTT_JSON_ERROR) {
+      return type == MQTT_JSON_END ? out : "error";
+    }
+    if (type == MQTT_JSON_OBJECT_END || type == MQTT_JSON_ARRAY_END) {
+      out += *token.ptr;
+      first = false;
+      continue;
+    }
+    if (!first && out.back() != ':') {
+      out += ',';
+    }
+    first = (type == MQTT_JSON_OBJECT || type == MQTT_JSON_ARRAY);
+    if (type == MQTT_JSON_KEY || type == MQTT_JSON_STRING) {
+      out += '"';
+      out.append(token.ptr, token.len);
+      out += (type == MQTT_JSON_KEY) ? "\":" : "\"";
+    } else {
+      out.append(token.ptr, token.len);
+    }
+  }
+}
+
+static void testRoundTrip() {
+  std::string out = minify(doc, sizeof(doc) - 1);
+  CHECK(out ==
+        "{\"id\":\"dev-1\",\"cfg\":{\"interval\":250,\"ratio\":-1.5e-3,\"on\":true,\"list\":[1,[2,3],{\"x\":null},4]},"
+        "\"name\":\"a \\\"quoted\\\" \\n word\",\"empty\":{},\"last\":false}");
+
+  // the minified document tokenizes to itself
+  CHECK(minify(out.c_str(), out.size()) == out);
+}
+
+static void testFind() {
+  MQTTJsonReader json(doc, sizeof(doc) - 1);
+  MQTTJsonToken token;
+
+  CHECK(json.find("cfg.interval", token) && token.type == MQTT_JSON_NUMBER && token.toInt() == 250);
+  CHECK(json.find("cfg.ratio", token) && fabs(token.toDouble() + 0.0015) < 1e-12);
+  CHECK(json.find("cfg.on", token) && token.toBool());
+  CHECK(json.find("cfg.list.1.1", token) && token.toInt() == 3);
+  CHECK(json.find("cfg.list.2.x", token) && token.type == MQTT_JSON_NULL);
+  CHECK(json.find("cfg.list.3", token) && token.toInt() == 4);
+  CHECK(json.find("id", token) && token.equals("dev-1"));
+  CHECK(json.find("last", token) && token.type == MQTT_JSON_FALSE && !token.toBool(true));
+  CHECK(json.find("empty", token) && token.type == MQTT_JSON_OBJECT);
+
+  // missing keys, indices and paths through values
+  CHECK(!json.find("cfg.missing", token));
+  CHECK(!json.find("cfg.list.4", token));
+  CHECK(!json.find("cfg.list.x", token));
+  CHECK(!json.find("id.x", token));
+  CHECK(!json.find("empty.x", token));
+
+  // escapes are resolved when copying
+  char buf[32];
+  CHECK(json.find("name", token));
+  CHECK(!token.equals("a \"quoted\" \n word"));
+  CHECK(token.copy(buf, sizeof(buf)) == 17 && strcmp(buf, "a \"quoted\" \n word") == 0);
+  CHECK(token.copy(buf, 4) == 3 && strcmp(buf, "a \"") == 0);
+}
+
+static double number(const char *str) {
+  MQTTJsonToken token;
+  token.type = MQTT_JSON_NUMBER;
+  token.ptr = str;
+  token.len = strlen(str);
+  return token.toDouble();
+}
+
+static void testNumbers() {
+  CHECK(number("0") == 0);
+  CHECK(number("-0.25") == -0.25);
+  CHECK(number("21.5") == 21.5);
+  CHECK(fabs(number("6.02214076e23") / 6.02214076e23 - 1) < 1e-12);
+  CHECK(fabs(number("1E-7") / 1e-7 - 1) < 1e-12);
+  CHECK(fabs(number("0.000123456789012345678901") / 0.000123456789012345678901 - 1) < 1e-12);
+
+  MQTTJsonToken text;
+  text.type = MQTT_JSON_STRING;
+  text.ptr = "12";
+  text.len = 2;
+  CHECK(text.toInt(-1) == -1 && text.toDouble(2.5) == 2.5);
+}
+
+static void testMalformed() {
+  const char *bad[] = {"{\"a\": tru}", "{\"a\": \"open}", "[1, 2, @]"};
+  for (const char *json : bad) {
+    CHECK(minify(json, strlen(json)) == "error");
+  }
+
+  // the reader stops at the end of the buffer and at a terminating zero
+  MQTTJsonReader reader("[1, 2]", 3);
+  MQTTJsonToken token;
+  CHECK(reader.next(token) == MQTT_JSON_ARRAY);
+  CHECK(reader.next(token) == MQTT_JSON_NUMBER && token.len == 1);
+  CHECK(reader.next(token) == MQTT_JSON_END);
+  CHECK(reader.level() == 1);
+}
+
+int main() {
+  testRoundTrip();
+  testFind();
+  testNumbers();
+  testMalformed();
+  return TEST_DONE();
+}
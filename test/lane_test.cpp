@@ -0,0 +1,167 @@
+#include <MQTTClient.h>
+#include <MQTTOutbox.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+// the test plays the broker on the server side of the pipe
+static void connectRaw(MQTTClient &client, PipeClient &net, PipeClient &server) {
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  client.setTimeout(20);
+  CHECK(client.connect("lanes"));
+  uint8_t buf[64];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+// reads the next publish sent by the client and returns its topic, the packet id is stored for acks
+static std::string nextTopic(PipeClient &server, uint16_t *id = nullptr) {
+  uint8_t head[2];
+  if (server.read(head, 2) != 2) {
+    return "";
+  }
+  CHECK((head[0] & 0xf0) == 0x30 && head[1] < 128);
+  uint8_t body[128];
+  CHECK(server.read(body, head[1]) == head[1]);
+  size_t len = (size_t)body[0] << 8 | body[1];
+  if (id != nullptr && (head[0] & 0x06) != 0) {
+    *id = (uint16_t)(body[2 + len] << 8 | body[3 + len]);
+  }
+  return std::string((const char *)body + 2, len);
+}
+
+static void writeAck(PipeClient &server, uint16_t id) {
+  const uint8_t ack[] = {0x40, 2, (uint8_t)(id >> 8), (uint8_t)id};
+  server.write(ack, sizeof(ack));
+}
+
+static MQTTOutboxSlot highSlots[8], lowSlots[8];
+static uint8_t highBuf[8 * 64], lowBuf[8 * 64];
+
+static void testWeightedRounds() {
+  MQTTOutbox high(highSlots, 8, highBuf, 64), low(lowSlots, 8, lowBuf, 64);
+  PipeClient net, server;
+  MQTTClient client(128);
+  connectRaw(client, net, server);
+  CHECK(client.setLane(0, &high, 2));
+  CHECK(client.setLane(1, &low, 1));
+
+  // each loop sends one round: two from the high lane, then one from the low lane
+  for (int i = 0; i < 4; i++) {
+    CHECK(client.enqueue(0, "h", "x", 1));
+    CHECK(client.enqueue(1, "l", "x", 1));
+  }
+  CHECK(client.loop());
+  CHECK(nextTopic(server) == "h" && nextTopic(server) == "h" && nextTopic(server) == "l");
+  CHECK(nextTopic(server) == "");
+
+  // a high lane that is refilled every call does not starve the low lane
+  for (int i = 0; i < 3; i++) {
+    while (client.enqueue(0, "h", "x", 1)) {
+    }
+    CHECK(client.loop());
+    CHECK(nextTopic(server) == "h" && nextTopic(server) == "h" && nextTopic(server) == "l");
+  }
+  CHECK(low.pending() == 0);
+  CHECK(client.laneStats(0).sent == 8 && client.laneStats(1).sent == 4);
+
+  // a budget of one message resumes the round where the last call stopped
+  high.clear();
+  for (int i = 0; i < 3; i++) {
+    CHECK(client.enqueue(0, "h", "x", 1));
+    CHECK(client.enqueue(1, "l", "x", 1));
+  }
+  std::string order;
+  for (int i = 0; i < 6; i++) {
+    CHECK(client.loop(1, 0));
+    order += nextTopic(server);
+  }
+  CHECK(order == "hhlhll");
+}
+
+static void testFailures() {
+  MQTTOutbox outbox(highSlots, 8, highBuf, 64);
+  PipeClient net, server;
+  MQTTClient client(128, 32);
+  connectRaw(client, net, server);
+  CHECK(client.setLane(0, &outbox));
+
+  // a header larger than the write buffer closes the connection once and is dropped with it
+  const char topic[] = "a/topic/that/does/not/fit/the/write/buffer";
+  CHECK(client.enqueue(0, topic, "x", 1));
+  CHECK(client.enqueue(0, "ok", "x", 1));
+  CHECK(!client.loop());
+  CHECK(client.lastError() == LWMQTT_BUFFER_TOO_SHORT);
+  CHECK(client.laneStats(0).dropped == 1);
+  CHECK(outbox.pending() == 1);
+
+  // the next message goes out after the reconnect
+  connectRaw(client, net, server);
+  CHECK(client.loop());
+  CHECK(nextTopic(server) == "ok");
+  CHECK(client.laneStats(0).sent == 1);
+
+  // a failing network keeps the message for the next connection
+  CHECK(client.enqueue(0, "kept", "x", 1));
+  net.writeLimit = 0;
+  CHECK(!client.loop());
+  CHECK(client.laneStats(0).dropped == 1);
+  CHECK(outbox.pending() == 1);
+  net.writeLimit = -1;
+  connectRaw(client, net, server);
+  CHECK(client.loop());
+  CHECK(nextTopic(server) == "kept");
+}
+
+// a clock that advances 50us with every reading
+static uint64_t stepMicros() {
+  static uint64_t now = 0;
+  return now += 50;
+}
+
+static void testTimeBudget() {
+  MQTTOutbox outbox(highSlots, 8, highBuf, 64);
+  PipeClient net, server;
+  MQTTClient client(128);
+  connectRaw(client, net, server);
+  client.setTimeout(1000);
+  CHECK(client.setLane(0, &outbox));
+
+  // with a time budget QoS 1 messages do not wait for their acks, the acks are handled by later calls
+  for (int i = 0; i < 4; i++) {
+    CHECK(client.enqueue(0, "q", "x", 1, false, 1));
+  }
+  uint32_t start = millis();
+  CHECK(client.loop(0, 100000));
+  CHECK(millis() - start < 500);
+  CHECK(outbox.pending() == 0);
+  CHECK(client.inFlight() == 4);
+  uint16_t id;
+  for (int i = 0; i < 4; i++) {
+    CHECK(nextTopic(server, &id) == "q");
+    writeAck(server, id);
+  }
+  CHECK(client.loop(0, 100000));
+  CHECK(client.inFlight() == 0);
+
+  // a budget that is spent with the first message stops the drain there
+  CHECK(client.useMicrosTimers(true, stepMicros));
+  for (int i = 0; i < 4; i++) {
+    CHECK(client.enqueue(0, "q", "x", 1));
+  }
+  CHECK(client.loop(0, 150));
+  CHECK(outbox.pending() == 3);
+}
+
+int main() {
+  testWeightedRounds();
+  testFailures();
+  testTimeBudget();
+  return TEST_DONE();
+}
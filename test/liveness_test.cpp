@@ -0,0 +1,102 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+
+#include "pipe.h"
+#include "test.h"
+
+// pipe that counts the liveness probes of the client
+class ProbedClient : public PipeClient {
+ public:
+  int probes = 0;
+
+  uint8_t connected() override {
+    this->probes++;
+    return PipeClient::connected();
+  }
+};
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[1];
+static MQTTBroker broker(sessions, 1, subscriptions, 1);
+
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+static void connect(MQTTClient &client, ProbedClient &net, PipeClient &session) {
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+  client.begin(net);
+  client.setWaitCallback(runBroker);
+  CHECK(client.connect("live"));
+}
+
+static void testProbes() {
+  ProbedClient net;
+  PipeClient session;
+  MQTTClient client(64);
+  connect(client, net, session);
+
+  // without an interval every call probes the network
+  net.probes = 0;
+  for (int i = 0; i < 10; i++) {
+    CHECK(client.loop());
+  }
+  CHECK(net.probes >= 10);
+
+  // with an interval the probe is trusted, the idle loop does not write
+  client.setLivenessInterval(100);
+  CHECK(client.connected());
+  net.probes = 0;
+  size_t written = net.written;
+  for (int i = 0; i < 10; i++) {
+    CHECK(client.loop());
+    CHECK(client.connected());
+  }
+  CHECK(net.probes == 0);
+  CHECK(net.written == written);
+
+  // the probe is repeated once the interval has passed
+  delay(110);
+  CHECK(client.loop());
+  CHECK(net.probes == 1);
+
+  // a dropped connection is noticed within the interval
+  session.stop();
+  broker.loop();
+  CHECK(client.loop());
+  delay(110);
+  CHECK(!client.loop());
+  CHECK(!client.connected());
+}
+
+static void testKeepAlive() {
+  ProbedClient net;
+  PipeClient session;
+  MQTTClient client(64);
+  client.setKeepAlive(1);
+  client.setLivenessInterval(200);
+  connect(client, net, session);
+
+  // the idle fast path still sends the ping when it is due
+  size_t written = net.written;
+  uint32_t start = millis();
+  while (net.written == written && millis() - start < 1500) {
+    CHECK(client.loop());
+    broker.loop();
+  }
+  CHECK(net.written == written + 2);
+  CHECK(millis() - start >= 900);
+
+  // the response arrives and the connection stays up
+  for (int i = 0; i < 4; i++) {
+    broker.loop();
+    CHECK(client.loop());
+  }
+  CHECK(client.connected());
+  client.disconnect();
+}
+
+int main() {
+  testProbes();
+  testKeepAlive();
+  return TEST_DONE();
+}
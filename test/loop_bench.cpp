@@ -0,0 +1,66 @@
+// Cost of an idle loop() with and without the liveness cache, against a pipe whose probe is free and against a
+// probe that asks the kernel about a socket like the WiFi clients of the boards do.
+
+#include <MQTTClient.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+// pipe that peeks into a socket pair on every liveness probe
+class SocketProbedClient : public PipeClient {
+ public:
+  int fds[2] = {-1, -1};
+  uint32_t probes = 0;
+
+  SocketProbedClient() { CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, this->fds) == 0); }
+  ~SocketProbedClient() {
+    close(this->fds[0]);
+    close(this->fds[1]);
+  }
+
+  uint8_t connected() override {
+    this->probes++;
+    char c;
+    ssize_t n = recv(this->fds[0], &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return (n > 0 || errno == EAGAIN || errno == EWOULDBLOCK) ? PipeClient::connected() : 0;
+  }
+};
+
+static void run(const char *name, PipeClient &net, int interval, uint32_t n) {
+  PipeClient server;
+  MQTTClient client(128);
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  CHECK(client.connect("bench"));
+  client.setLivenessInterval(interval);
+
+  uint64_t start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    bench_sink += client.loop();
+  }
+  benchReport(name, benchNanos() - start, n);
+  CHECK(client.connected());
+}
+
+int main(int argc, char **argv) {
+  uint32_t n = benchIterations(argc, argv, 1000000);
+
+  PipeClient pipe1, pipe2;
+  run("idle loop, pipe", pipe1, 0, n);
+  run("idle loop, pipe, liveness 1s", pipe2, 1000, n);
+
+  SocketProbedClient socket1, socket2;
+  run("idle loop, socket", socket1, 0, n);
+  CHECK(socket1.probes >= n);
+  run("idle loop, socket, liveness 1s", socket2, 1000, n);
+  CHECK(socket2.probes < n);
+
+  return TEST_DONE();
+}
@@ -0,0 +1,92 @@
+#include <MQTTClient.h>
+
+#include <string.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+static const uint8_t suback[] = {0x90, 3, 0, 1, 0};
+
+static int delivered = 0;
+static std::string lastTopic, lastPayload;
+
+// reads the payload as a C string like sketches do
+static void onAdvanced(MQTTClient *, char topic[], char bytes[], int length) {
+  delivered++;
+  lastTopic = topic;
+  lastPayload = bytes;
+  CHECK((int)strlen(bytes) == length);
+}
+
+static void onRaw(MQTTClient *, const char *topic, size_t topicLen, const char *payload, size_t len) {
+  delivered++;
+  lastTopic.assign(topic, topicLen);
+  lastPayload.assign(payload, len);
+}
+
+// the test plays the broker on the server side of the pipe
+static void connectRaw(MQTTClient &client, PipeClient &net, PipeClient &server) {
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  CHECK(client.connect("loop"));
+  server.write(suback, sizeof(suback));
+  CHECK(client.subscribe("l/#"));
+  uint8_t buf[64];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+static void testAdvanced() {
+  PipeClient net, server;
+  MQTTClient client(16, 64);
+  MQTTLoopbackFilter filters[2];
+  client.enableLoopback(filters, 2);
+  client.onMessageAdvanced(onAdvanced);
+  connectRaw(client, net, server);
+
+  // a payload that is not terminated is delivered terminated and nothing goes to the broker
+  const char data[] = {'o', 'n', 'X', 'X'};
+  delivered = 0;
+  CHECK(client.publish("l/a", data, 2, false, 0));
+  CHECK(delivered == 1 && lastTopic == "l/a" && lastPayload == "on");
+  CHECK(server.available() == 0);
+
+  // an empty payload reads as an empty string
+  CHECK(client.publish("l/a", data, 0, false, 0));
+  CHECK(delivered == 2 && lastPayload.empty());
+
+  // a payload larger than the read buffer is dropped like a received one
+  std::string large(17, 'x');
+  CHECK(client.publish("l/a", large.data(), (int)large.size(), false, 0));
+  CHECK(delivered == 2 && client.droppedMessages() == 1);
+
+  // other topics go to the broker
+  CHECK(client.publish("other", data, 2, false, 0));
+  CHECK(delivered == 2 && server.available() > 0);
+}
+
+static void testRaw() {
+  PipeClient net, server;
+  MQTTClient client(16, 64);
+  MQTTLoopbackFilter filters[2];
+  client.enableLoopback(filters, 2);
+  client.onMessageRaw(onRaw);
+  connectRaw(client, net, server);
+
+  // raw callbacks get the payload of the caller without a copy and without a size limit
+  std::string large(40, 'y');
+  delivered = 0;
+  CHECK(client.publish("l/b", large.data(), (int)large.size(), false, 0));
+  CHECK(delivered == 1 && lastTopic == "l/b" && lastPayload == large);
+  CHECK(client.droppedMessages() == 0);
+}
+
+int main() {
+  testAdvanced();
+  testRaw();
+  return TEST_DONE();
+}
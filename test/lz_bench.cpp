@@ -0,0 +1,72 @@
+// Compression ratio and speed of MQTTLz for JSON telemetry of several sizes, with and without a preset dictionary,
+// and for incompressible data.
+
+#include <MQTTLz.h>
+#include <string.h>
+
+#include <string>
+
+#include "bench.h"
+#include "test.h"
+
+static const char dict[] = "{\"temperature\":,\"humidity\":,\"pressure\":,\"battery\":,\"rssi\":}";
+
+// a telemetry document of about the given size with varying values
+static std::string telemetry(size_t size) {
+  std::string doc = "[";
+  for (int i = 0; doc.size() < size; i++) {
+    char rec[128];
+    snprintf(rec, sizeof(rec), "%s{\"temperature\":%.1f,\"humidity\":%.1f,\"pressure\":%d,\"battery\":%d,\"rssi\":%d}",
+             i > 0 ? "," : "", 20.0 + i * 0.3, 40.0 + (i % 7), 1000 + i % 30, 90 - i % 10, -50 - i % 25);
+    doc += rec;
+  }
+  return doc + "]";
+}
+
+static void run(const char *name, MQTTLz &lz, const uint8_t *in, size_t len, uint32_t n) {
+  uint8_t out[4096], back[4096];
+  size_t clen = lz.compress(in, len, out, sizeof(out));
+  CHECK(clen > 0);
+  CHECK(lz.decompress(out, clen, back, sizeof(back)) == len && memcmp(back, in, len) == 0);
+
+  printf("%s: %zu -> %zu bytes (%.0f%%)\n", name, len, clen, 100.0 * (double)clen / (double)len);
+  uint64_t start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    bench_sink += lz.compress(in, len, out, sizeof(out));
+  }
+  benchReport("  compress", benchNanos() - start, n, len);
+
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    bench_sink += lz.decompress(out, clen, back, sizeof(back));
+  }
+  benchReport("  decompress", benchNanos() - start, n, len);
+}
+
+int main(int argc, char **argv) {
+  uint32_t n = benchIterations(argc, argv, 100000);
+
+  MQTTLz plain, preset;
+  preset.setDictionary((const uint8_t *)dict, sizeof(dict) - 1);
+
+  const size_t sizes[] = {64, 200, 1000};
+  for (size_t size : sizes) {
+    std::string doc = telemetry(size);
+    char name[64];
+    snprintf(name, sizeof(name), "json %zu", size);
+    run(name, plain, (const uint8_t *)doc.data(), doc.size(), n);
+    snprintf(name, sizeof(name), "json %zu, dictionary", size);
+    run(name, preset, (const uint8_t *)doc.data(), doc.size(), n);
+  }
+
+  // incompressible data is expanded by the header and literal markers, publish() sends it as is
+  uint8_t noise[1000];
+  uint32_t x = 12345;
+  for (size_t i = 0; i < sizeof(noise); i++) {
+    x = x * 1103515245u + 12345u;
+    noise[i] = (uint8_t)(x >> 16);
+  }
+  run("random 1000", plain, noise, sizeof(noise), n);
+
+  return TEST_DONE();
+}
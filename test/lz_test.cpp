@@ -0,0 +1,165 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+#include <MQTTLz.h>
+
+#include "pipe.h"
+#include "test.h"
+
+static const char json[] =
+    "{\"temperature\":21.5,\"humidity\":40.2,\"pressure\":1013.2,\"temperature\":21.5,\"humidity\":40.2,"
+    "\"pressure\":1013.2,\"temperature\":21.5,\"humidity\":40.2,\"pressure\":1013.2}";
+
+static void testRoundTrip() {
+  MQTTLz lz;
+  uint8_t packed[256], out[256];
+
+  size_t len = lz.compress((const uint8_t *)json, sizeof(json) - 1, packed, sizeof(packed));
+  CHECK(len > 0 && len < sizeof(json) - 1);
+  CHECK(MQTTLz::compressed(packed, len));
+  CHECK(lz.decompress(packed, len, out, sizeof(out)) == sizeof(json) - 1);
+  CHECK(memcmp(out, json, sizeof(json) - 1) == 0);
+
+  // too small buffers fail on both sides
+  CHECK(lz.compress((const uint8_t *)json, sizeof(json) - 1, packed, 8) == 0);
+  CHECK(lz.decompress(packed, len, out, 16) == 0);
+
+  // truncated input is rejected
+  CHECK(lz.decompress(packed, len - 1, out, sizeof(out)) == 0);
+}
+
+static void testDictionary() {
+  static const char dict[] = "{\"temperature\":,\"humidity\":,\"pressure\":}";
+  static const char small[] = "{\"temperature\":22.1,\"humidity\":38.0}";
+  MQTTLz a, b, other;
+  a.setDictionary((const uint8_t *)dict, sizeof(dict) - 1);
+  b.setDictionary((const uint8_t *)dict, sizeof(dict) - 1);
+  other.setDictionary((const uint8_t *)"something else", 14);
+  uint8_t packed[128], out[128];
+
+  size_t len = a.compress((const uint8_t *)small, sizeof(small) - 1, packed, sizeof(packed));
+  CHECK(len > 0 && len < sizeof(small) - 1);
+  CHECK(packed[0] == MQTT_LZ_MAGIC_DICT);
+  CHECK(b.decompress(packed, len, out, sizeof(out)) == sizeof(small) - 1);
+  CHECK(memcmp(out, small, sizeof(small) - 1) == 0);
+
+  // a different or missing dictionary is rejected
+  CHECK(other.decompress(packed, len, out, sizeof(out)) == 0);
+  MQTTLz none;
+  CHECK(none.decompress(packed, len, out, sizeof(out)) == 0);
+}
+
+static void testCorruption() {
+  MQTTLz lz;
+  uint8_t packed[256], out[256];
+  size_t len = lz.compress((const uint8_t *)json, sizeof(json) - 1, packed, sizeof(packed));
+
+  // every flipped literal or match byte is caught by the structure or the checksum
+  int accepted = 0;
+  for (size_t i = 3; i < len; i++) {
+    packed[i] ^= 0x01;
+    size_t n = lz.decompress(packed, len, out, sizeof(out));
+    if (n > 0 && (n != sizeof(json) - 1 || memcmp(out, json, n) != 0)) {
+      accepted++;
+    }
+    packed[i] ^= 0x01;
+  }
+  CHECK(accepted == 0);
+
+  // binary data starting with the magic byte alone is not compressed
+  const uint8_t binary[] = {MQTT_LZ_MAGIC, 0x05, 0x40, 'a', 'b', 'c', 'd', 'e'};
+  CHECK(!MQTTLz::compressed(binary, sizeof(binary)));
+  CHECK(lz.decompress(binary, sizeof(binary), out, sizeof(out)) == 0);
+
+  // even with the full signature a payload that decodes is rejected by the checksum
+  const uint8_t fake[] = {MQTT_LZ_MAGIC, 'L', 'Z', 0x03, 0x00, 0x00, 0x00, 0x00, 0x30, 'a', 'b', 'c'};
+  CHECK(MQTTLz::compressed(fake, sizeof(fake)));
+  CHECK(lz.decompress(fake, sizeof(fake), out, sizeof(out)) == 0);
+}
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[2];
+static MQTTBroker broker(sessions, 1, subscriptions, 2);
+static char last[256];
+static size_t lastLen = 0;
+
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+static void copyMessage(MQTTClient *, const char *, size_t, const char *payload, size_t length) {
+  memcpy(last, payload, length);
+  lastLen = length;
+}
+
+static void testClient() {
+  PipeClient net, session;
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+
+  MQTTLz lz;
+  MQTTClient client(256);
+  client.begin(net);
+  client.setWaitCallback(runBroker);
+  client.onMessageRaw(copyMessage);
+  CHECK(client.setCompression(&lz, 32, 256));
+  CHECK(client.connect("lz"));
+  CHECK(client.subscribe("lz/#", 1));
+
+  // large payloads are compressed on the wire and inflated for the callback
+  size_t before = net.written;
+  CHECK(client.publish("lz/json", json, sizeof(json) - 1, false, 1));
+  for (int i = 0; i < 4; i++) client.loop();
+  CHECK(net.written - before < sizeof(json) - 1);
+  CHECK(lastLen == sizeof(json) - 1 && memcmp(last, json, lastLen) == 0);
+
+  // binary payloads that happen to start with the magic byte are delivered unchanged
+  char binary[40];
+  memset(binary, 0x55, sizeof(binary));
+  binary[0] = (char)MQTT_LZ_MAGIC;
+  binary[1] = 'L';
+  binary[2] = 'Z';
+  CHECK(client.publish("lz/bin", binary, 16, false, 1));
+  for (int i = 0; i < 4; i++) client.loop();
+  CHECK(lastLen == 16 && memcmp(last, binary, 16) == 0);
+
+  client.disconnect();
+  broker.loop();
+}
+
+static void testSmallWriteBuffer() {
+  PipeClient net, session;
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+
+  MQTTLz lz;
+  MQTTClient client(256, 64);
+  client.begin(net);
+  client.setWaitCallback(runBroker);
+  client.onMessageRaw(copyMessage);
+  CHECK(client.connect("lz"));
+  CHECK(client.subscribe("lz/#", 1));
+
+  // the compressed payload does not fit behind the header in a small write buffer and is sent as is
+  CHECK(client.setCompression(&lz, 32, 256));
+  size_t before = net.written;
+  CHECK(client.publish("lz/json", json, sizeof(json) - 1, false, 1));
+  CHECK(net.written - before > sizeof(json) - 1);
+
+  // a dedicated compression buffer does not depend on the write buffer
+  CHECK(client.setCompression(&lz, 32, 256, 256));
+  before = net.written;
+  CHECK(client.publish("lz/json", json, sizeof(json) - 1, false, 1));
+  CHECK(net.written - before < sizeof(json) - 1);
+  for (int i = 0; i < 4; i++) client.loop();
+  CHECK(lastLen == sizeof(json) - 1 && memcmp(last, json, lastLen) == 0);
+
+  client.disconnect();
+  broker.loop();
+}
+
+int main() {
+  testRoundTrip();
+  testDictionary();
+  testCorruption();
+  testClient();
+  testSmallWriteBuffer();
+  return TEST_DONE();
+}
@@ -0,0 +1,115 @@
+#include <MQTTClient.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+// the test plays the broker on the server side of the pipe
+static void connectRaw(MQTTClient &client, PipeClient &net, PipeClient &server) {
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  CHECK(client.connect("nb"));
+  uint8_t buf[64];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+// reads all packets sent by the client and counts them per type
+static void countPackets(PipeClient &server, int counts[16]) {
+  uint8_t head[2], body[128];
+  while (server.read(head, 2) == 2) {
+    CHECK(head[1] < 128);
+    CHECK(head[1] == 0 || server.read(body, head[1]) == head[1]);
+    counts[head[0] >> 4]++;
+  }
+}
+
+static void testRing() {
+  PipeClient net, server;
+  MQTTClient client(128);
+  CHECK(client.setNonBlocking(64));
+  net.writeLimit = 1000;
+  connectRaw(client, net, server);
+  CHECK(client.nonBlocking());
+
+  // publishes are queued while the client takes nothing and refused once only the reserve is left
+  net.writeLimit = 0;
+  int queued = 0;
+  while (client.publish("t", "0123456789")) {
+    queued++;
+  }
+  CHECK(client.lastError() == LWMQTT_NETWORK_WOULD_BLOCK);
+  CHECK(client.connected());
+  CHECK(queued == (64 - MQTT_TX_CONTROL_RESERVE) / 15);
+  CHECK(client.pendingWrites() == (size_t)queued * 15);
+  CHECK(server.available() == 0);
+
+  // loop() flushes the ring in order once the client takes bytes again
+  net.writeLimit = 1000;
+  CHECK(client.loop());
+  CHECK(client.pendingWrites() == 0);
+  int counts[16] = {0};
+  countPackets(server, counts);
+  CHECK(counts[3] == queued);
+}
+
+static void testAcksDoNotStall() {
+  PipeClient net, server;
+  MQTTClient client(128);
+  CHECK(client.setNonBlocking(64));
+  client.setTimeout(1000);
+  net.writeLimit = 1000;
+  connectRaw(client, net, server);
+
+  // fill the ring up to the reserve
+  net.writeLimit = 0;
+  while (client.publish("t", "0123456789")) {
+  }
+  int fit = (int)(64 - client.pendingWrites()) / MQTT_TX_ACK_SIZE;
+  CHECK(fit < 5);
+
+  // a burst of QoS 1 messages needs more acks than the reserve holds: loop() answers what fits and returns
+  const uint8_t publish[] = {0x32, 6, 0, 1, 't', 0, 1, 'x'};
+  for (int i = 0; i < 5; i++) {
+    server.write(publish, sizeof(publish));
+  }
+  uint32_t start = millis();
+  CHECK(client.loop());
+  CHECK(millis() - start < 500);
+  CHECK(net.available() == (5 - fit) * (int)sizeof(publish));
+
+  // the remaining messages are read and acked once the ring drains
+  net.writeLimit = 1000;
+  CHECK(client.loop());
+  CHECK(net.available() == 0);
+  int counts[16] = {0};
+  countPackets(server, counts);
+  CHECK(counts[4] == 5);
+}
+
+static void testWithoutAvailableForWrite() {
+  // clients that never report write space are written to directly, the mode reports that it is not in effect
+  PipeClient net, server;
+  MQTTClient client(128);
+  CHECK(client.setNonBlocking(64));
+  connectRaw(client, net, server);
+  CHECK(!client.nonBlocking());
+  for (int i = 0; i < 10; i++) {
+    CHECK(client.publish("t", "0123456789"));
+  }
+  CHECK(client.pendingWrites() == 0);
+  int counts[16] = {0};
+  countPackets(server, counts);
+  CHECK(counts[3] == 10);
+}
+
+int main() {
+  testRing();
+  testAcksDoNotStall();
+  testWithoutAvailableForWrite();
+  return TEST_DONE();
+}
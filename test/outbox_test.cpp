@@ -0,0 +1,151 @@
+#include <MQTTOutbox.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+extern "C" {
+#include <lwmqtt/helpers.h>
+}
+
+#include "test.h"
+
+static MQTTOutboxSlot slots[64];
+static uint8_t buf[64 * 16];
+
+static size_t home(const char topic[]) { return lwmqtt_fnv1a(topic, strlen(topic)) & (MQTT_OUTBOX_INDEX_SIZE - 1); }
+
+// finds the n-th topic of the form "t<number>" whose index entry starts at the given position
+static std::string topicAt(size_t pos, int n) {
+  char topic[16];
+  for (int i = 0;; i++) {
+    snprintf(topic, sizeof(topic), "t%d", i);
+    if (home(topic) == pos && n-- == 0) {
+      return topic;
+    }
+  }
+}
+
+static std::string frontPayload(MQTTOutbox &outbox) {
+  MQTTOutboxMessage message;
+  CHECK(outbox.front(message));
+  return std::string(message.payload, message.length);
+}
+
+static void testConflation() {
+  MQTTOutbox outbox(slots, 8, buf, 16);
+
+  // a pending message on the same topic is replaced in place and keeps its position
+  CHECK(outbox.push("a", "1", 1, false, 0, true));
+  CHECK(outbox.push("b", "1", 1, false, 0, true));
+  CHECK(outbox.push("a", "22", 2, true, 1, true));
+  CHECK(outbox.pending() == 2 && outbox.conflated() == 1);
+  MQTTOutboxMessage message;
+  CHECK(outbox.front(message));
+  CHECK(strcmp(message.topic, "a") == 0 && message.length == 2 && memcmp(message.payload, "22", 2) == 0);
+  CHECK(message.retained && message.qos == 1);
+
+  // topics sharing a prefix are not conflated, a replacement that does not fit leaves the pending message alone
+  CHECK(outbox.push("bb", "1", 1, false, 0, true));
+  CHECK(!outbox.push("b", "0123456789abcdef", 16, false, 0, true));
+  CHECK(outbox.pending() == 3 && outbox.conflated() == 1);
+
+  // messages pushed without conflation are neither replaced nor replace others
+  CHECK(outbox.push("c", "1", 1));
+  CHECK(outbox.push("c", "2", 1, false, 0, true));
+  CHECK(outbox.push("c", "3", 1, false, 0, true));
+  CHECK(outbox.pending() == 5 && outbox.conflated() == 2);
+  outbox.pop();
+  CHECK(frontPayload(outbox) == "1");
+  outbox.pop();
+  outbox.pop();
+  CHECK(frontPayload(outbox) == "1");
+  outbox.pop();
+  CHECK(frontPayload(outbox) == "3");
+}
+
+static void testFrontUnindexes() {
+  MQTTOutbox outbox(slots, 8, buf, 16);
+
+  // the message returned by front() is being sent, a later push on its topic queues a new one
+  CHECK(outbox.push("a", "1", 1, false, 0, true));
+  CHECK(frontPayload(outbox) == "1");
+  CHECK(outbox.push("a", "2", 1, false, 0, true));
+  CHECK(outbox.pending() == 2 && outbox.conflated() == 0);
+  CHECK(frontPayload(outbox) == "1");
+
+  // the new message is still indexed and takes further replacements
+  CHECK(outbox.push("a", "3", 1, false, 0, true));
+  CHECK(outbox.pending() == 2 && outbox.conflated() == 1);
+  outbox.pop();
+  CHECK(frontPayload(outbox) == "3");
+}
+
+static void testWrappingDelete() {
+  MQTTOutbox outbox(slots, 8, buf, 16);
+
+  // two topics starting at the last position of the index and one starting at the first: the second and third entry
+  // wrap around to positions 0 and 1
+  size_t last = MQTT_OUTBOX_INDEX_SIZE - 1;
+  std::string a = topicAt(last, 0), b = topicAt(last, 1), c = topicAt(0, 0);
+  CHECK(outbox.push(a.c_str(), "1", 1, false, 0, true));
+  CHECK(outbox.push(b.c_str(), "1", 1, false, 0, true));
+  CHECK(outbox.push(c.c_str(), "1", 1, false, 0, true));
+
+  // removing the first entry shifts both back across the end of the table, they stay reachable for replacements
+  outbox.pop();
+  CHECK(outbox.push(b.c_str(), "2", 1, false, 0, true));
+  CHECK(outbox.push(c.c_str(), "2", 1, false, 0, true));
+  CHECK(outbox.pending() == 2 && outbox.conflated() == 2);
+
+  // the entry at position 0 is at its own position and stays when the one before it is removed
+  outbox.pop();
+  CHECK(outbox.push(c.c_str(), "3", 1, false, 0, true));
+  CHECK(outbox.pending() == 1 && outbox.conflated() == 3);
+  CHECK(frontPayload(outbox) == "3");
+
+  // without wrapping, a displaced entry moves back and one at its own position behind it stays
+  outbox.clear();
+  std::string e = topicAt(5, 0), f = topicAt(5, 1), g = topicAt(7, 0);
+  CHECK(outbox.push(e.c_str(), "1", 1, false, 0, true));
+  CHECK(outbox.push(f.c_str(), "1", 1, false, 0, true));
+  CHECK(outbox.push(g.c_str(), "1", 1, false, 0, true));
+  outbox.pop();
+  CHECK(outbox.push(f.c_str(), "2", 1, false, 0, true));
+  CHECK(outbox.push(g.c_str(), "2", 1, false, 0, true));
+  CHECK(outbox.pending() == 2 && outbox.conflated() == 5);
+}
+
+static void testLoadFactor() {
+  MQTTOutbox outbox(slots, 64, buf, 16);
+
+  // the index takes three quarters of its size, later messages are queued but cannot be replaced
+  const size_t limit = MQTT_OUTBOX_INDEX_SIZE * 3 / 4;
+  char topic[16];
+  for (size_t i = 0; i <= limit; i++) {
+    snprintf(topic, sizeof(topic), "t%u", (unsigned)i);
+    CHECK(outbox.push(topic, "1", 1, false, 0, true));
+  }
+  CHECK(outbox.push("t0", "2", 1, false, 0, true));
+  snprintf(topic, sizeof(topic), "t%u", (unsigned)(limit - 1));
+  CHECK(outbox.push(topic, "2", 1, false, 0, true));
+  CHECK(outbox.pending() == limit + 1 && outbox.conflated() == 2);
+  snprintf(topic, sizeof(topic), "t%u", (unsigned)limit);
+  CHECK(outbox.push(topic, "2", 1, false, 0, true));
+  CHECK(outbox.pending() == limit + 2 && outbox.conflated() == 2);
+
+  // sending a message frees its entry for the next one
+  outbox.pop();
+  CHECK(outbox.push("u", "1", 1, false, 0, true));
+  CHECK(outbox.push("u", "2", 1, false, 0, true));
+  CHECK(outbox.pending() == limit + 2 && outbox.conflated() == 3);
+}
+
+int main() {
+  testConflation();
+  testFrontUnindexes();
+  testWrappingDelete();
+  testLoadFactor();
+  return TEST_DONE();
+}
@@ -0,0 +1,87 @@
+#ifndef MQTT_TEST_PIPE_H
+#define MQTT_TEST_PIPE_H
+
+// In-memory connection between two Client endpoints, e.g. a MQTTClient and a MQTTBroker session. The queue is a fixed
+// ring, so the pipe itself never allocates and does not show up in the allocation tests.
+
+#include <Client.h>
+
+#ifndef PIPE_SIZE
+#define PIPE_SIZE 8192
+#endif
+
+class PipeClient : public Client {
+ private:
+  uint8_t queue[PIPE_SIZE];
+  size_t head = 0;
+  size_t len = 0;
+  PipeClient *peer = nullptr;
+  bool open = false;
+
+  int reopen() {
+    if (this->peer != nullptr) {
+      this->open = this->peer->open = true;
+    }
+    return this->open;
+  }
+
+ public:
+  size_t written = 0;
+  int writeLimit = -1;  // bytes accepted per write, -1 accepts as much as the pipe holds
+
+  static void pair(PipeClient &a, PipeClient &b) {
+    a.head = a.len = 0;
+    b.head = b.len = 0;
+    a.peer = &b;
+    b.peer = &a;
+    a.open = b.open = true;
+  }
+
+  // reconnecting reopens the pair, data queued by the peer is kept (e.g. a prepared handshake response)
+  int connect(IPAddress, uint16_t) override { return this->reopen(); }
+  int connect(const char *, uint16_t) override { return this->reopen(); }
+  size_t write(uint8_t b) override { return this->write(&b, 1); }
+  size_t write(const uint8_t *buf, size_t size) override {
+    if (!this->open) {
+      return 0;
+    }
+    if (this->writeLimit >= 0 && size > (size_t)this->writeLimit) {
+      size = (size_t)this->writeLimit;
+    }
+    if (size > PIPE_SIZE - this->peer->len) {
+      size = PIPE_SIZE - this->peer->len;
+    }
+    for (size_t i = 0; i < size; i++) {
+      this->peer->queue[(this->peer->head + this->peer->len++) % PIPE_SIZE] = buf[i];
+    }
+    this->written += size;
+    return size;
+  }
+  int availableForWrite() override { return this->writeLimit; }
+  int available() override { return (int)this->len; }
+  int read() override {
+    uint8_t b;
+    return (this->read(&b, 1) == 1) ? b : -1;
+  }
+  int read(uint8_t *buf, size_t size) override {
+    size_t n = 0;
+    while (n < size && this->len > 0) {
+      buf[n++] = this->queue[this->head];
+      this->head = (this->head + 1) % PIPE_SIZE;
+      this->len--;
+    }
+    return (n > 0) ? (int)n : -1;
+  }
+  int peek() override { return (this->len == 0) ? -1 : this->queue[this->head]; }
+  void flush() override {}
+  void stop() override {
+    this->open = false;
+    if (this->peer != nullptr) {
+      this->peer->open = false;
+    }
+  }
+  uint8_t connected() override { return this->open || this->len > 0; }
+  operator bool() override { return this->open; }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include <MQTTClient.h>
+
+#include <string.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+static int delivered = 0;
+static std::string lastPayload;
+
+static void countMessage(MQTTClient *, const char *, size_t, const char *payload, size_t len) {
+  delivered++;
+  lastPayload.assign(payload, len);
+}
+
+// the test plays the broker on the server side of the pipe
+static void connectRaw(MQTTClient &client, PipeClient &net, PipeClient &server) {
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  client.onMessageRaw(countMessage);
+  CHECK(client.connect("retained"));
+  uint8_t buf[64];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+// sends a QoS 0 publish from the broker and lets the client handle it
+static void deliver(MQTTClient &client, PipeClient &server, const char topic[], const std::string &payload,
+                    bool retained) {
+  size_t len = strlen(topic);
+  std::string packet(1, (char)(retained ? 0x31 : 0x30));
+  packet += (char)(2 + len + payload.size());
+  packet += (char)(len >> 8);
+  packet += (char)len;
+  packet += topic;
+  packet += payload;
+  server.write((const uint8_t *)packet.data(), packet.size());
+  CHECK(client.loop());
+}
+
+static void testReplay() {
+  PipeClient net, server;
+  MQTTClient client(256);
+  MQTTRetainedEntry slots[2];
+  static uint8_t area[2 * 8];
+  client.enableRetainedCache(slots, 2, area, 8);
+  connectRaw(client, net, server);
+
+  // the first retained message is delivered and cached, an identical replay is suppressed
+  delivered = 0;
+  deliver(client, server, "a", "on", true);
+  deliver(client, server, "a", "on", true);
+  CHECK(delivered == 1 && client.retainedSuppressed() == 1);
+  const char *payload;
+  size_t length;
+  CHECK(client.getRetained("a", payload, length) && length == 2 && memcmp(payload, "on", 2) == 0);
+
+  // a changed retained message is delivered and replaces the cached one
+  deliver(client, server, "a", "of", true);
+  CHECK(delivered == 2 && client.retainedSuppressed() == 1);
+  CHECK(client.getRetained("a", payload, length) && memcmp(payload, "of", 2) == 0);
+
+  // a live message updates the cached topic, so the replay of the new value after a reconnect is suppressed
+  deliver(client, server, "a", "on", false);
+  CHECK(delivered == 3);
+  CHECK(client.getRetained("a", payload, length) && memcmp(payload, "on", 2) == 0);
+  deliver(client, server, "a", "on", true);
+  CHECK(delivered == 3 && client.retainedSuppressed() == 2);
+
+  // live messages are never suppressed and do not cache new topics
+  deliver(client, server, "a", "on", false);
+  deliver(client, server, "live", "x", false);
+  CHECK(delivered == 5 && client.retainedSuppressed() == 2);
+  CHECK(!client.getRetained("live", payload, length));
+
+  // an empty message clears the entry
+  deliver(client, server, "a", "", true);
+  CHECK(!client.getRetained("a", payload, length));
+  deliver(client, server, "a", "on", true);
+  CHECK(delivered == 7 && client.retainedSuppressed() == 2);
+}
+
+static void testEviction() {
+  PipeClient net, server;
+  MQTTClient client(256);
+  MQTTRetainedEntry slots[2];
+  client.enableRetainedCache(slots, 2);
+  connectRaw(client, net, server);
+
+  // the least recently updated topic is replaced once all slots are in use
+  deliver(client, server, "a", "1", true);
+  deliver(client, server, "b", "1", true);
+  deliver(client, server, "a", "2", false);
+  deliver(client, server, "c", "1", true);
+  const char *payload;
+  size_t length;
+  CHECK(client.getRetained("a", payload, length) && length == 1 && payload == nullptr);
+  CHECK(!client.getRetained("b", payload, length));
+  CHECK(client.getRetained("c", payload, length));
+
+  // without a copy payloads are compared by length and hash, the replay of the evicted topic is delivered again
+  delivered = 0;
+  deliver(client, server, "a", "2", true);
+  deliver(client, server, "b", "1", true);
+  CHECK(delivered == 1 && client.retainedSuppressed() == 1);
+}
+
+static void testLongTopics() {
+  PipeClient net, server;
+  MQTTClient client(256);
+  MQTTRetainedEntry slots[4];
+  client.enableRetainedCache(slots, 4);
+  connectRaw(client, net, server);
+
+  // topics longer than the stored prefix are told apart by their length and hash
+  std::string prefix(45, 't');
+  std::string a = prefix + "/a", b = prefix + "/b";
+  delivered = 0;
+  deliver(client, server, a.c_str(), "x", true);
+  deliver(client, server, b.c_str(), "x", true);
+  CHECK(delivered == 2);
+  deliver(client, server, a.c_str(), "x", true);
+  CHECK(delivered == 2 && client.retainedSuppressed() == 1);
+}
+
+int main() {
+  testReplay();
+  testEviction();
+  testLongTopics();
+  return TEST_DONE();
+}
@@ -0,0 +1,87 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal host replacement of the Arduino core to build and test the library on a desktop (see test/README.md)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+inline unsigned long millis() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// added to micros(), lets tests move the 32-bit counter of the library close to its rollover
+inline unsigned long &shimMicrosOffset() {
+  static unsigned long offset = 0;
+  return offset;
+}
+
+inline unsigned long micros() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000) + shimMicrosOffset();
+}
+
+inline void delay(unsigned long ms) {
+  timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+  nanosleep(&ts, nullptr);
+}
+
+// let other threads run, like yield() lets the RTOS and WiFi tasks run
+inline void yield() { sched_yield(); }
+
+// Heap allocated string like the Arduino String, so allocations of simple callbacks show up in the tests
+class String {
+ private:
+  char *buf = nullptr;
+  size_t len = 0;
+
+  void assign(const char *str, size_t length) {
+    char *copy = (char *)malloc(length + 1);
+    if (copy != nullptr) {
+      memcpy(copy, str, length);
+      copy[length] = '\0';
+    }
+    free(this->buf);
+    this->buf = copy;
+    this->len = (copy != nullptr) ? length : 0;
+  }
+
+ public:
+  String() = default;
+  String(const char *str) { this->assign(str, strlen(str)); }
+  String(const char *str, size_t length) { this->assign(str, length); }
+  String(const String &other) { this->assign(other.c_str(), other.len); }
+  ~String() { free(this->buf); }
+
+  String &operator=(const String &other) {
+    if (this != &other) {
+      this->assign(other.c_str(), other.len);
+    }
+    return *this;
+  }
+
+  bool operator==(const char *str) const { return strcmp(this->c_str(), str) == 0; }
+
+  const char *c_str() const { return (this->buf != nullptr) ? this->buf : ""; }
+  unsigned int length() const { return (unsigned int)this->len; }
+};
+
+class IPAddress {
+ private:
+  uint8_t bytes[4] = {0, 0, 0, 0};
+
+ public:
+  IPAddress() = default;
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+
+  uint8_t operator[](int i) const { return this->bytes[i]; }
+  bool operator==(const IPAddress &other) const { return memcmp(this->bytes, other.bytes, 4) == 0; }
+};
+
+#endif
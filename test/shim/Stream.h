@@ -0,0 +1,16 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "Arduino.h"
+
+class Stream {
+ public:
+  virtual ~Stream() = default;
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t write(uint8_t b) = 0;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include "Arduino.h"
+
+class UDP {
+ public:
+  virtual ~UDP() = default;
+
+  virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) = 0;
+  virtual int endPacket() = 0;
+  virtual int parsePacket() = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t *buf, size_t len) = 0;
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include <MQTTSNClient.h>
+
+#include "test.h"
+
+static void testCodec() {
+  uint8_t buf[300];
+  size_t len;
+  lwmqtt_sn_packet_type_t type;
+
+  // publish to a normal topic id
+  uint8_t payload[] = "21.5";
+  lwmqtt_sn_topic_t topic = {LWMQTT_SN_TOPIC_NORMAL, 0x1234};
+  CHECK(lwmqtt_sn_encode_publish(buf, sizeof(buf), &len, false, 1, true, topic, 7, payload, 4) == LWMQTT_SUCCESS);
+  CHECK(len == 7 + 4);
+  CHECK(lwmqtt_sn_detect_packet_type(buf, len, &type) == LWMQTT_SUCCESS && type == LWMQTT_SN_PUBLISH);
+
+  bool dup, retained;
+  int qos;
+  lwmqtt_sn_topic_t outTopic;
+  uint16_t msgId;
+  uint8_t *outPayload;
+  size_t outLen;
+  CHECK(lwmqtt_sn_decode_publish(buf, len, &dup, &qos, &retained, &outTopic, &msgId, &outPayload, &outLen) ==
+        LWMQTT_SUCCESS);
+  CHECK(!dup && qos == 1 && retained && outTopic.type == LWMQTT_SN_TOPIC_NORMAL && outTopic.id == 0x1234);
+  CHECK(msgId == 7 && outLen == 4 && memcmp(outPayload, "21.5", 4) == 0);
+
+  // QoS -1 to a short topic
+  lwmqtt_sn_topic_t shortTopic = {LWMQTT_SN_TOPIC_SHORT, ('t' << 8) | 'x'};
+  CHECK(lwmqtt_sn_encode_publish(buf, sizeof(buf), &len, false, -1, false, shortTopic, 0, payload, 4) ==
+        LWMQTT_SUCCESS);
+  CHECK(lwmqtt_sn_decode_publish(buf, len, &dup, &qos, &retained, &outTopic, &msgId, &outPayload, &outLen) ==
+        LWMQTT_SUCCESS);
+  CHECK(qos == -1 && outTopic.type == LWMQTT_SN_TOPIC_SHORT && outTopic.id == shortTopic.id);
+
+  // long packets use the three byte length header
+  uint8_t large[260];
+  memset(large, 'x', sizeof(large));
+  CHECK(lwmqtt_sn_encode_publish(buf, sizeof(buf), &len, false, 0, false, topic, 0, large, sizeof(large)) ==
+        LWMQTT_SUCCESS);
+  CHECK(buf[0] == 0x01 && len == 9 + sizeof(large));
+  CHECK(lwmqtt_sn_decode_publish(buf, len, &dup, &qos, &retained, &outTopic, &msgId, &outPayload, &outLen) ==
+        LWMQTT_SUCCESS);
+  CHECK(outLen == sizeof(large));
+  CHECK(lwmqtt_sn_encode_publish(buf, 100, &len, false, 0, false, topic, 0, large, sizeof(large)) ==
+        LWMQTT_BUFFER_TOO_SHORT);
+
+  // register and acks
+  CHECK(lwmqtt_sn_encode_register(buf, sizeof(buf), &len, 5, 9, lwmqtt_string("a/b")) == LWMQTT_SUCCESS);
+  uint16_t topicId;
+  lwmqtt_string_t name;
+  CHECK(lwmqtt_sn_decode_register(buf, len, &topicId, &msgId, &name) == LWMQTT_SUCCESS);
+  CHECK(topicId == 5 && msgId == 9 && name.len == 3 && memcmp(name.data, "a/b", 3) == 0);
+
+  CHECK(lwmqtt_sn_encode_ack(buf, sizeof(buf), &len, LWMQTT_SN_REGACK, 5, 9, LWMQTT_SN_CONGESTION) == LWMQTT_SUCCESS);
+  lwmqtt_sn_return_code_t rc;
+  CHECK(lwmqtt_sn_decode_ack(buf, len, LWMQTT_SN_REGACK, &topicId, &msgId, &rc) == LWMQTT_SUCCESS);
+  CHECK(topicId == 5 && msgId == 9 && rc == LWMQTT_SN_CONGESTION);
+  CHECK(lwmqtt_sn_decode_ack(buf, len, LWMQTT_SN_PUBACK, &topicId, &msgId, &rc) != LWMQTT_SUCCESS);
+
+  // a length field that does not match the datagram is rejected
+  CHECK(lwmqtt_sn_encode_zero(buf, sizeof(buf), &len, LWMQTT_SN_PINGREQ) == LWMQTT_SUCCESS);
+  CHECK(lwmqtt_sn_detect_packet_type(buf, len, &type) == LWMQTT_SUCCESS && type == LWMQTT_SN_PINGREQ);
+  CHECK(lwmqtt_sn_detect_packet_type(buf, len + 1, &type) != LWMQTT_SUCCESS);
+  CHECK(lwmqtt_sn_detect_packet_type(buf, 1, &type) != LWMQTT_SUCCESS);
+}
+
+// Minimal gateway on the other end of a loopback pair: registers topics, acknowledges and echoes subscribed messages
+class Gateway {
+ private:
+  uint8_t queue[512];
+  uint8_t buf[MQTT_SN_BUFFER_SIZE];
+  char names[4][16];
+  bool subscribed[4];
+  size_t count = 0;
+
+  uint16_t topicId(const char *name, size_t len) {
+    for (size_t i = 0; i < this->count; i++) {
+      if (strlen(this->names[i]) == len && memcmp(this->names[i], name, len) == 0) {
+        return (uint16_t)(i + 1);
+      }
+    }
+    if (this->count == 4 || len >= sizeof(this->names[0])) {
+      return 0;
+    }
+    memcpy(this->names[this->count], name, len);
+    this->names[this->count][len] = 0;
+    this->subscribed[this->count] = false;
+    return (uint16_t)(++this->count);
+  }
+
+  void reply(const uint8_t *data, size_t len) { this->endpoint.send(data, len); }
+
+  void handle(size_t len) {
+    lwmqtt_sn_packet_type_t type;
+    if (lwmqtt_sn_detect_packet_type(this->buf, len, &type) != LWMQTT_SUCCESS) {
+      return;
+    }
+    size_t outLen;
+    uint8_t out[MQTT_SN_BUFFER_SIZE];
+    switch (type) {
+      case LWMQTT_SN_CONNECT: {
+        const uint8_t connack[] = {3, LWMQTT_SN_CONNACK, this->accept ? LWMQTT_SN_ACCEPTED : LWMQTT_SN_CONGESTION};
+        this->reply(connack, sizeof(connack));
+        break;
+      }
+      case LWMQTT_SN_REGISTER: {
+        uint16_t id, msgId;
+        lwmqtt_string_t name;
+        lwmqtt_sn_decode_register(this->buf, len, &id, &msgId, &name);
+        id = this->topicId(name.data, name.len);
+        lwmqtt_sn_encode_ack(out, sizeof(out), &outLen, LWMQTT_SN_REGACK, id, msgId,
+                             id > 0 ? LWMQTT_SN_ACCEPTED : LWMQTT_SN_CONGESTION);
+        this->reply(out, outLen);
+        break;
+      }
+      case LWMQTT_SN_SUBSCRIBE: {
+        // flags, message id and the topic name
+        uint8_t flags = this->buf[2];
+        uint16_t msgId = (uint16_t)(this->buf[3] << 8 | this->buf[4]);
+        uint16_t id = this->topicId((const char *)this->buf + 5, len - 5);
+        if (id > 0) {
+          this->subscribed[id - 1] = true;
+        }
+        uint8_t qos = (flags >> 5) & 3;
+        const uint8_t suback[] = {8,         LWMQTT_SN_SUBACK,     (uint8_t)(qos << 5), (uint8_t)(id >> 8),
+                                  (uint8_t)id, (uint8_t)(msgId >> 8), (uint8_t)msgId,      LWMQTT_SN_ACCEPTED};
+        this->reply(suback, sizeof(suback));
+        break;
+      }
+      case LWMQTT_SN_PUBLISH: {
+        bool dup, retained;
+        int qos;
+        lwmqtt_sn_topic_t topic;
+        uint16_t msgId;
+        uint8_t *payload;
+        size_t payloadLen;
+        lwmqtt_sn_decode_publish(this->buf, len, &dup, &qos, &retained, &topic, &msgId, &payload, &payloadLen);
+        this->published++;
+        if (qos == 1) {
+          lwmqtt_sn_encode_ack(out, sizeof(out), &outLen, LWMQTT_SN_PUBACK, topic.id, msgId, LWMQTT_SN_ACCEPTED);
+          this->reply(out, outLen);
+        }
+        if (topic.type == LWMQTT_SN_TOPIC_NORMAL && topic.id > 0 && topic.id <= this->count &&
+            this->subscribed[topic.id - 1]) {
+          lwmqtt_sn_encode_publish(out, sizeof(out), &outLen, false, 0, false, topic, 0, payload, payloadLen);
+          this->reply(out, outLen);
+        }
+        break;
+      }
+      case LWMQTT_SN_PINGREQ:
+      case LWMQTT_SN_DISCONNECT:
+        lwmqtt_sn_encode_zero(out, sizeof(out), &outLen,
+                              type == LWMQTT_SN_PINGREQ ? LWMQTT_SN_PINGRESP : LWMQTT_SN_DISCONNECT);
+        this->reply(out, outLen);
+        break;
+      default:
+        break;
+    }
+  }
+
+ public:
+  MQTTLoopbackDatagram endpoint;
+  bool accept = true;
+  int published = 0;
+
+  Gateway() : endpoint(this->queue, sizeof(this->queue)) {}
+
+  void run() {
+    size_t len;
+    while ((len = this->endpoint.receive(this->buf, sizeof(this->buf))) > 0) {
+      this->handle(len);
+    }
+  }
+};
+
+// client endpoint that lets the gateway answer every datagram right away
+class Transport : public MQTTLoopbackDatagram {
+ private:
+  uint8_t queue[512];
+  Gateway &gateway;
+
+ public:
+  explicit Transport(Gateway &gateway) : MQTTLoopbackDatagram(this->queue, sizeof(this->queue)), gateway(gateway) {
+    this->connect(gateway.endpoint);
+  }
+
+  bool send(const uint8_t *data, size_t length) override {
+    bool ok = MQTTLoopbackDatagram::send(data, length);
+    this->gateway.run();
+    return ok;
+  }
+};
+
+static char lastTopic[32];
+static char lastPayload[32];
+static int received = 0;
+
+static void onMessage(MQTTSNClient *, const char topic[], uint16_t, const char payload[], size_t length) {
+  snprintf(lastTopic, sizeof(lastTopic), "%s", topic);
+  snprintf(lastPayload, sizeof(lastPayload), "%.*s", (int)length, payload);
+  received++;
+}
+
+static void testClient() {
+  Gateway gateway;
+  Transport transport(gateway);
+  MQTTSNClient client;
+  client.begin(transport);
+  client.onMessage(onMessage);
+  client.setTimeout(100);
+
+  // QoS -1 works without a connection
+  client.predefineTopic(42, "pre/defined");
+  CHECK(client.publish("pre/defined", "x", 1, false, -1));
+  CHECK(gateway.published == 1);
+
+  CHECK(client.connect("sensor"));
+  CHECK(client.connected());
+
+  // topics are registered once and their ids remembered
+  uint16_t id = client.registerTopic("sensors/temp");
+  CHECK(id > 0);
+  CHECK(client.registerTopic("sensors/temp") == id);
+
+  // subscribed messages are echoed back by the gateway
+  CHECK(client.subscribe("cmd/led", 1));
+  CHECK(client.publish("cmd/led", "on", 2, false, 1));
+  CHECK(client.loop());
+  CHECK(received == 1 && strcmp(lastTopic, "cmd/led") == 0 && strcmp(lastPayload, "on") == 0);
+
+  // unsubscribed topics are not delivered
+  CHECK(client.publish("sensors/temp", "21.5"));
+  CHECK(client.loop());
+  CHECK(received == 1 && gateway.published == 3);
+
+  CHECK(client.disconnect());
+  CHECK(!client.connected());
+  CHECK(!client.publish("sensors/temp", "21.5"));
+
+  // rejected connections report the return code
+  gateway.accept = false;
+  CHECK(!client.connect("sensor"));
+  CHECK(client.lastError() == LWMQTT_CONNECTION_DENIED && client.returnCode() == LWMQTT_SN_CONGESTION);
+}
+
+static void testTimeout() {
+  // a gateway that never answers
+  uint8_t a[64], b[64];
+  MQTTLoopbackDatagram client(a, sizeof(a)), silent(b, sizeof(b));
+  client.connect(silent);
+
+  MQTTSNClient sn;
+  sn.begin(client);
+  sn.setTimeout(20);
+  uint32_t start = millis();
+  CHECK(!sn.connect("sensor"));
+  CHECK(sn.lastError() == LWMQTT_NETWORK_TIMEOUT);
+  CHECK(millis() - start >= 20);
+
+  // datagrams that do not fit the queue are refused
+  uint8_t large[80] = {0};
+  CHECK(!client.send(large, sizeof(large)));
+}
+
+int main() {
+  testCodec();
+  testClient();
+  testTimeout();
+  return TEST_DONE();
+}
@@ -0,0 +1,20 @@
+#ifndef MQTT_TEST_H
+#define MQTT_TEST_H
+
+// Minimal checks for the host tests, every test binary returns the number of failed checks
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                              \
+  do {                                                                           \
+    if (!(cond)) {                                                               \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                                           \
+    }                                                                            \
+  } while (0)
+
+#define TEST_DONE() (test_failures == 0 ? (printf("ok\n"), 0) : (fprintf(stderr, "%d failed\n", test_failures), 1))
+
+#endif
@@ -0,0 +1,85 @@
+#include <MQTTClient.h>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+static void testMicrosRollover() {
+  MQTTClient client(64);
+  CHECK(client.useMicrosTimers(true));
+
+  // read the 32-bit counter in its upper half, then move it 10ms past its rollover
+  shimMicrosOffset() = 0;
+  shimMicrosOffset() = (uint32_t)(0xF0000000u - (uint32_t)micros());
+  uint64_t before = client.micros64();
+  CHECK((uint32_t)before >= 0xF0000000u);
+  uint32_t jump = (uint32_t)(0u - (uint32_t)before) + 10000;
+  shimMicrosOffset() += jump;
+
+  // the extension carries the wrap into the upper half, the time keeps going forward
+  uint64_t after = client.micros64();
+  CHECK((uint32_t)after < 0xF0000000u);
+  CHECK((after >> 32) == (before >> 32) + 1);
+  CHECK(after - before >= jump && after - before < jump + 1000000);
+
+  // clients keep their own extension
+  MQTTClient other(64);
+  CHECK(other.useMicrosTimers(true));
+  CHECK(other.micros64() < after);
+  shimMicrosOffset() = 0;
+}
+
+// both timer backends run on the same manual clock
+static uint64_t fakeNow = 0;
+static uint32_t fakeMillis() { return (uint32_t)(fakeNow / 1000); }
+static uint64_t fakeMicros() { return fakeNow; }
+
+static bool pingSent(PipeClient &server) {
+  bool ping = false;
+  uint8_t head[2];
+  while (server.read(head, 2) == 2) {
+    ping = ping || head[0] == 0xc0;
+    uint8_t body[64];
+    CHECK(head[1] < sizeof(body) && (head[1] == 0 || server.read(body, head[1]) == head[1]));
+  }
+  return ping;
+}
+
+static void testSwapKeepsKeepAlive() {
+  PipeClient net, server;
+  MQTTClient client(64);
+  client.setClockSource(fakeMillis);
+  client.setKeepAlive(1);
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  CHECK(client.connect("timers"));
+  pingSent(server);
+
+  // swapping to microsecond timers keeps the time that has passed since the last packet
+  fakeNow += 700000;
+  CHECK(client.useMicrosTimers(true, fakeMicros));
+  fakeNow += 200000;
+  CHECK(client.loop());
+  CHECK(!pingSent(server));
+  fakeNow += 200000;
+  CHECK(client.loop());
+  CHECK(pingSent(server));
+
+  // and so does swapping back
+  const uint8_t pingresp[] = {0xd0, 0};
+  server.write(pingresp, sizeof(pingresp));
+  CHECK(client.loop());
+  fakeNow += 700000;
+  CHECK(client.useMicrosTimers(false));
+  fakeNow += 400000;
+  CHECK(client.loop());
+  CHECK(pingSent(server));
+}
+
+int main() {
+  testMicrosRollover();
+  testSwapKeepsKeepAlive();
+  return TEST_DONE();
+}
@@ -0,0 +1,144 @@
+#include <MQTTClient.h>
+
+#include <string.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+static bool matches(const char filter[], const char topic[]) {
+  return MQTTClient::topicMatches(filter, topic, strlen(topic));
+}
+
+static void testLiteral() {
+  CHECK(matches("a/b", "a/b"));
+  CHECK(!matches("a/b", "a/c"));
+  CHECK(!matches("a/b", "a/b/c"));
+  CHECK(!matches("a/b/c", "a/b"));
+  CHECK(!matches("a", "ab"));
+  CHECK(!matches("ab", "a"));
+  CHECK(matches("/a", "/a"));
+  CHECK(!matches("/a", "a"));
+
+  // the topic is bounded by its length, not by a terminator
+  CHECK(MQTTClient::topicMatches("a/b", "a/bcd", 3));
+  CHECK(!MQTTClient::topicMatches("a/bcd", "a/bcd", 3));
+}
+
+static void testSingleLevel() {
+  CHECK(matches("+", "a"));
+  CHECK(!matches("+", "a/b"));
+  CHECK(matches("a/+", "a/b"));
+  CHECK(!matches("a/+", "a/b/c"));
+  CHECK(!matches("a/+", "a"));
+  CHECK(matches("a/+/c", "a/b/c"));
+  CHECK(!matches("a/+/c", "a/b/d"));
+  CHECK(matches("+/+", "a/b"));
+
+  // empty levels are levels too
+  CHECK(matches("a/+", "a/"));
+  CHECK(matches("+/+", "/a"));
+  CHECK(matches("+", ""));
+}
+
+static void testMultiLevel() {
+  CHECK(matches("#", "a"));
+  CHECK(matches("#", "a/b/c"));
+  CHECK(matches("a/#", "a/b"));
+  CHECK(matches("a/#", "a/b/c"));
+  CHECK(!matches("a/#", "b/a"));
+
+  // "a/#" also matches its parent level, but not a sibling sharing the prefix
+  CHECK(matches("a/#", "a"));
+  CHECK(matches("a/#", "a/"));
+  CHECK(!matches("a/#", "ab"));
+  CHECK(!matches("sport/tennis/#", "sport/tennisplayer"));
+  CHECK(matches("a/+/#", "a/b"));
+  CHECK(matches("a/+/#", "a/b/c/d"));
+  CHECK(!matches("a/+/#", "a"));
+}
+
+static void testSystemTopics() {
+  // wildcards on the first level never match topics starting with '$'
+  CHECK(!matches("#", "$SYS/broker"));
+  CHECK(!matches("+/broker", "$SYS/broker"));
+  CHECK(matches("$SYS/#", "$SYS/broker"));
+  CHECK(matches("$SYS/+", "$SYS/broker"));
+  CHECK(matches("a/#", "a/$b"));
+}
+
+// a manual clock, every callback takes the time set in spent
+static uint64_t now = 0;
+static uint64_t spent = 0;
+static uint64_t fakeMicros() { return now; }
+static void slowMessage(MQTTClient *, const char *, size_t, const char *, size_t) { now += spent; }
+
+// sends a QoS 0 publish from the broker and lets the client handle it
+static void deliver(MQTTClient &client, PipeClient &server, const char topic[], uint64_t micros) {
+  size_t len = strlen(topic);
+  std::string packet(1, (char)0x30);
+  packet += (char)(2 + len);
+  packet += (char)(len >> 8);
+  packet += (char)len;
+  packet += topic;
+  server.write((const uint8_t *)packet.data(), packet.size());
+  spent = micros;
+  CHECK(client.loop());
+}
+
+static void collect(const MQTTTopicStat &stat, void *ref) { ((std::string *)ref)->append(stat.filter).append(","); }
+
+static void testStats() {
+  PipeClient net, server;
+  MQTTClient client(64);
+  MQTTTopicStat stats[3];
+  client.enableTopicStats(stats, 3);
+  CHECK(client.useMicrosTimers(true, fakeMicros));
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  client.onMessageRaw(slowMessage);
+  CHECK(client.connect("stats"));
+
+  // filters claim slots once, too long filters and filters beyond the slots are not tracked
+  CHECK(client.trackTopicStat("a/+"));
+  CHECK(client.trackTopicStat("a/#"));
+  CHECK(client.trackTopicStat("a/+"));
+  CHECK(!client.trackTopicStat("0123456789012345678901234567890123456789"));
+  CHECK(!client.trackTopicStat(""));
+  CHECK(client.trackTopicStat("b"));
+  CHECK(!client.trackTopicStat("c"));
+  std::string filters;
+  client.forEachTopicStat(collect, &filters);
+  CHECK(filters == "a/+,a/#,b,");
+
+  // each message counts for the first matching filter in subscription order only
+  deliver(client, server, "a/x", 5);
+  deliver(client, server, "a/y", 20);
+  deliver(client, server, "a/x/y", 7);
+  deliver(client, server, "a", 3);
+  deliver(client, server, "c", 100);
+  CHECK(stats[0].calls == 2 && stats[0].totalMicros == 25 && stats[0].maxMicros == 20);
+  CHECK(stats[1].calls == 2 && stats[1].totalMicros == 10 && stats[1].maxMicros == 7);
+  CHECK(stats[2].calls == 0 && stats[2].totalMicros == 0 && stats[2].maxMicros == 0);
+
+  // enabling again clears the slots, a null array disables the stats
+  client.enableTopicStats(stats, 3);
+  CHECK(stats[0].filter[0] == '\0' && stats[0].calls == 0);
+  client.enableTopicStats(nullptr, 0);
+  CHECK(!client.trackTopicStat("a/+"));
+  deliver(client, server, "a/x", 5);
+  CHECK(stats[0].calls == 0);
+}
+
+int main() {
+  testLiteral();
+  testSingleLevel();
+  testMultiLevel();
+  testSystemTopics();
+  testStats();
+  return TEST_DONE();
+}
@@ -0,0 +1,136 @@
+// Fills and wraps the trace ring with a client whose microsecond clock crosses the 32-bit rollover, then converts the
+// dump with tools/trace_to_chrome.py if the interpreter and the script are passed as arguments.
+
+#include <MQTTClient.h>
+#include <MQTTJson.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+extern "C" {
+#include <lwmqtt/trace.h>
+}
+
+#include "pipe.h"
+#include "test.h"
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+// a clock that advances 10us with every reading
+static uint64_t now = 0;
+static uint32_t readings = 0;
+static uint64_t stepMicros() {
+  readings++;
+  return now += 10;
+}
+
+static lwmqtt_trace_record_t records[LWMQTT_TRACE_SIZE];
+
+static void publish(MQTTClient &client, PipeClient &server) {
+  CHECK(client.publish("t", "x"));
+  uint8_t buf[64];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+static size_t record() {
+  PipeClient net, server;
+  MQTTClient client(128);
+  CHECK(client.useMicrosTimers(true, stepMicros));
+  PipeClient::pair(net, server);
+  server.write(connack, sizeof(connack));
+  client.begin(net);
+  CHECK(client.connect("trace"));
+
+  // measure the records and clock readings of one publish
+  lwmqtt_trace_reset();
+  readings = 0;
+  publish(client, server);
+  uint32_t perPublish = readings;
+  size_t kept = LWMQTT_TRACE_SIZE / lwmqtt_trace_dump(records, LWMQTT_TRACE_SIZE);
+
+  // overwrite the ring with publishes whose stamps pass the 32-bit rollover halfway through
+  now = 0x100000000ull - 10ull * perPublish * (kept / 2 + 1);
+  for (size_t i = 0; i <= kept; i++) {
+    publish(client, server);
+  }
+
+  return lwmqtt_trace_dump(records, LWMQTT_TRACE_SIZE);
+}
+
+static void testRing(size_t count) {
+  // the ring keeps the newest records, oldest first, ending with the last write
+  CHECK(count == LWMQTT_TRACE_SIZE);
+  CHECK(records[count - 1].event == LWMQTT_TRACE_NETWORK_WRITE_END);
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    CHECK(records[i].event == LWMQTT_TRACE_NETWORK_WRITE_BEGIN);
+    CHECK(records[i + 1].event == LWMQTT_TRACE_NETWORK_WRITE_END);
+  }
+
+  // the stamps come from the clock of the client and wrap once within the ring
+  int wraps = 0;
+  for (size_t i = 1; i < count; i++) {
+    uint32_t delta = records[i].time - records[i - 1].time;
+    CHECK(delta > 0 && delta < 1000);
+    wraps += records[i].time < records[i - 1].time;
+  }
+  CHECK(wraps == 1);
+}
+
+static void testReleasedClock() {
+  // the destroyed client has released its clock, later records are stamped with zero
+  LWMQTT_TRACE_EVENT(LWMQTT_TRACE_KEEP_ALIVE, 0, 0, 0);
+  lwmqtt_trace_record_t last[LWMQTT_TRACE_SIZE];
+  size_t count = lwmqtt_trace_dump(last, LWMQTT_TRACE_SIZE);
+  CHECK(last[count - 1].event == LWMQTT_TRACE_KEEP_ALIVE && last[count - 1].time == 0);
+}
+
+static void testConverter(size_t count, const char *python, const char *script) {
+  const char dump[] = "trace_test.bin", json[] = "trace_test.json";
+  FILE *f = fopen(dump, "wb");
+  CHECK(f != nullptr);
+  CHECK(fwrite(records, sizeof(lwmqtt_trace_record_t), count, f) == count);
+  fclose(f);
+  std::string cmd = std::string(python) + " " + script + " " + dump + " > " + json;
+  CHECK(system(cmd.c_str()) == 0);
+
+  // the converter unwraps the stamps, so the timeline keeps going forward across the rollover
+  static char doc[256 * 1024];
+  f = fopen(json, "rb");
+  CHECK(f != nullptr);
+  size_t len = fread(doc, 1, sizeof(doc), f);
+  fclose(f);
+  MQTTJsonReader reader(doc, len);
+  MQTTJsonToken token;
+  size_t events = 0;
+  double last = 0;
+  CHECK(reader.next(token) == MQTT_JSON_OBJECT);
+  while (reader.next(token) != MQTT_JSON_END) {
+    if (token.type == MQTT_JSON_ERROR) {
+      break;
+    }
+    if (token.type == MQTT_JSON_KEY && token.equals("ts")) {
+      CHECK(reader.next(token) == MQTT_JSON_NUMBER);
+      double ts = token.toDouble();
+      CHECK(ts > last);
+      last = ts;
+      events++;
+    }
+  }
+  CHECK(events == count);
+  CHECK(last > 4294967296.0);
+  remove(dump);
+  remove(json);
+}
+
+int main(int argc, char **argv) {
+  size_t count = record();
+  testRing(count);
+  if (argc > 2) {
+    testConverter(count, argv[1], argv[2]);
+  }
+  testReleasedClock();
+  return TEST_DONE();
+}
@@ -0,0 +1,92 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+
+#include "pipe.h"
+#include "test.h"
+
+// connects to a peer that never answers and returns the wakeups spent until the timeout
+static uint32_t waitForTimeout(MQTTWaitPolicy policy, uint16_t param, uint32_t &elapsed) {
+  PipeClient net, silent;
+  PipeClient::pair(net, silent);
+  MQTTClient client(64);
+  client.begin(net);
+  client.setTimeout(60);
+  client.setWaitPolicy(policy, param);
+  uint32_t start = millis();
+  CHECK(!client.connect("wait"));
+  // a read that times out without data leaves the connect without its connack
+  CHECK(client.lastError() == LWMQTT_MISSING_OR_WRONG_PACKET);
+  elapsed = millis() - start;
+  return client.waitStats().wakeups;
+}
+
+static void testPolicies() {
+  uint32_t elapsed;
+
+  // yielding and spinning poll continuously
+  uint32_t yielding = waitForTimeout(MQTT_WAIT_YIELD, 0, elapsed);
+  CHECK(elapsed >= 60 && yielding > 100);
+  uint32_t spinning = waitForTimeout(MQTT_WAIT_SPIN, 1000, elapsed);
+  CHECK(elapsed >= 60 && spinning > 100);
+
+  // sleeping backs off exponentially: 1, 2, 4, 8, 16 and the remaining time
+  uint32_t sleeping = waitForTimeout(MQTT_WAIT_SLEEP, 0, elapsed);
+  CHECK(elapsed >= 60 && sleeping >= 5 && sleeping <= 8);
+
+  // a cap keeps the sleeps short
+  uint32_t capped = waitForTimeout(MQTT_WAIT_SLEEP, 2, elapsed);
+  CHECK(elapsed >= 60 && capped >= 20 && capped <= 40);
+}
+
+static uint32_t calls = 0;
+static uint32_t lastIdle = 0;
+static uint32_t lastRemaining = 0;
+static bool ordered = true;
+
+static void recordWait(Client *, uint32_t idle, uint32_t remaining) {
+  if (calls > 0 && (idle != lastIdle + 1 || remaining > lastRemaining)) {
+    ordered = false;
+  }
+  calls++;
+  lastIdle = idle;
+  lastRemaining = remaining;
+  delay(1);
+}
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[1];
+static MQTTBroker broker(sessions, 1, subscriptions, 1);
+
+static void runBroker(Client *, uint32_t, uint32_t) { broker.loop(); }
+
+static void testCallback() {
+  // the callback sees the consecutive empty reads and the remaining time
+  PipeClient net, silent;
+  PipeClient::pair(net, silent);
+  MQTTClient client(64);
+  client.begin(net);
+  client.setTimeout(30);
+  client.setWaitCallback(recordWait);
+  CHECK(!client.connect("wait"));
+  CHECK(calls > 5 && ordered && lastRemaining <= 30);
+  CHECK(client.waitStats().wakeups == calls);
+
+  // received bytes are counted, the stats can be reset
+  PipeClient session;
+  PipeClient::pair(net, session);
+  CHECK(broker.accept(session));
+  client.setWaitCallback(runBroker);
+  client.resetWaitStats();
+  CHECK(client.connect("wait"));
+  CHECK(client.waitStats().bytes == 4);
+  client.resetWaitStats();
+  CHECK(client.waitStats().bytes == 0 && client.waitStats().wakeups == 0);
+
+  client.disconnect();
+}
+
+int main() {
+  testPolicies();
+  testCallback();
+  return TEST_DONE();
+}
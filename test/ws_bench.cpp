@@ -0,0 +1,105 @@
+// Publish and receive throughput of the client over a plain pipe and over MQTTWebSocketClient on the same pipe, for
+// several payload sizes. Outgoing frames are masked by the adapter, incoming frames are unwrapped.
+
+#include <MQTTClient.h>
+#include <MQTTWebSocket.h>
+
+#include <string>
+
+#include "bench.h"
+#include "pipe.h"
+#include "test.h"
+
+static const char upgrade[] =
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Protocol: mqtt\r\n\r\n";
+
+static const uint8_t connack[] = {0x20, 2, 0, 0};
+
+// the broker side sends unmasked binary frames when tunneled, raw bytes otherwise
+static void send(PipeClient &server, bool ws, const std::string &data) {
+  if (ws) {
+    uint8_t head[4] = {0x82};
+    size_t n = 2;
+    if (data.size() < 126) {
+      head[1] = (uint8_t)data.size();
+    } else {
+      head[1] = 126;
+      head[2] = (uint8_t)(data.size() >> 8);
+      head[3] = (uint8_t)data.size();
+      n = 4;
+    }
+    server.write(head, n);
+  }
+  server.write((const uint8_t *)data.data(), data.size());
+}
+
+static void drain(PipeClient &server) {
+  uint8_t buf[512];
+  while (server.read(buf, sizeof(buf)) > 0) {
+  }
+}
+
+// a QoS 0 publish packet of the given payload size
+static std::string publishPacket(const std::string &payload) {
+  std::string body = std::string("\x00\x03s/t", 5) + payload;
+  std::string packet = "\x30";
+  size_t len = body.size();
+  do {
+    uint8_t b = (uint8_t)(len % 128);
+    len /= 128;
+    packet += (char)(len > 0 ? b | 0x80 : b);
+  } while (len > 0);
+  return packet + body;
+}
+
+static int received = 0;
+static void countMessage(MQTTClient *, const char *, size_t, const char *, size_t) { received++; }
+
+static void run(bool ws, size_t size, uint32_t n) {
+  PipeClient net, server;
+  MQTTWebSocketClient wsClient(net);
+  MQTTClient client(2048, 128);
+  PipeClient::pair(net, server);
+  if (ws) {
+    server.write((const uint8_t *)upgrade, sizeof(upgrade) - 1);
+    client.begin("broker", 80, wsClient);
+  } else {
+    client.begin(net);
+  }
+  send(server, ws, std::string((const char *)connack, sizeof(connack)));
+  client.onMessageRaw(countMessage);
+  CHECK(client.connect("bench"));
+  drain(server);
+
+  std::string payload(size, 'x');
+  char name[64];
+  snprintf(name, sizeof(name), "%s publish %zu", ws ? "ws" : "pipe", size);
+  uint64_t start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    CHECK(client.publish("s/t", payload.data(), (int)size, false, 0));
+    drain(server);
+  }
+  benchReport(name, benchNanos() - start, n, size);
+
+  std::string packet = publishPacket(payload);
+  received = 0;
+  snprintf(name, sizeof(name), "%s receive %zu", ws ? "ws" : "pipe", size);
+  start = benchNanos();
+  for (uint32_t i = 0; i < n; i++) {
+    send(server, ws, packet);
+    CHECK(client.loop());
+  }
+  benchReport(name, benchNanos() - start, n, size);
+  CHECK(received == (int)n);
+}
+
+int main(int argc, char **argv) {
+  uint32_t n = benchIterations(argc, argv, 200000);
+  const size_t sizes[] = {16, 128, 1024};
+  for (size_t size : sizes) {
+    run(false, size, n);
+    run(true, size, n);
+  }
+  return TEST_DONE();
+}
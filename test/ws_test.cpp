@@ -0,0 +1,186 @@
+#include <MQTTBroker.h>
+#include <MQTTClient.h>
+#include <MQTTWebSocket.h>
+
+#include <string>
+
+#include "pipe.h"
+#include "test.h"
+
+static const char upgrade[] =
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Protocol: mqtt\r\n\r\n";
+
+// reads a masked client frame from the server side of the pipe, returns false if none is complete
+static bool readFrame(PipeClient &server, uint8_t &opcode, std::string &payload) {
+  uint8_t head[2];
+  if (server.available() < 2 || server.read(head, 2) != 2) {
+    return false;
+  }
+  opcode = head[0] & 0x0f;
+  CHECK((head[0] & 0x80) != 0 && (head[1] & 0x80) != 0);
+  size_t len = head[1] & 0x7f;
+  if (len == 126) {
+    uint8_t ext[2];
+    server.read(ext, 2);
+    len = (size_t)ext[0] << 8 | ext[1];
+  }
+  uint8_t key[4];
+  CHECK(server.read(key, 4) == 4);
+  payload.resize(len);
+  for (size_t i = 0; i < len; i++) {
+    payload[i] = (char)(server.read() ^ key[i % 4]);
+  }
+  return true;
+}
+
+// writes an unmasked server frame
+static void writeFrame(PipeClient &server, uint8_t opcode, const void *data, size_t len, bool fin = true) {
+  uint8_t head[4] = {(uint8_t)((fin ? 0x80 : 0) | opcode)};
+  size_t n = 2;
+  if (len < 126) {
+    head[1] = (uint8_t)len;
+  } else {
+    head[1] = 126;
+    head[2] = (uint8_t)(len >> 8);
+    head[3] = (uint8_t)len;
+    n = 4;
+  }
+  server.write(head, n);
+  server.write((const uint8_t *)data, len);
+}
+
+static std::string readAll(Client &client) {
+  std::string out;
+  int c;
+  while ((c = client.read()) >= 0) {
+    out += (char)c;
+  }
+  return out;
+}
+
+static void testHandshake() {
+  PipeClient net, server;
+
+  // the upgrade request asks for the mqtt subprotocol on the path
+  PipeClient::pair(net, server);
+  server.write((const uint8_t *)upgrade, sizeof(upgrade) - 1);
+  MQTTWebSocketClient ws(net, "/ws");
+  CHECK(ws.connect("broker", 8080) == 1);
+  CHECK(ws.connected());
+  std::string request = readAll(server);
+  CHECK(request.compare(0, 18, "GET /ws HTTP/1.1\r\n") == 0);
+  CHECK(request.find("Host: broker:8080\r\n") != std::string::npos);
+  CHECK(request.find("Upgrade: websocket\r\n") != std::string::npos);
+  CHECK(request.find("Sec-WebSocket-Protocol: mqtt\r\n") != std::string::npos);
+  CHECK(request.find("Sec-WebSocket-Key: ") != std::string::npos);
+
+  // other responses and silence fail the connect
+  PipeClient::pair(net, server);
+  const char denied[] = "HTTP/1.1 403 Forbidden\r\n\r\n";
+  server.write((const uint8_t *)denied, sizeof(denied) - 1);
+  CHECK(ws.connect("broker", 8080) == 0);
+
+  PipeClient::pair(net, server);
+  ws.setHandshakeTimeout(20);
+  CHECK(ws.connect("broker", 8080) == 0);
+  CHECK(!ws.connected());
+}
+
+static void testFrames() {
+  PipeClient net, server;
+  PipeClient::pair(net, server);
+  server.write((const uint8_t *)upgrade, sizeof(upgrade) - 1);
+  MQTTWebSocketClient ws(net);
+  CHECK(ws.connect("broker", 80) == 1);
+  readAll(server);
+
+  // writes are masked binary frames, large ones are masked in chunks
+  uint8_t opcode;
+  std::string payload;
+  CHECK(ws.write((const uint8_t *)"hello", 5) == 5);
+  CHECK(readFrame(server, opcode, payload) && opcode == 0x2 && payload == "hello");
+  std::string large(300, 'x');
+  for (size_t i = 0; i < large.size(); i++) {
+    large[i] = (char)('a' + i % 26);
+  }
+  CHECK(ws.write((const uint8_t *)large.data(), large.size()) == large.size());
+  CHECK(readFrame(server, opcode, payload) && opcode == 0x2 && payload == large);
+
+  // fragmented frames are joined and pings in between are answered
+  writeFrame(server, 0x2, "ab", 2, false);
+  writeFrame(server, 0x9, "p1", 2);
+  writeFrame(server, 0x0, "cd", 2);
+  CHECK(ws.available() == 2);
+  CHECK(readAll(ws) == "abcd");
+  CHECK(readFrame(server, opcode, payload) && opcode == 0xa && payload == "p1");
+
+  // a close is echoed and ends the connection
+  const uint8_t status[] = {0x03, 0xe8};
+  writeFrame(server, 0x8, status, 2);
+  CHECK(ws.read() == -1);
+  CHECK(readFrame(server, opcode, payload) && opcode == 0x8 && payload == std::string("\x03\xe8", 2));
+  CHECK(!ws.connected());
+}
+
+static MQTTBrokerSession sessions[1];
+static MQTTBrokerSubscription subscriptions[2];
+static MQTTBroker broker(sessions, 1, subscriptions, 2);
+static PipeClient wsServer, relayClient, brokerSession;
+static std::string request;
+static int received = 0;
+
+// skips the upgrade request, then unwraps the frames of the client for the broker and wraps the responses of the broker
+static void relay(Client *, uint32_t, uint32_t) {
+  while (request.size() < 4 || request.compare(request.size() - 4, 4, "\r\n\r\n") != 0) {
+    int c = wsServer.read();
+    if (c < 0) {
+      return;
+    }
+    request += (char)c;
+  }
+  uint8_t opcode;
+  std::string payload;
+  while (readFrame(wsServer, opcode, payload)) {
+    relayClient.write((const uint8_t *)payload.data(), payload.size());
+  }
+  broker.loop();
+  uint8_t buf[256];
+  int n;
+  while ((n = relayClient.read(buf, sizeof(buf))) > 0) {
+    writeFrame(wsServer, 0x2, buf, (size_t)n);
+  }
+}
+
+static void countMessage(MQTTClient *, const char *, size_t, const char *, size_t) { received++; }
+
+static void testMqtt() {
+  PipeClient net;
+  PipeClient::pair(net, wsServer);
+  PipeClient::pair(relayClient, brokerSession);
+  CHECK(broker.accept(brokerSession));
+  wsServer.write((const uint8_t *)upgrade, sizeof(upgrade) - 1);
+
+  MQTTWebSocketClient ws(net);
+  MQTTClient client(128);
+  client.begin("broker", 80, ws);
+  client.setWaitCallback(relay);
+  client.onMessageRaw(countMessage);
+  CHECK(client.connect("ws"));
+
+  CHECK(client.subscribe("ws/#", 1));
+  CHECK(client.publish("ws/test", "hello", false, 1));
+  for (int i = 0; i < 4; i++) {
+    relay(nullptr, 0, 0);
+    client.loop();
+  }
+  CHECK(received == 1);
+  CHECK(client.disconnect());
+}
+
+int main() {
+  testHandshake();
+  testFrames();
+  testMqtt();
+  return TEST_DONE();
+}
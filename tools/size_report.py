@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""Report the code size of the host libraries per build profile.
+
+Runs `size` on the static libraries of a host build (see test/CMakeLists.txt) and prints the client core (the objects
+every sketch links) and the whole library per profile:
+
+    cmake -S test -B build/size -DCMAKE_BUILD_TYPE=MinSizeRel && cmake --build build/size
+    python3 tools/size_report.py build/size
+
+The numbers are for the host compiler, boards differ in absolute size but show the same relative savings.
+"""
+
+import os
+import subprocess
+import sys
+
+PROFILES = [("default", "libmqtt.a"), ("LWMQTT_PROFILE_MINIMAL", "libmqtt_minimal.a"), ("MQTT_ALLOC_STATS", "libmqtt_stats.a")]
+
+CORE = {"MQTTClient.cpp.o", "client.c.o", "packet.c.o", "helpers.c.o", "string.c.o"}
+
+
+def measure(path):
+    out = subprocess.run(["size", path], check=True, capture_output=True, text=True).stdout
+    core = [0, 0, 0]
+    total = [0, 0, 0]
+    for line in out.splitlines()[1:]:
+        fields = line.split()
+        if len(fields) < 6:
+            continue
+        values = [int(v) for v in fields[:3]]
+        total = [a + b for a, b in zip(total, values)]
+        if fields[5] in CORE:
+            core = [a + b for a, b in zip(core, values)]
+    return core, total
+
+
+def main():
+    build = sys.argv[1] if len(sys.argv) > 1 else "build/size"
+    print("%-24s %8s %6s %6s %10s" % ("profile", "text", "data", "bss", "lib text"))
+    for name, lib in PROFILES:
+        path = os.path.join(build, lib)
+        if not os.path.exists(path):
+            continue
+        core, total = measure(path)
+        print("%-24s %8d %6d %6d %10d" % (name, core[0], core[1], core[2], total[0]))
+
+
+if __name__ == "__main__":
+    main()
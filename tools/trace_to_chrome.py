@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Convert an lwmqtt trace dump into Chrome/Perfetto trace JSON.
+
+The dump is the raw array of 16-byte records returned by lwmqtt_trace_dump(),
+e.g. written with Serial.write() and captured on the host:
+
+    python3 tools/trace_to_chrome.py dump.bin > trace.json
+
+Open the result in chrome://tracing or https://ui.perfetto.dev.
+"""
+
+import json
+import struct
+import sys
+
+RECORD = struct.Struct("<IHHII")
+
+PACKET_TYPES = {
+    0: "NONE", 1: "CONNECT", 2: "CONNACK", 3: "PUBLISH", 4: "PUBACK", 5: "PUBREC", 6: "PUBREL",
+    7: "PUBCOMP", 8: "SUBSCRIBE", 9: "SUBACK", 10: "UNSUBSCRIBE", 11: "UNSUBACK", 12: "PINGREQ",
+    13: "PINGRESP", 14: "DISCONNECT",
+}
+
+# event id -> (name, phase, argument names)
+EVENTS = {
+    1: ("packet", "B", ("header", None, None)),
+    2: ("packet", "E", ("type", "length", None)),
+    3: ("decode", "i", ("type", "packet_id", "payload_len")),
+    4: ("callback", "B", ("topic_len", "packet_id", "payload_len")),
+    5: ("callback", "E", ("topic_len", "packet_id", "payload_len")),
+    6: ("ack", "i", ("type", "packet_id", None)),
+    7: ("keep_alive", "i", ("type", None, None)),
+    8: ("network_read", "B", (None, "len", "timeout")),
+    9: ("network_read", "E", ("err", "read", "len")),
+    10: ("network_write", "B", (None, "len", "timeout")),
+    11: ("network_write", "E", ("err", "sent", "len")),
+}
+
+
+def convert(data):
+    events = []
+    offset = 0
+    last = None
+
+    for i in range(len(data) // RECORD.size):
+        time, event, arg0, arg1, arg2 = RECORD.unpack_from(data, i * RECORD.size)
+
+        # unwrap the 32-bit microsecond clock
+        if last is not None and time < last:
+            offset += 1 << 32
+        last = time
+
+        name, phase, arg_names = EVENTS.get(event, ("event_%d" % event, "i", ("arg0", "arg1", "arg2")))
+        args = {}
+        for key, value in zip(arg_names, (arg0, arg1, arg2)):
+            if key is None:
+                continue
+            if key == "type":
+                value = PACKET_TYPES.get(value, value)
+            elif key == "header":
+                value = PACKET_TYPES.get(value >> 4, value)
+            elif key == "err":
+                value = -value
+            args[key] = value
+
+        record = {"name": name, "ph": phase, "ts": offset + time, "pid": 1, "tid": 1, "args": args}
+        if phase == "i":
+            record["s"] = "t"
+        events.append(record)
+
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: %s <dump.bin>\n" % sys.argv[0])
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    json.dump(convert(data), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())